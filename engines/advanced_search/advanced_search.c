@@ -48,47 +48,91 @@ static uint32_t hash_string(const char* str) {
     return hash;
 }
 
-static float levenshtein_distance_normalized(const char* s1, const char* s2) {
-    int len1 = strlen(s1);
-    int len2 = strlen(s2);
-    int max_len = (len1 > len2) ? len1 : len2;
-    
-    if (max_len == 0) return 1.0f;
-    
-    // Matrice de programmation dynamique
-    int** dp = malloc((len1 + 1) * sizeof(int*));
-    for (int i = 0; i <= len1; i++) {
-        dp[i] = malloc((len2 + 1) * sizeof(int));
+// Motif de recherche approximative préparé une fois par requête.
+// Jusqu'à 64 caractères, la distance d'édition est calculée par
+// l'algorithme bit-parallèle de Myers (variante globale de Hyyrö) : une
+// colonne de la matrice tient dans un mot de 64 bits et chaque caractère du
+// texte coûte quelques opérations, sans allocation. Au-delà, une seule
+// ligne de programmation dynamique allouée avec le motif.
+typedef struct {
+    const char* text;
+    int length;
+    uint64_t peq[256];          // Positions de chaque octet dans le motif
+    int* row;                   // Ligne DP pour les motifs de plus de 64 caractères
+} FuzzyPattern;
+
+static bool fuzzy_pattern_init(FuzzyPattern* pattern, const char* text) {
+    pattern->text = text;
+    pattern->length = strlen(text);
+    pattern->row = NULL;
+    memset(pattern->peq, 0, sizeof(pattern->peq));
+    if (pattern->length <= 64) {
+        for (int i = 0; i < pattern->length; i++) {
+            pattern->peq[(unsigned char)text[i]] |= (uint64_t)1 << i;
+        }
+        return true;
     }
-    
-    // Initialisation
-    for (int i = 0; i <= len1; i++) dp[i][0] = i;
-    for (int j = 0; j <= len2; j++) dp[0][j] = j;
-    
-    // Calcul de la distance
-    for (int i = 1; i <= len1; i++) {
-        for (int j = 1; j <= len2; j++) {
-            int cost = (s1[i-1] == s2[j-1]) ? 0 : 1;
-            
-            int min_val = dp[i-1][j] + 1;      // Suppression
-            int insert = dp[i][j-1] + 1;      // Insertion
-            int subst = dp[i-1][j-1] + cost;  // Substitution
-            
-            if (insert < min_val) min_val = insert;
-            if (subst < min_val) min_val = subst;
-            
-            dp[i][j] = min_val;
+    pattern->row = malloc((pattern->length + 1) * sizeof(int));
+    return pattern->row != NULL;
+}
+
+static void fuzzy_pattern_free(FuzzyPattern* pattern) {
+    free(pattern->row);
+}
+
+static int fuzzy_pattern_distance(const FuzzyPattern* pattern, const char* text, int text_length) {
+    int m = pattern->length;
+    if (m == 0) return text_length;
+    
+    if (m <= 64) {
+        uint64_t pv = ~(uint64_t)0;     // Différences verticales +1
+        uint64_t mv = 0;                // Différences verticales -1
+        uint64_t last = (uint64_t)1 << (m - 1);
+        int score = m;
+        for (int j = 0; j < text_length; j++) {
+            uint64_t eq = pattern->peq[(unsigned char)text[j]];
+            uint64_t xv = eq | mv;
+            uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+            uint64_t ph = mv | ~(xh | pv);
+            uint64_t mh = pv & xh;
+            if (ph & last) score++;
+            else if (mh & last) score--;
+            // Alignement global : la première ligne croît d'une unité par colonne
+            ph = (ph << 1) | 1;
+            mh <<= 1;
+            pv = mh | ~(xv | ph);
+            mv = ph & xv;
+        }
+        return score;
+    }
+    
+    int* row = pattern->row;
+    for (int i = 0; i <= m; i++) row[i] = i;
+    for (int j = 1; j <= text_length; j++) {
+        int diagonal = row[0];
+        row[0] = j;
+        for (int i = 1; i <= m; i++) {
+            int cost = diagonal + (pattern->text[i - 1] != text[j - 1]);
+            if (row[i] + 1 < cost) cost = row[i] + 1;       // Suppression
+            if (row[i - 1] + 1 < cost) cost = row[i - 1] + 1; // Insertion
+            diagonal = row[i];
+            row[i] = cost;
         }
     }
+    return row[m];
+}
+
+// Similarité 1 - distance / longueur maximale, ou -1 si elle ne peut pas
+// atteindre `threshold` : l'écart des longueurs minore déjà la distance
+static float fuzzy_pattern_similarity(const FuzzyPattern* pattern, const char* text, float threshold) {
+    int text_length = strlen(text);
+    int max_len = (pattern->length > text_length) ? pattern->length : text_length;
+    if (max_len == 0) return 1.0f;
     
-    int distance = dp[len1][len2];
-    
-    // Libération mémoire
-    for (int i = 0; i <= len1; i++) {
-        free(dp[i]);
-    }
-    free(dp);
+    int gap = abs(pattern->length - text_length);
+    if (1.0f - (float)gap / max_len < threshold) return -1.0f;
     
+    int distance = fuzzy_pattern_distance(pattern, text, text_length);
     return 1.0f - ((float)distance / max_len);
 }
 
@@ -400,10 +444,19 @@ SearchResult* search_filename_fuzzy(SearchEngine* engine, const char* query, int
         return NULL;
     }
     
+    FuzzyPattern pattern;
+    if (!fuzzy_pattern_init(&pattern, query)) {
+        free(results);
+        engine->last_error = SEARCH_ERROR_OUT_OF_MEMORY;
+        *num_results = 0;
+        return NULL;
+    }
+    
     int result_count = 0;
     
     for (int i = 0; i < engine->num_files && result_count < engine->config.max_results; i++) {
-        float similarity = levenshtein_distance_normalized(query, engine->file_indices[i].name);
+        float similarity = fuzzy_pattern_similarity(&pattern, engine->file_indices[i].name,
+                                                    engine->config.similarity_threshold);
         
         if (similarity >= engine->config.similarity_threshold) {
             SearchResult* result = &results[result_count];
@@ -425,6 +478,7 @@ SearchResult* search_filename_fuzzy(SearchEngine* engine, const char* query, int
             result_count++;
         }
     }
+    fuzzy_pattern_free(&pattern);
     
     clock_t end = clock();
     double query_time = ((double)(end - start)) / CLOCKS_PER_SEC * 1000.0;
@@ -16,6 +16,14 @@
 #define CURSOR_DEBUG(fmt, ...)
 #endif
 
+// Engine configuration
+static cursor_config_t g_config = {
+    .position_unit = CURSOR_UNIT_BYTE,
+    .full_content_output = false
+};
+
+static cursor_operation_result_t split_line(int position, const char* content);
+
 // Helper function to safely allocate and copy string
 static char* safe_strdup(const char* str) {
     if (!str) return NULL;
@@ -43,6 +51,33 @@ static char* safe_substr(const char* str, int start, int length) {
     return result;
 }
 
+// Record the operation's edit (byte offsets into the original content)
+static bool set_delta(cursor_operation_result_t* result, int offset, int delete_length,
+                      const char* insert, int insert_length) {
+    result->delta.insert_text = safe_substr(insert, 0, insert_length);
+    if (!result->delta.insert_text) return false;
+    result->delta.offset = offset;
+    result->delta.delete_length = delete_length;
+    result->delta.insert_length = insert_length;
+    return true;
+}
+
+// Full content output: the edited content split at the end of the insertion
+static bool fill_full_output(cursor_operation_result_t* result, const char* content) {
+    const cursor_edit_delta_t* delta = &result->delta;
+    int len = strlen(content);
+    int tail = delta->offset + delta->delete_length;
+
+    result->before_cursor = malloc(delta->offset + delta->insert_length + 1);
+    result->after_cursor = safe_substr(content, tail, len - tail);
+    if (!result->before_cursor || !result->after_cursor) return false;
+
+    memcpy(result->before_cursor, content, delta->offset);
+    memcpy(result->before_cursor + delta->offset, delta->insert_text, delta->insert_length);
+    result->before_cursor[delta->offset + delta->insert_length] = '\0';
+    return true;
+}
+
 static bool is_position_in_marker_token(const formatting_context_t* context,
                                         int position) {
     if (!context) return false;
@@ -76,7 +111,7 @@ static bool should_add_merge_space(const char* line1, const char* line2,
 }
 
 // Analyze formatting context at a given position
-formatting_context_t cursor_analyze_formatting(const char* content, int position) {
+static formatting_context_t analyze_formatting(const char* content, int position) {
     formatting_context_t context = {MARKER_NONE, -1, -1, 0, false};
     
     if (!content || position < 0) {
@@ -200,7 +235,7 @@ formatting_context_t cursor_analyze_formatting(const char* content, int position
 }
 
 // Adjust cursor position to avoid problematic splits in formatting
-cursor_position_t cursor_adjust_for_formatting(int position, const char* content, bool is_markdown_mode) {
+static cursor_position_t adjust_for_formatting(int position, const char* content, bool is_markdown_mode) {
     cursor_position_t result = {0, position, is_markdown_mode, true};
     
     if (!content) {
@@ -210,7 +245,7 @@ cursor_position_t cursor_adjust_for_formatting(int position, const char* content
     
     CURSOR_DEBUG("Adjusting position %d for formatting in: \"%s\"", position, content);
     
-    formatting_context_t context = cursor_analyze_formatting(content, position);
+    formatting_context_t context = analyze_formatting(content, position);
     
     if (is_position_in_marker_token(&context, position)) {
         if (context.type == MARKER_HEADER ||
@@ -231,125 +266,303 @@ cursor_position_t cursor_adjust_for_formatting(int position, const char* content
     return result;
 }
 
-// Convert HTML position to markdown position
-cursor_position_t cursor_html_to_markdown(int html_position, const char* markdown_text) {
-    cursor_position_t result = {0, 0, false, false};
-    
-    if (!markdown_text) {
-        return result;
+// ============= OFFSET MAP =============
+
+// Forward scanner for the next closing marker of one kind. Queries during a
+// map build come with non-decreasing start positions, so each scanner walks
+// its line at most once instead of rescanning for every opening marker.
+typedef struct {
+    char marker;        // '*', '=' or '+'
+    bool pair;          // "**"/"=="/"++" rather than a lone '*'
+    int found;          // last match, -1 when none was found up to line_end
+    int scanned_from;   // start of the last scan, -1 before the first one
+} marker_scanner_t;
+
+static int scanner_next(marker_scanner_t* scanner, const char* text, int from, int line_end) {
+    if (scanner->scanned_from >= 0 && from >= scanner->scanned_from) {
+        if (scanner->found == -1 || scanner->found >= from) {
+            return scanner->found;
+        }
     }
-    
-    int markdown_len = strlen(markdown_text);
-    int html_pos = 0;
-    int markdown_pos = 0;
-    
-    CURSOR_DEBUG("Converting HTML position %d to markdown in: \"%s\"", html_position, markdown_text);
-    
-    // Handle header prefix
-    if (markdown_text[0] == '#') {
-        int header_len = 0;
-        while (header_len < markdown_len && markdown_text[header_len] == '#') header_len++;
-        if (header_len < markdown_len && markdown_text[header_len] == ' ') {
-            if (html_position == 0) {
-                result.position = header_len + 1;
-                result.is_valid = true;
-                CURSOR_DEBUG("HTML position 0 maps to markdown %d (after header)", result.position);
-                return result;
+
+    scanner->scanned_from = from;
+    scanner->found = -1;
+    for (int i = from; i < line_end; i++) {
+        if (text[i] != scanner->marker) continue;
+        if (scanner->pair) {
+            if (i + 1 < line_end && text[i + 1] == scanner->marker) {
+                scanner->found = i;
+                break;
             }
-            markdown_pos = header_len + 1;
+        } else if (i == line_end - 1 || text[i + 1] != '*') {
+            scanner->found = i;
+            break;
         }
     }
-    
-    // Process character by character
-    while (markdown_pos < markdown_len && html_pos < html_position) {
-        char current = markdown_text[markdown_pos];
-        
-        // Check for formatting markers
-        if (current == '*' && markdown_pos + 1 < markdown_len) {
-            if (markdown_text[markdown_pos + 1] == '*') {
-                // Bold **text**
-                int end_pos = -1;
-                for (int i = markdown_pos + 2; i < markdown_len - 1; i++) {
-                    if (markdown_text[i] == '*' && markdown_text[i + 1] == '*') {
-                        end_pos = i;
-                        break;
-                    }
-                }
-                
-                if (end_pos != -1) {
-                    int inner_len = end_pos - (markdown_pos + 2);
-                    if (html_position - html_pos <= inner_len) {
-                        result.position = markdown_pos + 2 + (html_position - html_pos);
-                        result.is_valid = true;
-                        CURSOR_DEBUG("HTML %d maps to markdown %d (inside bold)", html_position, result.position);
-                        return result;
-                    }
-                    html_pos += inner_len;
-                    markdown_pos = end_pos + 2;
-                    continue;
-                }
-            } else {
-                // Italic *text*
-                int end_pos = -1;
-                for (int i = markdown_pos + 1; i < markdown_len; i++) {
-                    if (markdown_text[i] == '*' && 
-                        (i == markdown_len - 1 || markdown_text[i + 1] != '*')) {
-                        end_pos = i;
-                        break;
-                    }
-                }
-                
-                if (end_pos != -1) {
-                    int inner_len = end_pos - (markdown_pos + 1);
-                    if (html_position - html_pos <= inner_len) {
-                        result.position = markdown_pos + 1 + (html_position - html_pos);
-                        result.is_valid = true;
-                        CURSOR_DEBUG("HTML %d maps to markdown %d (inside italic)", html_position, result.position);
-                        return result;
-                    }
-                    html_pos += inner_len;
-                    markdown_pos = end_pos + 1;
-                    continue;
-                }
+    return scanner->found;
+}
+
+// Converts non-decreasing byte offsets of the map source to map units
+typedef struct {
+    const char* text;
+    cursor_unit_t unit;
+    int byte;
+    int units;
+} unit_tracker_t;
+
+static int tracker_units_at(unit_tracker_t* tracker, int byte) {
+    if (tracker->unit == CURSOR_UNIT_BYTE) return byte;
+    tracker->units += cursor_utf8_count_units(tracker->text + tracker->byte,
+                                              byte - tracker->byte, tracker->unit);
+    tracker->byte = byte;
+    return tracker->units;
+}
+
+// Append the run for source bytes [source_byte, source_byte + byte_length)
+// and advance the rendered position past it
+static bool offset_map_push_run(cursor_offset_map_t* map, unit_tracker_t* tracker,
+                                int* rendered, int source_byte, int byte_length,
+                                bool ends_line) {
+    int source_start = tracker_units_at(tracker, source_byte);
+    int length = tracker_units_at(tracker, source_byte + byte_length) - source_start;
+
+    if (map->run_count == map->run_capacity) {
+        int capacity = map->run_capacity ? map->run_capacity * 2 : 16;
+        cursor_offset_run_t* runs = realloc(map->runs, capacity * sizeof(cursor_offset_run_t));
+        if (!runs) return false;
+        map->runs = runs;
+        map->run_capacity = capacity;
+    }
+    cursor_offset_run_t* run = &map->runs[map->run_count++];
+    run->rendered_start = *rendered;
+    run->source_start = source_start;
+    run->length = length;
+    run->ends_line = ends_line;
+    *rendered += length;
+    return true;
+}
+
+// Single pass over the text, line by line. Marker semantics match the
+// renderer: a header prefix is hidden, and **, *, == and ++ hide their
+// markers when a closing marker exists on the same line (no nesting).
+static bool offset_map_build(cursor_offset_map_t* map) {
+    const char* text = map->source;
+    int len = map->source_bytes;
+    int rendered = 0;
+    int line_start = 0;
+    unit_tracker_t tracker = {text, map->unit, 0, 0};
+
+    map->run_count = 0;
+
+    for (;;) {
+        const char* newline = memchr(text + line_start, '\n', len - line_start);
+        int line_end = newline ? (int)(newline - text) : len;
+        int pos = line_start;
+
+        // Header prefix "# " is not rendered
+        if (text[pos] == '#') {
+            int header_end = pos;
+            while (header_end < line_end && text[header_end] == '#') header_end++;
+            if (header_end < line_end && text[header_end] == ' ') {
+                pos = header_end + 1;
             }
-        } else if (current == '=' && markdown_pos + 1 < markdown_len && markdown_text[markdown_pos + 1] == '=') {
-            // Highlight ==text==
-            int end_pos = -1;
-            for (int i = markdown_pos + 2; i < markdown_len - 1; i++) {
-                if (markdown_text[i] == '=' && markdown_text[i + 1] == '=') {
-                    end_pos = i;
-                    break;
+        }
+
+        marker_scanner_t bold = {'*', true, -1, -1};
+        marker_scanner_t italic = {'*', false, -1, -1};
+        marker_scanner_t highlight = {'=', true, -1, -1};
+        marker_scanner_t underline = {'+', true, -1, -1};
+        int plain_start = pos;
+
+        while (pos < line_end) {
+            char current = text[pos];
+            int marker_len = 0;
+            int close = -1;
+
+            if (current == '*' && pos + 1 < line_end) {
+                if (text[pos + 1] == '*') {
+                    marker_len = 2;
+                    close = scanner_next(&bold, text, pos + 2, line_end);
+                } else {
+                    marker_len = 1;
+                    close = scanner_next(&italic, text, pos + 1, line_end);
                 }
+            } else if ((current == '=' || current == '+') &&
+                       pos + 1 < line_end && text[pos + 1] == current) {
+                marker_len = 2;
+                close = scanner_next(current == '=' ? &highlight : &underline,
+                                     text, pos + 2, line_end);
             }
-            
-            if (end_pos != -1) {
-                int inner_len = end_pos - (markdown_pos + 2);
-                if (html_position - html_pos <= inner_len) {
-                    result.position = markdown_pos + 2 + (html_position - html_pos);
-                    result.is_valid = true;
-                    CURSOR_DEBUG("HTML %d maps to markdown %d (inside highlight)", html_position, result.position);
-                    return result;
-                }
-                html_pos += inner_len;
-                markdown_pos = end_pos + 2;
+
+            if (close == -1) {
+                pos++;
                 continue;
             }
+
+            // Plain text before the marker (possibly empty), then the content
+            int plain_len = pos - plain_start;
+            int inner_len = close - (pos + marker_len);
+            if (!offset_map_push_run(map, &tracker, &rendered, plain_start, plain_len, false) ||
+                !offset_map_push_run(map, &tracker, &rendered, pos + marker_len, inner_len, false)) {
+                return false;
+            }
+
+            pos = close + marker_len;
+            plain_start = pos;
         }
-        
-        // Regular character
-        html_pos++;
-        markdown_pos++;
+
+        // Trailing plain text, carrying the line break when there is one
+        int tail_len = line_end - plain_start + (newline ? 1 : 0);
+        if (!offset_map_push_run(map, &tracker, &rendered, plain_start, tail_len, newline != NULL)) {
+            return false;
+        }
+
+        if (!newline) break;
+        line_start = line_end + 1;
     }
-    
-    result.position = markdown_pos;
-    result.is_valid = true;
-    CURSOR_DEBUG("HTML %d maps to markdown %d (final)", html_position, result.position);
+
+    map->source_length = tracker_units_at(&tracker, len);
+    map->rendered_length = rendered;
+    return true;
+}
+
+cursor_offset_map_t* cursor_offset_map_create(const char* markdown_text) {
+    if (!markdown_text) return NULL;
+
+    cursor_offset_map_t* map = calloc(1, sizeof(cursor_offset_map_t));
+    if (!map) return NULL;
+
+    if (!cursor_offset_map_sync(map, markdown_text)) {
+        cursor_offset_map_destroy(map);
+        return NULL;
+    }
+    return map;
+}
+
+// Rebuild the map if the text (or the configured position unit) differs from
+// the one it was built with. Returns false only on allocation failure.
+bool cursor_offset_map_sync(cursor_offset_map_t* map, const char* markdown_text) {
+    if (!map || !markdown_text) return false;
+
+    int len = strlen(markdown_text);
+    if (map->source && len == map->source_bytes &&
+        map->unit == g_config.position_unit &&
+        memcmp(map->source, markdown_text, len) == 0) {
+        return true;
+    }
+
+    if (len + 1 > map->source_capacity) {
+        int capacity = map->source_capacity ? map->source_capacity : 64;
+        while (capacity < len + 1) capacity *= 2;
+        char* source = realloc(map->source, capacity);
+        if (!source) return false;
+        map->source = source;
+        map->source_capacity = capacity;
+    }
+    memcpy(map->source, markdown_text, len + 1);
+    map->source_bytes = len;
+    map->unit = g_config.position_unit;
+
+    if (!offset_map_build(map)) {
+        // Never leave a map that claims to match the text
+        map->source_bytes = -1;
+        return false;
+    }
+    return true;
+}
+
+static void offset_map_release(cursor_offset_map_t* map) {
+    free(map->source);
+    free(map->runs);
+}
+
+void cursor_offset_map_destroy(cursor_offset_map_t* map) {
+    if (!map) return;
+    offset_map_release(map);
+    free(map);
+}
+
+// Rendered -> source. Positions on a run boundary stay in the earlier run
+// (before an opening marker, before a closing marker), except at a line
+// break, where they move to the start of the next line's content. Positions
+// past the rendered end map to the end of the source.
+int cursor_offset_map_to_source(const cursor_offset_map_t* map, int rendered_position) {
+    if (!map || map->run_count == 0) return 0;
+    if (rendered_position < 0) rendered_position = 0;
+    if (rendered_position > map->rendered_length) return map->source_length;
+
+    // First run whose end reaches the position
+    int lo = 0, hi = map->run_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        const cursor_offset_run_t* run = &map->runs[mid];
+        if (run->rendered_start + run->length >= rendered_position) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    const cursor_offset_run_t* run = &map->runs[lo];
+    if (run->ends_line && lo + 1 < map->run_count &&
+        run->rendered_start + run->length == rendered_position) {
+        run = &map->runs[lo + 1];
+    }
+    return run->source_start + (rendered_position - run->rendered_start);
+}
+
+// Source -> rendered. Positions inside a hidden marker snap to the rendered
+// boundary the marker sits on.
+int cursor_offset_map_to_rendered(const cursor_offset_map_t* map, int source_position) {
+    if (!map || map->run_count == 0) return 0;
+    if (source_position < 0) source_position = 0;
+
+    // Last run starting at or before the position
+    int lo = 0, hi = map->run_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (map->runs[mid].source_start <= source_position) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    const cursor_offset_run_t* run = &map->runs[lo];
+    int offset = source_position - run->source_start;
+    if (offset < 0) offset = 0;             // inside a leading header prefix
+    if (offset > run->length) offset = run->length;
+    return run->rendered_start + offset;
+}
+
+// One conversion through a map of `markdown_text` built for the call; callers
+// converting many positions of one text hold a cursor_offset_map_t instead
+static cursor_position_t convert_position(int position, const char* markdown_text, bool to_source) {
+    cursor_position_t result = {0, 0, false, false};
+
+    cursor_offset_map_t map = {0};
+    if (cursor_offset_map_sync(&map, markdown_text)) {
+        result.position = to_source ? cursor_offset_map_to_source(&map, position)
+                                    : cursor_offset_map_to_rendered(&map, position);
+        result.is_valid = true;
+    }
+    offset_map_release(&map);
     return result;
 }
 
+// Convert HTML position to markdown position
+cursor_position_t cursor_html_to_markdown(int html_position, const char* markdown_text) {
+    return convert_position(html_position, markdown_text, true);
+}
+
+// Convert markdown position to HTML position
+cursor_position_t cursor_markdown_to_html(int markdown_position, const char* markdown_text) {
+    return convert_position(markdown_position, markdown_text, false);
+}
+
 // Handle Enter key with smart cursor positioning
-cursor_operation_result_t cursor_handle_enter_key(int position, const char* content, bool is_markdown_mode) {
-    cursor_operation_result_t result = {false, {0, 0, false, false}, NULL, NULL, NULL};
+static cursor_operation_result_t handle_enter_key(int position, const char* content, bool is_markdown_mode) {
+    cursor_operation_result_t result = {false, {0, 0, false, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
     
     if (!content) {
         result.error_message = safe_strdup("Invalid content");
@@ -359,7 +572,7 @@ cursor_operation_result_t cursor_handle_enter_key(int position, const char* cont
     CURSOR_DEBUG("Handling Enter key at position %d in: \"%s\"", position, content);
     
     // First, adjust position for formatting if needed
-    cursor_position_t adjusted = cursor_adjust_for_formatting(position, content, is_markdown_mode);
+    cursor_position_t adjusted = adjust_for_formatting(position, content, is_markdown_mode);
     if (!adjusted.is_valid) {
         result.error_message = safe_strdup("Failed to adjust position");
         return result;
@@ -371,7 +584,7 @@ cursor_operation_result_t cursor_handle_enter_key(int position, const char* cont
     CURSOR_DEBUG("Using final position %d for line split", final_position);
     
     // Perform the line split
-    cursor_operation_result_t split_result = cursor_split_line(final_position, content);
+    cursor_operation_result_t split_result = split_line(final_position, content);
     if (!split_result.success) {
         return split_result; // Return the error
     }
@@ -384,10 +597,12 @@ cursor_operation_result_t cursor_handle_enter_key(int position, const char* cont
     result.new_position.is_valid = true;
     result.before_cursor = split_result.before_cursor;
     result.after_cursor = split_result.after_cursor;
+    result.delta = split_result.delta;
     
     // Don't double-free, transfer ownership
     split_result.before_cursor = NULL;
     split_result.after_cursor = NULL;
+    split_result.delta.insert_text = NULL;
     cursor_free_result(&split_result);
     
     CURSOR_DEBUG("Enter key handled successfully, cursor at start of new line");
@@ -395,8 +610,8 @@ cursor_operation_result_t cursor_handle_enter_key(int position, const char* cont
 }
 
 // Split line at given position
-cursor_operation_result_t cursor_split_line(int position, const char* content) {
-    cursor_operation_result_t result = {false, {0, 0, false, false}, NULL, NULL, NULL};
+static cursor_operation_result_t split_line(int position, const char* content) {
+    cursor_operation_result_t result = {false, {0, 0, false, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
     
     if (!content) {
         result.error_message = safe_strdup("Invalid content");
@@ -409,25 +624,32 @@ cursor_operation_result_t cursor_split_line(int position, const char* content) {
     
     CURSOR_DEBUG("Splitting line at position %d", position);
     
+    bool ok = set_delta(&result, position, 0, "\n", 1);
+
     // Extract before and after cursor
-    result.before_cursor = safe_substr(content, 0, position);
-    result.after_cursor = safe_substr(content, position, len - position);
+    if (ok && g_config.full_content_output) {
+        result.before_cursor = safe_substr(content, 0, position);
+        result.after_cursor = safe_substr(content, position, len - position);
+        ok = result.before_cursor && result.after_cursor;
+    }
     
-    if (!result.before_cursor || !result.after_cursor) {
-        result.error_message = safe_strdup("Failed to allocate memory for split");
+    if (!ok) {
         cursor_free_result(&result);
+        result.error_message = safe_strdup("Failed to allocate memory for split");
         return result;
     }
     
     result.success = true;
-    CURSOR_DEBUG("Line split: \"%s\" | \"%s\"", result.before_cursor, result.after_cursor);
+    CURSOR_DEBUG("Line split at %d", position);
     
     return result;
 }
 
 // Merge two lines with optional spacing
-cursor_operation_result_t cursor_merge_lines(const char* line1, const char* line2, bool add_space) {
-    cursor_operation_result_t result = {false, {0, 0, false, false}, NULL, NULL, NULL};
+// The delta applies to line1 + "\n" + line2: the line break becomes a space
+// or disappears.
+static cursor_operation_result_t merge_lines(const char* line1, const char* line2, bool add_space) {
+    cursor_operation_result_t result = {false, {0, 0, false, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
     
     if (!line1 || !line2) {
         result.error_message = safe_strdup("Invalid line content");
@@ -440,57 +662,56 @@ cursor_operation_result_t cursor_merge_lines(const char* line1, const char* line
     // Determine if we need to add space
     bool needs_space = should_add_merge_space(line1, line2, add_space);
     
-    int total_len = len1 + len2 + (needs_space ? 1 : 0);
-    
-    char* merged = malloc(total_len + 1);
-    if (!merged) {
+    if (!set_delta(&result, len1, 1, " ", needs_space ? 1 : 0)) {
         result.error_message = safe_strdup("Failed to allocate memory for merge");
         return result;
     }
-    
-    // Copy first line
-    memcpy(merged, line1, len1);
-    
-    // Add space if needed
-    if (needs_space) {
-        merged[len1] = ' ';
-        len1++;
+
+    if (g_config.full_content_output) {
+        int total_len = len1 + len2 + (needs_space ? 1 : 0);
+        char* merged = malloc(total_len + 1);
+        if (!merged) {
+            cursor_free_result(&result);
+            result.error_message = safe_strdup("Failed to allocate memory for merge");
+            return result;
+        }
+        
+        // Copy first line, space if needed, second line
+        memcpy(merged, line1, len1);
+        if (needs_space) merged[len1] = ' ';
+        memcpy(merged + total_len - len2, line2, len2);
+        merged[total_len] = '\0';
+        result.before_cursor = merged;
     }
     
-    // Copy second line
-    memcpy(merged + len1, line2, len2);
-    merged[total_len] = '\0';
-    
     result.success = true;
-    result.before_cursor = merged;
-    result.new_position.position = len1; // Cursor after first line + space
+    result.new_position.position = len1 + (needs_space ? 1 : 0); // Cursor after first line + space
     result.new_position.is_valid = true;
     
-    CURSOR_DEBUG("Lines merged: \"%s\" + \"%s\" = \"%s\" (cursor at %d)", 
-                line1, line2, merged, result.new_position.position);
+    CURSOR_DEBUG("Lines merged (cursor at %d)", result.new_position.position);
     
     return result;
 }
 
 // Utility functions
-bool cursor_validate_position(const char* content, int position) {
+static bool validate_position(const char* content, int position) {
     if (!content || position < 0) return false;
     return position <= (int)strlen(content);
 }
 
-int cursor_find_safe_split_position(const char* content, int position) {
+static int find_safe_split_position(const char* content, int position) {
     if (!content) return 0;
     
-    cursor_position_t adjusted = cursor_adjust_for_formatting(position, content, true);
+    cursor_position_t adjusted = adjust_for_formatting(position, content, true);
     return adjusted.is_valid ? adjusted.position : position;
 }
 
-char* cursor_extract_before_position(const char* content, int position) {
+static char* extract_before_position(const char* content, int position) {
     if (!content || position < 0) return NULL;
     return safe_substr(content, 0, position);
 }
 
-char* cursor_extract_after_position(const char* content, int position) {
+static char* extract_after_position(const char* content, int position) {
     if (!content || position < 0) return NULL;
     int len = strlen(content);
     return safe_substr(content, position, len - position);
@@ -512,10 +733,12 @@ void cursor_free_result(cursor_operation_result_t* result) {
         free(result->error_message);
         result->error_message = NULL;
     }
+    free(result->delta.insert_text);
+    result->delta.insert_text = NULL;
 }
 
 // Debug function
-void cursor_print_debug(const char* content, int position) {
+static void print_debug(const char* content, int position) {
     if (!content) {
         CURSOR_DEBUG("Debug: Invalid content");
         return;
@@ -532,7 +755,7 @@ void cursor_print_debug(const char* content, int position) {
         CURSOR_DEBUG("Position out of bounds");
     }
     
-    formatting_context_t context = cursor_analyze_formatting(content, position);
+    formatting_context_t context = analyze_formatting(content, position);
     if (context.type != MARKER_NONE) {
         CURSOR_DEBUG("Formatting context: type %d, range %d-%d, inside: %s", 
                     context.type, context.start_pos, context.end_pos, 
@@ -551,7 +774,7 @@ bool cursor_is_word_char(char c) {
     return isalnum((unsigned char)c) || c == '_';
 }
 
-bool cursor_is_at_word_boundary(const char* content, int position) {
+static bool is_at_word_boundary(const char* content, int position) {
     if (!content) return false;
     int len = strlen(content);
     
@@ -565,7 +788,7 @@ bool cursor_is_at_word_boundary(const char* content, int position) {
 }
 
 // Word navigation functions
-cursor_position_t cursor_move_word_left(const char* content, int position) {
+static cursor_position_t move_word_left(const char* content, int position) {
     cursor_position_t result = {0, position, true, false};
     
     if (!content || position <= 0) {
@@ -601,7 +824,7 @@ cursor_position_t cursor_move_word_left(const char* content, int position) {
     return result;
 }
 
-cursor_position_t cursor_move_word_right(const char* content, int position) {
+static cursor_position_t move_word_right(const char* content, int position) {
     cursor_position_t result = {0, position, true, false};
     
     if (!content) {
@@ -640,7 +863,7 @@ cursor_position_t cursor_move_word_right(const char* content, int position) {
     return result;
 }
 
-cursor_position_t cursor_move_to_line_start(const char* content, int position) {
+static cursor_position_t move_to_line_start(const char* content, int position) {
     cursor_position_t result = {0, position, true, false};
     
     if (!content) {
@@ -662,7 +885,7 @@ cursor_position_t cursor_move_to_line_start(const char* content, int position) {
     return result;
 }
 
-cursor_position_t cursor_move_to_line_end(const char* content, int position) {
+static cursor_position_t move_to_line_end(const char* content, int position) {
     cursor_position_t result = {0, position, true, false};
     
     if (!content) {
@@ -721,46 +944,63 @@ char* cursor_create_indented_line(const char* content, int indent_level) {
     return result;
 }
 
-cursor_operation_result_t cursor_smart_indent(const char* content, int position) {
-    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL};
+// Byte range [start, end) of the line containing position, without its '\n'
+static void line_bounds(const char* content, int len, int position, int* start, int* end) {
+    if (position < 0) position = 0;
+    if (position > len) position = len;
+
+    int line_start = position;
+    while (line_start > 0 && content[line_start - 1] != '\n') line_start--;
+    int line_end = position;
+    while (line_end < len && content[line_end] != '\n') line_end++;
+
+    *start = line_start;
+    *end = line_end;
+}
+
+static int previous_line_start(const char* content, int line_start) {
+    int start = line_start - 1;
+    while (start > 0 && content[start - 1] != '\n') start--;
+    return start;
+}
+
+// Finish a line operation: full content output on request, error on failure
+static cursor_operation_result_t finish_line_operation(cursor_operation_result_t result,
+                                                       const char* content, bool ok) {
+    if (ok && g_config.full_content_output) {
+        ok = fill_full_output(&result, content);
+    }
+    if (!ok) {
+        cursor_free_result(&result);
+        result.error_message = safe_strdup("Memory allocation failed");
+        return result;
+    }
+    result.new_position.is_valid = true;
+    result.success = true;
+    return result;
+}
+
+static cursor_operation_result_t smart_indent(const char* content, int position) {
+    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
     
     if (!content) {
         result.error_message = safe_strdup("Invalid content");
         return result;
     }
     
-    // Find the start of the current line
-    cursor_position_t line_start = cursor_move_to_line_start(content, position);
-    cursor_position_t line_end = cursor_move_to_line_end(content, position);
-    
-    // Extract current line
-    char* current_line = safe_substr(content, line_start.position, 
-                                   line_end.position - line_start.position);
-    if (!current_line) {
-        result.error_message = safe_strdup("Memory allocation failed");
-        return result;
-    }
+    int len = strlen(content);
+    int line_start, line_end;
+    line_bounds(content, len, position, &line_start, &line_end);
     
     // Get indentation of previous line (if exists)
     int prev_indent = 0;
-    if (line_start.position > 0) {
-        // Find previous line
-        int prev_line_end = line_start.position - 2; // Skip the \n
-        while (prev_line_end >= 0 && content[prev_line_end] != '\n') {
-            prev_line_end--;
-        }
-        int prev_line_start = prev_line_end + 1;
-        
-        char* prev_line = safe_substr(content, prev_line_start, 
-                                    line_start.position - 1 - prev_line_start);
-        if (prev_line) {
-            prev_indent = cursor_get_line_indentation(prev_line);
-            free(prev_line);
-        }
+    if (line_start > 0) {
+        prev_indent = cursor_get_line_indentation(content + previous_line_start(content, line_start));
     }
     
-    // Create properly indented line
-    char* indented_line = cursor_create_indented_line(current_line, prev_indent);
+    // Replace the current line by its indented version
+    char* current_line = safe_substr(content, line_start, line_end - line_start);
+    char* indented_line = current_line ? cursor_create_indented_line(current_line, prev_indent) : NULL;
     free(current_line);
     
     if (!indented_line) {
@@ -768,33 +1008,16 @@ cursor_operation_result_t cursor_smart_indent(const char* content, int position)
         return result;
     }
     
-    // Create result
-    result.before_cursor = safe_substr(content, 0, line_start.position);
-    result.after_cursor = safe_substr(content, line_end.position, 
-                                    strlen(content) - line_end.position);
-    
-    // Concatenate with indented line
-    size_t before_len = result.before_cursor ? strlen(result.before_cursor) : 0;
-    size_t indented_len = strlen(indented_line);
-    
-    char* new_before = malloc(before_len + indented_len + 1);
-    if (new_before) {
-        strcpy(new_before, result.before_cursor ? result.before_cursor : "");
-        strcat(new_before, indented_line);
-        free(result.before_cursor);
-        result.before_cursor = new_before;
-    }
-    
-    result.new_position.position = line_start.position + indented_len;
-    result.new_position.is_valid = true;
-    result.success = true;
-    
+    int indented_len = strlen(indented_line);
+    bool ok = set_delta(&result, line_start, line_end - line_start, indented_line, indented_len);
     free(indented_line);
-    return result;
+    
+    result.new_position.position = line_start + indented_len;
+    return finish_line_operation(result, content, ok);
 }
 
 // Bracket matching functions
-cursor_position_t cursor_find_matching_bracket(const char* content, int position) {
+static cursor_position_t find_matching_bracket(const char* content, int position) {
     cursor_position_t result = {0, -1, true, false};
     
     if (!content || position < 0 || position >= (int)strlen(content)) {
@@ -861,62 +1084,332 @@ cursor_position_t cursor_find_matching_bracket(const char* content, int position
 }
 
 // Line manipulation functions
-cursor_operation_result_t cursor_duplicate_line(const char* content, int position) {
-    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL};
+static cursor_operation_result_t duplicate_line(const char* content, int position) {
+    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
     
     if (!content) {
         result.error_message = safe_strdup("Invalid content");
         return result;
     }
     
-    // Find line boundaries
-    cursor_position_t line_start = cursor_move_to_line_start(content, position);
-    cursor_position_t line_end = cursor_move_to_line_end(content, position);
+    int len = strlen(content);
+    int line_start, line_end;
+    line_bounds(content, len, position, &line_start, &line_end);
     
-    // Extract current line
-    char* current_line = safe_substr(content, line_start.position, 
-                                   line_end.position - line_start.position);
-    if (!current_line) {
+    // Insert "\n" + line after the line
+    int line_len = line_end - line_start;
+    char* copy = malloc(line_len + 2);
+    if (!copy) {
         result.error_message = safe_strdup("Memory allocation failed");
         return result;
     }
+    copy[0] = '\n';
+    memcpy(copy + 1, content + line_start, line_len);
+    copy[line_len + 1] = '\0';
     
-    // Create duplicated content
-    size_t line_len = strlen(current_line);
-    char* duplicated = malloc(line_len * 2 + 2); // +2 for \n
-    if (!duplicated) {
-        free(current_line);
-        result.error_message = safe_strdup("Memory allocation failed");
+    bool ok = set_delta(&result, line_end, 0, copy, line_len + 1);
+    free(copy);
+    
+    result.new_position.position = line_end + 1; // Position on duplicated line
+    return finish_line_operation(result, content, ok);
+}
+
+static cursor_operation_result_t delete_line(const char* content, int position) {
+    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
+    
+    if (!content) {
+        result.error_message = safe_strdup("Invalid content");
         return result;
     }
     
-    sprintf(duplicated, "%s\n%s", current_line, current_line);
+    int len = strlen(content);
+    int line_start, line_end;
+    line_bounds(content, len, position, &line_start, &line_end);
+    
+    // Take the line break with the line; the last line takes the one before it
+    int start = line_start;
+    int end = line_end;
+    int cursor = line_start;
+    if (end < len) {
+        end++;
+    } else if (start > 0) {
+        start--;
+        cursor = previous_line_start(content, line_start);
+    }
     
-    // Build result
-    result.before_cursor = safe_substr(content, 0, line_start.position);
-    result.after_cursor = safe_substr(content, line_end.position, 
-                                    strlen(content) - line_end.position);
+    bool ok = set_delta(&result, start, end - start, "", 0);
     
-    // Update before_cursor to include duplicated line
-    if (result.before_cursor) {
-        size_t before_len = strlen(result.before_cursor);
-        size_t dup_len = strlen(duplicated);
-        char* new_before = malloc(before_len + dup_len + 1);
-        if (new_before) {
-            strcpy(new_before, result.before_cursor);
-            strcat(new_before, duplicated);
-            free(result.before_cursor);
-            result.before_cursor = new_before;
-        }
-    } else {
-        result.before_cursor = safe_strdup(duplicated);
+    result.new_position.position = cursor;
+    return finish_line_operation(result, content, ok);
+}
+
+// Replace [upper_start, lower_end) by the lower line, "\n", the upper line
+static bool swap_lines(cursor_operation_result_t* result, const char* content,
+                       int upper_start, int upper_end, int lower_start, int lower_end) {
+    int upper_len = upper_end - upper_start;
+    int lower_len = lower_end - lower_start;
+    char* swapped = malloc(upper_len + lower_len + 2);
+    if (!swapped) return false;
+    
+    memcpy(swapped, content + lower_start, lower_len);
+    swapped[lower_len] = '\n';
+    memcpy(swapped + lower_len + 1, content + upper_start, upper_len);
+    swapped[upper_len + lower_len + 1] = '\0';
+    
+    bool ok = set_delta(result, upper_start, lower_end - upper_start, swapped, upper_len + lower_len + 1);
+    free(swapped);
+    return ok;
+}
+
+static cursor_operation_result_t move_line_up(const char* content, int position) {
+    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
+    
+    if (!content) {
+        result.error_message = safe_strdup("Invalid content");
+        return result;
     }
     
-    result.new_position.position = line_start.position + line_len + 1; // Position on duplicated line
-    result.new_position.is_valid = true;
-    result.success = true;
+    int len = strlen(content);
+    if (position < 0) position = 0;
+    if (position > len) position = len;
+    int line_start, line_end;
+    line_bounds(content, len, position, &line_start, &line_end);
+    
+    // First line: nothing to do, empty edit
+    if (line_start == 0) {
+        bool ok = set_delta(&result, 0, 0, "", 0);
+        result.new_position.position = position;
+        return finish_line_operation(result, content, ok);
+    }
     
-    free(current_line);
-    free(duplicated);
+    int prev_start = previous_line_start(content, line_start);
+    bool ok = swap_lines(&result, content, prev_start, line_start - 1, line_start, line_end);
+    
+    result.new_position.position = prev_start + (position - line_start);
+    return finish_line_operation(result, content, ok);
+}
+
+static cursor_operation_result_t move_line_down(const char* content, int position) {
+    cursor_operation_result_t result = {false, {0, 0, true, false}, NULL, NULL, NULL, {0, 0, NULL, 0}};
+    
+    if (!content) {
+        result.error_message = safe_strdup("Invalid content");
+        return result;
+    }
+    
+    int len = strlen(content);
+    if (position < 0) position = 0;
+    if (position > len) position = len;
+    int line_start, line_end;
+    line_bounds(content, len, position, &line_start, &line_end);
+    
+    // Last line: nothing to do, empty edit
+    if (line_end == len) {
+        bool ok = set_delta(&result, len, 0, "", 0);
+        result.new_position.position = position;
+        return finish_line_operation(result, content, ok);
+    }
+    
+    int next_start = line_end + 1;
+    int next_end = next_start;
+    while (next_end < len && content[next_end] != '\n') next_end++;
+    bool ok = swap_lines(&result, content, line_start, line_end, next_start, next_end);
+    
+    result.new_position.position = line_start + (next_end - next_start) + 1 + (position - line_start);
+    return finish_line_operation(result, content, ok);
+}
+
+// ============= POSITION UNITS =============
+//
+// The implementations above work on UTF-8 byte offsets. The public entry
+// points below convert positions from and to the configured unit at the
+// boundary, so hosts that count UTF-16 units (Flutter, JavaScript) or
+// codepoints never rescan strings themselves.
+
+void cursor_set_config(const cursor_config_t* config) {
+    if (config) {
+        g_config = *config;
+    }
+}
+
+cursor_config_t cursor_get_config(void) {
+    return g_config;
+}
+
+// Caller unit -> byte offset. Out-of-range positions stay out of range by
+// the same amount so validation keeps working.
+static int position_to_bytes(const char* content, int position) {
+    cursor_unit_t unit = g_config.position_unit;
+    if (unit == CURSOR_UNIT_BYTE || !content || position <= 0) return position;
+
+    int len = strlen(content);
+    int byte = cursor_utf8_byte_offset(content, len, position, unit);
+    if (byte == len) {
+        int total = cursor_utf8_count_units(content, len, unit);
+        if (position > total) return len + (position - total);
+    }
+    return byte;
+}
+
+// Byte offset -> caller unit
+static int position_from_bytes(const char* content, int byte) {
+    cursor_unit_t unit = g_config.position_unit;
+    if (unit == CURSOR_UNIT_BYTE || !content || byte <= 0) return byte;
+
+    int len = strlen(content);
+    if (byte > len) return cursor_utf8_count_units(content, len, unit) + (byte - len);
+    return cursor_utf8_count_units(content, byte, unit);
+}
+
+static cursor_position_t position_result(const char* content, cursor_position_t position) {
+    position.position = position_from_bytes(content, position.position);
+    return position;
+}
+
+// Operation results: the delta is relative to `content`, new_position is a
+// byte offset into the edited content
+static cursor_operation_result_t operation_result(const char* content, cursor_operation_result_t result) {
+    if (!result.success || g_config.position_unit == CURSOR_UNIT_BYTE) return result;
+
+    cursor_edit_delta_t* delta = &result.delta;
+    int position = result.new_position.position;
+    int offset_units = position_from_bytes(content, delta->offset);
+    if (position <= delta->offset) {
+        result.new_position.position = position_from_bytes(content, position);
+    } else if (position <= delta->offset + delta->insert_length) {
+        result.new_position.position = offset_units +
+            position_from_bytes(delta->insert_text, position - delta->offset);
+    } else {
+        result.new_position.position = offset_units +
+            position_from_bytes(delta->insert_text, delta->insert_length) +
+            position_from_bytes(content + delta->offset + delta->delete_length,
+                                position - delta->offset - delta->insert_length);
+    }
+
+    delta->delete_length = position_from_bytes(content + delta->offset, delta->delete_length);
+    delta->offset = offset_units;
     return result;
 }
+
+// Apply an operation's edit to the content it was computed from
+char* cursor_apply_edit_delta(const char* content, const cursor_edit_delta_t* delta) {
+    if (!content || !delta) return NULL;
+    
+    int len = strlen(content);
+    int offset = position_to_bytes(content, delta->offset);
+    if (offset < 0 || offset > len) return NULL;
+    int tail = offset + position_to_bytes(content + offset, delta->delete_length);
+    if (tail > len || (delta->insert_length > 0 && !delta->insert_text)) return NULL;
+    
+    char* edited = malloc(offset + delta->insert_length + (len - tail) + 1);
+    if (!edited) return NULL;
+    
+    memcpy(edited, content, offset);
+    if (delta->insert_length > 0) memcpy(edited + offset, delta->insert_text, delta->insert_length);
+    memcpy(edited + offset + delta->insert_length, content + tail, len - tail + 1);
+    return edited;
+}
+
+formatting_context_t cursor_analyze_formatting(const char* content, int position) {
+    formatting_context_t context = analyze_formatting(content, position_to_bytes(content, position));
+    if (context.type != MARKER_NONE) {
+        context.start_pos = position_from_bytes(content, context.start_pos);
+        context.end_pos = position_from_bytes(content, context.end_pos);
+    }
+    return context;
+}
+
+cursor_position_t cursor_adjust_for_formatting(int position, const char* content, bool is_markdown_mode) {
+    return position_result(content, adjust_for_formatting(position_to_bytes(content, position),
+                                                          content, is_markdown_mode));
+}
+
+cursor_operation_result_t cursor_handle_enter_key(int position, const char* content, bool is_markdown_mode) {
+    cursor_operation_result_t result = handle_enter_key(position_to_bytes(content, position),
+                                                        content, is_markdown_mode);
+    // new_position is relative to the new line
+    if (result.success) {
+        result.delta.offset = position_from_bytes(content, result.delta.offset);
+    }
+    return result;
+}
+
+cursor_operation_result_t cursor_split_line(int position, const char* content) {
+    return operation_result(content, split_line(position_to_bytes(content, position), content));
+}
+
+cursor_operation_result_t cursor_merge_lines(const char* line1, const char* line2, bool add_space) {
+    cursor_operation_result_t result = merge_lines(line1, line2, add_space);
+    // The delta applies to line1 + "\n" + line2
+    if (result.success) {
+        int line1_units = position_from_bytes(line1, result.delta.offset);
+        result.new_position.position = line1_units + result.delta.insert_length;
+        result.delta.offset = line1_units;
+    }
+    return result;
+}
+
+bool cursor_validate_position(const char* content, int position) {
+    return validate_position(content, position_to_bytes(content, position));
+}
+
+int cursor_find_safe_split_position(const char* content, int position) {
+    return position_from_bytes(content, find_safe_split_position(content, position_to_bytes(content, position)));
+}
+
+char* cursor_extract_before_position(const char* content, int position) {
+    return extract_before_position(content, position_to_bytes(content, position));
+}
+
+char* cursor_extract_after_position(const char* content, int position) {
+    return extract_after_position(content, position_to_bytes(content, position));
+}
+
+void cursor_print_debug(const char* content, int position) {
+    print_debug(content, position_to_bytes(content, position));
+}
+
+bool cursor_is_at_word_boundary(const char* content, int position) {
+    return is_at_word_boundary(content, position_to_bytes(content, position));
+}
+
+cursor_position_t cursor_move_word_left(const char* content, int position) {
+    return position_result(content, move_word_left(content, position_to_bytes(content, position)));
+}
+
+cursor_position_t cursor_move_word_right(const char* content, int position) {
+    return position_result(content, move_word_right(content, position_to_bytes(content, position)));
+}
+
+cursor_position_t cursor_move_to_line_start(const char* content, int position) {
+    return position_result(content, move_to_line_start(content, position_to_bytes(content, position)));
+}
+
+cursor_position_t cursor_move_to_line_end(const char* content, int position) {
+    return position_result(content, move_to_line_end(content, position_to_bytes(content, position)));
+}
+
+cursor_operation_result_t cursor_smart_indent(const char* content, int position) {
+    return operation_result(content, smart_indent(content, position_to_bytes(content, position)));
+}
+
+cursor_position_t cursor_find_matching_bracket(const char* content, int position) {
+    cursor_position_t result = find_matching_bracket(content, position_to_bytes(content, position));
+    return result.is_valid ? position_result(content, result) : result;
+}
+
+cursor_operation_result_t cursor_duplicate_line(const char* content, int position) {
+    return operation_result(content, duplicate_line(content, position_to_bytes(content, position)));
+}
+
+cursor_operation_result_t cursor_delete_line(const char* content, int position) {
+    return operation_result(content, delete_line(content, position_to_bytes(content, position)));
+}
+
+cursor_operation_result_t cursor_move_line_up(const char* content, int position) {
+    return operation_result(content, move_line_up(content, position_to_bytes(content, position)));
+}
+
+cursor_operation_result_t cursor_move_line_down(const char* content, int position) {
+    return operation_result(content, move_line_down(content, position_to_bytes(content, position)));
+}
@@ -3,6 +3,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include "cursor_text_index.h"
 
 // Cursor position structure
 typedef struct {
@@ -12,13 +13,24 @@ typedef struct {
     bool is_valid;
 } cursor_position_t;
 
+// Edit produced by an operation: replace `delete_length` positions at
+// `offset` of the content the operation was called with by `insert_text`.
+// Applies to any text buffer; offsets use the configured position unit.
+typedef struct {
+    int offset;
+    int delete_length;
+    char* insert_text;      // UTF-8, owned by the result
+    int insert_length;      // byte length of insert_text
+} cursor_edit_delta_t;
+
 // Cursor operation result
 typedef struct {
     bool success;
     cursor_position_t new_position;
-    char* before_cursor;
-    char* after_cursor;
+    char* before_cursor;    // Full content output, only filled when
+    char* after_cursor;     // cursor_config_t.full_content_output is set
     char* error_message;
+    cursor_edit_delta_t delta;
 } cursor_operation_result_t;
 
 // Formatting marker types
@@ -40,10 +52,53 @@ typedef struct {
     bool inside_marker;
 } formatting_context_t;
 
-// Core cursor management functions
+// A stretch of text rendered verbatim: rendered and source positions advance
+// together over `length` units. Formatting markers are the gaps between runs.
+typedef struct {
+    int rendered_start;
+    int source_start;
+    int length;
+    bool ends_line;     // run ends with the line's '\n'
+} cursor_offset_run_t;
+
+// Rendered <-> source offset map, built in one pass over a line or a whole
+// document and reused until the text changes
+typedef struct {
+    char* source;       // copy of the text the map was built from
+    int source_bytes;
+    int source_capacity;
+    cursor_unit_t unit; // unit of every position below
+    int source_length;
+    int rendered_length;
+    cursor_offset_run_t* runs;
+    int run_count;
+    int run_capacity;
+} cursor_offset_map_t;
+
+// Engine configuration
+typedef struct {
+    cursor_unit_t position_unit;    // unit of every position passed to or
+                                    // returned by the functions below
+    bool full_content_output;       // also return before/after strings from
+                                    // operations (copies the content)
+} cursor_config_t;
+
+void cursor_set_config(const cursor_config_t* config);
+cursor_config_t cursor_get_config(void);
+
+// Core cursor management functions. Each call maps the text it is given and
+// keeps no state; callers converting many positions of one text hold an
+// offset map (see below) and sync it when the text changes.
 cursor_position_t cursor_html_to_markdown(int html_position, const char* markdown_text);
 cursor_position_t cursor_markdown_to_html(int markdown_position, const char* markdown_text);
 
+// Offset map (O(log n) lookups in both directions)
+cursor_offset_map_t* cursor_offset_map_create(const char* markdown_text);
+bool cursor_offset_map_sync(cursor_offset_map_t* map, const char* markdown_text);
+void cursor_offset_map_destroy(cursor_offset_map_t* map);
+int cursor_offset_map_to_source(const cursor_offset_map_t* map, int rendered_position);
+int cursor_offset_map_to_rendered(const cursor_offset_map_t* map, int source_position);
+
 // Position adjustment for formatting
 cursor_position_t cursor_adjust_for_formatting(int position, const char* content, bool is_markdown_mode);
 formatting_context_t cursor_analyze_formatting(const char* content, int position);
@@ -61,6 +116,9 @@ int cursor_find_safe_split_position(const char* content, int position);
 char* cursor_extract_before_position(const char* content, int position);
 char* cursor_extract_after_position(const char* content, int position);
 
+// Edit deltas
+char* cursor_apply_edit_delta(const char* content, const cursor_edit_delta_t* delta);
+
 // Memory management
 void cursor_free_result(cursor_operation_result_t* result);
 
@@ -0,0 +1,263 @@
+#include "cursor_text_index.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define CURSOR_UTF8_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define CURSOR_UTF8_NEON 1
+#endif
+
+// A UTF-8 character starts at every byte that is not a continuation byte
+// (10xxxxxx); it needs two UTF-16 units when its lead byte is 11110xxx.
+#define IS_CONTINUATION(c) (((c) & 0xC0) == 0x80)
+
+// Count character starts (`leads`) and 4-byte lead bytes (`fours`) in 16 bytes
+static inline void count_chunk16(const unsigned char* p, int* leads, int* fours) {
+#if CURSOR_UTF8_SSE2
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    if (_mm_movemask_epi8(v) == 0) {
+        *leads += 16;
+        return;
+    }
+    __m128i cont = _mm_cmplt_epi8(v, _mm_set1_epi8((char)0xC0));
+    __m128i four = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8((char)0xF0)), v);
+    *leads += 16 - __builtin_popcount(_mm_movemask_epi8(cont));
+    *fours += __builtin_popcount(_mm_movemask_epi8(four));
+#elif CURSOR_UTF8_NEON
+    uint8x16_t v = vld1q_u8(p);
+    if (vmaxvq_u8(v) < 0x80) {
+        *leads += 16;
+        return;
+    }
+    uint8x16_t cont = vcltq_s8(vreinterpretq_s8_u8(v), vdupq_n_s8(-64));
+    uint8x16_t four = vcgeq_u8(v, vdupq_n_u8(0xF0));
+    *leads += 16 - vaddvq_u8(vshrq_n_u8(cont, 7));
+    *fours += vaddvq_u8(vshrq_n_u8(four, 7));
+#else
+    for (int i = 0; i < 16; i++) {
+        if (!IS_CONTINUATION(p[i])) (*leads)++;
+        if (p[i] >= 0xF0) (*fours)++;
+    }
+#endif
+}
+
+static void count_utf8(const unsigned char* p, int n, int* leads, int* fours) {
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        count_chunk16(p + i, leads, fours);
+    }
+    for (; i < n; i++) {
+        if (!IS_CONTINUATION(p[i])) (*leads)++;
+        if (p[i] >= 0xF0) (*fours)++;
+    }
+}
+
+static inline int units_of(int leads, int fours, cursor_unit_t unit) {
+    return unit == CURSOR_UNIT_UTF16 ? leads + fours : leads;
+}
+
+// Walk forward from byte `start` (where `acc` units precede) to the first
+// character start at which `target` units precede. Stops early instead of
+// splitting a surrogate pair.
+static int scan_to_units(const unsigned char* p, int start, int n, int acc,
+                         int target, cursor_unit_t unit) {
+    int i = start;
+
+    // Skip whole chunks while they stay at or under the target
+    while (i + 16 <= n) {
+        int leads = 0, fours = 0;
+        count_chunk16(p + i, &leads, &fours);
+        int chunk = units_of(leads, fours, unit);
+        if (acc + chunk > target) break;
+        acc += chunk;
+        i += 16;
+    }
+
+    for (; i < n; i++) {
+        if (IS_CONTINUATION(p[i])) continue;
+        int width = (unit == CURSOR_UNIT_UTF16 && p[i] >= 0xF0) ? 2 : 1;
+        if (acc + width > target) break;
+        acc += width;
+    }
+    return i;
+}
+
+static int snap_to_char_start(const unsigned char* p, int n, int byte) {
+    if (byte < 0) return 0;
+    if (byte > n) return n;
+    while (byte > 0 && byte < n && IS_CONTINUATION(p[byte])) byte--;
+    return byte;
+}
+
+// ============= STATELESS CONVERSIONS =============
+
+int cursor_utf8_count_units(const char* text, int byte_length, cursor_unit_t unit) {
+    if (!text || byte_length <= 0) return 0;
+    if (unit == CURSOR_UNIT_BYTE) return byte_length;
+
+    int leads = 0, fours = 0;
+    count_utf8((const unsigned char*)text, byte_length, &leads, &fours);
+    return units_of(leads, fours, unit);
+}
+
+int cursor_utf8_byte_offset(const char* text, int byte_length, int units, cursor_unit_t unit) {
+    if (!text || byte_length <= 0 || units <= 0) return 0;
+
+    const unsigned char* p = (const unsigned char*)text;
+    if (unit == CURSOR_UNIT_BYTE) {
+        return snap_to_char_start(p, byte_length, units);
+    }
+    return scan_to_units(p, 0, byte_length, 0, units, unit);
+}
+
+int cursor_convert_offset(const char* text, int byte_length, int offset,
+                          cursor_unit_t from, cursor_unit_t to) {
+    int byte = cursor_utf8_byte_offset(text, byte_length, offset, from);
+    return cursor_utf8_count_units(text, byte, to);
+}
+
+// ============= INDEX =============
+
+cursor_text_index_t* cursor_text_index_create(const char* text, int length) {
+    if (!text) return NULL;
+    if (length < 0) length = strlen(text);
+
+    cursor_text_index_t* index = calloc(1, sizeof(cursor_text_index_t));
+    if (!index) return NULL;
+
+    index->byte_length = length;
+    index->checkpoint_count = length / CURSOR_TEXT_INDEX_STRIDE + 1;
+    index->text = malloc(length + 1);
+    index->checkpoints = malloc(index->checkpoint_count * sizeof(cursor_text_checkpoint_t));
+    if (!index->text || !index->checkpoints) {
+        cursor_text_index_destroy(index);
+        return NULL;
+    }
+    memcpy(index->text, text, length);
+    index->text[length] = '\0';
+
+    const unsigned char* p = (const unsigned char*)index->text;
+    int leads = 0, fours = 0;
+    for (int k = 0; k < index->checkpoint_count; k++) {
+        index->checkpoints[k].codepoint = leads;
+        index->checkpoints[k].utf16 = leads + fours;
+
+        int block_start = k * CURSOR_TEXT_INDEX_STRIDE;
+        int block_len = length - block_start;
+        if (block_len > CURSOR_TEXT_INDEX_STRIDE) block_len = CURSOR_TEXT_INDEX_STRIDE;
+        count_utf8(p + block_start, block_len, &leads, &fours);
+    }
+    index->codepoint_length = leads;
+    index->utf16_length = leads + fours;
+
+    int line_count = 1;
+    for (const char* nl = memchr(index->text, '\n', length); nl;
+         nl = memchr(nl + 1, '\n', length - (nl + 1 - index->text))) {
+        line_count++;
+    }
+    index->line_starts = malloc(line_count * sizeof(int));
+    if (!index->line_starts) {
+        cursor_text_index_destroy(index);
+        return NULL;
+    }
+    index->line_starts[0] = 0;
+    index->line_count = 1;
+    for (const char* nl = memchr(index->text, '\n', length); nl;
+         nl = memchr(nl + 1, '\n', length - (nl + 1 - index->text))) {
+        index->line_starts[index->line_count++] = (int)(nl + 1 - index->text);
+    }
+
+    return index;
+}
+
+void cursor_text_index_destroy(cursor_text_index_t* index) {
+    if (!index) return;
+    free(index->text);
+    free(index->checkpoints);
+    free(index->line_starts);
+    free(index);
+}
+
+int cursor_text_index_length(const cursor_text_index_t* index, cursor_unit_t unit) {
+    if (!index) return 0;
+    switch (unit) {
+        case CURSOR_UNIT_UTF16: return index->utf16_length;
+        case CURSOR_UNIT_CODEPOINT: return index->codepoint_length;
+        default: return index->byte_length;
+    }
+}
+
+static inline int checkpoint_value(const cursor_text_checkpoint_t* cp, cursor_unit_t unit) {
+    return unit == CURSOR_UNIT_UTF16 ? cp->utf16 : cp->codepoint;
+}
+
+// O(1): checkpoint plus at most one block
+static int index_from_byte(const cursor_text_index_t* index, int byte, cursor_unit_t unit) {
+    if (unit == CURSOR_UNIT_BYTE) return byte;
+
+    int k = byte / CURSOR_TEXT_INDEX_STRIDE;
+    int leads = 0, fours = 0;
+    int block_start = k * CURSOR_TEXT_INDEX_STRIDE;
+    count_utf8((const unsigned char*)index->text + block_start, byte - block_start, &leads, &fours);
+    return checkpoint_value(&index->checkpoints[k], unit) + units_of(leads, fours, unit);
+}
+
+// O(log n): binary search on checkpoints, then at most one block
+static int index_to_byte(const cursor_text_index_t* index, int offset, cursor_unit_t unit) {
+    const unsigned char* p = (const unsigned char*)index->text;
+    if (unit == CURSOR_UNIT_BYTE) {
+        return snap_to_char_start(p, index->byte_length, offset);
+    }
+    if (offset <= 0) return 0;
+
+    // Last checkpoint at or before the target
+    int lo = 0, hi = index->checkpoint_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (checkpoint_value(&index->checkpoints[mid], unit) <= offset) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return scan_to_units(p, lo * CURSOR_TEXT_INDEX_STRIDE, index->byte_length,
+                         checkpoint_value(&index->checkpoints[lo], unit), offset, unit);
+}
+
+int cursor_text_index_convert(const cursor_text_index_t* index, int offset,
+                              cursor_unit_t from, cursor_unit_t to) {
+    if (!index) return 0;
+    return index_from_byte(index, index_to_byte(index, offset, from), to);
+}
+
+int cursor_text_index_line_at(const cursor_text_index_t* index, int offset, cursor_unit_t unit) {
+    if (!index) return 0;
+    int byte = index_to_byte(index, offset, unit);
+
+    int lo = 0, hi = index->line_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (index->line_starts[mid] <= byte) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+int cursor_text_index_line_start(const cursor_text_index_t* index, int line, cursor_unit_t unit) {
+    if (!index || line < 0) return 0;
+    if (line >= index->line_count) return cursor_text_index_length(index, unit);
+    return index_from_byte(index, index->line_starts[line], unit);
+}
+
+// Offset of the line's '\n' (or of the end of the text on the last line)
+int cursor_text_index_line_end(const cursor_text_index_t* index, int line, cursor_unit_t unit) {
+    if (!index || line < 0) return 0;
+    if (line >= index->line_count - 1) return cursor_text_index_length(index, unit);
+    return index_from_byte(index, index->line_starts[line + 1] - 1, unit);
+}
@@ -0,0 +1,58 @@
+#ifndef CURSOR_TEXT_INDEX_H
+#define CURSOR_TEXT_INDEX_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+// Unit a position is expressed in. Text is always stored as UTF-8; hosts
+// such as Flutter and JavaScript count UTF-16 code units instead.
+typedef enum {
+    CURSOR_UNIT_BYTE = 0,       // UTF-8 bytes (native)
+    CURSOR_UNIT_UTF16 = 1,      // UTF-16 code units (Dart, JS, NSString)
+    CURSOR_UNIT_CODEPOINT = 2   // Unicode scalar values
+} cursor_unit_t;
+
+// Bytes covered by one checkpoint of a cursor_text_index_t
+#define CURSOR_TEXT_INDEX_STRIDE 64
+
+// Unit counts at the start of a CURSOR_TEXT_INDEX_STRIDE-byte block
+typedef struct {
+    int utf16;
+    int codepoint;
+} cursor_text_checkpoint_t;
+
+// Checkpointed offset index over a whole text: byte -> unit conversions are
+// O(1), unit -> byte conversions O(log n), each plus a scan of at most one
+// block. Also keeps the byte offset of every line start.
+typedef struct {
+    char* text;                         // copy of the indexed text
+    int byte_length;
+    int utf16_length;
+    int codepoint_length;
+    cursor_text_checkpoint_t* checkpoints;
+    int checkpoint_count;
+    int* line_starts;                   // byte offset of each line
+    int line_count;
+} cursor_text_index_t;
+
+// Stateless conversions (vectorized scan of the prefix). Offsets that fall
+// inside a multi-byte sequence or a surrogate pair snap back to the start of
+// the character; offsets past the end clamp to the end.
+int cursor_utf8_count_units(const char* text, int byte_length, cursor_unit_t unit);
+int cursor_utf8_byte_offset(const char* text, int byte_length, int units, cursor_unit_t unit);
+int cursor_convert_offset(const char* text, int byte_length, int offset,
+                          cursor_unit_t from, cursor_unit_t to);
+
+// Index (length < 0 means NUL-terminated)
+cursor_text_index_t* cursor_text_index_create(const char* text, int length);
+void cursor_text_index_destroy(cursor_text_index_t* index);
+int cursor_text_index_length(const cursor_text_index_t* index, cursor_unit_t unit);
+int cursor_text_index_convert(const cursor_text_index_t* index, int offset,
+                              cursor_unit_t from, cursor_unit_t to);
+
+// Lines, with offsets in the requested unit
+int cursor_text_index_line_at(const cursor_text_index_t* index, int offset, cursor_unit_t unit);
+int cursor_text_index_line_start(const cursor_text_index_t* index, int line, cursor_unit_t unit);
+int cursor_text_index_line_end(const cursor_text_index_t* index, int line, cursor_unit_t unit);
+
+#endif // CURSOR_TEXT_INDEX_H
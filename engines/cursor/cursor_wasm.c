@@ -15,6 +15,33 @@ int cursor_wasm_html_to_markdown(int html_position, const char* markdown_text) {
     return result.is_valid ? result.position : -1;
 }
 
+// Offset map held across calls: JS syncs it when the text changes, then
+// converts every cursor move with a binary search and no string copy
+static cursor_offset_map_t* g_wasm_offset_map = NULL;
+
+// Rebuild the held map if the text changed; returns 0 when out of memory
+EMSCRIPTEN_KEEPALIVE
+int cursor_wasm_offset_map_sync(const char* markdown_text) {
+    if (!markdown_text) return 0;
+    if (!g_wasm_offset_map) {
+        g_wasm_offset_map = cursor_offset_map_create(markdown_text);
+        return g_wasm_offset_map ? 1 : 0;
+    }
+    return cursor_offset_map_sync(g_wasm_offset_map, markdown_text) ? 1 : 0;
+}
+
+// HTML -> Markdown through the held map (-1 before any sync)
+EMSCRIPTEN_KEEPALIVE
+int cursor_wasm_offset_map_to_source(int html_position) {
+    return g_wasm_offset_map ? cursor_offset_map_to_source(g_wasm_offset_map, html_position) : -1;
+}
+
+// Markdown -> HTML through the held map (-1 before any sync)
+EMSCRIPTEN_KEEPALIVE
+int cursor_wasm_offset_map_to_rendered(int markdown_position) {
+    return g_wasm_offset_map ? cursor_offset_map_to_rendered(g_wasm_offset_map, markdown_position) : -1;
+}
+
 // Adjust position for formatting (returns adjusted position)
 EMSCRIPTEN_KEEPALIVE
 int cursor_wasm_adjust_for_formatting(int position, const char* content) {
@@ -42,12 +69,23 @@ int cursor_wasm_get_formatting_type(const char* content, int position) {
     return (int)context.type;
 }
 
+// The JSON results keep the full before/after strings JS callers expect
+static bool set_full_content_output(bool enabled) {
+    cursor_config_t config = cursor_get_config();
+    bool previous = config.full_content_output;
+    config.full_content_output = enabled;
+    cursor_set_config(&config);
+    return previous;
+}
+
 // Handle Enter key - returns JSON string with result
 EMSCRIPTEN_KEEPALIVE
 char* cursor_wasm_handle_enter_key(int position, const char* content) {
     if (!content) return NULL;
     
+    bool previous = set_full_content_output(true);
     cursor_operation_result_t result = cursor_handle_enter_key(position, content, true);
+    set_full_content_output(previous);
     
     // Create JSON response
     char* json = malloc(2048);
@@ -62,11 +100,13 @@ char* cursor_wasm_handle_enter_key(int position, const char* content) {
             "\"success\": true, "
             "\"beforeCursor\": \"%s\", "
             "\"afterCursor\": \"%s\", "
-            "\"newPosition\": %d"
+            "\"newPosition\": %d, "
+            "\"deltaOffset\": %d"
             "}",
             result.before_cursor ? result.before_cursor : "",
             result.after_cursor ? result.after_cursor : "",
-            result.new_position.position
+            result.new_position.position,
+            result.delta.offset
         );
     } else {
         snprintf(json, 2048,
@@ -87,7 +127,9 @@ EMSCRIPTEN_KEEPALIVE
 char* cursor_wasm_split_line(int position, const char* content) {
     if (!content) return NULL;
     
+    bool previous = set_full_content_output(true);
     cursor_operation_result_t result = cursor_split_line(position, content);
+    set_full_content_output(previous);
     
     // Create JSON response
     char* json = malloc(2048);
@@ -101,10 +143,12 @@ char* cursor_wasm_split_line(int position, const char* content) {
             "{"
             "\"success\": true, "
             "\"beforeCursor\": \"%s\", "
-            "\"afterCursor\": \"%s\""
+            "\"afterCursor\": \"%s\", "
+            "\"deltaOffset\": %d"
             "}",
             result.before_cursor ? result.before_cursor : "",
-            result.after_cursor ? result.after_cursor : ""
+            result.after_cursor ? result.after_cursor : "",
+            result.delta.offset
         );
     } else {
         snprintf(json, 2048,
@@ -125,7 +169,9 @@ EMSCRIPTEN_KEEPALIVE
 char* cursor_wasm_merge_lines(const char* line1, const char* line2, int add_space) {
     if (!line1 || !line2) return NULL;
     
+    bool previous = set_full_content_output(true);
     cursor_operation_result_t result = cursor_merge_lines(line1, line2, add_space != 0);
+    set_full_content_output(previous);
     
     // Create JSON response
     char* json = malloc(2048);
@@ -139,10 +185,14 @@ char* cursor_wasm_merge_lines(const char* line1, const char* line2, int add_spac
             "{"
             "\"success\": true, "
             "\"mergedContent\": \"%s\", "
-            "\"cursorPosition\": %d"
+            "\"cursorPosition\": %d, "
+            "\"deltaOffset\": %d, "
+            "\"insertText\": \"%s\""
             "}",
             result.before_cursor ? result.before_cursor : "",
-            result.new_position.position
+            result.new_position.position,
+            result.delta.offset,
+            result.delta.insert_text ? result.delta.insert_text : ""
         );
     } else {
         snprintf(json, 2048,
@@ -171,6 +221,23 @@ int cursor_wasm_find_safe_position(const char* content, int position) {
     return cursor_find_safe_split_position(content, position);
 }
 
+// Select the unit of every position exchanged with the engine
+// (0=UTF-8 bytes, 1=UTF-16 code units as used by JavaScript strings, 2=codepoints)
+EMSCRIPTEN_KEEPALIVE
+void cursor_wasm_set_position_unit(int unit) {
+    cursor_config_t config = cursor_get_config();
+    config.position_unit = (cursor_unit_t)unit;
+    cursor_set_config(&config);
+}
+
+// Convert an offset in content between units
+EMSCRIPTEN_KEEPALIVE
+int cursor_wasm_convert_offset(const char* content, int offset, int from_unit, int to_unit) {
+    if (!content) return 0;
+    return cursor_convert_offset(content, (int)strlen(content), offset,
+                                 (cursor_unit_t)from_unit, (cursor_unit_t)to_unit);
+}
+
 // Free memory allocated by WASM functions
 EMSCRIPTEN_KEEPALIVE
 void cursor_wasm_free(void* ptr) {
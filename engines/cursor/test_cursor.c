@@ -0,0 +1,254 @@
+#include "cursor_manager.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int to_source(const char* text, int rendered) {
+    cursor_position_t pos = cursor_html_to_markdown(rendered, text);
+    assert(pos.is_valid);
+    return pos.position;
+}
+
+static int to_rendered(const char* text, int source) {
+    cursor_position_t pos = cursor_markdown_to_html(source, text);
+    assert(pos.is_valid);
+    return pos.position;
+}
+
+static void test_header_prefix_is_skipped(void) {
+    const char* text = "## Title";
+    assert(to_source(text, 0) == 3);
+    assert(to_source(text, 5) == 8);
+    assert(to_rendered(text, 0) == 0);
+    assert(to_rendered(text, 4) == 1);
+}
+
+static void test_markers_are_hidden(void) {
+    const char* text = "a **bold** *it* ==hi== ++u++";
+    // Boundaries stay before the markers
+    assert(to_source(text, 2) == 2);
+    assert(to_source(text, 3) == 5);
+    assert(to_source(text, 6) == 8);
+    assert(to_source(text, 7) == 11);
+    assert(to_source(text, 8) == 13);
+    assert(to_source(text, 12) == 20);
+    assert(to_source(text, 14) == 26);
+    // Marker bytes snap to the rendered boundary
+    assert(to_rendered(text, 3) == 2);
+    assert(to_rendered(text, 9) == 6);
+    assert(to_rendered(text, 27) == 14);
+}
+
+static void test_unclosed_markers_are_plain(void) {
+    const char* text = "**open ==and ++x";
+    for (int i = 0; i <= (int)strlen(text); i++) {
+        assert(to_source(text, i) == i);
+        assert(to_rendered(text, i) == i);
+    }
+    assert(to_source(text, 100) == (int)strlen(text));
+}
+
+static void test_map_round_trips_across_lines(void) {
+    const char* text = "# H **b**\nx *i* y\n\nlast";
+    cursor_offset_map_t* map = cursor_offset_map_create(text);
+    assert(map != NULL);
+    assert(map->rendered_length == 15);
+
+    for (int r = 0; r <= map->rendered_length; r++) {
+        int source = cursor_offset_map_to_source(map, r);
+        assert(cursor_offset_map_to_rendered(map, source) == r);
+    }
+    // Line end stays before the closing marker, next position is line two
+    assert(cursor_offset_map_to_source(map, 3) == 7);
+    assert(cursor_offset_map_to_source(map, 4) == 10);
+
+    // Same text keeps the map, new text rebuilds it
+    cursor_offset_run_t* runs = map->runs;
+    assert(cursor_offset_map_sync(map, text));
+    assert(map->runs == runs);
+    assert(cursor_offset_map_sync(map, "**z**"));
+    assert(map->rendered_length == 1);
+    assert(cursor_offset_map_to_source(map, 1) == 3);
+
+    cursor_offset_map_destroy(map);
+}
+
+static void test_conversions_follow_text_changes(void) {
+    // Each conversion maps the text it is given: a buffer edited in place
+    // is converted against its new text
+    char text[] = "**ab** c";
+    assert(to_source(text, 2) == 4);
+    assert(to_rendered(text, 4) == 2);
+    text[0] = 'x';
+    text[1] = 'y';
+    assert(to_source(text, 2) == 2);
+    assert(to_source("*a*", 1) == 2);
+    assert(to_source(text, 7) == 7);
+}
+
+static void test_utf8_offset_conversions(void) {
+    // "a" (1 byte), "é" (2), "😀" (4, surrogate pair), "中" (3)
+    const char* text = "a\xc3\xa9\xf0\x9f\x98\x80\xe4\xb8\xad";
+    int len = (int)strlen(text);
+    assert(cursor_utf8_count_units(text, len, CURSOR_UNIT_UTF16) == 5);
+    assert(cursor_utf8_count_units(text, len, CURSOR_UNIT_CODEPOINT) == 4);
+
+    assert(cursor_convert_offset(text, len, 7, CURSOR_UNIT_BYTE, CURSOR_UNIT_UTF16) == 4);
+    assert(cursor_convert_offset(text, len, 4, CURSOR_UNIT_UTF16, CURSOR_UNIT_BYTE) == 7);
+    // Inside the surrogate pair / inside a sequence snaps back
+    assert(cursor_convert_offset(text, len, 3, CURSOR_UNIT_UTF16, CURSOR_UNIT_BYTE) == 3);
+    assert(cursor_convert_offset(text, len, 5, CURSOR_UNIT_BYTE, CURSOR_UNIT_CODEPOINT) == 2);
+}
+
+static void test_text_index_lines_and_units(void) {
+    char text[400];
+    strcpy(text, "first \xf0\x9f\x98\x80\n");
+    for (int i = 0; i < 40; i++) strcat(text, "\xc3\xa9t\xc3\xa9 ");
+    strcat(text, "\nlast");
+
+    cursor_text_index_t* index = cursor_text_index_create(text, -1);
+    assert(index != NULL);
+    assert(index->line_count == 3);
+    assert(cursor_text_index_line_start(index, 1, CURSOR_UNIT_BYTE) == 11);
+    assert(cursor_text_index_line_start(index, 1, CURSOR_UNIT_UTF16) == 9);
+    assert(cursor_text_index_line_start(index, 2, CURSOR_UNIT_UTF16) == 9 + 160 + 1);
+    assert(cursor_text_index_line_end(index, 0, CURSOR_UNIT_CODEPOINT) == 7);
+    assert(cursor_text_index_line_at(index, 9 + 160 + 1, CURSOR_UNIT_UTF16) == 2);
+
+    for (int u = 0; u <= cursor_text_index_length(index, CURSOR_UNIT_UTF16); u++) {
+        int byte = cursor_text_index_convert(index, u, CURSOR_UNIT_UTF16, CURSOR_UNIT_BYTE);
+        int expected = cursor_convert_offset(text, (int)strlen(text), u,
+                                             CURSOR_UNIT_UTF16, CURSOR_UNIT_BYTE);
+        assert(byte == expected);
+    }
+    cursor_text_index_destroy(index);
+}
+
+static char* apply(const char* content, cursor_operation_result_t* result) {
+    assert(result->success);
+    assert(result->before_cursor == NULL && result->after_cursor == NULL);
+    char* edited = cursor_apply_edit_delta(content, &result->delta);
+    assert(edited != NULL);
+    cursor_free_result(result);
+    return edited;
+}
+
+static void test_line_operations_return_deltas(void) {
+    const char* text = "one\n  two\nthree";
+
+    cursor_operation_result_t result = cursor_handle_enter_key(2, "ab**cd**", true);
+    assert(result.delta.offset == 2 && result.delta.delete_length == 0);
+    char* edited = apply("ab**cd**", &result);
+    assert(strcmp(edited, "ab\n**cd**") == 0);
+    free(edited);
+
+    result = cursor_duplicate_line(text, 6);
+    assert(result.new_position.position == 10);
+    edited = apply(text, &result);
+    assert(strcmp(edited, "one\n  two\n  two\nthree") == 0);
+    free(edited);
+
+    result = cursor_delete_line(text, 6);
+    assert(result.new_position.position == 4);
+    edited = apply(text, &result);
+    assert(strcmp(edited, "one\nthree") == 0);
+    free(edited);
+
+    result = cursor_delete_line(text, 12);
+    edited = apply(text, &result);
+    assert(strcmp(edited, "one\n  two") == 0);
+    free(edited);
+
+    result = cursor_move_line_up(text, 7);
+    assert(result.new_position.position == 3);
+    edited = apply(text, &result);
+    assert(strcmp(edited, "  two\none\nthree") == 0);
+    free(edited);
+
+    result = cursor_move_line_down(text, 1);
+    assert(result.new_position.position == 7);
+    edited = apply(text, &result);
+    assert(strcmp(edited, "  two\none\nthree") == 0);
+    free(edited);
+
+    // Boundary moves are empty edits
+    result = cursor_move_line_up(text, 1);
+    assert(result.delta.delete_length == 0 && result.delta.insert_length == 0);
+    assert(result.new_position.position == 1);
+    cursor_free_result(&result);
+
+    result = cursor_merge_lines("abc.", "def", true);
+    assert(result.delta.offset == 4 && result.delta.delete_length == 1);
+    assert(strcmp(result.delta.insert_text, " ") == 0);
+    cursor_free_result(&result);
+}
+
+static void test_full_content_output(void) {
+    cursor_config_t saved = cursor_get_config();
+    cursor_config_t config = saved;
+    config.full_content_output = true;
+    cursor_set_config(&config);
+
+    cursor_operation_result_t result = cursor_handle_enter_key(2, "abcd", true);
+    assert(strcmp(result.before_cursor, "ab") == 0);
+    assert(strcmp(result.after_cursor, "cd") == 0);
+    cursor_free_result(&result);
+
+    result = cursor_merge_lines("abc.", "def", true);
+    assert(strcmp(result.before_cursor, "abc. def") == 0);
+    assert(result.new_position.position == 5);
+    cursor_free_result(&result);
+
+    cursor_set_config(&saved);
+}
+
+static void test_api_positions_in_utf16(void) {
+    cursor_config_t saved = cursor_get_config();
+    cursor_config_t config = saved;
+    config.position_unit = CURSOR_UNIT_UTF16;
+    cursor_set_config(&config);
+
+    // "😀 **gras** fin": the emoji is 2 UTF-16 units, 4 bytes
+    const char* text = "\xf0\x9f\x98\x80 **gras** fin";
+    assert(cursor_move_word_right(text, 0).position == 3);
+    assert(cursor_move_to_line_end(text, 0).position == 15);
+    assert(cursor_validate_position(text, 15));
+    assert(!cursor_validate_position(text, 16));
+    assert(to_source(text, 3) == 3);
+    assert(to_source(text, 4) == 6);
+    assert(to_rendered(text, 5) == 3);
+
+    cursor_operation_result_t merged = cursor_merge_lines("\xc3\xa9t\xc3\xa9", "suite", true);
+    assert(merged.success);
+    assert(merged.new_position.position == 4);
+    assert(merged.delta.offset == 3);
+    cursor_free_result(&merged);
+
+    // Deltas are in UTF-16 units too: "é" is 2 bytes, 1 unit
+    const char* lines = "\xc3\xa9\nx\xc3\xa9";
+    cursor_operation_result_t moved = cursor_move_line_down(lines, 1);
+    assert(moved.delta.offset == 0 && moved.delta.delete_length == 4);
+    assert(moved.new_position.position == 4);
+    char* edited = cursor_apply_edit_delta(lines, &moved.delta);
+    assert(strcmp(edited, "x\xc3\xa9\n\xc3\xa9") == 0);
+    free(edited);
+    cursor_free_result(&moved);
+
+    cursor_set_config(&saved);
+}
+
+int main(void) {
+    test_header_prefix_is_skipped();
+    test_markers_are_hidden();
+    test_unclosed_markers_are_plain();
+    test_map_round_trips_across_lines();
+    test_conversions_follow_text_changes();
+    test_utf8_offset_conversions();
+    test_text_index_lines_and_units();
+    test_line_operations_return_deltas();
+    test_full_content_output();
+    test_api_positions_in_utf16();
+    printf("cursor tests passed\n");
+    return 0;
+}
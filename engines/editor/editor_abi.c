@@ -1,6 +1,7 @@
 // editor_abi.c - Implementation of stable ABI interface
 #include "editor_abi.h"
 #include "editor.h"
+#include "cursor_text_index.h"
 #include "json.h"
 #include "markdown.h"
 #include <stdarg.h>
@@ -928,6 +929,56 @@ EDITOR_API size_t editor_estimate_markdown_size(const char *json) {
   return strlen(json) * 2 / 3;
 }
 
+// Text offsets (EditorOffsetUnit values match cursor_unit_t)
+EDITOR_API int32_t editor_offset_convert(const char *text, int32_t offset,
+                                         EditorOffsetUnit from,
+                                         EditorOffsetUnit to) {
+  if (!text) {
+    set_last_error(EDITOR_ERROR_INVALID_PARAMETER);
+    return 0;
+  }
+  return cursor_convert_offset(text, (int)strlen(text), offset,
+                               (cursor_unit_t)from, (cursor_unit_t)to);
+}
+
+EDITOR_API EditorOffsetIndex *editor_offset_index_create(const char *text) {
+  if (!text) {
+    set_last_error(EDITOR_ERROR_INVALID_PARAMETER);
+    return NULL;
+  }
+
+  cursor_text_index_t *index = cursor_text_index_create(text, -1);
+  if (!index) {
+    set_last_error(EDITOR_ERROR_OUT_OF_MEMORY);
+  }
+  return (EditorOffsetIndex *)index;
+}
+
+EDITOR_API void editor_offset_index_destroy(EditorOffsetIndex *index) {
+  cursor_text_index_destroy((cursor_text_index_t *)index);
+}
+
+EDITOR_API int32_t editor_offset_index_convert(const EditorOffsetIndex *index,
+                                               int32_t offset,
+                                               EditorOffsetUnit from,
+                                               EditorOffsetUnit to) {
+  return cursor_text_index_convert((const cursor_text_index_t *)index, offset,
+                                   (cursor_unit_t)from, (cursor_unit_t)to);
+}
+
+EDITOR_API int32_t editor_offset_index_line_at(const EditorOffsetIndex *index,
+                                               int32_t offset,
+                                               EditorOffsetUnit unit) {
+  return cursor_text_index_line_at((const cursor_text_index_t *)index, offset,
+                                   (cursor_unit_t)unit);
+}
+
+EDITOR_API int32_t editor_offset_index_line_start(
+    const EditorOffsetIndex *index, int32_t line, EditorOffsetUnit unit) {
+  return cursor_text_index_line_start((const cursor_text_index_t *)index, line,
+                                      (cursor_unit_t)unit);
+}
+
 // Feature detection
 EDITOR_API uint32_t editor_get_features(void) {
   uint32_t features = 0;
@@ -15,7 +15,7 @@ extern "C" {
 
 // Version information
 #define EDITOR_ABI_VERSION_MAJOR 1
-#define EDITOR_ABI_VERSION_MINOR 0
+#define EDITOR_ABI_VERSION_MINOR 1
 #define EDITOR_ABI_VERSION_PATCH 0
 
 // Export macros for different platforms
@@ -116,6 +116,34 @@ EDITOR_API bool editor_is_valid_json(const char *json);
 EDITOR_API size_t editor_estimate_json_size(const char *markdown);
 EDITOR_API size_t editor_estimate_markdown_size(const char *json);
 
+// Text offsets. Editor text is UTF-8; Dart and JavaScript strings count
+// UTF-16 code units. Offsets inside a character snap back to its start.
+typedef enum {
+  EDITOR_OFFSET_UTF8 = 0,
+  EDITOR_OFFSET_UTF16 = 1,
+  EDITOR_OFFSET_CODEPOINT = 2,
+} EditorOffsetUnit;
+
+// Checkpointed index over one text for repeated conversions
+typedef struct EditorOffsetIndex EditorOffsetIndex;
+
+// One-off conversion, O(offset) vectorized scan
+EDITOR_API int32_t editor_offset_convert(const char *text, int32_t offset,
+                                         EditorOffsetUnit from,
+                                         EditorOffsetUnit to);
+// Index: UTF-8 -> other units in O(1), other units -> UTF-8 in O(log n)
+EDITOR_API EditorOffsetIndex *editor_offset_index_create(const char *text);
+EDITOR_API void editor_offset_index_destroy(EditorOffsetIndex *index);
+EDITOR_API int32_t editor_offset_index_convert(const EditorOffsetIndex *index,
+                                               int32_t offset,
+                                               EditorOffsetUnit from,
+                                               EditorOffsetUnit to);
+EDITOR_API int32_t editor_offset_index_line_at(const EditorOffsetIndex *index,
+                                               int32_t offset,
+                                               EditorOffsetUnit unit);
+EDITOR_API int32_t editor_offset_index_line_start(
+    const EditorOffsetIndex *index, int32_t line, EditorOffsetUnit unit);
+
 // Thread safety (if compiled with thread support)
 #ifdef EDITOR_THREAD_SAFE
 EDITOR_API EditorResult editor_lock(void);
@@ -131,8 +131,28 @@ static void test_html_block_rendering(void) {
   assert_contains(code_html, "int x = 1;");
 }
 
+static void test_offset_conversions(void) {
+  // "é" is 2 UTF-8 bytes / 1 UTF-16 unit, "😀" is 4 bytes / 2 units
+  const char *text = "\xc3\xa9t\xc3\xa9\n\xf0\x9f\x98\x80 ok";
+  assert(editor_offset_convert(text, 6, EDITOR_OFFSET_UTF8,
+                               EDITOR_OFFSET_UTF16) == 4);
+  assert(editor_offset_convert(text, 7, EDITOR_OFFSET_UTF16,
+                               EDITOR_OFFSET_UTF8) == 11);
+
+  EditorOffsetIndex *index = editor_offset_index_create(text);
+  assert(index != NULL);
+  assert(editor_offset_index_convert(index, 10, EDITOR_OFFSET_UTF8,
+                                     EDITOR_OFFSET_UTF16) == 6);
+  assert(editor_offset_index_convert(index, 6, EDITOR_OFFSET_UTF16,
+                                     EDITOR_OFFSET_CODEPOINT) == 5);
+  assert(editor_offset_index_line_at(index, 6, EDITOR_OFFSET_UTF16) == 1);
+  assert(editor_offset_index_line_start(index, 1, EDITOR_OFFSET_UTF16) == 4);
+  editor_offset_index_destroy(index);
+}
+
 int main(void) {
   assert(editor_library_init() == EDITOR_SUCCESS);
+  test_offset_conversions();
   test_header_case_is_preserved();
   test_table_headers_keep_inline_styles();
   test_table_rows_keep_inline_styles();
@@ -1,5 +1,6 @@
 // hybrid_editor_core.c - Core hybrid editor logic implementation
 #include "hybrid_editor_core.h"
+#include "cursor_text_index.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
@@ -15,6 +16,20 @@ static HybridConfig g_config = {
     .max_line_length = 10000
 };
 
+static HybridPositionUnit g_position_unit = HYBRID_UNIT_BYTE;
+
+// Byte offset within `text` -> configured unit
+static int to_unit(const char* text, int byte) {
+    if (g_position_unit == HYBRID_UNIT_BYTE || byte <= 0) return byte;
+    return cursor_utf8_count_units(text, byte, (cursor_unit_t)g_position_unit);
+}
+
+// Configured unit -> byte offset within `text` (clamped to its length)
+static int from_unit(const char* text, int offset) {
+    if (g_position_unit == HYBRID_UNIT_BYTE || offset <= 0) return offset;
+    return cursor_utf8_byte_offset(text, strlen(text), offset, (cursor_unit_t)g_position_unit);
+}
+
 // Helper function to count lines in text
 HYBRID_API int hybrid_count_lines(const char* text) {
     if (!text) return 0;
@@ -43,7 +58,7 @@ HYBRID_API TextLines* hybrid_parse_text(const char* text) {
     }
     
     lines->line_count = line_count;
-    lines->total_length = strlen(text);
+    HybridPositionUnit unit = g_position_unit;
     
     // Parse each line
     const char* line_start = text;
@@ -55,17 +70,17 @@ HYBRID_API TextLines* hybrid_parse_text(const char* text) {
         
         // Find end of line
         const char* line_end = strchr(line_start, '\n');
+        int byte_length = line_end ? (int)(line_end - line_start) : (int)strlen(line_start);
+        lines->lines[i].length = unit == HYBRID_UNIT_BYTE ? byte_length :
+            cursor_utf8_count_units(line_start, byte_length, (cursor_unit_t)unit);
+        lines->lines[i].char_end = char_pos + lines->lines[i].length;
+
         if (line_end) {
-            lines->lines[i].length = line_end - line_start;
-            lines->lines[i].char_end = char_pos + lines->lines[i].length;
             char_pos = lines->lines[i].char_end + 1; // +1 for \n
             line_start = line_end + 1;
-        } else {
-            // Last line without \n
-            lines->lines[i].length = strlen(line_start);
-            lines->lines[i].char_end = char_pos + lines->lines[i].length;
         }
     }
+    lines->total_length = line_count > 0 ? lines->lines[line_count - 1].char_end : 0;
     
     return lines;
 }
@@ -80,15 +95,19 @@ HYBRID_API void hybrid_free_text_lines(TextLines* lines) {
 
 // Get line index at cursor position
 HYBRID_API int hybrid_get_line_at_cursor(const TextLines* lines, int cursor_pos) {
-    if (!lines || cursor_pos < 0) return 0;
+    if (!lines || cursor_pos < 0 || lines->line_count == 0) return 0;
     
-    for (int i = 0; i < lines->line_count; i++) {
-        if (cursor_pos >= lines->lines[i].char_start && cursor_pos <= lines->lines[i].char_end) {
-            return i;
+    // Last line starting at or before the cursor
+    int lo = 0, hi = lines->line_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (lines->lines[mid].char_start <= cursor_pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
         }
     }
-    
-    return lines->line_count - 1; // Default to last line
+    return lo;
 }
 
 // Get line info by index
@@ -277,6 +296,15 @@ HYBRID_API LineFormats* hybrid_analyze_markdown_line(const char* line) {
         }
     }
     
+    // Report ranges in the configured unit
+    for (int i = 0; i < formats->format_count; i++) {
+        FormatInfo* info = &formats->formats[i];
+        info->range.start = to_unit(line, info->range.start);
+        info->range.end = to_unit(line, info->range.end);
+        info->content_range.start = to_unit(line, info->content_range.start);
+        info->content_range.end = to_unit(line, info->content_range.end);
+    }
+    
     return formats;
 }
 
@@ -333,21 +361,12 @@ HYBRID_API char* hybrid_strip_markdown_markup(const char* line) {
     return result;
 }
 
-// Find markup ranges in line
-HYBRID_API HybridTextRange* hybrid_find_markup_ranges(const char* line, int* range_count) {
-    if (!line || !range_count) return NULL;
-    
-    LineFormats* formats = hybrid_analyze_markdown_line(line);
-    if (!formats) {
-        *range_count = 0;
-        return NULL;
-    }
-    
-    // Convert formats to markup ranges
+// Convert formats to markup ranges
+static HybridTextRange* markup_ranges_from_formats(const LineFormats* formats, int* range_count) {
     HybridTextRange* ranges = malloc(sizeof(HybridTextRange) * formats->format_count * 2); // Each format has 2 markup ranges
     int count = 0;
     
-    for (int i = 0; i < formats->format_count; i++) {
+    for (int i = 0; ranges && i < formats->format_count; i++) {
         FormatInfo* info = &formats->formats[i];
         
         // Opening markup
@@ -362,6 +381,20 @@ HYBRID_API HybridTextRange* hybrid_find_markup_ranges(const char* line, int* ran
     }
     
     *range_count = count;
+    return ranges;
+}
+
+// Find markup ranges in line
+HYBRID_API HybridTextRange* hybrid_find_markup_ranges(const char* line, int* range_count) {
+    if (!line || !range_count) return NULL;
+    
+    LineFormats* formats = hybrid_analyze_markdown_line(line);
+    if (!formats) {
+        *range_count = 0;
+        return NULL;
+    }
+    
+    HybridTextRange* ranges = markup_ranges_from_formats(formats, range_count);
     hybrid_free_line_formats(formats);
     return ranges;
 }
@@ -370,20 +403,21 @@ HYBRID_API HybridTextRange* hybrid_find_markup_ranges(const char* line, int* ran
 HYBRID_API char* hybrid_get_line_content(const char* text, int line_index) {
     if (!text || line_index < 0) return NULL;
     
-    TextLines* lines = hybrid_parse_text(text);
-    if (!lines || line_index >= lines->line_count) {
-        hybrid_free_text_lines(lines);
-        return NULL;
+    // Skip to the line instead of splitting the whole text
+    const char* line = text;
+    for (int i = 0; i < line_index; i++) {
+        line = strchr(line, '\n');
+        if (!line) return NULL;
+        line++;
     }
     
-    LineInfo* info = &lines->lines[line_index];
-    char* content = malloc(info->length + 1);
+    const char* end = strchr(line, '\n');
+    int length = end ? (int)(end - line) : (int)strlen(line);
+    char* content = malloc(length + 1);
     if (content) {
-        strncpy(content, text + info->char_start, info->length);
-        content[info->length] = '\0';
+        memcpy(content, line, length);
+        content[length] = '\0';
     }
-    
-    hybrid_free_text_lines(lines);
     return content;
 }
 
@@ -420,12 +454,23 @@ HYBRID_API HybridConfig hybrid_get_config(void) {
     return g_config;
 }
 
+HYBRID_API void hybrid_set_position_unit(HybridPositionUnit unit) {
+    if (unit >= HYBRID_UNIT_BYTE && unit <= HYBRID_UNIT_CODEPOINT) {
+        g_position_unit = unit;
+    }
+}
+
+HYBRID_API HybridPositionUnit hybrid_get_position_unit(void) {
+    return g_position_unit;
+}
+
 // Utility functions
 HYBRID_API HybridTextRange hybrid_get_word_at_position(const char* text, int position) {
     HybridTextRange range = {position, position};
     if (!text || position < 0) return range;
     
     int len = strlen(text);
+    position = from_unit(text, position);
     if (position >= len) return range;
     
     // Find word boundaries
@@ -439,11 +484,17 @@ HYBRID_API HybridTextRange hybrid_get_word_at_position(const char* text, int pos
         end++;
     }
     
-    range.start = start;
-    range.end = end;
+    range.start = to_unit(text, start);
+    range.end = to_unit(text, end);
     return range;
 }
 
+HYBRID_API int hybrid_convert_offset(const char* text, int offset,
+                                     HybridPositionUnit from, HybridPositionUnit to) {
+    if (!text) return 0;
+    return cursor_convert_offset(text, strlen(text), offset, (cursor_unit_t)from, (cursor_unit_t)to);
+}
+
 // Error handling
 HYBRID_API const char* hybrid_get_error_message(HybridResult result) {
     switch (result) {
@@ -454,4 +505,647 @@ HYBRID_API const char* hybrid_get_error_message(HybridResult result) {
         case HYBRID_ERROR_INVALID_FORMAT: return "Invalid format";
         default: return "Unknown error";
     }
-}
\ No newline at end of file
+}
+// Persistent line index
+//
+// Lines are nodes of an implicit treap (ordered by position, balanced by
+// random priorities). Each node stores its line length, including the '\n',
+// in every unit, plus the subtree totals, so offset <-> line lookups are a
+// single descent. The text itself lives in a gap buffer.
+
+#define LINE_NIL -1
+#define UNIT_COUNT 3
+
+typedef struct {
+    int left;
+    int right;
+    uint32_t priority;
+    int count;                  // lines in subtree
+    int length[UNIT_COUNT];     // this line, per HybridPositionUnit
+    int sum[UNIT_COUNT];        // subtree totals
+} LineNode;
+
+struct HybridLineIndex {
+    char* text;                 // gap buffer
+    int capacity;
+    int gap_start;
+    int gap_end;
+    LineNode* nodes;            // node pool, free nodes chained by `left`
+    int node_capacity;
+    int node_used;
+    int free_node;
+    int root;
+    uint32_t seed;
+};
+
+typedef struct {
+    int line;
+    int start[UNIT_COUNT];
+    int length[UNIT_COUNT];
+} LineSpan;
+
+static inline int node_count(const HybridLineIndex* index, int node) {
+    return node == LINE_NIL ? 0 : index->nodes[node].count;
+}
+
+static void node_update(HybridLineIndex* index, int node) {
+    LineNode* n = &index->nodes[node];
+    n->count = 1 + node_count(index, n->left) + node_count(index, n->right);
+    for (int u = 0; u < UNIT_COUNT; u++) {
+        n->sum[u] = n->length[u];
+        if (n->left != LINE_NIL) n->sum[u] += index->nodes[n->left].sum[u];
+        if (n->right != LINE_NIL) n->sum[u] += index->nodes[n->right].sum[u];
+    }
+}
+
+static int tree_merge(HybridLineIndex* index, int a, int b) {
+    if (a == LINE_NIL) return b;
+    if (b == LINE_NIL) return a;
+    LineNode* nodes = index->nodes;
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right = tree_merge(index, nodes[a].right, b);
+        node_update(index, a);
+        return a;
+    }
+    nodes[b].left = tree_merge(index, a, nodes[b].left);
+    node_update(index, b);
+    return b;
+}
+
+// First `k` lines of `node` go to `left`, the rest to `right`
+static void tree_split(HybridLineIndex* index, int node, int k, int* left, int* right) {
+    if (node == LINE_NIL) {
+        *left = *right = LINE_NIL;
+        return;
+    }
+    LineNode* n = &index->nodes[node];
+    int left_count = node_count(index, n->left);
+    if (k <= left_count) {
+        tree_split(index, n->left, k, left, &n->left);
+        *right = node;
+    } else {
+        tree_split(index, n->right, k - left_count - 1, &n->right, right);
+        *left = node;
+    }
+    node_update(index, node);
+}
+
+static void tree_free(HybridLineIndex* index, int node) {
+    if (node == LINE_NIL) return;
+    tree_free(index, index->nodes[node].left);
+    tree_free(index, index->nodes[node].right);
+    index->nodes[node].left = index->free_node;
+    index->free_node = node;
+}
+
+// Make room for `count` new nodes so that no allocation happens mid-edit
+static bool reserve_nodes(HybridLineIndex* index, int count) {
+    int available = index->node_capacity - index->node_used;
+    for (int node = index->free_node; node != LINE_NIL && available < count;
+         node = index->nodes[node].left) {
+        available++;
+    }
+    if (available >= count) return true;
+
+    int capacity = index->node_capacity ? index->node_capacity : 64;
+    while (capacity - index->node_used < count) capacity *= 2;
+    LineNode* nodes = realloc(index->nodes, sizeof(LineNode) * capacity);
+    if (!nodes) return false;
+    index->nodes = nodes;
+    index->node_capacity = capacity;
+    return true;
+}
+
+static int new_line_node(HybridLineIndex* index, const char* line, int byte_length) {
+    int node = index->free_node;
+    if (node != LINE_NIL) {
+        index->free_node = index->nodes[node].left;
+    } else {
+        node = index->node_used++;
+    }
+
+    // xorshift32
+    uint32_t x = index->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    index->seed = x;
+
+    LineNode* n = &index->nodes[node];
+    n->left = n->right = LINE_NIL;
+    n->priority = x;
+    n->length[HYBRID_UNIT_BYTE] = byte_length;
+    n->length[HYBRID_UNIT_UTF16] = cursor_utf8_count_units(line, byte_length, CURSOR_UNIT_UTF16);
+    n->length[HYBRID_UNIT_CODEPOINT] = cursor_utf8_count_units(line, byte_length, CURSOR_UNIT_CODEPOINT);
+    node_update(index, node);
+    return node;
+}
+
+static void move_gap(HybridLineIndex* index, int position) {
+    int gap = index->gap_end - index->gap_start;
+    if (position < index->gap_start) {
+        memmove(index->text + position + gap, index->text + position, index->gap_start - position);
+    } else if (position > index->gap_start) {
+        memmove(index->text + index->gap_start, index->text + index->gap_end, position - index->gap_start);
+    }
+    index->gap_start = position;
+    index->gap_end = position + gap;
+}
+
+static bool reserve_gap(HybridLineIndex* index, int count) {
+    int gap = index->gap_end - index->gap_start;
+    if (gap >= count) return true;
+
+    int tail = index->capacity - index->gap_end;
+    int capacity = index->capacity * 2;
+    if (capacity < index->capacity - gap + count + 64) capacity = index->capacity - gap + count + 64;
+    char* text = realloc(index->text, capacity);
+    if (!text) return false;
+    memmove(text + capacity - tail, text + index->gap_end, tail);
+    index->text = text;
+    index->gap_end = capacity - tail;
+    index->capacity = capacity;
+    return true;
+}
+
+// Contiguous view of bytes [from, to); moves the gap out of the range if
+// needed, which costs at most the size of the range
+static const char* text_range(HybridLineIndex* index, int from, int to) {
+    if (from < index->gap_start && index->gap_start < to) {
+        move_gap(index, to);
+    }
+    if (from < index->gap_start) return index->text + from;
+    return index->text + from + (index->gap_end - index->gap_start);
+}
+
+// Tree of the lines in bytes [from, to). The range holds whole lines; only
+// when it reaches the end of the text is the last line not '\n'-terminated.
+static int build_lines(HybridLineIndex* index, int from, int to, bool ends_text) {
+    const char* p = text_range(index, from, to);
+    int length = to - from;
+    int root = LINE_NIL;
+    int pos = 0;
+    for (;;) {
+        const char* nl = memchr(p + pos, '\n', length - pos);
+        if (!nl && !ends_text) break;
+        int end = nl ? (int)(nl - p) + 1 : length;
+        root = tree_merge(index, root, new_line_node(index, p + pos, end - pos));
+        if (!nl) break;
+        pos = end;
+    }
+    return root;
+}
+
+static int count_newlines(HybridLineIndex* index, int from, int to) {
+    const char* p = text_range(index, from, to);
+    int count = 0;
+    for (const char* nl = memchr(p, '\n', to - from); nl; nl = memchr(nl + 1, '\n', p + (to - from) - nl - 1)) {
+        count++;
+    }
+    return count;
+}
+
+static void span_descend(const HybridLineIndex* index, int node, LineSpan* span) {
+    const LineNode* n = &index->nodes[node];
+    if (n->left == LINE_NIL) return;
+    const LineNode* left = &index->nodes[n->left];
+    span->line += left->count;
+    for (int u = 0; u < UNIT_COUNT; u++) span->start[u] += left->sum[u];
+}
+
+static void span_fill(const HybridLineIndex* index, int node, LineSpan* span) {
+    for (int u = 0; u < UNIT_COUNT; u++) span->length[u] = index->nodes[node].length[u];
+}
+
+// Line by index (clamped)
+static void locate_line(const HybridLineIndex* index, int line, LineSpan* span) {
+    memset(span, 0, sizeof(*span));
+    int total = node_count(index, index->root);
+    if (line < 0) line = 0;
+    if (line >= total) line = total - 1;
+
+    int node = index->root;
+    while (node != LINE_NIL) {
+        const LineNode* n = &index->nodes[node];
+        int left_count = node_count(index, n->left);
+        if (line < left_count) {
+            node = n->left;
+            continue;
+        }
+        span_descend(index, node, span);
+        line -= left_count;
+        if (line == 0) {
+            span_fill(index, node, span);
+            return;
+        }
+        line--;
+        span->line++;
+        for (int u = 0; u < UNIT_COUNT; u++) span->start[u] += n->length[u];
+        node = n->right;
+    }
+}
+
+// Line containing `offset` (in `unit`); past the end means the last line
+static void locate_offset(const HybridLineIndex* index, HybridPositionUnit unit, int offset,
+                          LineSpan* span) {
+    if (offset >= index->nodes[index->root].sum[unit]) {
+        locate_line(index, node_count(index, index->root) - 1, span);
+        return;
+    }
+    memset(span, 0, sizeof(*span));
+    if (offset < 0) offset = 0;
+
+    int node = index->root;
+    while (node != LINE_NIL) {
+        const LineNode* n = &index->nodes[node];
+        int left_sum = n->left == LINE_NIL ? 0 : index->nodes[n->left].sum[unit];
+        if (offset < left_sum) {
+            node = n->left;
+            continue;
+        }
+        span_descend(index, node, span);
+        offset -= left_sum;
+        if (offset < n->length[unit]) {
+            span_fill(index, node, span);
+            return;
+        }
+        offset -= n->length[unit];
+        span->line++;
+        for (int u = 0; u < UNIT_COUNT; u++) span->start[u] += n->length[u];
+        node = n->right;
+    }
+}
+
+// Byte offset of `offset` (in the configured unit), and its line
+static int byte_at(HybridLineIndex* index, int offset, LineSpan* span) {
+    HybridPositionUnit unit = g_position_unit;
+    locate_offset(index, unit, offset, span);
+
+    int units = offset - span->start[unit];
+    if (units <= 0) return span->start[HYBRID_UNIT_BYTE];
+    int from = span->start[HYBRID_UNIT_BYTE];
+    int length = span->length[HYBRID_UNIT_BYTE];
+    const char* p = text_range(index, from, from + length);
+    return from + cursor_utf8_byte_offset(p, length, units, (cursor_unit_t)unit);
+}
+
+HYBRID_API HybridLineIndex* hybrid_line_index_create(const char* text) {
+    if (!text) return NULL;
+
+    HybridLineIndex* index = calloc(1, sizeof(HybridLineIndex));
+    if (!index) return NULL;
+
+    int length = strlen(text);
+    index->capacity = length + 64;
+    index->text = malloc(index->capacity);
+    index->free_node = LINE_NIL;
+    index->root = LINE_NIL;
+    index->seed = 2463534242u;
+    if (!index->text || !reserve_nodes(index, hybrid_count_lines(text))) {
+        hybrid_line_index_destroy(index);
+        return NULL;
+    }
+    memcpy(index->text, text, length);
+    index->gap_start = length;
+    index->gap_end = index->capacity;
+
+    index->root = build_lines(index, 0, length, true);
+    return index;
+}
+
+HYBRID_API void hybrid_line_index_destroy(HybridLineIndex* index) {
+    if (index) {
+        free(index->text);
+        free(index->nodes);
+        free(index);
+    }
+}
+
+HYBRID_API HybridResult hybrid_line_index_apply_edit(HybridLineIndex* index, int offset,
+                                                     int delete_length, const char* insert) {
+    if (!index) return HYBRID_ERROR_NULL_POINTER;
+    if (!insert) insert = "";
+    if (delete_length < 0) delete_length = 0;
+
+    LineSpan first, last;
+    int start = byte_at(index, offset, &first);
+    int end = delete_length > 0 ? byte_at(index, offset + delete_length, &last) : start;
+    if (delete_length == 0) last = first;
+    int insert_length = strlen(insert);
+
+    // The touched lines are rebuilt from scratch
+    int region_start = first.start[HYBRID_UNIT_BYTE];
+    int region_end = last.start[HYBRID_UNIT_BYTE] + last.length[HYBRID_UNIT_BYTE];
+    bool ends_text = last.line == node_count(index, index->root) - 1;
+    int new_lines = 1;
+    for (const char* nl = strchr(insert, '\n'); nl; nl = strchr(nl + 1, '\n')) new_lines++;
+    new_lines += count_newlines(index, region_start, start) + count_newlines(index, end, region_end);
+    if (!reserve_gap(index, insert_length) || !reserve_nodes(index, new_lines)) {
+        return HYBRID_ERROR_OUT_OF_MEMORY;
+    }
+
+    move_gap(index, start);
+    index->gap_end += end - start;
+    memcpy(index->text + index->gap_start, insert, insert_length);
+    index->gap_start += insert_length;
+
+    int before, touched, after;
+    tree_split(index, index->root, first.line, &before, &touched);
+    tree_split(index, touched, last.line - first.line + 1, &touched, &after);
+    tree_free(index, touched);
+
+    region_end += insert_length - (end - start);
+    touched = build_lines(index, region_start, region_end, ends_text);
+    index->root = tree_merge(index, tree_merge(index, before, touched), after);
+    return HYBRID_SUCCESS;
+}
+
+HYBRID_API int hybrid_line_index_line_count(const HybridLineIndex* index) {
+    return index ? node_count(index, index->root) : 0;
+}
+
+HYBRID_API int hybrid_line_index_length(const HybridLineIndex* index) {
+    if (!index) return 0;
+    return index->nodes[index->root].sum[g_position_unit];
+}
+
+HYBRID_API int hybrid_line_index_line_at(const HybridLineIndex* index, int offset) {
+    if (!index) return 0;
+    LineSpan span;
+    locate_offset(index, g_position_unit, offset, &span);
+    return span.line;
+}
+
+HYBRID_API HybridResult hybrid_line_index_get_line_info(const HybridLineIndex* index, int line_index,
+                                                        LineInfo* info) {
+    if (!index || !info) return HYBRID_ERROR_NULL_POINTER;
+    int line_count = node_count(index, index->root);
+    if (line_index < 0 || line_index >= line_count) return HYBRID_ERROR_INVALID_LINE;
+
+    LineSpan span;
+    locate_line(index, line_index, &span);
+    HybridPositionUnit unit = g_position_unit;
+    info->line_index = line_index;
+    info->char_start = span.start[unit];
+    info->length = span.length[unit] - (line_index < line_count - 1 ? 1 : 0);
+    info->char_end = info->char_start + info->length;
+    return HYBRID_SUCCESS;
+}
+
+HYBRID_API const char* hybrid_line_index_get_line_text(HybridLineIndex* index, int line_index,
+                                                       int* byte_length) {
+    if (!index || line_index < 0 || line_index >= node_count(index, index->root)) return NULL;
+
+    LineSpan span;
+    locate_line(index, line_index, &span);
+    int from = span.start[HYBRID_UNIT_BYTE];
+    int length = span.length[HYBRID_UNIT_BYTE];
+    if (line_index < node_count(index, index->root) - 1) length--;
+    if (byte_length) *byte_length = length;
+    return text_range(index, from, from + length);
+}
+
+// Per-line analysis cache
+//
+// Entries live in an array and are chained two ways by index: per hash
+// bucket, and in a doubly linked recency list whose tail is evicted.
+
+#define CACHE_NIL -1
+
+typedef struct {
+    uint64_t hash;
+    char* line;                 // NUL-terminated copy of the key
+    int length;
+    MarkdownFormat line_format;
+    LineFormats* formats;
+    HybridTextRange* markup_ranges;
+    int markup_range_count;
+    char* stripped;
+    int bucket_next;
+    int newer;
+    int older;
+} FormatCacheEntry;
+
+struct HybridFormatCache {
+    FormatCacheEntry* entries;
+    int capacity;
+    int count;
+    int* buckets;
+    int bucket_mask;
+    int newest;
+    int oldest;
+    HybridConfig config;        // configuration the entries were built with
+    HybridPositionUnit position_unit;
+    int hits;
+    int misses;
+};
+
+// FNV-1a
+static uint64_t hash_line(const char* line, int length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)line[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool same_config(const HybridConfig* a, const HybridConfig* b) {
+    return a->enable_bold == b->enable_bold && a->enable_italic == b->enable_italic &&
+           a->enable_highlight == b->enable_highlight && a->enable_headers == b->enable_headers &&
+           a->enable_lists == b->enable_lists && a->strict_markdown == b->strict_markdown &&
+           a->max_line_length == b->max_line_length;
+}
+
+static void entry_release(FormatCacheEntry* entry) {
+    free(entry->line);
+    hybrid_free_line_formats(entry->formats);
+    free(entry->markup_ranges);
+    free(entry->stripped);
+}
+
+static void recency_unlink(HybridFormatCache* cache, int slot) {
+    FormatCacheEntry* entry = &cache->entries[slot];
+    if (entry->newer != CACHE_NIL) cache->entries[entry->newer].older = entry->older;
+    else cache->newest = entry->older;
+    if (entry->older != CACHE_NIL) cache->entries[entry->older].newer = entry->newer;
+    else cache->oldest = entry->newer;
+}
+
+static void recency_push(HybridFormatCache* cache, int slot) {
+    FormatCacheEntry* entry = &cache->entries[slot];
+    entry->newer = CACHE_NIL;
+    entry->older = cache->newest;
+    if (cache->newest != CACHE_NIL) cache->entries[cache->newest].newer = slot;
+    cache->newest = slot;
+    if (cache->oldest == CACHE_NIL) cache->oldest = slot;
+}
+
+static void bucket_unlink(HybridFormatCache* cache, int slot) {
+    int* link = &cache->buckets[cache->entries[slot].hash & cache->bucket_mask];
+    while (*link != slot) link = &cache->entries[*link].bucket_next;
+    *link = cache->entries[slot].bucket_next;
+}
+
+// Grow to `capacity` entries, with at least twice as many buckets
+static bool cache_reserve(HybridFormatCache* cache, int capacity) {
+    if (capacity <= cache->capacity) return true;
+
+    FormatCacheEntry* entries = realloc(cache->entries, sizeof(FormatCacheEntry) * capacity);
+    if (!entries) return false;
+    cache->entries = entries;
+    cache->capacity = capacity;
+
+    int bucket_count = 16;
+    while (bucket_count < capacity * 2) bucket_count *= 2;
+    if (bucket_count <= cache->bucket_mask + 1) return true;
+
+    int* buckets = malloc(sizeof(int) * bucket_count);
+    if (!buckets) return false;
+    free(cache->buckets);
+    cache->buckets = buckets;
+    cache->bucket_mask = bucket_count - 1;
+    for (int i = 0; i < bucket_count; i++) buckets[i] = CACHE_NIL;
+    for (int slot = 0; slot < cache->count; slot++) {
+        int* bucket = &buckets[entries[slot].hash & cache->bucket_mask];
+        entries[slot].bucket_next = *bucket;
+        *bucket = slot;
+    }
+    return true;
+}
+
+static void fill_viewport_line(const FormatCacheEntry* entry, HybridViewportLine* out) {
+    out->line_index = -1;
+    out->line_format = entry->line_format;
+    out->formats = entry->formats;
+    out->markup_ranges = entry->markup_ranges;
+    out->markup_range_count = entry->markup_range_count;
+    out->stripped = entry->stripped;
+}
+
+HYBRID_API HybridFormatCache* hybrid_format_cache_create(int capacity) {
+    if (capacity < 1) capacity = 1;
+
+    HybridFormatCache* cache = calloc(1, sizeof(HybridFormatCache));
+    if (!cache) return NULL;
+    cache->bucket_mask = -1;
+    cache->newest = cache->oldest = CACHE_NIL;
+    cache->config = g_config;
+    cache->position_unit = g_position_unit;
+    if (!cache_reserve(cache, capacity)) {
+        hybrid_format_cache_destroy(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+HYBRID_API void hybrid_format_cache_destroy(HybridFormatCache* cache) {
+    if (cache) {
+        hybrid_format_cache_clear(cache);
+        free(cache->entries);
+        free(cache->buckets);
+        free(cache);
+    }
+}
+
+HYBRID_API void hybrid_format_cache_clear(HybridFormatCache* cache) {
+    if (!cache) return;
+    for (int slot = 0; slot < cache->count; slot++) {
+        entry_release(&cache->entries[slot]);
+    }
+    for (int i = 0; i <= cache->bucket_mask; i++) cache->buckets[i] = CACHE_NIL;
+    cache->count = 0;
+    cache->newest = cache->oldest = CACHE_NIL;
+}
+
+HYBRID_API void hybrid_format_cache_get_stats(const HybridFormatCache* cache, int* hits, int* misses) {
+    if (hits) *hits = cache ? cache->hits : 0;
+    if (misses) *misses = cache ? cache->misses : 0;
+}
+
+HYBRID_API HybridResult hybrid_format_cache_lookup(HybridFormatCache* cache, const char* line,
+                                                   int byte_length, HybridViewportLine* out) {
+    if (!cache || !line || !out) return HYBRID_ERROR_NULL_POINTER;
+    if (byte_length < 0) byte_length = strlen(line);
+
+    if (!same_config(&cache->config, &g_config) || cache->position_unit != g_position_unit) {
+        hybrid_format_cache_clear(cache);
+        cache->config = g_config;
+        cache->position_unit = g_position_unit;
+    }
+
+    uint64_t hash = hash_line(line, byte_length);
+    int* bucket = &cache->buckets[hash & cache->bucket_mask];
+    for (int slot = *bucket; slot != CACHE_NIL; slot = cache->entries[slot].bucket_next) {
+        FormatCacheEntry* entry = &cache->entries[slot];
+        if (entry->hash == hash && entry->length == byte_length &&
+            memcmp(entry->line, line, byte_length) == 0) {
+            recency_unlink(cache, slot);
+            recency_push(cache, slot);
+            fill_viewport_line(entry, out);
+            cache->hits++;
+            return HYBRID_SUCCESS;
+        }
+    }
+
+    // Miss: analyze into a fresh entry, evicting the oldest one when full
+    FormatCacheEntry fresh = {0};
+    fresh.hash = hash;
+    fresh.length = byte_length;
+    fresh.line = malloc(byte_length + 1);
+    if (fresh.line) {
+        memcpy(fresh.line, line, byte_length);
+        fresh.line[byte_length] = '\0';
+        fresh.line_format = hybrid_detect_line_format(fresh.line);
+        fresh.formats = hybrid_analyze_markdown_line(fresh.line);
+        fresh.stripped = hybrid_strip_markdown_markup(fresh.line);
+        if (fresh.formats) {
+            fresh.markup_ranges = markup_ranges_from_formats(fresh.formats, &fresh.markup_range_count);
+        }
+    }
+    if (!fresh.line || !fresh.formats || !fresh.stripped ||
+        (fresh.formats->format_count > 0 && !fresh.markup_ranges)) {
+        entry_release(&fresh);
+        return HYBRID_ERROR_OUT_OF_MEMORY;
+    }
+    cache->misses++;
+
+    int slot;
+    if (cache->count < cache->capacity) {
+        slot = cache->count++;
+    } else {
+        slot = cache->oldest;
+        recency_unlink(cache, slot);
+        bucket_unlink(cache, slot);
+        entry_release(&cache->entries[slot]);
+    }
+    fresh.bucket_next = *bucket;
+    *bucket = slot;
+    cache->entries[slot] = fresh;
+    recency_push(cache, slot);
+
+    fill_viewport_line(&cache->entries[slot], out);
+    return HYBRID_SUCCESS;
+}
+
+HYBRID_API int hybrid_analyze_viewport(HybridFormatCache* cache, HybridLineIndex* index,
+                                       int first_line, int line_count, HybridViewportLine* out) {
+    if (!cache || !index || !out || first_line < 0 || line_count <= 0) return 0;
+
+    int available = hybrid_line_index_line_count(index) - first_line;
+    if (line_count > available) line_count = available;
+    if (line_count <= 0) return 0;
+
+    // Room for the whole viewport, so this call never evicts its own lines
+    if (!cache_reserve(cache, line_count)) return 0;
+
+    for (int i = 0; i < line_count; i++) {
+        int length;
+        const char* line = hybrid_line_index_get_line_text(index, first_line + i, &length);
+        if (hybrid_format_cache_lookup(cache, line, length, &out[i]) != HYBRID_SUCCESS) {
+            return i;
+        }
+        out[i].line_index = first_line + i;
+    }
+    return line_count;
+}
@@ -23,6 +23,14 @@ extern "C" {
 #define HYBRID_API __attribute__((visibility("default")))
 #endif
 
+// Unit of every position exchanged with the library. Text is UTF-8;
+// Flutter and JavaScript hosts count UTF-16 code units.
+typedef enum {
+    HYBRID_UNIT_BYTE = 0,
+    HYBRID_UNIT_UTF16 = 1,
+    HYBRID_UNIT_CODEPOINT = 2
+} HybridPositionUnit;
+
 // Text position and range structures
 typedef struct {
     int start;
@@ -94,6 +102,8 @@ HYBRID_API bool hybrid_html_contains_tag(const char* html, const char* tag);
 HYBRID_API char* hybrid_get_line_content(const char* text, int line_index);
 HYBRID_API int hybrid_count_lines(const char* text);
 HYBRID_API HybridTextRange hybrid_get_word_at_position(const char* text, int position);
+HYBRID_API int hybrid_convert_offset(const char* text, int offset,
+                                     HybridPositionUnit from, HybridPositionUnit to);
 
 // Configuration
 typedef struct {
@@ -109,6 +119,11 @@ typedef struct {
 HYBRID_API void hybrid_set_config(const HybridConfig* config);
 HYBRID_API HybridConfig hybrid_get_config(void);
 
+// Unit of every position, range and length (HYBRID_UNIT_BYTE by default).
+// Kept out of HybridConfig so hosts built against its original layout still work.
+HYBRID_API void hybrid_set_position_unit(HybridPositionUnit unit);
+HYBRID_API HybridPositionUnit hybrid_get_position_unit(void);
+
 // Error handling
 typedef enum {
     HYBRID_SUCCESS = 0,
@@ -120,6 +135,58 @@ typedef enum {
 
 HYBRID_API const char* hybrid_get_error_message(HybridResult result);
 
+// Persistent line index: keeps the text in a gap buffer and line lengths
+// in a balanced tree, so edits and line queries are O(log n) plus the size
+// of the touched lines. Offsets and lengths are in the configured unit.
+typedef struct HybridLineIndex HybridLineIndex;
+
+HYBRID_API HybridLineIndex* hybrid_line_index_create(const char* text);
+HYBRID_API void hybrid_line_index_destroy(HybridLineIndex* index);
+
+// Replace `delete_length` positions at `offset` with `insert`
+HYBRID_API HybridResult hybrid_line_index_apply_edit(HybridLineIndex* index, int offset,
+                                                     int delete_length, const char* insert);
+
+HYBRID_API int hybrid_line_index_line_count(const HybridLineIndex* index);
+HYBRID_API int hybrid_line_index_length(const HybridLineIndex* index);
+HYBRID_API int hybrid_line_index_line_at(const HybridLineIndex* index, int offset);
+HYBRID_API HybridResult hybrid_line_index_get_line_info(const HybridLineIndex* index, int line_index,
+                                                        LineInfo* info);
+
+// Line bytes without the '\n' (not NUL-terminated), valid until the next edit
+HYBRID_API const char* hybrid_line_index_get_line_text(HybridLineIndex* index, int line_index,
+                                                       int* byte_length);
+
+// Per-line analysis cache: formats, markup ranges and stripped text keyed by
+// line content, least recently used lines evicted first. Results are owned
+// by the cache and stay valid until the next lookup or viewport call on it;
+// the lines of one viewport call are never evicted by that same call. A
+// configuration change clears the cache.
+typedef struct HybridFormatCache HybridFormatCache;
+
+typedef struct {
+    int line_index;
+    MarkdownFormat line_format;
+    const LineFormats* formats;
+    const HybridTextRange* markup_ranges;
+    int markup_range_count;
+    const char* stripped;
+} HybridViewportLine;
+
+HYBRID_API HybridFormatCache* hybrid_format_cache_create(int capacity);
+HYBRID_API void hybrid_format_cache_destroy(HybridFormatCache* cache);
+HYBRID_API void hybrid_format_cache_clear(HybridFormatCache* cache);
+HYBRID_API void hybrid_format_cache_get_stats(const HybridFormatCache* cache, int* hits, int* misses);
+
+// One line (byte_length < 0 means NUL-terminated)
+HYBRID_API HybridResult hybrid_format_cache_lookup(HybridFormatCache* cache, const char* line,
+                                                   int byte_length, HybridViewportLine* out);
+
+// Lines [first_line, first_line + line_count) of the index in one call;
+// returns the number of lines written to `out`
+HYBRID_API int hybrid_analyze_viewport(HybridFormatCache* cache, HybridLineIndex* index,
+                                       int first_line, int line_count, HybridViewportLine* out);
+
 #ifdef __cplusplus
 }
 #endif
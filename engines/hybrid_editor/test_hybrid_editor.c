@@ -0,0 +1,178 @@
+// test_hybrid_editor.c - Unit tests for hybrid_editor_core
+#include "hybrid_editor_core.h"
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void set_unit(HybridPositionUnit unit) {
+    hybrid_set_position_unit(unit);
+    assert(hybrid_get_position_unit() == unit);
+}
+
+static void test_parse_text_lines(void) {
+    TextLines* lines = hybrid_parse_text("# Titre\nligne deux\n");
+    assert(lines != NULL);
+    assert(lines->line_count == 3);
+    assert(lines->lines[1].char_start == 8);
+    assert(lines->lines[1].length == 10);
+    assert(lines->total_length == 19);
+    assert(hybrid_get_line_at_cursor(lines, 9) == 1);
+    hybrid_free_text_lines(lines);
+
+    char* content = hybrid_get_line_content("a\nbc\nd", 1);
+    assert(content && strcmp(content, "bc") == 0);
+    free(content);
+}
+
+static void test_positions_in_utf16(void) {
+    // "😀" is 4 bytes and 2 UTF-16 units, "é" 2 bytes and 1 unit
+    const char* text = "\xf0\x9f\x98\x80 caf\xc3\xa9\n**gr\xc3\xa9s**";
+    set_unit(HYBRID_UNIT_UTF16);
+
+    TextLines* lines = hybrid_parse_text(text);
+    assert(lines->lines[0].length == 7);
+    assert(lines->lines[1].char_start == 8);
+    assert(lines->total_length == 16);
+    assert(hybrid_get_line_at_cursor(lines, 8) == 1);
+    hybrid_free_text_lines(lines);
+
+    HybridTextRange word = hybrid_get_word_at_position(text, 4);
+    assert(word.start == 3 && word.end == 7);
+
+    LineFormats* formats = hybrid_analyze_markdown_line("\xc3\xa9 **gr\xc3\xa9s**");
+    assert(formats->format_count == 1);
+    assert(formats->formats[0].range.start == 2);
+    assert(formats->formats[0].content_range.end == 8);
+    assert(formats->formats[0].range.end == 10);
+    hybrid_free_line_formats(formats);
+
+    assert(hybrid_convert_offset(text, 5, HYBRID_UNIT_BYTE, HYBRID_UNIT_UTF16) == 3);
+    assert(hybrid_convert_offset(text, 3, HYBRID_UNIT_UTF16, HYBRID_UNIT_CODEPOINT) == 2);
+
+    set_unit(HYBRID_UNIT_BYTE);
+}
+
+// Compare the index with a fresh parse of the same text
+static void check_index(HybridLineIndex* index, const char* text) {
+    TextLines* lines = hybrid_parse_text(text);
+    assert(hybrid_line_index_line_count(index) == lines->line_count);
+    assert(hybrid_line_index_length(index) == lines->total_length);
+
+    for (int i = 0; i < lines->line_count; i++) {
+        LineInfo info;
+        assert(hybrid_line_index_get_line_info(index, i, &info) == HYBRID_SUCCESS);
+        assert(info.char_start == lines->lines[i].char_start);
+        assert(info.length == lines->lines[i].length);
+        assert(hybrid_line_index_line_at(index, info.char_start) == i);
+        assert(hybrid_line_index_line_at(index, info.char_end) == i);
+
+        int length;
+        const char* line = hybrid_line_index_get_line_text(index, i, &length);
+        char* expected = hybrid_get_line_content(text, i);
+        assert((int)strlen(expected) == length && memcmp(line, expected, length) == 0);
+        free(expected);
+    }
+    hybrid_free_text_lines(lines);
+}
+
+static void test_line_index_edits(void) {
+    HybridLineIndex* index = hybrid_line_index_create("un\ndeux\ntrois");
+    assert(hybrid_line_index_line_count(index) == 3);
+    assert(hybrid_line_index_line_at(index, 5) == 1);
+
+    // Join lines 1 and 2, then split the first one
+    assert(hybrid_line_index_apply_edit(index, 7, 1, " ") == HYBRID_SUCCESS);
+    check_index(index, "un\ndeux trois");
+    assert(hybrid_line_index_apply_edit(index, 1, 0, "\n\n") == HYBRID_SUCCESS);
+    check_index(index, "u\n\nn\ndeux trois");
+    assert(hybrid_line_index_apply_edit(index, 0, 100, "") == HYBRID_SUCCESS);
+    check_index(index, "");
+    hybrid_line_index_destroy(index);
+}
+
+static void test_line_index_matches_parse(void) {
+    static const char* pieces[] = {"a", "\n", "\xc3\xa9", "\xf0\x9f\x98\x80", " **b** ", "\n\n", "\xe4\xb8\xad"};
+    char text[4096] = "";
+    char edited[4096];
+    srand(7);
+    set_unit(HYBRID_UNIT_UTF16);
+
+    HybridLineIndex* index = hybrid_line_index_create(text);
+    for (int step = 0; step < 400; step++) {
+        char insert[64] = "";
+        int parts = rand() % 4;
+        for (int i = 0; i < parts; i++) strcat(insert, pieces[rand() % 7]);
+
+        int length = hybrid_convert_offset(text, (int)strlen(text), HYBRID_UNIT_BYTE, HYBRID_UNIT_UTF16);
+        int offset = rand() % (length + 1);
+        int deleted = strlen(text) > 1000 ? rand() % 40 : rand() % 3;
+        assert(hybrid_line_index_apply_edit(index, offset, deleted, insert) == HYBRID_SUCCESS);
+
+        int start = hybrid_convert_offset(text, offset, HYBRID_UNIT_UTF16, HYBRID_UNIT_BYTE);
+        int end = hybrid_convert_offset(text, offset + deleted, HYBRID_UNIT_UTF16, HYBRID_UNIT_BYTE);
+        snprintf(edited, sizeof(edited), "%.*s%s%s", start, text, insert, text + end);
+        strcpy(text, edited);
+        check_index(index, text);
+    }
+    hybrid_line_index_destroy(index);
+    set_unit(HYBRID_UNIT_BYTE);
+}
+
+static void test_viewport_format_cache(void) {
+    const char* text = "# Titre\n- **gras** et *it*\ntexte ==hl==\n- **gras** et *it*";
+    HybridLineIndex* index = hybrid_line_index_create(text);
+    HybridFormatCache* cache = hybrid_format_cache_create(2);
+    HybridViewportLine view[8];
+    int hits, misses;
+
+    // Viewports larger than the cache still come back whole
+    assert(hybrid_analyze_viewport(cache, index, 0, 8, view) == 4);
+    hybrid_format_cache_get_stats(cache, &hits, &misses);
+    assert(hits == 1 && misses == 3);
+    assert(view[1].formats == view[3].formats);
+    assert(view[3].line_index == 3);
+    assert(view[0].line_format & MD_FORMAT_HEADER1);
+
+    // Same results as the uncached calls
+    int count;
+    HybridTextRange* ranges = hybrid_find_markup_ranges("- **gras** et *it*", &count);
+    char* stripped = hybrid_strip_markdown_markup("- **gras** et *it*");
+    assert(view[1].markup_range_count == count);
+    assert(memcmp(view[1].markup_ranges, ranges, sizeof(HybridTextRange) * count) == 0);
+    assert(strcmp(view[1].stripped, stripped) == 0);
+    free(ranges);
+    free(stripped);
+
+    // Scrolling back over the same lines is all hits
+    assert(hybrid_analyze_viewport(cache, index, 1, 2, view) == 2);
+    hybrid_format_cache_get_stats(cache, &hits, &misses);
+    assert(hits == 3 && misses == 3);
+
+    // An edited line is a new key; a unit change invalidates everything
+    hybrid_line_index_apply_edit(index, 8, 0, "\xc3\xa9");
+    assert(hybrid_analyze_viewport(cache, index, 1, 1, view) == 1);
+    hybrid_format_cache_get_stats(cache, &hits, &misses);
+    assert(misses == 4);
+    assert(view[0].formats->formats[0].range.start == 4);
+
+    set_unit(HYBRID_UNIT_UTF16);
+    assert(hybrid_analyze_viewport(cache, index, 1, 1, view) == 1);
+    hybrid_format_cache_get_stats(cache, &hits, &misses);
+    assert(misses == 5);
+    assert(view[0].formats->formats[0].range.start == 3);
+    set_unit(HYBRID_UNIT_BYTE);
+
+    hybrid_format_cache_destroy(cache);
+    hybrid_line_index_destroy(index);
+}
+
+int main(void) {
+    test_parse_text_lines();
+    test_positions_in_utf16();
+    test_line_index_edits();
+    test_line_index_matches_parse();
+    test_viewport_format_cache();
+    printf("hybrid editor tests passed\n");
+    return 0;
+}
@@ -1,32 +1,755 @@
+#define _POSIX_C_SOURCE 200809L
 #include "search_engine.h"
+#include "search_markdown.h"
+#include "search_postings.h"
+#include "search_segment.h"
+#include "search_regex.h"
+#include "search_query.h"
+#include "search_suggest.h"
+#include "search_tokenizer.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
+#include <limits.h>
 #include <time.h>
 #include <regex.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <unistd.h>
 
-#define HASH_TABLE_SIZE 10007
+#define WORD_INDEX_INITIAL_SLOTS 1024
+#define WORD_ARENA_BLOCK_SIZE 65536
 #define MAX_WORD_LENGTH 256
 #define MAX_LINE_LENGTH 4096
+#define MAX_QUERY_TERMS 16
+#define BM25_K1 1.2f
+#define BM25_B 0.75f
 
-// Hash function for word index
-static size_t hash_word(const char* word) {
-    size_t hash = 5381;
-    for (int i = 0; word[i]; i++) {
-        hash = ((hash << 5) + hash) +
-               (unsigned char)tolower((unsigned char)word[i]);
+// ============= WORD INDEX =============
+
+struct word_arena_block {
+    struct word_arena_block* next;
+    size_t used;
+    char data[WORD_ARENA_BLOCK_SIZE];
+};
+
+// 64-bit FNV-1a, finished with the MurmurHash3 mixer so the low bits used
+// for slot selection depend on every input byte
+static uint64_t hash_word(const char* word, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char)word[i];
+        hash *= 0x100000001b3ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Copy a term into the arena; terms are never freed individually
+static char* arena_intern(word_index_t* word_index, const char* word, size_t len) {
+    struct word_arena_block* block = word_index->arena;
+    if (!block || block->used + len + 1 > WORD_ARENA_BLOCK_SIZE) {
+        block = malloc(sizeof(struct word_arena_block));
+        if (!block) return NULL;
+        block->next = word_index->arena;
+        block->used = 0;
+        word_index->arena = block;
+    }
+    char* interned = block->data + block->used;
+    memcpy(interned, word, len);
+    interned[len] = '\0';
+    block->used += len + 1;
+    return interned;
+}
+
+// Robin Hood insertion: a slot is taken from any entry closer to its home
+static void slot_insert(word_index_slot_t* slots, size_t mask, word_index_slot_t slot) {
+    size_t pos = slot.hash & mask;
+    size_t distance = 0;
+    while (slots[pos].entry) {
+        size_t resident = (pos - (slots[pos].hash & mask)) & mask;
+        if (resident < distance) {
+            word_index_slot_t displaced = slots[pos];
+            slots[pos] = slot;
+            slot = displaced;
+            distance = resident;
+        }
+        pos = (pos + 1) & mask;
+        distance++;
+    }
+    slots[pos] = slot;
+}
+
+static bool word_index_resize(word_index_t* word_index, size_t table_size) {
+    word_index_slot_t* slots = calloc(table_size, sizeof(word_index_slot_t));
+    if (!slots) return false;
+    for (size_t i = 0; i < word_index->table_size; i++) {
+        if (word_index->slots[i].entry) slot_insert(slots, table_size - 1, word_index->slots[i]);
+    }
+    free(word_index->slots);
+    word_index->slots = slots;
+    word_index->table_size = table_size;
+    return true;
+}
+
+static word_index_t* word_index_create(void) {
+    word_index_t* word_index = calloc(1, sizeof(word_index_t));
+    if (!word_index) return NULL;
+    word_index->slots = calloc(WORD_INDEX_INITIAL_SLOTS, sizeof(word_index_slot_t));
+    if (!word_index->slots) {
+        free(word_index);
+        return NULL;
+    }
+    word_index->table_size = WORD_INDEX_INITIAL_SLOTS;
+    return word_index;
+}
+
+static void word_index_destroy(word_index_t* word_index) {
+    if (!word_index) return;
+    for (size_t i = 0; i < word_index->entry_count; i++) {
+        posting_list_free(word_index->entries[i].postings);
+        free(word_index->entries[i].postings);
+    }
+    while (word_index->arena) {
+        struct word_arena_block* next = word_index->arena->next;
+        free(word_index->arena);
+        word_index->arena = next;
+    }
+    free(word_index->entries);
+    free(word_index->slots);
+    free(word_index);
+}
+
+// Lookup stops at the first slot closer to its home than the probe
+static word_index_entry_t* word_index_find(const word_index_t* word_index, const char* word,
+                                           size_t len, uint32_t hash) {
+    size_t mask = word_index->table_size - 1;
+    size_t pos = hash & mask;
+    for (size_t distance = 0;; distance++, pos = (pos + 1) & mask) {
+        const word_index_slot_t* slot = &word_index->slots[pos];
+        if (!slot->entry || ((pos - (slot->hash & mask)) & mask) < distance) return NULL;
+        if (slot->hash == hash) {
+            word_index_entry_t* entry = &word_index->entries[slot->entry - 1];
+            if (strncmp(entry->word, word, len) == 0 && entry->word[len] == '\0') return entry;
+        }
+    }
+}
+
+// Entry for `word`, created empty if missing. Entry pointers are valid
+// until the next insertion.
+static word_index_entry_t* word_index_insert(word_index_t* word_index, const char* word, size_t len) {
+    uint32_t hash = (uint32_t)hash_word(word, len);
+    word_index_entry_t* entry = word_index_find(word_index, word, len, hash);
+    if (entry) return entry;
+    
+    // Keep the load factor under 0.8
+    if ((word_index->entry_count + 1) * 5 > word_index->table_size * 4 &&
+        !word_index_resize(word_index, word_index->table_size * 2)) {
+        return NULL;
+    }
+    if (word_index->entry_count == word_index->entry_capacity) {
+        size_t capacity = word_index->entry_capacity ? word_index->entry_capacity * 2 : 256;
+        word_index_entry_t* entries = realloc(word_index->entries, capacity * sizeof(word_index_entry_t));
+        if (!entries) return NULL;
+        word_index->entries = entries;
+        word_index->entry_capacity = capacity;
+    }
+    
+    entry = &word_index->entries[word_index->entry_count];
+    entry->word = arena_intern(word_index, word, len);
+    entry->postings = malloc(sizeof(posting_list_t));
+    entry->occurrence_count = 0;
+    if (!entry->word || !entry->postings) {
+        free(entry->postings);
+        return NULL;
+    }
+    posting_list_init(entry->postings);
+    
+    word_index_slot_t slot = { hash, (uint32_t)(word_index->entry_count + 1) };
+    slot_insert(word_index->slots, word_index->table_size - 1, slot);
+    word_index->entry_count++;
+    return entry;
+}
+
+// ============= SEGMENTS =============
+
+// Documents are added to the in-memory segment, which only writers see,
+// and deletions of flushed documents are queued. A flush turns both into
+// one immutable snapshot of the segments and their deletion bitmaps,
+// published with an atomic pointer swap. Searches read the latest snapshot
+// without taking a lock; a replaced snapshot is retired and freed once
+// every reader that could have loaded it has left (epoch-based
+// reclamation with two reader counters). A background thread merges runs
+// of MERGE_FACTOR segments of similar size (a tiered policy) and rewrites
+// segments that are mostly deleted. Writes are serialized; each publishes
+// when it returns unless another write is waiting for the lock, and then
+// the last of the queue publishes. A queue that never drains still
+// publishes every PUBLISH_INTERVAL_MS, as does a full in-memory segment.
+
+#define MEMORY_SEGMENT_DOCUMENTS 1024
+#define PUBLISH_INTERVAL_MS 1000        // queued writes publish at most this late
+#define MERGE_FACTOR 4
+#define SEGMENT_MEMORY 0                // location of in-memory documents
+#define SEGMENT_NONE UINT32_MAX         // location of removed documents
+
+typedef struct {
+    search_segment_t* segment;
+    uint32_t id;
+    int refcount;                       // snapshots holding it
+} segment_ref_t;
+
+typedef struct segment_snapshot {
+    int refcount;                       // the published reference and merges reading it
+    int count;
+    segment_ref_t** segments;           // oldest first
+    uint8_t** deleted;                  // deletion bitmap of each segment
+    uint64_t changes;                   // document changes published so far; merges keep it
+
+    // Retired: no longer published, freed when its readers are gone
+    uint64_t retired_epoch;
+    struct segment_snapshot* next_retired;
+} segment_snapshot_t;
+
+// A search's hold on the published snapshot
+typedef struct {
+    const segment_snapshot_t* snapshot;
+    int parity;                         // reader counter it entered
+} snapshot_reader_t;
+
+typedef struct {
+    uint32_t segment;                   // segment id, SEGMENT_MEMORY or SEGMENT_NONE
+    uint32_t document;                  // local index in that segment
+} document_location_t;
+
+struct search_segments {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t merge_thread;
+    bool merge_thread_started;
+    bool stopping;
+    bool merging;
+    bool merge_failed;
+    bool compacting;                    // an optimize or rebuild holds the segments
+
+    // Read without the lock, swapped under it
+    _Atomic(segment_snapshot_t*) snapshot;
+    _Atomic uint64_t epoch;
+    atomic_int readers[2];              // readers inside an epoch of each parity
+
+    // Everything below is guarded by `lock`
+    segment_snapshot_t* retired;
+    uint32_t next_segment_id;
+    document_location_t* locations;     // by document id
+    int location_capacity;
+    int next_document_id;
+    document_location_t* pending;       // deletions waiting for the next flush
+    int pending_count;
+    int pending_capacity;
+
+    // Held for every write
+    pthread_mutex_t writer;
+    atomic_int waiting_writers;         // blocked in writer_lock()
+
+    // Owned by the writer
+    uint8_t* memory_deleted;            // bitmap over the in-memory documents
+    uint64_t last_publish_ms;           // monotonic time of the last flush or creation
+};
+
+// Completion dictionary over the words and titles of the live documents,
+// rebuilt on the first request after a published change
+struct search_suggestions {
+    pthread_mutex_t lock;
+    uint64_t changes;                   // of the snapshot it was built from
+    suggest_dictionary_t* dictionary;
+};
+
+static struct search_suggestions* suggestions_create(void) {
+    struct search_suggestions* suggestions = calloc(1, sizeof(struct search_suggestions));
+    if (!suggestions) return NULL;
+    pthread_mutex_init(&suggestions->lock, NULL);
+    return suggestions;
+}
+
+static void suggestions_destroy(struct search_suggestions* suggestions) {
+    if (!suggestions) return;
+    suggest_dictionary_free(suggestions->dictionary);
+    pthread_mutex_destroy(&suggestions->lock);
+    free(suggestions);
+}
+
+static inline bool bit_test(const uint8_t* bits, int i) {
+    return bits && (bits[i >> 3] >> (i & 7)) & 1;
+}
+
+static inline void bit_set(uint8_t* bits, int i) {
+    bits[i >> 3] |= (uint8_t)(1u << (i & 7));
+}
+
+static inline size_t bitmap_bytes(int bits) {
+    return (size_t)(bits + 7) / 8 + 1;
+}
+
+static int segment_documents(const segment_ref_t* ref) {
+    return (int)ref->segment->header->document_count;
+}
+
+static void snapshot_release_locked(segment_snapshot_t* snapshot) {
+    if (!snapshot || --snapshot->refcount > 0) return;
+    for (int i = 0; i < snapshot->count; i++) {
+        segment_ref_t* ref = snapshot->segments[i];
+        if (--ref->refcount == 0) {
+            search_segment_close(ref->segment);
+            free(ref);
+        }
+        free(snapshot->deleted[i]);
+    }
+    free(snapshot->segments);
+    free(snapshot->deleted);
+    free(snapshot);
+}
+
+// Copy of `source` with room for `extra` more segments; segments are
+// shared, deletion bitmaps copied
+static segment_snapshot_t* snapshot_copy_locked(const segment_snapshot_t* source, int extra) {
+    segment_snapshot_t* snapshot = calloc(1, sizeof(segment_snapshot_t));
+    if (!snapshot) return NULL;
+    int capacity = source->count + extra + 1;
+    snapshot->segments = calloc(capacity, sizeof(segment_ref_t*));
+    snapshot->deleted = calloc(capacity, sizeof(uint8_t*));
+    snapshot->refcount = 1;
+    snapshot->changes = source->changes;
+    if (!snapshot->segments || !snapshot->deleted) {
+        snapshot_release_locked(snapshot);
+        return NULL;
+    }
+    for (int i = 0; i < source->count; i++) {
+        size_t bytes = bitmap_bytes(segment_documents(source->segments[i]));
+        snapshot->deleted[i] = malloc(bytes);
+        if (!snapshot->deleted[i]) {
+            snapshot_release_locked(snapshot);
+            return NULL;
+        }
+        memcpy(snapshot->deleted[i], source->deleted[i], bytes);
+        snapshot->segments[i] = source->segments[i];
+        snapshot->segments[i]->refcount++;
+        snapshot->count++;
+    }
+    return snapshot;
+}
+
+// Append a new segment (with no deletions) to a snapshot being built
+static bool snapshot_append_locked(segment_snapshot_t* snapshot, segment_ref_t* ref) {
+    snapshot->deleted[snapshot->count] = calloc(1, bitmap_bytes(segment_documents(ref)));
+    if (!snapshot->deleted[snapshot->count]) return false;
+    snapshot->segments[snapshot->count++] = ref;
+    ref->refcount++;
+    return true;
+}
+
+// The published snapshot; stable while the lock is held
+static segment_snapshot_t* snapshot_current_locked(struct search_segments* segments) {
+    return atomic_load_explicit(&segments->snapshot, memory_order_relaxed);
+}
+
+// Free retired snapshots nobody can still be reading. A reader entered an
+// epoch before loading the snapshot pointer, so a snapshot retired in
+// epoch E is unreachable once the epoch has moved on twice: each step
+// waits for the readers of the parity it is about to reuse to drain.
+static void reclaim_locked(struct search_segments* segments) {
+    for (int pass = 0; pass < 3 && segments->retired; pass++) {
+        uint64_t epoch = atomic_load(&segments->epoch);
+        segment_snapshot_t** link = &segments->retired;
+        while (*link) {
+            segment_snapshot_t* snapshot = *link;
+            if (snapshot->retired_epoch + 2 > epoch) {
+                link = &snapshot->next_retired;
+                continue;
+            }
+            *link = snapshot->next_retired;
+            snapshot_release_locked(snapshot);
+        }
+        if (!segments->retired || atomic_load(&segments->readers[(epoch + 1) & 1]) != 0) break;
+        atomic_store(&segments->epoch, epoch + 1);
+    }
+}
+
+static void snapshot_publish_locked(struct search_segments* segments, segment_snapshot_t* snapshot) {
+    segment_snapshot_t* old = atomic_exchange(&segments->snapshot, snapshot);
+    old->retired_epoch = atomic_load(&segments->epoch);
+    old->next_retired = segments->retired;
+    segments->retired = old;
+    reclaim_locked(segments);
+    pthread_cond_broadcast(&segments->changed);
+}
+
+// Enter the current epoch and load the published snapshot. Never blocks:
+// the retry only happens when the epoch moves between the two loads.
+static void snapshot_acquire(struct search_segments* segments, snapshot_reader_t* reader) {
+    for (;;) {
+        uint64_t epoch = atomic_load(&segments->epoch);
+        reader->parity = (int)(epoch & 1);
+        atomic_fetch_add(&segments->readers[reader->parity], 1);
+        if (atomic_load(&segments->epoch) == epoch) break;
+        atomic_fetch_sub(&segments->readers[reader->parity], 1);
+    }
+    reader->snapshot = atomic_load(&segments->snapshot);
+}
+
+// Leave the epoch; snapshots retired meanwhile are freed here unless the
+// lock is busy, in which case its holder will get to them
+static void snapshot_release(struct search_segments* segments, snapshot_reader_t* reader) {
+    atomic_fetch_sub(&segments->readers[reader->parity], 1);
+    if (pthread_mutex_trylock(&segments->lock) == 0) {
+        reclaim_locked(segments);
+        pthread_mutex_unlock(&segments->lock);
+    }
+}
+
+static int find_segment(const segment_snapshot_t* snapshot, uint32_t id) {
+    for (int i = 0; i < snapshot->count; i++) {
+        if (snapshot->segments[i]->id == id) return i;
+    }
+    return -1;
+}
+
+static int live_documents(const segment_snapshot_t* snapshot, int i) {
+    int count = segment_documents(snapshot->segments[i]);
+    int live = count;
+    for (int d = 0; d < count; d++) {
+        if (bit_test(snapshot->deleted[i], d)) live--;
+    }
+    return live;
+}
+
+// Next merge under the tiered policy: a mostly deleted segment alone, or
+// the newest run of MERGE_FACTOR adjacent segments within a size factor
+// of MERGE_FACTOR of each other. Segments smaller than a full in-memory
+// segment count as one, so the small ones that single writes publish
+// during indexing fold into their neighbours.
+static bool pick_merge_locked(const segment_snapshot_t* snapshot, int* start, int* count) {
+    for (int i = 0; i < snapshot->count; i++) {
+        if (live_documents(snapshot, i) * 2 < segment_documents(snapshot->segments[i])) {
+            *start = i;
+            *count = 1;
+            return true;
+        }
+    }
+    for (int i = snapshot->count - MERGE_FACTOR; i >= 0; i--) {
+        int smallest = INT32_MAX, largest = 0;
+        for (int k = i; k < i + MERGE_FACTOR; k++) {
+            int documents = segment_documents(snapshot->segments[k]);
+            if (documents < MEMORY_SEGMENT_DOCUMENTS) documents = MEMORY_SEGMENT_DOCUMENTS;
+            if (documents < smallest) smallest = documents;
+            if (documents > largest) largest = documents;
+        }
+        if (largest <= smallest * MERGE_FACTOR) {
+            *start = i;
+            *count = MERGE_FACTOR;
+            return true;
+        }
+    }
+    return false;
+}
+
+static segment_ref_t* segment_ref_create(search_segment_t* segment, uint32_t id) {
+    segment_ref_t* ref = calloc(1, sizeof(segment_ref_t));
+    if (!ref) return NULL;
+    ref->segment = segment;
+    ref->id = id;
+    return ref;
+}
+
+// Swap the merged segments for `merged` in the current snapshot. The
+// inputs were read from `base`: documents deleted since then are deleted
+// in `merged` too.
+static bool install_merge_locked(struct search_segments* segments, const segment_snapshot_t* base,
+                                 int start, int count, search_segment_t* merged) {
+    segment_snapshot_t* current = snapshot_current_locked(segments);
+    int position = find_segment(current, base->segments[start]->id);
+    uint32_t merged_id = segments->next_segment_id++;
+    segment_ref_t* ref = NULL;
+    if (merged->header->document_count > 0) {
+        ref = segment_ref_create(merged, merged_id);
+        if (!ref) return false;
+    }
+    
+    segment_snapshot_t* snapshot = calloc(1, sizeof(segment_snapshot_t));
+    int capacity = current->count + 1;
+    if (snapshot) {
+        snapshot->refcount = 1;
+        snapshot->changes = current->changes;
+        snapshot->segments = calloc(capacity, sizeof(segment_ref_t*));
+        snapshot->deleted = calloc(capacity, sizeof(uint8_t*));
+    }
+    if (!snapshot || !snapshot->segments || !snapshot->deleted) {
+        if (snapshot) snapshot_release_locked(snapshot);
+        free(ref);
+        return false;
+    }
+    
+    for (int i = 0; i < current->count; i++) {
+        if (i == position && ref && !snapshot_append_locked(snapshot, ref)) {
+            snapshot_release_locked(snapshot);
+            return false;
+        }
+        if (i >= position && i < position + count) continue;
+        segment_ref_t* kept = current->segments[i];
+        size_t bytes = bitmap_bytes(segment_documents(kept));
+        snapshot->deleted[snapshot->count] = malloc(bytes);
+        if (!snapshot->deleted[snapshot->count]) {
+            snapshot_release_locked(snapshot);
+            return false;
+        }
+        memcpy(snapshot->deleted[snapshot->count], current->deleted[i], bytes);
+        snapshot->segments[snapshot->count++] = kept;
+        kept->refcount++;
+    }
+    
+    // Carry deletions over and point locations and queued deletions at the
+    // merged segment
+    uint8_t* merged_deleted = ref ? snapshot->deleted[position] : NULL;
+    uint32_t next = 0;
+    for (int k = 0; k < count; k++) {
+        const segment_ref_t* input = base->segments[start + k];
+        for (int d = 0; d < segment_documents(input); d++) {
+            if (bit_test(base->deleted[start + k], d)) continue;
+            uint32_t local = next++;
+            if (bit_test(current->deleted[position + k], d)) {
+                bit_set(merged_deleted, (int)local);
+                continue;
+            }
+            uint32_t id = input->segment->documents[d].document_id;
+            document_location_t* location = &segments->locations[id];
+            if (location->segment == input->id && location->document == (uint32_t)d) {
+                location->segment = merged_id;
+                location->document = local;
+                continue;
+            }
+            for (int p = 0; p < segments->pending_count; p++) {
+                document_location_t* pending = &segments->pending[p];
+                if (pending->segment == input->id && pending->document == (uint32_t)d) {
+                    pending->segment = merged_id;
+                    pending->document = local;
+                    break;
+                }
+            }
+        }
+    }
+    if (!ref) search_segment_close(merged);
+    snapshot_publish_locked(segments, snapshot);
+    return true;
+}
+
+static void* merge_thread_main(void* arg) {
+    struct search_segments* segments = arg;
+    pthread_mutex_lock(&segments->lock);
+    while (!segments->stopping) {
+        int start, count;
+        if (segments->merge_failed || segments->compacting ||
+            !pick_merge_locked(snapshot_current_locked(segments), &start, &count)) {
+            pthread_cond_wait(&segments->changed, &segments->lock);
+            continue;
+        }
+        segment_snapshot_t* base = snapshot_current_locked(segments);
+        base->refcount++;
+        segments->merging = true;
+        pthread_mutex_unlock(&segments->lock);
+        
+        search_segment_input_t inputs[MERGE_FACTOR];
+        for (int k = 0; k < count; k++) {
+            inputs[k].segment = base->segments[start + k]->segment;
+            inputs[k].index = NULL;
+            inputs[k].deleted = base->deleted[start + k];
+        }
+        search_segment_t* merged = search_segment_merge(inputs, count);
+        
+        pthread_mutex_lock(&segments->lock);
+        if (!merged || !install_merge_locked(segments, base, start, count, merged)) {
+            search_segment_close(merged);
+            segments->merge_failed = true;
+        }
+        snapshot_release_locked(base);
+        segments->merging = false;
+        pthread_cond_broadcast(&segments->changed);
     }
-    return hash % HASH_TABLE_SIZE;
+    pthread_mutex_unlock(&segments->lock);
+    return NULL;
+}
+
+static uint64_t monotonic_ms(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static struct search_segments* segments_create(void) {
+    struct search_segments* segments = calloc(1, sizeof(struct search_segments));
+    if (!segments) return NULL;
+    segment_snapshot_t* snapshot = calloc(1, sizeof(segment_snapshot_t));
+    segments->memory_deleted = calloc(1, bitmap_bytes(MEMORY_SEGMENT_DOCUMENTS));
+    if (!snapshot || !segments->memory_deleted) {
+        free(snapshot);
+        free(segments->memory_deleted);
+        free(segments);
+        return NULL;
+    }
+    snapshot->refcount = 1;
+    atomic_init(&segments->snapshot, snapshot);
+    atomic_init(&segments->epoch, 0);
+    atomic_init(&segments->readers[0], 0);
+    atomic_init(&segments->readers[1], 0);
+    atomic_init(&segments->waiting_writers, 0);
+    segments->next_segment_id = SEGMENT_MEMORY + 1;
+    segments->last_publish_ms = monotonic_ms();
+    pthread_mutex_init(&segments->lock, NULL);
+    pthread_cond_init(&segments->changed, NULL);
+    pthread_mutex_init(&segments->writer, NULL);
+    return segments;
+}
+
+static void segments_destroy(struct search_segments* segments) {
+    if (!segments) return;
+    pthread_mutex_lock(&segments->lock);
+    segments->stopping = true;
+    pthread_cond_broadcast(&segments->changed);
+    pthread_mutex_unlock(&segments->lock);
+    if (segments->merge_thread_started) pthread_join(segments->merge_thread, NULL);
+    
+    // No readers are left: everything retired can go
+    while (segments->retired) {
+        segment_snapshot_t* snapshot = segments->retired;
+        segments->retired = snapshot->next_retired;
+        snapshot_release_locked(snapshot);
+    }
+    snapshot_release_locked(snapshot_current_locked(segments));
+    pthread_mutex_destroy(&segments->lock);
+    pthread_cond_destroy(&segments->changed);
+    pthread_mutex_destroy(&segments->writer);
+    free(segments->locations);
+    free(segments->pending);
+    free(segments->memory_deleted);
+    free(segments);
+}
+
+// Location slot of a new document id
+static bool reserve_location_locked(struct search_segments* segments, int document_id) {
+    if (document_id < 0) return false;
+    if (document_id < segments->location_capacity) return true;
+    size_t grown = segments->location_capacity ? (size_t)segments->location_capacity : 1024;
+    while (grown <= (size_t)document_id) grown *= 2;
+    int capacity = grown > INT_MAX ? INT_MAX : (int)grown;
+    document_location_t* locations = realloc(segments->locations, (size_t)capacity * sizeof(document_location_t));
+    if (!locations) return false;
+    for (int i = segments->location_capacity; i < capacity; i++) {
+        locations[i].segment = SEGMENT_NONE;
+        locations[i].document = 0;
+    }
+    segments->locations = locations;
+    segments->location_capacity = capacity;
+    return true;
+}
+
+// Queue the deletion of a flushed document until the next flush, so that
+// an update never publishes the removal without the new version
+static bool queue_deletion_locked(struct search_segments* segments, document_location_t location) {
+    if (segments->pending_count == segments->pending_capacity) {
+        int capacity = segments->pending_capacity ? segments->pending_capacity * 2 : 64;
+        document_location_t* pending = realloc(segments->pending, capacity * sizeof(document_location_t));
+        if (!pending) return false;
+        segments->pending = pending;
+        segments->pending_capacity = capacity;
+    }
+    segments->pending[segments->pending_count++] = location;
+    return true;
+}
+
+// Publish new segments at the end of the list, all at once and together
+// with the queued deletions; `memory_documents`, when given, are the
+// in-memory documents the one new segment was built from
+static bool add_segments(struct search_segments* segments, search_segment_t* const* added, int added_count,
+                         const search_document_t* const* memory_documents, int memory_count) {
+    pthread_mutex_lock(&segments->lock);
+    if (added_count == 0 && segments->pending_count == 0) {
+        pthread_mutex_unlock(&segments->lock);
+        return true;
+    }
+    for (int k = 0; !memory_documents && k < added_count; k++) {
+        for (uint32_t d = 0; d < added[k]->header->document_count; d++) {
+            if (!reserve_location_locked(segments, (int)added[k]->documents[d].document_id)) {
+                pthread_mutex_unlock(&segments->lock);
+                return false;
+            }
+        }
+    }
+    segment_snapshot_t* snapshot = snapshot_copy_locked(snapshot_current_locked(segments), added_count);
+    int kept = snapshot ? snapshot->count : 0;
+    for (int k = 0; snapshot && k < added_count; k++) {
+        segment_ref_t* ref = segment_ref_create(added[k], segments->next_segment_id++);
+        if (ref && snapshot_append_locked(snapshot, ref)) continue;
+        
+        // Detach the new segments: they still belong to the caller
+        free(ref);
+        while (snapshot->count > kept) {
+            ref = snapshot->segments[--snapshot->count];
+            free(snapshot->deleted[snapshot->count]);
+            free(ref);
+        }
+        snapshot_release_locked(snapshot);
+        snapshot = NULL;
+    }
+    if (!snapshot) {
+        pthread_mutex_unlock(&segments->lock);
+        return false;
+    }
+    for (int p = 0; p < segments->pending_count; p++) {
+        document_location_t location = segments->pending[p];
+        bit_set(snapshot->deleted[find_segment(snapshot, location.segment)], (int)location.document);
+    }
+    segments->pending_count = 0;
+    snapshot->changes++;
+    
+    uint32_t local = 0;
+    for (int i = 0; memory_documents && i < memory_count; i++) {
+        if (bit_test(segments->memory_deleted, i)) continue;
+        document_location_t* location = &segments->locations[memory_documents[i]->document_id];
+        location->segment = snapshot->segments[kept]->id;
+        location->document = local++;
+    }
+    for (int k = kept; !memory_documents && k < snapshot->count; k++) {
+        const search_segment_t* segment = snapshot->segments[k]->segment;
+        for (uint32_t d = 0; d < segment->header->document_count; d++) {
+            uint32_t id = segment->documents[d].document_id;
+            segments->locations[id].segment = snapshot->segments[k]->id;
+            segments->locations[id].document = d;
+            if ((int)id >= segments->next_document_id) segments->next_document_id = (int)id + 1;
+        }
+    }
+    segments->merge_failed = false;         // Each publish retries a failed merge
+    snapshot_publish_locked(segments, snapshot);
+    
+    if (added_count > 0 && !segments->merge_thread_started) {
+        segments->merge_thread_started =
+            pthread_create(&segments->merge_thread, NULL, merge_thread_main, segments) == 0;
+    }
+    pthread_mutex_unlock(&segments->lock);
+    return true;
 }
 
+// ============= INDEX =============
+
 // Create a new search engine index
 search_index_t* search_engine_create(size_t max_documents) {
     search_index_t* index = calloc(1, sizeof(search_index_t));
     if (!index) return NULL;
     
-    index->documents = calloc(max_documents, sizeof(search_document_t*));
+    index->documents = calloc(MEMORY_SEGMENT_DOCUMENTS, sizeof(search_document_t*));
     if (!index->documents) {
         free(index);
         return NULL;
@@ -35,67 +758,53 @@ search_index_t* search_engine_create(size_t max_documents) {
     index->max_documents = max_documents;
     index->document_count = 0;
     
-    // Initialize word index
-    index->word_index = calloc(1, sizeof(word_index_t));
-    if (!index->word_index) {
-        free(index->documents);
-        free(index);
-        return NULL;
-    }
-    
-    index->word_index->entries = calloc(HASH_TABLE_SIZE, sizeof(word_index_entry_t*));
-    if (!index->word_index->entries) {
-        free(index->word_index);
+    // Initialize word and trigram indexes and segments
+    index->word_index = word_index_create();
+    index->trigram_index = word_index_create();
+    index->segments = segments_create();
+    index->suggestions = suggestions_create();
+    if (!index->word_index || !index->trigram_index || !index->segments || !index->suggestions) {
+        word_index_destroy(index->word_index);
+        word_index_destroy(index->trigram_index);
+        segments_destroy(index->segments);
+        suggestions_destroy(index->suggestions);
         free(index->documents);
         free(index);
         return NULL;
     }
     
-    index->word_index->table_size = HASH_TABLE_SIZE;
     index->embeddings_enabled = false;
     index->embedding_dimension = 0;
     
     return index;
 }
 
+static void free_document(search_document_t* doc) {
+    if (!doc) return;
+    free(doc->filepath);
+    free(doc->content);
+    free(doc->line_starts);
+    free(doc->line_fields);
+    free(doc);
+}
+
 // Destroy search engine and free memory
 void search_engine_destroy(search_index_t* index) {
     if (!index) return;
     
+    // Stop merging before anything is freed
+    segments_destroy(index->segments);
+    
     // Free documents
-    for (int i = 0; i < index->document_count; i++) {
-        if (index->documents[i]) {
-            free(index->documents[i]->filepath);
-            free(index->documents[i]->content);
-            
-            if (index->documents[i]->lines) {
-                for (int j = 0; j < index->documents[i]->line_count; j++) {
-                    free(index->documents[i]->lines[j]);
-                }
-                free(index->documents[i]->lines);
-            }
-            
-            free(index->documents[i]);
-        }
+    for (int i = 0; i < index->memory_document_count; i++) {
+        free_document(index->documents[i]);
     }
     free(index->documents);
     
-    // Free word index
-    if (index->word_index) {
-        for (size_t i = 0; i < index->word_index->table_size; i++) {
-            word_index_entry_t* entry = index->word_index->entries[i];
-            while (entry) {
-                word_index_entry_t* next = entry->next;
-                free(entry->word);
-                free(entry->document_ids);
-                free(entry->positions);
-                free(entry);
-                entry = next;
-            }
-        }
-        free(index->word_index->entries);
-        free(index->word_index);
-    }
+    // Free word and trigram indexes
+    word_index_destroy(index->word_index);
+    word_index_destroy(index->trigram_index);
+    suggestions_destroy(index->suggestions);
     
     // Free embeddings
     if (index->embeddings) {
@@ -108,213 +817,539 @@ void search_engine_destroy(search_index_t* index) {
     free(index);
 }
 
-// Parse content into lines
-static char** parse_lines(const char* content, int* line_count) {
-    if (!content) return NULL;
-    
-    // Count lines
+// Copy `content` into the document as its lines, each NUL-terminated in
+// place of its '\n' (a trailing '\n' ends with an empty line), and their
+// start offsets; the layout of segment text
+static bool store_lines(search_document_t* doc, const char* content, bool fields) {
+    size_t length = strlen(content);
     int count = 1;
-    for (const char* p = content; *p; p++) {
-        if (*p == '\n') count++;
+    for (const char* p = memchr(content, '\n', length); p; p = memchr(p + 1, '\n', length - (p + 1 - content))) {
+        count++;
     }
+    doc->content = malloc(length + 1);
+    doc->line_starts = malloc(count * sizeof(uint32_t));
+    if (!doc->content || !doc->line_starts) return false;
     
-    char** lines = malloc(count * sizeof(char*));
-    if (!lines) return NULL;
-    
-    // Split content into lines
-    const char* start = content;
-    int line_idx = 0;
+    memcpy(doc->content, content, length + 1);
+    doc->content_length = length;
+    doc->line_count = count;
+    doc->line_starts[0] = 0;
+    int line = 1;
+    for (char* p = memchr(doc->content, '\n', length); p; p = memchr(p + 1, '\n', length - (p + 1 - doc->content))) {
+        *p = '\0';
+        doc->line_starts[line++] = (uint32_t)(p + 1 - doc->content);
+    }
     
-    for (const char* p = content; *p; p++) {
-        if (*p == '\n' || *(p + 1) == '\0') {
-            size_t len = p - start + (*p != '\n' ? 1 : 0);
-            lines[line_idx] = malloc(len + 1);
-            if (lines[line_idx]) {
-                strncpy(lines[line_idx], start, len);
-                lines[line_idx][len] = '\0';
-            }
-            line_idx++;
-            start = p + 1;
+    // The markdown field of each line, in the same pass over the lines
+    if (fields) {
+        doc->line_fields = malloc(count);
+        if (!doc->line_fields) return false;
+        search_markdown_t markdown = {0};
+        for (int l = 0; l < count; l++) {
+            const char* text = doc->content + doc->line_starts[l];
+            doc->line_fields[l] = search_markdown_line(&markdown, text, strlen(text));
         }
     }
-    
-    *line_count = count;
-    return lines;
+    return true;
 }
 
-// Add word to index
-static void add_word_to_index(search_index_t* index, const char* word, int document_id, int position) {
-    if (!word || strlen(word) == 0) return;
-    
-    // Convert to lowercase for case-insensitive indexing
+// Add a word of `length` bytes to the index, folded to lowercase
+static void add_word_to_index(search_index_t* index, const char* word, size_t length, int document_id,
+                              int position, int line_number) {
     char lower_word[MAX_WORD_LENGTH];
-    strncpy(lower_word, word, MAX_WORD_LENGTH - 1);
-    lower_word[MAX_WORD_LENGTH - 1] = '\0';
+    size_t lower_length = search_fold(word, length, lower_word, sizeof(lower_word));
+    if (lower_length == 0) return;
     
-    for (int i = 0; lower_word[i]; i++) {
-        lower_word[i] = (char)tolower((unsigned char)lower_word[i]);
+    word_index_entry_t* entry = word_index_insert(index->word_index, lower_word, lower_length);
+    if (entry && posting_list_add(entry->postings, document_id, line_number, position)) {
+        entry->occurrence_count++;
     }
+}
+
+// Index a document's words. Every word takes a position; single
+// characters other than ideographs are skipped.
+#define MAX_LINE_LINKS 32
+
+// Hidden link targets of a line of a document indexed with fields (at
+// most MAX_LINE_LINKS), in line order; returns their count
+static int hidden_links(const search_document_t* doc, int line, search_link_t* links) {
+    if (!doc->line_fields || !(doc->line_fields[line] & SEARCH_FIELD_LINKS)) return 0;
+    const char* text = doc->content + doc->line_starts[line];
+    size_t length = strlen(text);
+    search_link_t link;
+    int count = 0;
+    for (size_t from = 0; count < MAX_LINE_LINKS && search_markdown_next_link(text, length, from, &link);
+         from = link.end) {
+        if (link.hidden) links[count++] = link;
+    }
+    return count;
+}
+
+static void index_document_words(search_index_t* index, search_document_t* doc, int local_id) {
+    int line_number = 0;
+    search_tokenizer_t tokenizer;
+    search_token_t token;
+    search_link_t links[MAX_LINE_LINKS];
+    int link_count = 0, link = 0, links_line = -1;
     
-    size_t hash = hash_word(lower_word);
-    word_index_entry_t* entry = index->word_index->entries[hash];
-    
-    // Find existing entry
-    while (entry) {
-        if (strcmp(entry->word, lower_word) == 0) {
-            // Add to existing entry
-            entry->occurrence_count++;
-            entry->document_ids = realloc(entry->document_ids, entry->occurrence_count * sizeof(int));
-            entry->positions = realloc(entry->positions, entry->occurrence_count * sizeof(int));
-            
-            if (entry->document_ids && entry->positions) {
-                entry->document_ids[entry->occurrence_count - 1] = document_id;
-                entry->positions[entry->occurrence_count - 1] = position;
+    search_tokenizer_init(&tokenizer, doc->content, doc->content_length);
+    for (int position = 0; search_tokenizer_next(&tokenizer, &token); position++) {
+        uint32_t offset = (uint32_t)(token.start - doc->content);
+        while (line_number + 1 < doc->line_count && doc->line_starts[line_number + 1] <= offset) line_number++;
+        if (token.indexed && doc->line_fields) {
+            // Link targets are not text of the note; their words keep
+            // their positions
+            if (links_line != line_number) {
+                link_count = hidden_links(doc, line_number, links);
+                link = 0;
+                links_line = line_number;
             }
-            return;
+            size_t at = offset - doc->line_starts[line_number];
+            while (link < link_count && links[link].end <= at) link++;
+            if (link < link_count && links[link].start <= at) continue;
+        }
+        if (token.indexed) {
+            add_word_to_index(index, token.start, token.length, local_id, position, line_number);
+            doc->word_count++;
         }
-        entry = entry->next;
     }
-    
-    // Create new entry
-    entry = calloc(1, sizeof(word_index_entry_t));
-    if (!entry) return;
-    
-    entry->word = strdup(lower_word);
-    entry->document_ids = malloc(sizeof(int));
-    entry->positions = malloc(sizeof(int));
-    
-    if (entry->word && entry->document_ids && entry->positions) {
-        entry->document_ids[0] = document_id;
-        entry->positions[0] = position;
-        entry->occurrence_count = 1;
-        
-        // Insert at head of chain
-        entry->next = index->word_index->entries[hash];
-        index->word_index->entries[hash] = entry;
-        index->word_index->entry_count++;
-    } else {
-        free(entry->word);
-        free(entry->document_ids);
-        free(entry->positions);
-        free(entry);
+}
+
+// Whether `document` is the last one in `postings`
+static bool postings_end_with(const posting_list_t* postings, uint32_t document) {
+    if (postings->tail_count > 0) return postings->tail_documents[postings->tail_count - 1] == document;
+    return postings->block_count > 0 && postings->skips[postings->block_count - 1].last_document == document;
+}
+
+#define TRIGRAM_SET_SIZE 4096      // open-addressing slots, a power of two
+
+// Post each distinct trigram of the set (keys are packed bytes plus one, 0
+// marks a free slot) and empty it
+static void flush_trigram_set(search_index_t* index, uint32_t* set, int local_id) {
+    for (int i = 0; i < TRIGRAM_SET_SIZE; i++) {
+        if (!set[i]) continue;
+        uint32_t key = set[i] - 1;
+        set[i] = 0;
+        char trigram[3] = { (char)(key >> 16), (char)(key >> 8), (char)key };
+        word_index_entry_t* entry = word_index_insert(index->trigram_index, trigram, 3);
+        if (!entry || postings_end_with(entry->postings, (uint32_t)local_id)) continue;
+        if (posting_list_add(entry->postings, (uint32_t)local_id, 0, 0)) entry->occurrence_count++;
     }
 }
 
-// Index a document's words
-static void index_document_words(search_index_t* index, search_document_t* doc) {
-    const char* content = doc->content;
-    int position = 0;
-    char word[MAX_WORD_LENGTH];
-    int word_pos = 0;
-    
-    for (int i = 0; content[i]; i++) {
-        char c = content[i];
-        
-        if (isalnum((unsigned char)c) || c == '_') {
-            if (word_pos < MAX_WORD_LENGTH - 1) {
-                word[word_pos++] = c;
-            }
-        } else {
-            if (word_pos > 0) {
-                word[word_pos] = '\0';
-                if (strlen(word) > 1) { // Skip single character words
-                    add_word_to_index(index, word, doc->document_id, position);
-                }
-                word_pos = 0;
-                position++;
+// Index the trigrams of each line, one posting per document. Most trigrams
+// repeat within a document, so they are deduplicated in a small local set
+// before touching the dictionary.
+static void index_document_trigrams(search_index_t* index, const search_document_t* doc, int local_id) {
+    uint32_t set[TRIGRAM_SET_SIZE] = {0};
+    int used = 0;
+    for (int l = 0; l < doc->line_count; l++) {
+        const char* line = doc->content + doc->line_starts[l];
+        size_t end = l + 1 < doc->line_count ? doc->line_starts[l + 1] - 1 : doc->content_length;
+        size_t length = end - doc->line_starts[l];
+        for (size_t i = 0; i + 3 <= length; i++) {
+            char trigram[4];
+            search_trigram(line + i, trigram);
+            uint32_t key = ((uint32_t)(unsigned char)trigram[0] << 16 |
+                            (uint32_t)(unsigned char)trigram[1] << 8 | (unsigned char)trigram[2]) + 1;
+            uint32_t slot = (key * 2654435761u) >> 20;
+            while (set[slot] && set[slot] != key) slot = (slot + 1) & (TRIGRAM_SET_SIZE - 1);
+            if (set[slot]) continue;
+            set[slot] = key;
+            if (++used == TRIGRAM_SET_SIZE / 2) {
+                flush_trigram_set(index, set, local_id);
+                used = 0;
             }
         }
     }
-    
-    // Handle last word
-    if (word_pos > 0) {
-        word[word_pos] = '\0';
-        if (strlen(word) > 1) {
-            add_word_to_index(index, word, doc->document_id, position);
-        }
+    if (used > 0) flush_trigram_set(index, set, local_id);
+}
+
+static int flush_memory(search_index_t* index);
+
+// Every write holds the writer lock. Unlocking publishes the writes not yet
+// published unless another writer is waiting, so a write is searchable when
+// it returns and concurrent writers share one segment; waiting writers
+// still publish once PUBLISH_INTERVAL_MS has passed since the last flush.
+// Searches never write.
+static void writer_lock(const search_index_t* index) {
+    atomic_fetch_add(&index->segments->waiting_writers, 1);
+    pthread_mutex_lock(&index->segments->writer);
+    atomic_fetch_sub(&index->segments->waiting_writers, 1);
+}
+
+static void writer_unlock(search_index_t* index) {
+    struct search_segments* segments = index->segments;
+    if ((index->memory_document_count > 0 || segments->pending_count > 0) &&
+        (atomic_load(&segments->waiting_writers) == 0 ||
+         monotonic_ms() - segments->last_publish_ms >= PUBLISH_INTERVAL_MS)) {
+        flush_memory(index);
     }
+    pthread_mutex_unlock(&segments->writer);
 }
 
-// Add document to search index
-int search_engine_add_document(search_index_t* index, const char* filepath, const char* content) {
-    if (!index || !filepath || !content) return -1;
-    if (index->document_count >= index->max_documents) return -2;
-    
+// Append a document to the in-memory segment of `index` (its own or a
+// bulk worker's) and index its words and trigrams; returns its local index
+static int index_document(search_index_t* index, int document_id, const char* filepath,
+                          const char* content) {
     search_document_t* doc = calloc(1, sizeof(search_document_t));
     if (!doc) return -3;
     
-    doc->document_id = index->document_count;
+    doc->document_id = document_id;
     doc->filepath = strdup(filepath);
-    doc->content = strdup(content);
-    doc->content_length = strlen(content);
     doc->last_modified = time(NULL);
-    
-    if (!doc->filepath || !doc->content) {
-        free(doc->filepath);
-        free(doc->content);
-        free(doc);
+    if (!doc->filepath || !store_lines(doc, content, index->field_indexing)) {
+        free_document(doc);
         return -4;
     }
     
-    // Parse content into lines
-    doc->lines = parse_lines(content, &doc->line_count);
-    
     // Add to document array
-    index->documents[index->document_count] = doc;
+    int local_id = index->memory_document_count++;
+    index->documents[local_id] = doc;
+    
+    // Index the document's words and trigrams
+    index_document_words(index, doc, local_id);
+    index_document_trigrams(index, doc, local_id);
+    return local_id;
+}
+
+// Add a document under `document_id` to the in-memory segment
+static int add_document_with_id(search_index_t* index, int document_id, const char* filepath,
+                                const char* content) {
+    if (index->memory_document_count == MEMORY_SEGMENT_DOCUMENTS && flush_memory(index) != 0) {
+        return -3;
+    }
+    struct search_segments* segments = index->segments;
+    pthread_mutex_lock(&segments->lock);
+    bool reserved = reserve_location_locked(segments, document_id);
+    pthread_mutex_unlock(&segments->lock);
+    if (!reserved) return -3;
     
-    // Index the document's words
-    index_document_words(index, doc);
+    int local_id = index_document(index, document_id, filepath, content);
+    if (local_id < 0) return local_id;
     
+    pthread_mutex_lock(&segments->lock);
+    segments->locations[document_id].segment = SEGMENT_MEMORY;
+    segments->locations[document_id].document = (uint32_t)local_id;
+    if (document_id >= segments->next_document_id) segments->next_document_id = document_id + 1;
+    pthread_mutex_unlock(&segments->lock);
     index->document_count++;
     
-    return doc->document_id;
+    return document_id;
 }
 
-// Calculate fuzzy match score using Levenshtein distance
-static float calculate_fuzzy_score(const char* str1, const char* str2) {
-    if (!str1 || !str2) return 0.0f;
-    
-    int len1 = strlen(str1);
-    int len2 = strlen(str2);
-    
-    if (len1 == 0) return (len2 == 0) ? 1.0f : 0.0f;
-    if (len2 == 0) return 0.0f;
+// Add document to search index
+int search_engine_add_document(search_index_t* index, const char* filepath, const char* content) {
+    if (!index || !filepath || !content) return -1;
+    writer_lock(index);
+    int result = index->document_count >= index->max_documents
+        ? -2 : add_document_with_id(index, index->segments->next_document_id, filepath, content);
+    writer_unlock(index);
+    return result;
+}
+
+// Delete a document wherever it lives; the caller holds both locks
+static int remove_document_locked(search_index_t* index, int document_id) {
+    struct search_segments* segments = index->segments;
+    if (document_id < 0 || document_id >= segments->location_capacity) return -1;
+    document_location_t* location = &segments->locations[document_id];
+    if (location->segment == SEGMENT_NONE) return -1;
     
-    // Dynamic programming matrix for Levenshtein distance
-    int matrix[len1 + 1][len2 + 1];
+    if (location->segment == SEGMENT_MEMORY) {
+        bit_set(segments->memory_deleted, (int)location->document);
+    } else if (!queue_deletion_locked(segments, *location)) {
+        return -3;
+    }
+    location->segment = SEGMENT_NONE;
+    index->document_count--;
+    return 0;
+}
+
+int search_engine_remove_document(search_index_t* index, int document_id) {
+    if (!index) return -1;
+    struct search_segments* segments = index->segments;
+    writer_lock(index);
+    pthread_mutex_lock(&segments->lock);
+    int result = remove_document_locked(index, document_id);
+    bool flush = segments->pending_count >= MEMORY_SEGMENT_DOCUMENTS;
+    pthread_mutex_unlock(&segments->lock);
+    if (flush) flush_memory(index);
+    writer_unlock(index);
+    return result;
+}
+
+// The new version keeps the document id and path
+int search_engine_update_document(search_index_t* index, int document_id, const char* content) {
+    if (!index || !content) return -1;
+    struct search_segments* segments = index->segments;
     
-    // Initialize first row and column
-    for (int i = 0; i <= len1; i++) matrix[i][0] = i;
-    for (int j = 0; j <= len2; j++) matrix[0][j] = j;
+    writer_lock(index);
     
-    // Fill the matrix
-    for (int i = 1; i <= len1; i++) {
-        for (int j = 1; j <= len2; j++) {
-            int cost = (tolower(str1[i-1]) == tolower(str2[j-1])) ? 0 : 1;
-            
-            int substitute = matrix[i-1][j-1] + cost;
-            int delete = matrix[i-1][j] + 1;
-            int insert = matrix[i][j-1] + 1;
-            
-            matrix[i][j] = (substitute < delete) ? 
-                          (substitute < insert ? substitute : insert) :
-                          (delete < insert ? delete : insert);
+    // A full in-memory segment is flushed before the removal is queued, or
+    // adding the new version would publish the removal without it
+    if (index->memory_document_count == MEMORY_SEGMENT_DOCUMENTS && flush_memory(index) != 0) {
+        writer_unlock(index);
+        return -3;
+    }
+    pthread_mutex_lock(&segments->lock);
+    char* filepath = NULL;
+    if (document_id >= 0 && document_id < segments->location_capacity) {
+        document_location_t location = segments->locations[document_id];
+        if (location.segment == SEGMENT_MEMORY) {
+            filepath = strdup(index->documents[location.document]->filepath);
+        } else if (location.segment != SEGMENT_NONE) {
+            const segment_snapshot_t* snapshot = snapshot_current_locked(segments);
+            filepath = strdup(search_segment_path(
+                snapshot->segments[find_segment(snapshot, location.segment)]->segment,
+                (int)location.document));
         }
     }
+    int result = filepath ? remove_document_locked(index, document_id) : -1;
+    pthread_mutex_unlock(&segments->lock);
     
-    int max_len = (len1 > len2) ? len1 : len2;
-    return 1.0f - (float)matrix[len1][len2] / max_len;
+    if (result == 0) {
+        result = add_document_with_id(index, document_id, filepath, content);
+        if (result >= 0) result = 0;
+    }
+    writer_unlock(index);
+    free(filepath);
+    return result;
 }
 
-// Create search result
-static search_result_t* create_search_result(int document_id, int line_number, int col_start, int col_end, 
-                                           float score, const char* context, const char* matched_text) {
-    search_result_t* result = calloc(1, sizeof(search_result_t));
-    if (!result) return NULL;
+// Freeze the in-memory segment into an immutable one and publish it with
+// the queued deletions; the caller holds the writer lock
+static int flush_memory(search_index_t* index) {
+    struct search_segments* segments = index->segments;
+    int count = index->memory_document_count;
+    if (count == 0 && segments->pending_count == 0) return 0;
+    if (count == 0) return add_segments(segments, NULL, 0, NULL, 0) ? 0 : -3;
     
-    result->document_id = document_id;
-    result->line_number = line_number;
-    result->column_start = col_start;
+    word_index_t* word_index = word_index_create();
+    word_index_t* trigram_index = word_index_create();
+    search_segment_input_t input = { NULL, index, segments->memory_deleted };
+    search_segment_t* segment = word_index && trigram_index ? search_segment_merge(&input, 1) : NULL;
+    if (!segment) {
+        word_index_destroy(word_index);
+        word_index_destroy(trigram_index);
+        return -3;
+    }
+    if (segment->header->document_count == 0) {
+        search_segment_close(segment);          // Everything was deleted
+        segment = NULL;
+    }
+    if (!add_segments(segments, &segment, segment ? 1 : 0, (const search_document_t* const*)index->documents,
+                      count)) {
+        search_segment_close(segment);
+        word_index_destroy(word_index);
+        word_index_destroy(trigram_index);
+        return -3;
+    }
+    
+    word_index_destroy(index->word_index);
+    word_index_destroy(index->trigram_index);
+    index->word_index = word_index;
+    index->trigram_index = trigram_index;
+    for (int i = 0; i < count; i++) {
+        free_document(index->documents[i]);
+        index->documents[i] = NULL;
+    }
+    index->memory_document_count = 0;
+    memset(segments->memory_deleted, 0, bitmap_bytes(MEMORY_SEGMENT_DOCUMENTS));
+    segments->last_publish_ms = monotonic_ms();
+    return 0;
+}
+
+int search_engine_flush(search_index_t* index) {
+    if (!index) return -1;
+    writer_lock(index);
+    int result = flush_memory(index);
+    writer_unlock(index);
+    return result;
+}
+
+// ============= BULK INDEXING =============
+
+#define BULK_MIN_DOCUMENTS 64           // per thread
+
+// A bulk worker's share of the documents, [begin, end). It indexes them
+// into a private in-memory segment frozen every MEMORY_SEGMENT_DOCUMENTS
+// documents, then merges the frozen batches into one segment.
+typedef struct {
+    const char* const* filepaths;
+    const char* const* contents;
+    const int* document_ids;            // by document, or NULL: first_id + i
+    const time_t* modified;             // by document, or NULL: now
+    bool field_indexing;
+    int begin;
+    int end;
+    int first_id;
+    search_segment_t* segment;          // the result, NULL on failure
+    pthread_t thread;
+    bool started;                       // runs on `thread`, else on the caller's
+} bulk_worker_t;
+
+// Drop a worker's in-memory segment
+static void clear_bulk_memory(search_index_t* memory) {
+    for (int i = 0; i < memory->memory_document_count; i++) free_document(memory->documents[i]);
+    memory->memory_document_count = 0;
+    word_index_destroy(memory->word_index);
+    word_index_destroy(memory->trigram_index);
+    memory->word_index = NULL;
+    memory->trigram_index = NULL;
+}
+
+static void* bulk_worker_main(void* arg) {
+    bulk_worker_t* worker = arg;
+    search_document_t* documents[MEMORY_SEGMENT_DOCUMENTS];
+    search_index_t memory = {0};
+    memory.documents = documents;
+    memory.field_indexing = worker->field_indexing;
+    int count = worker->end - worker->begin;
+    search_segment_t** batches = calloc((count + MEMORY_SEGMENT_DOCUMENTS - 1) / MEMORY_SEGMENT_DOCUMENTS,
+                                        sizeof(search_segment_t*));
+    int batch_count = 0;
+    bool ok = batches != NULL;
+    for (int i = worker->begin; ok && i < worker->end; i++) {
+        if (!memory.word_index) {
+            memory.word_index = word_index_create();
+            memory.trigram_index = word_index_create();
+            ok = memory.word_index && memory.trigram_index;
+        }
+        int id = worker->document_ids ? worker->document_ids[i] : worker->first_id + i;
+        int local = ok ? index_document(&memory, id, worker->filepaths[i], worker->contents[i]) : -1;
+        ok = local >= 0;
+        if (ok && worker->modified) memory.documents[local]->last_modified = worker->modified[i];
+        if (ok && (memory.memory_document_count == MEMORY_SEGMENT_DOCUMENTS || i + 1 == worker->end)) {
+            search_segment_input_t input = { NULL, &memory, NULL };
+            batches[batch_count] = search_segment_merge(&input, 1);
+            ok = batches[batch_count++] != NULL;
+            clear_bulk_memory(&memory);
+        }
+    }
+    clear_bulk_memory(&memory);
+    
+    // k-way merge of the batches' sorted dictionaries
+    if (ok && batch_count == 1) {
+        worker->segment = batches[0];
+        batch_count = 0;
+    } else if (ok) {
+        search_segment_input_t* inputs = malloc(batch_count * sizeof(search_segment_input_t));
+        for (int b = 0; inputs && b < batch_count; b++) {
+            inputs[b] = (search_segment_input_t){ batches[b], NULL, NULL };
+        }
+        worker->segment = inputs ? search_segment_merge(inputs, batch_count) : NULL;
+        free(inputs);
+    }
+    for (int b = 0; b < batch_count; b++) search_segment_close(batches[b]);
+    free(batches);
+    return NULL;
+}
+
+// Threads for `count` documents: thread_count, or one per CPU when 0, and
+// no more than there are shares of BULK_MIN_DOCUMENTS
+static int bulk_thread_count(int count, int thread_count) {
+    if (thread_count <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (int)cpus : 1;
+    }
+    int most = (count + BULK_MIN_DOCUMENTS - 1) / BULK_MIN_DOCUMENTS;
+    return thread_count > most ? most : thread_count;
+}
+
+// Index documents [0, count) described by `shared` on thread_count
+// threads, into one segment per thread in `built` (in document order)
+static bool run_bulk_workers(const bulk_worker_t* shared, int count, int thread_count, search_segment_t** built) {
+    bulk_worker_t* workers = calloc(thread_count, sizeof(bulk_worker_t));
+    if (!workers) return false;
+    
+    // The calling thread takes the first share, and any whose thread
+    // cannot start
+    for (int t = 0; t < thread_count; t++) {
+        bulk_worker_t* worker = &workers[t];
+        *worker = *shared;
+        worker->begin = (int)((int64_t)count * t / thread_count);
+        worker->end = (int)((int64_t)count * (t + 1) / thread_count);
+        worker->segment = NULL;
+        worker->started = t > 0 && pthread_create(&worker->thread, NULL, bulk_worker_main, worker) == 0;
+    }
+    for (int t = 0; t < thread_count; t++) {
+        if (!workers[t].started) bulk_worker_main(&workers[t]);
+    }
+    bool ok = true;
+    for (int t = 0; t < thread_count; t++) {
+        if (workers[t].started) pthread_join(workers[t].thread, NULL);
+        built[t] = workers[t].segment;
+        if (!built[t]) ok = false;
+    }
+    free(workers);
+    return ok;
+}
+
+// The documents are split across the threads, each indexing its share
+// into a private segment, and all are published at once with consecutive
+// ids. Documents added before keep their order: the in-memory segment is
+// flushed first, and the new segments follow it
+int search_engine_add_documents(search_index_t* index, const char* const* filepaths,
+                                const char* const* contents, int count, int thread_count) {
+    if (!index || !filepaths || !contents || count <= 0) return -1;
+    for (int i = 0; i < count; i++) {
+        if (!filepaths[i] || !contents[i]) return -1;
+    }
+    thread_count = bulk_thread_count(count, thread_count);
+    
+    struct search_segments* segments = index->segments;
+    writer_lock(index);
+    if (count > index->max_documents - index->document_count) {
+        writer_unlock(index);
+        return -2;
+    }
+    search_segment_t** built = calloc(thread_count, sizeof(search_segment_t*));
+    int first_id = segments->next_document_id;
+    int result = built && flush_memory(index) == 0 ? first_id : -3;
+    if (result >= 0) {
+        bulk_worker_t shared = { .filepaths = filepaths, .contents = contents, .first_id = first_id,
+                                 .field_indexing = index->field_indexing };
+        if (!run_bulk_workers(&shared, count, thread_count, built)) result = -3;
+    }
+    if (result >= 0 && !add_segments(segments, built, thread_count, NULL, 0)) result = -3;
+    if (result >= 0) index->document_count += count;
+    for (int t = 0; result < 0 && built && t < thread_count; t++) search_segment_close(built[t]);
+    free(built);
+    writer_unlock(index);
+    return result;
+}
+
+// Block until the merge policy has nothing left to do
+void search_engine_wait_for_merges(search_index_t* index) {
+    if (!index) return;
+    struct search_segments* segments = index->segments;
+    int start, count;
+    pthread_mutex_lock(&segments->lock);
+    while (segments->compacting || (segments->merge_thread_started && !segments->merge_failed &&
+           (segments->merging || pick_merge_locked(snapshot_current_locked(segments), &start, &count)))) {
+        pthread_cond_wait(&segments->changed, &segments->lock);
+    }
+    pthread_mutex_unlock(&segments->lock);
+}
+
+int search_engine_segment_count(const search_index_t* index) {
+    if (!index) return 0;
+    snapshot_reader_t reader;
+    snapshot_acquire(index->segments, &reader);
+    int count = reader.snapshot->count;
+    snapshot_release(index->segments, &reader);
+    return count;
+}
+
+// Create search result
+static search_result_t* create_search_result(int document_id, int line_number, int col_start, int col_end, 
+                                           float score, const char* context, const char* matched_text) {
+    search_result_t* result = calloc(1, sizeof(search_result_t));
+    if (!result) return NULL;
+    
+    result->document_id = document_id;
+    result->line_number = line_number;
+    result->column_start = col_start;
     result->column_end = col_end;
     result->relevance_score = score;
     result->context = context ? strdup(context) : NULL;
@@ -323,202 +1358,2302 @@ static search_result_t* create_search_result(int document_id, int line_number, i
     return result;
 }
 
-// Basic search implementation
-search_result_t* search_engine_search(search_index_t* index, const search_query_t* query, int* result_count) {
-    if (!result_count) {
+// Grow the result array by one slot; false on allocation failure
+static bool append_result(search_result_t** results, int* count, int* capacity,
+                          int document_id, int line_number, int col_start, int col_end,
+                          float score, const char* context, const char* matched_text) {
+    if (*count >= *capacity) {
+        int new_capacity = (*capacity == 0) ? 10 : *capacity * 2;
+        search_result_t* new_results = realloc(*results, new_capacity * sizeof(search_result_t));
+        if (!new_results) return false;
+        *results = new_results;
+        *capacity = new_capacity;
+    }
+    
+    search_result_t* result = create_search_result(document_id, line_number, col_start, col_end,
+                                                   score, context, matched_text);
+    if (!result) return false;
+    (*results)[(*count)++] = *result;
+    free(result);
+    return true;
+}
+
+// Copy a word into a term, cut on a character boundary
+static void copy_term(char term[MAX_WORD_LENGTH], const search_token_t* token) {
+    size_t len = token->length;
+    if (len > MAX_WORD_LENGTH - 1) {
+        len = MAX_WORD_LENGTH - 1;
+        while (len > 0 && ((unsigned char)token->start[len] & 0xC0) == 0x80) len--;
+    }
+    memcpy(term, token->start, len);
+    term[len] = '\0';
+}
+
+// Split a query into terms (original case), with the same rules as indexing
+static int tokenize_query(const char* query, char terms[][MAX_WORD_LENGTH], int max_terms) {
+    int count = 0;
+    search_tokenizer_t tokenizer;
+    search_token_t token;
+    search_tokenizer_init(&tokenizer, query, strlen(query));
+    while (count < max_terms && search_tokenizer_next(&tokenizer, &token)) {
+        if (token.indexed) copy_term(terms[count++], &token);
+    }
+    return count;
+}
+
+static int lower_term(const char* word, char lower_word[MAX_WORD_LENGTH]) {
+    return (int)search_fold(word, strlen(word), lower_word, MAX_WORD_LENGTH);
+}
+
+// A run of query terms at fixed word offsets: a "quoted phrase", or a lone
+// word. Single-letter words are not indexed but keep their place.
+typedef struct {
+    int first;                      // its terms are terms[first..first + count)
+    int count;
+    int span;                       // word positions from its first term to its last
+    const char* text;               // in the query, checked against the line
+    int text_length;
+    int near;                       // NEAR/k to the next phrase: at most k words between, else -1
+} query_phrase_t;
+
+// A term query: its terms in query order and their phrases, all of which
+// must be on a matching line
+typedef struct {
+    char terms[MAX_QUERY_TERMS][MAX_WORD_LENGTH];
+    int offsets[MAX_QUERY_TERMS];   // word position in its phrase
+    int term_count;
+    query_phrase_t phrases[MAX_QUERY_TERMS];
+    int phrase_count;
+    bool positional;                // a phrase or NEAR constrains positions
+} term_query_t;
+
+// Length of a NEAR/k operator starting with `word`, before `end`, and its
+// k; 0 if there is none
+static int near_operator(const search_token_t* word, const char* end, int* distance) {
+    if (word->length != 4 || memcmp(word->start, "NEAR", 4) != 0) return 0;
+    const char* slash = word->start + 4;
+    if (slash == end || *slash != '/') return 0;
+    search_tokenizer_t tokenizer;
+    search_token_t number;
+    search_tokenizer_init(&tokenizer, slash + 1, (size_t)(end - slash - 1));
+    if (!search_tokenizer_next(&tokenizer, &number) || number.start != slash + 1) return 0;
+    long k = 0;
+    for (size_t i = 0; i < number.length; i++) {
+        if (!isdigit((unsigned char)number.start[i])) return 0;
+        if (k < MAX_LINE_LENGTH) k = k * 10 + (number.start[i] - '0');
+    }
+    *distance = (int)k;
+    return (int)(number.start + number.length - word->start);
+}
+
+// Add the words from `text` to `end` as a phrase
+static void add_query_phrase(term_query_t* parsed, const char* text, const char* end) {
+    query_phrase_t phrase = { parsed->term_count, 0, 0, NULL, 0, -1 };
+    search_tokenizer_t tokenizer;
+    search_token_t word;
+    int first_position = 0;
+    search_tokenizer_init(&tokenizer, text, (size_t)(end - text));
+    for (int position = 0; parsed->term_count < MAX_QUERY_TERMS && search_tokenizer_next(&tokenizer, &word);
+         position++) {
+        if (!word.indexed) continue;
+        if (phrase.count == 0) {
+            first_position = position;
+            phrase.text = word.start;
+        }
+        copy_term(parsed->terms[parsed->term_count], &word);
+        parsed->offsets[parsed->term_count++] = position - first_position;
+        phrase.span = position - first_position;
+        phrase.text_length = (int)(word.start + word.length - phrase.text);
+        phrase.count++;
+    }
+    if (phrase.count > 0) {
+        parsed->phrases[parsed->phrase_count++] = phrase;
+        if (phrase.count > 1) parsed->positional = true;
+    }
+}
+
+// Split a query into terms (original case) and phrases, with the same
+// word rules as indexing. Words written together without a separator
+// (ideographs) make a phrase, as if quoted.
+static void parse_term_query(const char* query, term_query_t* parsed) {
+    parsed->term_count = 0;
+    parsed->phrase_count = 0;
+    parsed->positional = false;
+    const char* end = query + strlen(query);
+    const char* p = query;
+    while (parsed->term_count < MAX_QUERY_TERMS) {
+        search_tokenizer_t tokenizer;
+        search_token_t word;
+        search_tokenizer_init(&tokenizer, p, (size_t)(end - p));
+        bool found = search_tokenizer_next(&tokenizer, &word);
+        const char* quote = memchr(p, '"', (size_t)((found ? word.start : end) - p));
+        if (!found && !quote) break;
+        
+        const char* phrase_end;
+        if (quote) {
+            p = quote + 1;
+            phrase_end = memchr(p, '"', (size_t)(end - p));
+            if (!phrase_end) phrase_end = end;
+        } else {
+            int distance;
+            int operator_length = near_operator(&word, end, &distance);
+            if (operator_length > 0) {
+                if (parsed->phrase_count > 0) {
+                    parsed->phrases[parsed->phrase_count - 1].near = distance;
+                    parsed->positional = true;
+                }
+                p = word.start + operator_length;
+                continue;
+            }
+            p = word.start;
+            phrase_end = word.start + word.length;
+            search_tokenizer_t next = tokenizer;
+            while (search_tokenizer_next(&next, &word) && word.start == phrase_end) {
+                phrase_end = word.start + word.length;
+            }
+        }
+        add_query_phrase(parsed, p, phrase_end);
+        p = quote && phrase_end < end ? phrase_end + 1 : phrase_end;
+    }
+}
+
+// A searchable part of the index: a segment of the published snapshot
+// and its deletions. Each part numbers its documents from 0 in its
+// postings.
+typedef struct {
+    const search_segment_t* segment;
+    const uint8_t* deleted;
+} index_part_t;
+
+static int part_document_count(const index_part_t* part) {
+    return (int)part->segment->header->document_count;
+}
+
+static inline bool part_live(const index_part_t* part, int document) {
+    return !bit_test(part->deleted, document);
+}
+
+static uint32_t part_document_length(const index_part_t* part, int document) {
+    return part->segment->documents[document].word_count;
+}
+
+static uint64_t part_word_count(const index_part_t* part) {
+    return part->segment->header->word_count;
+}
+
+static int part_document_id(const index_part_t* part, int document) {
+    return (int)part->segment->documents[document].document_id;
+}
+
+static int64_t part_modified(const index_part_t* part, int document) {
+    return part->segment->documents[document].last_modified;
+}
+
+static const char* part_path(const index_part_t* part, int document) {
+    return search_segment_path(part->segment, document);
+}
+
+static const char* part_line(const index_part_t* part, int document, int line) {
+    return search_segment_line(part->segment, document, line);
+}
+
+// Whether the part was built with markdown fields, and which of its
+// documents were
+static bool part_has_fields(const index_part_t* part) {
+    return (part->segment->header->flags & SEARCH_SEGMENT_FIELDS) != 0;
+}
+
+static bool part_document_fields(const index_part_t* part, int document) {
+    return (part->segment->documents[document].flags & SEARCH_SEGMENT_FIELDS) != 0;
+}
+
+static uint8_t part_line_field(const index_part_t* part, int document, int line) {
+    return search_segment_line_field(part->segment, document, line);
+}
+
+// Title of a note (search_markdown.h), cut to a completion's length
+static void note_title(const char* path, char title[SUGGEST_MAX_LENGTH + 1]) {
+    const char* name;
+    size_t length = search_note_title(path, &name);
+    if (length > SUGGEST_MAX_LENGTH) length = SUGGEST_MAX_LENGTH;
+    memcpy(title, name, length);
+    title[length] = '\0';
+}
+
+// Field boosts: a match in a heading, or in a note whose title holds a
+// query term, outranks one in the body; code blocks rank below
+#define FIELD_TITLE_BOOST 1.5f
+#define FIELD_HEADING_BOOST 1.5f
+#define FIELD_CODE_BOOST 0.5f
+#define FIELD_MAX_BOOST (FIELD_TITLE_BOOST * FIELD_HEADING_BOOST)
+
+static float field_boost(uint8_t field) {
+    switch (search_field_kind(field)) {
+    case SEARCH_FIELD_HEADING:
+        return FIELD_HEADING_BOOST;
+    case SEARCH_FIELD_CODE:
+        return FIELD_CODE_BOOST;
+    default:
+        return 1.0f;
+    }
+}
+
+// Largest boost of a posting block's documents, from its fields
+// (search_segment.h); blocks that do not know their fields get the largest
+static float block_boost(uint32_t fields) {
+    if (fields == 0) return FIELD_MAX_BOOST;
+    float boost = 0.0f;
+    for (int kind = SEARCH_FIELD_BODY; kind <= SEARCH_FIELD_CODE; kind++) {
+        if (fields & (1u << kind) && field_boost((uint8_t)kind) > boost) boost = field_boost((uint8_t)kind);
+        if (fields & (1u << kind) << SEARCH_BLOCK_TITLE_SHIFT &&
+            FIELD_TITLE_BOOST * field_boost((uint8_t)kind) > boost) {
+            boost = FIELD_TITLE_BOOST * field_boost((uint8_t)kind);
+        }
+    }
+    return boost;
+}
+
+// Whether a word of a note's title is one of the query's terms
+static bool title_holds_term(const char* path, const term_query_t* query) {
+    for (int t = 0; t < query->term_count; t++) {
+        char lower_word[MAX_WORD_LENGTH];
+        int length = lower_term(query->terms[t], lower_word);
+        if (search_note_title_holds(path, lower_word, (size_t)length)) return true;
+    }
+    return false;
+}
+
+// Postings of a lowercase word, returned in `view`
+static const posting_list_t* part_postings(const index_part_t* part, const char* word,
+                                           posting_list_t* view) {
+    return search_segment_find_term(part->segment, word, view) ? view : NULL;
+}
+
+static const posting_list_t* part_trigram_postings(const index_part_t* part, const char* trigram,
+                                                   posting_list_t* view) {
+    return search_segment_find_trigram(part->segment, trigram, view) ? view : NULL;
+}
+
+// Documents of a part that may hold a match of `query`, as a bitmap; NULL
+// when any may (no constraint, or out of memory)
+static uint8_t* trigram_candidates(const index_part_t* part, const trigram_query_t* query) {
+    if (query->op == TRIGRAM_ALL) return NULL;
+    size_t bytes = bitmap_bytes(part_document_count(part));
+    if (query->op == TRIGRAM_ONE) {
+        uint8_t* bits = calloc(1, bytes);
+        posting_list_t view;
+        const posting_list_t* postings = bits ? part_trigram_postings(part, query->trigram, &view) : NULL;
+        if (postings) {
+            posting_cursor_t cursor;
+            for (posting_cursor_init(&cursor, postings); !cursor.done;
+                 posting_cursor_seek_document(&cursor, cursor.document + 1)) {
+                bit_set(bits, (int)cursor.document);
+            }
+        }
+        return bits;
+    }
+    
+    uint8_t* result = NULL;
+    for (int i = 0; i < query->child_count; i++) {
+        uint8_t* bits = trigram_candidates(part, query->children[i]);
+        if (!bits) {
+            if (query->op == TRIGRAM_AND) continue;
+            free(result);
+            return NULL;
+        }
+        if (!result) {
+            result = bits;
+            continue;
+        }
+        for (size_t b = 0; b < bytes; b++) {
+            result[b] = query->op == TRIGRAM_AND ? result[b] & bits[b] : result[b] | bits[b];
+        }
+        free(bits);
+    }
+    return result;
+}
+
+static size_t part_term_count(const index_part_t* part) {
+    return part->segment->header->term_count;
+}
+
+// The part's `i`-th word (in dictionary order) and its postings view
+static const char* part_term(const index_part_t* part, size_t i, posting_list_t* view) {
+    return search_segment_term(part->segment, i, view);
+}
+
+// Parts of the published snapshot, oldest segment first. Release with
+// release_parts().
+static index_part_t* acquire_parts(search_index_t* index, snapshot_reader_t* reader, int* count) {
+    snapshot_acquire(index->segments, reader);
+    const segment_snapshot_t* snapshot = reader->snapshot;
+    index_part_t* parts = malloc((snapshot->count + 1) * sizeof(index_part_t));
+    if (!parts) {
+        snapshot_release(index->segments, reader);
         return NULL;
     }
-    if (!index || !query || !query->query) {
+    for (int i = 0; i < snapshot->count; i++) {
+        parts[i] = (index_part_t){ snapshot->segments[i]->segment, snapshot->deleted[i] };
+    }
+    *count = snapshot->count;
+    return parts;
+}
+
+static void release_parts(search_index_t* index, snapshot_reader_t* reader, index_part_t* parts) {
+    free(parts);
+    snapshot_release(index->segments, reader);
+}
+
+// Substring search honoring case sensitivity
+static const char* find_text(const char* haystack, const char* needle, bool case_sensitive) {
+    if (case_sensitive) return strstr(haystack, needle);
+    size_t len = strlen(needle);
+    char lower = (char)tolower((unsigned char)needle[0]);
+    char upper = (char)toupper((unsigned char)needle[0]);
+    for (; *haystack; haystack++) {
+        if ((*haystack == lower || *haystack == upper) &&
+            strncasecmp(haystack, needle, len) == 0) {
+            return haystack;
+        }
+    }
+    return NULL;
+}
+
+// Whether a word is `expected` (`length` bytes, folded unless case
+// sensitive)
+static inline bool word_is(const search_token_t* word, const char* expected, size_t length, bool case_sensitive) {
+    if (case_sensitive) return word->length == length && memcmp(word->start, expected, length) == 0;
+    return search_fold_equal(word->start, word->length, expected, length);
+}
+
+// Next occurrence of `word` as a whole word of the line from `from` (a
+// word boundary); its end in `end`
+static const char* find_word_in_line(const char* from, const char* word, bool case_sensitive, const char** end) {
+    char lower_word[MAX_WORD_LENGTH];
+    size_t len = case_sensitive ? strlen(word) : search_fold(word, strlen(word), lower_word, sizeof(lower_word));
+    const char* expected = case_sensitive ? word : lower_word;
+    search_tokenizer_t tokenizer;
+    search_token_t token;
+    search_tokenizer_init(&tokenizer, from, strlen(from));
+    while (search_tokenizer_next(&tokenizer, &token)) {
+        if (word_is(&token, expected, len, case_sensitive)) {
+            *end = token.start + token.length;
+            return token.start;
+        }
+    }
+    return NULL;
+}
+
+// Next occurrence of a phrase's words (`text`, `length` bytes) as
+// consecutive words of the line from `from` (a word boundary); its end in
+// `end`
+static const char* find_phrase_in_line(const char* from, const char* text, int length, bool case_sensitive,
+                                       const char** end) {
+    search_tokenizer_t phrase;
+    search_token_t expected;
+    search_tokenizer_init(&phrase, text, (size_t)length);
+    if (!search_tokenizer_next(&phrase, &expected)) return NULL;
+    char lower_first[MAX_WORD_LENGTH], lower_word[MAX_WORD_LENGTH];
+    size_t first_length = case_sensitive ? expected.length
+                                         : search_fold(expected.start, expected.length, lower_first, sizeof(lower_first));
+    const char* first = case_sensitive ? expected.start : lower_first;
+    search_tokenizer_t rest = phrase;
+    
+    search_tokenizer_t tokenizer;
+    search_token_t start;
+    search_tokenizer_init(&tokenizer, from, strlen(from));
+    while (search_tokenizer_next(&tokenizer, &start)) {
+        if (!word_is(&start, first, first_length, case_sensitive)) continue;
+        search_tokenizer_t line = tokenizer;
+        search_token_t word = start;
+        phrase = rest;
+        bool matched = true;
+        while (matched && search_tokenizer_next(&phrase, &expected)) {
+            if (!search_tokenizer_next(&line, &word)) return NULL;
+            if (case_sensitive) {
+                matched = word_is(&word, expected.start, expected.length, true);
+            } else {
+                size_t lower_length = search_fold(expected.start, expected.length, lower_word, sizeof(lower_word));
+                matched = word_is(&word, lower_word, lower_length, false);
+            }
+        }
+        if (matched) {
+            *end = word.start + word.length;
+            return start.start;
+        }
+    }
+    return NULL;
+}
+
+// Substring search: every occurrence of the query text, inside words too,
+// in corpus order. Only documents holding every trigram of the query are
+// read. Also serves word queries without an indexable term (lone
+// characters), whose words must then be whole words of the line.
+static search_result_t* substring_search(search_index_t* index, const search_query_t* query, int* result_count) {
+    search_result_t* results = NULL;
+    int count = 0;
+    int capacity = 0;
+    int limit = query->max_results > 0 ? query->max_results : INT32_MAX;
+    size_t query_len = strlen(query->query);
+    if (query_len == 0) {
         *result_count = 0;
         return NULL;
     }
     
-    // For now, implement simple text search
-    // TODO: Use word index for better performance
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    if (!parts) {
+        *result_count = 0;
+        return NULL;
+    }
+    // Words of one character have no trigram
+    bool whole_words = query->whole_words_only;
+    trigram_query_t* trigrams = whole_words ? NULL : trigram_query_literal(query->query, query_len);
+    for (int p = 0; p < part_count && count < limit; p++) {
+        const index_part_t* part = &parts[p];
+        uint8_t* candidates = trigrams ? trigram_candidates(part, trigrams) : NULL;
+        for (int doc_idx = 0; doc_idx < part_document_count(part) && count < limit; doc_idx++) {
+            if (!part_live(part, doc_idx) || (candidates && !bit_test(candidates, doc_idx))) continue;
+            const char* line;
+            for (int line_idx = 0; count < limit && (line = part_line(part, doc_idx, line_idx)); line_idx++) {
+                const char* end = line;
+                for (const char* match_pos = whole_words ? find_phrase_in_line(line, query->query, (int)query_len,
+                                                                               query->case_sensitive, &end)
+                                                         : find_text(line, query->query, query->case_sensitive);
+                     match_pos && count < limit;
+                     match_pos = whole_words ? find_phrase_in_line(end, query->query, (int)query_len,
+                                                                   query->case_sensitive, &end)
+                                             : find_text(match_pos + 1, query->query, query->case_sensitive)) {
+                    int col_start = match_pos - line;
+                    int col_end = whole_words ? (int)(end - line) : col_start + (int)query_len;
+                    if (!append_result(&results, &count, &capacity, part_document_id(part, doc_idx),
+                                       line_idx, col_start, col_end, 1.0f, line, query->query)) {
+                        search_engine_free_results(results, count);
+                        free(candidates);
+                        trigram_query_free(trigrams);
+                        release_parts(index, &reader, parts);
+                        *result_count = 0;
+                        return NULL;
+                    }
+                }
+            }
+        }
+        free(candidates);
+    }
+    trigram_query_free(trigrams);
+    release_parts(index, &reader, parts);
+    
+    *result_count = count;
+    return results;
+}
+
+// Regex search: candidate documents come from the pattern's trigrams, then
+// their lines run through the matcher. Every non-empty match is a result,
+// in corpus order.
+static search_result_t* regex_search(search_index_t* index, const char* pattern, bool case_sensitive,
+                                     int max_results, int* result_count) {
+    *result_count = 0;
+    if (!pattern[0]) return NULL;
+    search_regex_t* regex = search_regex_compile(pattern, case_sensitive);
+    if (!regex) return NULL;
     
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    if (!parts) {
+        search_regex_free(regex);
+        return NULL;
+    }
     search_result_t* results = NULL;
     int count = 0;
     int capacity = 0;
+    int limit = max_results > 0 ? max_results : INT32_MAX;
+    bool ok = true;
+    for (int p = 0; p < part_count && count < limit && ok; p++) {
+        const index_part_t* part = &parts[p];
+        uint8_t* candidates = trigram_candidates(part, search_regex_prefilter(regex));
+        for (int doc_idx = 0; doc_idx < part_document_count(part) && count < limit && ok; doc_idx++) {
+            if (!part_live(part, doc_idx) || (candidates && !bit_test(candidates, doc_idx))) continue;
+            const char* line;
+            for (int line_idx = 0; count < limit && ok && (line = part_line(part, doc_idx, line_idx)); line_idx++) {
+                size_t length = strlen(line);
+                size_t from = 0, start, end;
+                while (count < limit && from <= length &&
+                       search_regex_find(regex, line, length, from, &start, &end)) {
+                    if (end == start) {
+                        from = start + 1;
+                        continue;
+                    }
+                    char* matched = strndup(line + start, end - start);
+                    ok = matched && append_result(&results, &count, &capacity, part_document_id(part, doc_idx),
+                                                  line_idx, (int)start, (int)end, 1.0f, line, matched);
+                    free(matched);
+                    if (!ok) break;
+                    from = end;
+                }
+            }
+        }
+        free(candidates);
+    }
+    release_parts(index, &reader, parts);
+    search_regex_free(regex);
+    if (!ok) {
+        search_engine_free_results(results, count);
+        return NULL;
+    }
+    *result_count = count;
+    return results;
+}
+
+// ============= RANKING =============
+
+// BM25 weight of one term in a document of `length` words
+static inline float bm25_term(float idf, uint32_t frequency, uint32_t length, float average_length) {
+    float tf = (float)frequency;
+    return idf * tf * (BM25_K1 + 1.0f) /
+           (tf + BM25_K1 * (1.0f - BM25_B + BM25_B * (float)length / average_length));
+}
+
+// A scored result; `order` is its arrival, so ties keep corpus order. Its
+// strings are copied from `line` only once it makes the final list.
+typedef struct {
+    search_result_t result;
+    uint64_t order;
+    const char* line;               // in its part
+} ranked_result_t;
+
+// The best `limit` results (all of them when limit is 0), kept as a heap
+// whose top is the worst one while the limit is in force
+typedef struct {
+    ranked_result_t* entries;
+    int count;
+    int capacity;
+    int limit;
+    uint64_t next_order;
+} ranking_t;
+
+static inline bool ranked_worse(const ranked_result_t* a, const ranked_result_t* b) {
+    return a->result.relevance_score < b->result.relevance_score ||
+           (a->result.relevance_score == b->result.relevance_score && a->order > b->order);
+}
+
+static inline bool ranking_full(const ranking_t* ranking) {
+    return ranking->limit > 0 && ranking->count == ranking->limit;
+}
+
+// Score a result must beat to be kept
+static inline float ranking_threshold(const ranking_t* ranking) {
+    return ranking_full(ranking) ? ranking->entries[0].result.relevance_score : -INFINITY;
+}
+
+static void ranking_sift_down(ranking_t* ranking, int i) {
+    ranked_result_t* entries = ranking->entries;
+    for (;;) {
+        int worst = i, left = 2 * i + 1, right = left + 1;
+        if (left < ranking->count && ranked_worse(&entries[left], &entries[worst])) worst = left;
+        if (right < ranking->count && ranked_worse(&entries[right], &entries[worst])) worst = right;
+        if (worst == i) return;
+        ranked_result_t swap = entries[i];
+        entries[i] = entries[worst];
+        entries[worst] = swap;
+        i = worst;
+    }
+}
+
+static bool ranking_add(ranking_t* ranking, int document_id, int line_number, int col_start, int col_end,
+                        float score, const char* line) {
+    if (ranking_full(ranking)) {
+        if (score <= ranking_threshold(ranking)) return true;
+        ranking->entries[0] = ranking->entries[--ranking->count];
+        ranking_sift_down(ranking, 0);
+    }
+    if (ranking->count >= ranking->capacity) {
+        int capacity = ranking->capacity ? ranking->capacity * 2 : 16;
+        if (ranking->limit > 0 && capacity > ranking->limit) capacity = ranking->limit;
+        ranked_result_t* entries = realloc(ranking->entries, capacity * sizeof(ranked_result_t));
+        if (!entries) return false;
+        ranking->entries = entries;
+        ranking->capacity = capacity;
+    }
+
+    ranked_result_t entry = {0};
+    entry.result.document_id = document_id;
+    entry.result.line_number = line_number;
+    entry.result.column_start = col_start;
+    entry.result.column_end = col_end;
+    entry.result.relevance_score = score;
+    entry.order = ranking->next_order++;
+    entry.line = line;
+
+    int i = ranking->count++;
+    if (ranking->limit > 0) {
+        while (i > 0 && ranked_worse(&entry, &ranking->entries[(i - 1) / 2])) {
+            ranking->entries[i] = ranking->entries[(i - 1) / 2];
+            i = (i - 1) / 2;
+        }
+    }
+    ranking->entries[i] = entry;
+    return true;
+}
+
+static int compare_ranked(const void* a, const void* b) {
+    const ranked_result_t* x = a;
+    const ranked_result_t* y = b;
+    if (ranked_worse(x, y)) return 1;
+    return ranked_worse(y, x) ? -1 : 0;
+}
+
+// Best first, with their strings copied (so before the parts are
+// released); the entries are compacted in place into the result array.
+// NULL when out of memory.
+static search_result_t* ranking_finish(ranking_t* ranking, int* result_count) {
+    qsort(ranking->entries, ranking->count, sizeof(ranked_result_t), compare_ranked);
+    search_result_t* results = (search_result_t*)ranking->entries;
+    bool ok = true;
+    for (int i = 0; i < ranking->count; i++) {
+        const char* line = ranking->entries[i].line;
+        search_result_t result = ranking->entries[i].result;
+        result.context = strdup(line);
+        result.matched_text = strndup(line + result.column_start, result.column_end - result.column_start);
+        ok = ok && result.context && result.matched_text;
+        results[i] = result;
+    }
+    *result_count = ranking->count;
+    if (!ok) {
+        search_engine_free_results(results, ranking->count);
+        *result_count = 0;
+        return NULL;
+    }
+    return results;
+}
+
+static void ranking_free(ranking_t* ranking) {
+    free(ranking->entries);
+}
+
+// Postings of the query terms in one part, by query term (NULL if absent)
+typedef struct {
+    posting_list_t views[MAX_QUERY_TERMS];
+    const posting_list_t* lists[MAX_QUERY_TERMS];
+} part_terms_t;
+
+// Positions of each term on one line, for phrase and NEAR checks
+typedef struct {
+    uint32_t* positions[MAX_QUERY_TERMS];
+    int counts[MAX_QUERY_TERMS];
+    int capacities[MAX_QUERY_TERMS];
+} line_positions_t;
+
+static void line_positions_free(line_positions_t* line) {
+    for (int t = 0; t < MAX_QUERY_TERMS; t++) free(line->positions[t]);
+}
+
+// Read the occurrences on (document, line_number) of each cursor, whose
+// term is order[k], leaving the cursors past the line. False when out of
+// memory.
+static bool read_line_positions(posting_cursor_t* cursors, const int* order, int term_count,
+                                uint32_t document, uint32_t line_number, line_positions_t* line) {
+    for (int k = 0; k < term_count; k++) {
+        int t = order[k];
+        posting_cursor_t* cursor = &cursors[k];
+        line->counts[t] = 0;
+        while (!cursor->done && cursor->document == document && cursor->line == line_number) {
+            if (line->counts[t] == line->capacities[t]) {
+                int capacity = line->capacities[t] ? line->capacities[t] * 2 : 16;
+                uint32_t* positions = realloc(line->positions[t], capacity * sizeof(uint32_t));
+                if (!positions) return false;
+                line->positions[t] = positions;
+                line->capacities[t] = capacity;
+            }
+            line->positions[t][line->counts[t]++] = cursor->position;
+            posting_cursor_next(cursor);
+        }
+    }
+    return true;
+}
+
+// Keep, in its first term's positions, those starting an occurrence of the
+// phrase: a merge with each other term's positions shifted by its offset.
+// Returns their count.
+static int phrase_starts(const term_query_t* query, const query_phrase_t* phrase, line_positions_t* line) {
+    uint32_t* starts = line->positions[phrase->first];
+    int count = line->counts[phrase->first];
+    int next[MAX_QUERY_TERMS] = {0};
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        bool found = true;
+        for (int t = phrase->first + 1; found && t < phrase->first + phrase->count; t++) {
+            uint32_t target = starts[i] + (uint32_t)query->offsets[t];
+            const uint32_t* positions = line->positions[t];
+            while (next[t] < line->counts[t] && positions[next[t]] < target) next[t]++;
+            found = next[t] < line->counts[t] && positions[next[t]] == target;
+        }
+        if (found) starts[kept++] = starts[i];
+    }
+    line->counts[phrase->first] = kept;
+    return kept;
+}
+
+// Whether occurrences of two phrases (by their starts) overlap or have at
+// most `distance` words between them
+static bool phrases_near(const line_positions_t* line, const query_phrase_t* a, const query_phrase_t* b,
+                         int distance) {
+    uint64_t reach = (uint64_t)distance + 1;
+    const uint32_t* starts_a = line->positions[a->first];
+    const uint32_t* starts_b = line->positions[b->first];
+    int count_b = line->counts[b->first];
+    int j = 0;
+    for (int i = 0; i < line->counts[a->first]; i++) {
+        // Skip the occurrences of b ending too far before this one of a
+        uint64_t start_a = starts_a[i];
+        while (j < count_b && (uint64_t)starts_b[j] + b->span + reach < start_a) j++;
+        if (j == count_b) return false;
+        if ((uint64_t)starts_b[j] <= start_a + a->span + reach) return true;
+    }
+    return false;
+}
+
+// Whether the positions of a line hold every phrase, with the NEAR ones
+// close enough
+static bool positions_match(const term_query_t* query, line_positions_t* line) {
+    for (int p = 0; p < query->phrase_count; p++) {
+        const query_phrase_t* phrase = &query->phrases[p];
+        if (phrase->count > 1 && phrase_starts(query, phrase, line) == 0) return false;
+    }
+    for (int p = 0; p + 1 < query->phrase_count; p++) {
+        int distance = query->phrases[p].near;
+        if (distance >= 0 && !phrases_near(line, &query->phrases[p], &query->phrases[p + 1], distance)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Next occurrence of a query phrase in the text of a line; its end in `end`
+static const char* find_query_phrase(const char* from, const term_query_t* query, const query_phrase_t* phrase,
+                                     bool case_sensitive, const char** end) {
+    if (phrase->count == 1) return find_word_in_line(from, query->terms[phrase->first], case_sensitive, end);
+    return find_phrase_in_line(from, phrase->text, phrase->text_length, case_sensitive, end);
+}
+
+// Next line of `document` whose postings hold every term, and for a
+// positional query every phrase and NEAR distance. The cursors are on the
+// document, cursor k on term order[k]; they are left on or past the line,
+// so the caller moves on with posting_cursor_seek(&cursors[0], document,
+// line + 1). Returns 1 with the line in `line_number`, 0 when there is none
+// and -1 when out of memory.
+static int next_aligned_line(posting_cursor_t* cursors, const int* order, const term_query_t* query,
+                             uint32_t document, line_positions_t* positions, uint32_t* line_number) {
+    int term_count = query->term_count;
+    while (!cursors[0].done && cursors[0].document == document) {
+        // Leapfrog: every cursor must land on the same line
+        uint32_t line = cursors[0].line;
+        bool aligned = true;
+        for (int t = 1; t < term_count; t++) {
+            if (!posting_cursor_seek(&cursors[t], document, line) || cursors[t].document != document) {
+                return 0;
+            }
+            if (cursors[t].line != line) {
+                posting_cursor_seek(&cursors[0], document, cursors[t].line);
+                aligned = false;
+                break;
+            }
+        }
+        if (!aligned) continue;
+        
+        // Phrases and NEAR from the positions alone; this moves the
+        // cursors past the line
+        if (query->positional) {
+            if (!read_line_positions(cursors, order, term_count, document, line, positions)) return -1;
+            if (!positions_match(query, positions)) continue;
+        }
+        *line_number = line;
+        return 1;
+    }
+    return 0;
+}
+
+// Verify a line against its text, for case and words longer than the
+// indexed prefix: the first occurrence of the query's first phrase (its
+// end in `end`) when the line holds every phrase, else NULL
+static const char* verify_line(const char* line, const term_query_t* query, bool case_sensitive,
+                               const char** end) {
+    const char* first = NULL;
+    for (int p = 0; line && p < query->phrase_count; p++) {
+        const char* phrase_end;
+        const char* match = find_query_phrase(line, query, &query->phrases[p], case_sensitive, &phrase_end);
+        if (!match) return NULL;
+        if (p == 0) {
+            first = match;
+            *end = phrase_end;
+        }
+    }
+    return first;
+}
+
+// Lines of `document` holding every phrase, ranked at the document's score,
+// boosted by each line's field when the document has fields. The cursors
+// are on the document, cursor k on term order[k]; returns false when out
+// of memory.
+static bool rank_document_lines(const index_part_t* part, posting_cursor_t* cursors, const int* order,
+                                const term_query_t* query, bool case_sensitive, uint32_t document,
+                                float score, bool fields, line_positions_t* positions, ranking_t* ranking) {
+    int document_id = part_document_id(part, (int)document);
+    for (int t = 0; t < query->term_count; t++) {
+        posting_cursor_seek(&cursors[t], document, 0);
+    }
+    float best_score = fields ? score * FIELD_HEADING_BOOST : score;
+    uint32_t line_number;
+    int found;
+    while (best_score > ranking_threshold(ranking) &&
+           (found = next_aligned_line(cursors, order, query, document, positions, &line_number)) != 0) {
+        if (found < 0) return false;
+        int line_idx = (int)line_number;
+        float line_score = fields ? score * field_boost(part_line_field(part, (int)document, line_idx)) : score;
+        if (line_score <= ranking_threshold(ranking)) {
+            posting_cursor_seek(&cursors[0], document, line_number + 1);
+            continue;
+        }
+        const char* line = part_line(part, (int)document, line_idx);
+        const char* end = NULL;
+        
+        // A single phrase reports each occurrence, several the line
+        for (const char* match = verify_line(line, query, case_sensitive, &end); match;
+             match = query->phrase_count == 1
+                         ? find_query_phrase(end, query, &query->phrases[0], case_sensitive, &end)
+                         : NULL) {
+            int col_start = match - line;
+            if (!ranking_add(ranking, document_id, line_idx, col_start, end - line, line_score, line)) {
+                return false;
+            }
+        }
+        
+        posting_cursor_seek(&cursors[0], document, line_number + 1);
+    }
+    return true;
+}
+
+static bool search_part(const index_part_t* part, const part_terms_t* lookup, const float* idf,
+                        const term_query_t* query, bool case_sensitive, float average_length,
+                        line_positions_t* positions, ranking_t* ranking) {
+    // Drive from the rarest term; `order` maps back to query order, which
+    // phrases and verification use
+    int term_count = query->term_count;
+    const posting_list_t* lists[MAX_QUERY_TERMS];
+    float weights[MAX_QUERY_TERMS];
+    int order[MAX_QUERY_TERMS];
+    for (int t = 0; t < term_count; t++) {
+        const posting_list_t* list = lookup->lists[t];
+        if (!list) return true;  // A term that never occurs
+        int k = t - 1;
+        while (k >= 0 && lists[k]->occurrence_count > list->occurrence_count) {
+            lists[k + 1] = lists[k];
+            weights[k + 1] = weights[k];
+            order[k + 1] = order[k];
+            k--;
+        }
+        lists[k + 1] = list;
+        weights[k + 1] = idf[t];
+        order[k + 1] = t;
+    }
+    posting_cursor_t cursors[MAX_QUERY_TERMS];
+    for (int t = 0; t < term_count; t++) {
+        posting_cursor_init(&cursors[t], lists[t]);
+    }
+    bool part_fields = part_has_fields(part);
+    
+    // Score bound of the documents up to `bound_last`, valid while every
+    // cursor stays in the same blocks. A ranked line holds every term, and
+    // a title boost needs one of them in the title, so the largest boost
+    // of any term's blocks bounds the field boosts.
+    float bound = 0.0f;
+    uint32_t bound_last = 0;
+    bool bounded = false;
+    while (!cursors[0].done) {
+        uint32_t document = cursors[0].document;
+        if (ranking_full(ranking)) {
+            if (!bounded || document > bound_last) {
+                bound = 0.0f;
+                bound_last = UINT32_MAX;
+                float boost = part_fields ? 0.0f : 1.0f;
+                for (int t = 0; t < term_count; t++) {
+                    posting_skip_t block;
+                    if (!posting_cursor_block_bound(&cursors[t], document, &block)) return true;
+                    bound += bm25_term(weights[t], block.max_frequency, block.min_length, average_length);
+                    if (block.last_document < bound_last) bound_last = block.last_document;
+                    if (part_fields && block_boost(block.fields) > boost) boost = block_boost(block.fields);
+                }
+                bound *= boost;
+                bounded = true;
+            }
+            if (bound <= ranking_threshold(ranking)) {
+                if (bound_last == UINT32_MAX) return true;
+                posting_cursor_seek_document(&cursors[0], bound_last + 1);
+                continue;
+            }
+        }
+        
+        // Leapfrog: every cursor must reach the same document. Occurrences
+        // are only decoded for documents that may be ranked.
+        bool aligned = true;
+        for (int t = 1; t < term_count; t++) {
+            if (!posting_cursor_seek_document(&cursors[t], document)) return true;
+            if (cursors[t].document != document) {
+                posting_cursor_seek_document(&cursors[0], cursors[t].document);
+                aligned = false;
+                break;
+            }
+        }
+        if (!aligned) continue;
+        
+        if (part_live(part, (int)document)) {
+            uint32_t length = part_document_length(part, (int)document);
+            float score = 0.0f;
+            for (int t = 0; t < term_count; t++) {
+                score += bm25_term(weights[t], cursors[t].frequencies[cursors[t].doc_index], length,
+                                   average_length);
+            }
+            bool fields = part_document_fields(part, (int)document);
+            if (fields && score * FIELD_MAX_BOOST > ranking_threshold(ranking) &&
+                title_holds_term(part_path(part, (int)document), query)) {
+                score *= FIELD_TITLE_BOOST;
+            }
+            if (!rank_document_lines(part, cursors, order, query, case_sensitive, document, score, fields,
+                                     positions, ranking)) {
+                return false;
+            }
+        }
+        posting_cursor_seek_document(&cursors[0], document + 1);
+    }
+    return true;
+}
+
+static search_result_t* boolean_search(search_index_t* index, const search_query_t* query, int* result_count);
+
+// Substrings by default. Term search (whole_words_only): documents holding
+// every query term are ranked by BM25 and
+// only the lines holding them all are read. Results come best first, lines
+// of one document in order within a field.
+search_result_t* search_engine_search(search_index_t* index, const search_query_t* query, int* result_count) {
+    if (!result_count) {
+        return NULL;
+    }
+    if (!index || !query || !query->query) {
+        *result_count = 0;
+        return NULL;
+    }
+    
+    if (query->regex_mode) {
+        return regex_search(index, query->query, query->case_sensitive, query->max_results, result_count);
+    }
+    if (query->boolean_mode) {
+        return boolean_search(index, query, result_count);
+    }
+    if (!query->whole_words_only) {
+        return substring_search(index, query, result_count);
+    }
+    term_query_t parsed;
+    parse_term_query(query->query, &parsed);
+    int term_count = parsed.term_count;
+    if (term_count == 0) {
+        return substring_search(index, query, result_count);
+    }
+    
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    part_terms_t* lookups = parts ? malloc(part_count * sizeof(part_terms_t)) : NULL;
+    if (!lookups) {
+        if (parts) release_parts(index, &reader, parts);
+        *result_count = 0;
+        return NULL;
+    }
+    
+    // Collection statistics over every part; like the postings, they
+    // include deleted documents until their segment is merged
+    uint64_t documents = 0, words = 0;
+    uint64_t document_frequency[MAX_QUERY_TERMS] = {0};
+    for (int p = 0; p < part_count; p++) {
+        documents += part_document_count(&parts[p]);
+        words += part_word_count(&parts[p]);
+        for (int t = 0; t < term_count; t++) {
+            char lower_word[MAX_WORD_LENGTH];
+            lower_term(parsed.terms[t], lower_word);
+            const posting_list_t* list = part_postings(&parts[p], lower_word, &lookups[p].views[t]);
+            lookups[p].lists[t] = list;
+            if (list) document_frequency[t] += list->document_count;
+        }
+    }
+    float average_length = words > 0 ? (float)words / (float)documents : 1.0f;
+    float idf[MAX_QUERY_TERMS];
+    for (int t = 0; t < term_count; t++) {
+        float df = (float)document_frequency[t];
+        idf[t] = logf(1.0f + ((float)documents - df + 0.5f) / (df + 0.5f));
+    }
+    
+    ranking_t ranking = {0};
+    ranking.limit = query->max_results > 0 ? query->max_results : 0;
+    line_positions_t positions = {0};
+    for (int p = 0; p < part_count; p++) {
+        if (!search_part(&parts[p], &lookups[p], idf, &parsed, query->case_sensitive, average_length,
+                         &positions, &ranking)) {
+            ranking_free(&ranking);
+            line_positions_free(&positions);
+            free(lookups);
+            release_parts(index, &reader, parts);
+            *result_count = 0;
+            return NULL;
+        }
+    }
+    line_positions_free(&positions);
+    free(lookups);
+    
+    search_result_t* results = NULL;
+    *result_count = 0;
+    if (ranking.count > 0) {
+        results = ranking_finish(&ranking, result_count);
+    } else {
+        ranking_free(&ranking);
+    }
+    release_parts(index, &reader, parts);
+    return results;
+}
+
+// Levenshtein automaton over a term dictionary. Its state after reading a
+// prefix of a term is one row of the edit-distance table against the query;
+// rows are kept per depth, so consecutive terms sharing a prefix (sorted
+// segment dictionaries) reuse its rows, and once every cell of a row exceeds
+// the distance bound no term with that prefix can match and they are
+// skipped with a prefix comparison.
+typedef struct {
+    const char* query;              // lowercase
+    int length;
+    int max_distance;               // bound over every term length
+    int* rows;                      // MAX_WORD_LENGTH rows of length + 1 cells
+    char previous[MAX_WORD_LENGTH]; // last term read
+    int depth;                      // rows valid for its first `depth` bytes
+    bool dead;                      // and no term with that prefix matches
+} fuzzy_matcher_t;
+
+// Terms scoring at least `threshold` (1 - distance / longer length) are
+// within max_distance: a term of length n needs n <= length / threshold
+static bool fuzzy_matcher_init(fuzzy_matcher_t* matcher, const char* query, float threshold) {
+    size_t query_length = strlen(query);
+    char* lower = malloc(query_length + 1);
+    if (!lower) return false;
+    matcher->length = (int)search_fold(query, query_length, lower, query_length + 1);
+    double bound = threshold > 0.0f ? (1.0 - threshold) * matcher->length / threshold : MAX_WORD_LENGTH;
+    matcher->max_distance = bound < MAX_WORD_LENGTH ? (int)(bound + 1e-6) : MAX_WORD_LENGTH;
+    matcher->rows = malloc((size_t)MAX_WORD_LENGTH * (matcher->length + 1) * sizeof(int));
+    if (!matcher->rows) {
+        free(lower);
+        return false;
+    }
+    for (int i = 0; i <= matcher->length; i++) matcher->rows[i] = i;
+    matcher->query = lower;
+    matcher->depth = 0;
+    matcher->dead = false;
+    return true;
+}
+
+static void fuzzy_matcher_free(fuzzy_matcher_t* matcher) {
+    free((char*)matcher->query);
+    free(matcher->rows);
+}
+
+// Edit distance between the query and `word`, or -1 beyond max_distance
+static int fuzzy_matcher_distance(fuzzy_matcher_t* matcher, const char* word) {
+    int m = matcher->length;
+    int shared = 0;
+    while (shared < matcher->depth && word[shared] && word[shared] == matcher->previous[shared]) shared++;
+    if (matcher->dead && shared == matcher->depth) return -1;
+    
+    int n = shared;
+    matcher->dead = false;
+    for (; word[n]; n++) {
+        if (n + 1 >= MAX_WORD_LENGTH) {
+            matcher->depth = n;
+            return -1;
+        }
+        const int* above = &matcher->rows[n * (m + 1)];
+        int* row = &matcher->rows[(n + 1) * (m + 1)];
+        char c = word[n];
+        matcher->previous[n] = c;
+        
+        // Only cells within max_distance of the diagonal can stay within
+        // it; the ones bordering that band are set above the bound
+        int k = matcher->max_distance;
+        int low = n + 1 - k > 1 ? n + 1 - k : 1;
+        int high = n + 1 + k < m ? n + 1 + k : m;
+        row[0] = n + 1;
+        if (low > 1) row[low - 1] = k + 1;
+        int best = row[0];
+        for (int j = low; j <= high; j++) {
+            int cost = above[j - 1] + (matcher->query[j - 1] != c);
+            if (above[j] + 1 < cost) cost = above[j] + 1;
+            if (row[j - 1] + 1 < cost) cost = row[j - 1] + 1;
+            row[j] = cost;
+            if (cost < best) best = cost;
+        }
+        if (high < m) row[high + 1] = k + 1;
+        if (best > k) {
+            matcher->depth = n + 1;
+            matcher->dead = true;
+            return -1;
+        }
+    }
+    matcher->depth = n;
+    if (n - m > matcher->max_distance || m - n > matcher->max_distance) return -1;
+    int distance = matcher->rows[n * (m + 1) + m];
+    return distance <= matcher->max_distance ? distance : -1;
+}
+
+// Fuzzy search: every occurrence of each dictionary term similar enough to
+// the query
+search_result_t* search_engine_search_fuzzy(search_index_t* index, const char* query, float threshold, int* result_count) {
+    if (!result_count) {
+        return NULL;
+    }
+    *result_count = 0;
+    if (!index || !query) {
+        return NULL;
+    }
+    
+    search_result_t* results = NULL;
+    int count = 0;
+    int capacity = 0;
+    
+    fuzzy_matcher_t matcher;
+    if (!fuzzy_matcher_init(&matcher, query, threshold)) return NULL;
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    if (!parts) {
+        fuzzy_matcher_free(&matcher);
+        return NULL;
+    }
+    for (int p = 0; p < part_count; p++) {
+        matcher.depth = 0;
+        matcher.dead = false;
+        for (size_t i = 0; i < part_term_count(&parts[p]); i++) {
+            posting_list_t view;
+            const char* word = part_term(&parts[p], i, &view);
+            int distance = fuzzy_matcher_distance(&matcher, word);
+            if (distance < 0) continue;
+            int word_length = (int)strlen(word);
+            int longer = word_length > matcher.length ? word_length : matcher.length;
+            float score = longer > 0 ? 1.0f - (float)distance / longer : 1.0f;
+            
+            if (score >= threshold) {
+                // Add all occurrences of this word
+                posting_cursor_t cursor;
+                for (posting_cursor_init(&cursor, &view); !cursor.done;
+                     posting_cursor_next(&cursor)) {
+                    if (!part_live(&parts[p], (int)cursor.document)) continue;
+                    if (count >= capacity) {
+                        capacity = (capacity == 0) ? 10 : capacity * 2;
+                        search_result_t* new_results =
+                            realloc(results, capacity * sizeof(search_result_t));
+                        if (!new_results) {
+                            search_engine_free_results(results, count);
+                            release_parts(index, &reader, parts);
+                            fuzzy_matcher_free(&matcher);
+                            return NULL;
+                        }
+                        results = new_results;
+                    }
+                    
+                    search_result_t* result = create_search_result(
+                        part_document_id(&parts[p], (int)cursor.document), 0, 0, 0, score, word, word
+                    );
+                    
+                    if (result) {
+                        results[count++] = *result;
+                        free(result);
+                    }
+                }
+            }
+        }
+    }
+    release_parts(index, &reader, parts);
+    fuzzy_matcher_free(&matcher);
+    
+    *result_count = count;
+    return results;
+}
+
+// ============= SUGGESTIONS =============
+
+// Words weighted by the documents holding them (summed over parts, so
+// deleted documents count until their segment is merged) and one entry per
+// live note title
+static suggest_dictionary_t* build_suggestions(const index_part_t* parts, int part_count) {
+    size_t count = 0, documents = 0;
+    for (int p = 0; p < part_count; p++) {
+        count += part_term_count(&parts[p]) + (size_t)part_document_count(&parts[p]);
+        documents += (size_t)part_document_count(&parts[p]);
+    }
+    suggest_entry_t* entries = malloc((count ? count : 1) * sizeof(suggest_entry_t));
+    char (*titles)[SUGGEST_MAX_LENGTH + 1] = malloc((documents ? documents : 1) * sizeof(*titles));
+    suggest_dictionary_t* dictionary = NULL;
+    if (entries && titles) {
+        size_t n = 0, title_count = 0;
+        for (int p = 0; p < part_count; p++) {
+            for (size_t i = 0; i < part_term_count(&parts[p]); i++) {
+                posting_list_t view;
+                const char* word = part_term(&parts[p], i, &view);
+                entries[n++] = (suggest_entry_t){ word, (uint32_t)view.document_count };
+            }
+            for (int d = 0; d < part_document_count(&parts[p]); d++) {
+                if (!part_live(&parts[p], d)) continue;
+                note_title(part_path(&parts[p], d), titles[title_count]);
+                if (titles[title_count][0]) entries[n++] = (suggest_entry_t){ titles[title_count++], 1 };
+            }
+        }
+        dictionary = suggest_dictionary_build(entries, n);
+    }
+    free(entries);
+    free(titles);
+    return dictionary;
+}
+
+// Up to max_suggestions indexed words and note titles (file names without
+// extension) starting with `prefix`, ignoring case, most frequent first.
+// Words weigh the documents holding them, titles one.
+char** search_engine_suggest(search_index_t* index, const char* prefix, int max_suggestions, int* count) {
+    if (!count) return NULL;
+    *count = 0;
+    if (!index || !prefix || max_suggestions <= 0) return NULL;
+    if (max_suggestions > SUGGEST_MAX_RESULTS) max_suggestions = SUGGEST_MAX_RESULTS;
+    
+    char texts[SUGGEST_MAX_RESULTS][SUGGEST_MAX_LENGTH + 1];
+    uint32_t weights[SUGGEST_MAX_RESULTS];
+    struct search_suggestions* suggestions = index->suggestions;
+    pthread_mutex_lock(&suggestions->lock);
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    if (parts && (!suggestions->dictionary || suggestions->changes != reader.snapshot->changes)) {
+        suggest_dictionary_t* dictionary = build_suggestions(parts, part_count);
+        if (dictionary) {
+            suggest_dictionary_free(suggestions->dictionary);
+            suggestions->dictionary = dictionary;
+            suggestions->changes = reader.snapshot->changes;
+        }
+    }
+    if (parts) release_parts(index, &reader, parts);
+    int found = suggest_dictionary_complete(suggestions->dictionary, prefix, max_suggestions, texts, weights);
+    pthread_mutex_unlock(&suggestions->lock);
+    
+    char** results = found > 0 ? malloc(found * sizeof(char*)) : NULL;
+    if (!results) return NULL;
+    for (int i = 0; i < found; i++) {
+        results[i] = strdup(texts[i]);
+        if (!results[i]) {
+            search_engine_free_suggestions(results, i);
+            return NULL;
+        }
+    }
+    *count = found;
+    return results;
+}
+
+void search_engine_free_suggestions(char** suggestions, int count) {
+    if (!suggestions) return;
+    for (int i = 0; i < count; i++) free(suggestions[i]);
+    free(suggestions);
+}
+
+// Free search results
+void search_engine_free_results(search_result_t* results, int count) {
+    if (!results) return;
+    
+    for (int i = 0; i < count; i++) {
+        free(results[i].context);
+        free(results[i].matched_text);
+    }
+    
+    free(results);
+}
+
+// Print statistics
+void search_engine_print_stats(const search_index_t* index) {
+    if (!index) return;
+    
+    writer_lock(index);
+    printf("Search Engine Statistics:\n");
+    printf("  Documents indexed: %d/%d\n", index->document_count, index->max_documents);
+    printf("  Word index entries: %zu\n", index->word_index->entry_count);
+    printf("  Hash table size: %zu\n", index->word_index->table_size);
+    printf("  Trigram index entries: %zu\n", index->trigram_index->entry_count);
+    
+    size_t posting_bytes = 0;
+    for (size_t i = 0; i < index->word_index->entry_count; i++) {
+        posting_bytes += posting_list_memory(index->word_index->entries[i].postings);
+    }
+    printf("  Posting list memory: %zu bytes\n", posting_bytes);
+    
+    snapshot_reader_t reader;
+    snapshot_acquire(index->segments, &reader);
+    size_t segment_bytes = 0;
+    for (int i = 0; i < reader.snapshot->count; i++) {
+        segment_bytes += reader.snapshot->segments[i]->segment->size;
+    }
+    printf("  Segments: %d (%zu bytes), %d documents in memory\n",
+           reader.snapshot->count, segment_bytes, index->memory_document_count);
+    snapshot_release(index->segments, &reader);
+    pthread_mutex_unlock(&index->segments->writer);
+    printf("  Embeddings enabled: %s\n", index->embeddings_enabled ? "Yes" : "No");
+    
+    if (index->embeddings_enabled) {
+        printf("  Embedding dimension: %d\n", index->embedding_dimension);
+    }
+}
+
+// ============= BOOLEAN QUERIES =============
+
+// A text, tag, title, heading or code clause of a boolean query, with its
+// terms
+typedef struct {
+    const query_node_t* node;
+    term_query_t query;
+    char tag[MAX_WORD_LENGTH];      // TAG: '#' and its name
+    bool scored;                    // not a title nor under NOT: ranks and places results
+} boolean_clause_t;
+
+typedef struct {
+    query_node_t* root;
+    boolean_clause_t* clauses;      // by node->clause
+    int clause_count;
+} boolean_plan_t;
+
+// Evaluation of a boolean query in one part
+typedef struct {
+    const index_part_t* part;
+    const boolean_clause_t* clauses;
+    const part_terms_t* lookups;    // postings of each clause's terms
+    bool case_sensitive;
+    size_t bytes;                   // of a document bitmap
+    line_positions_t* positions;
+} boolean_part_t;
+
+#define ESTIMATE_UNKNOWN UINT64_MAX
+
+static void compile_clauses(boolean_plan_t* plan, const query_node_t* node, bool negated) {
+    for (int i = 0; i < node->child_count; i++) {
+        compile_clauses(plan, node->children[i], negated || node->kind == QUERY_NOT);
+    }
+    if (node->clause < 0) return;
+    boolean_clause_t* clause = &plan->clauses[node->clause];
+    clause->node = node;
+    clause->scored = !negated && node->kind != QUERY_TITLE;
+    if (node->phrase) {
+        clause->query.term_count = 0;
+        clause->query.phrase_count = 0;
+        clause->query.positional = false;
+        add_query_phrase(&clause->query, node->text, node->text + strlen(node->text));
+    } else {
+        parse_term_query(node->text, &clause->query);
+    }
+    if (node->kind == QUERY_TAG) snprintf(clause->tag, sizeof(clause->tag), "#%s", node->text);
+}
+
+// Parse a boolean query and the terms of its clauses; false if it is
+// invalid or when out of memory
+static bool boolean_plan_init(boolean_plan_t* plan, const char* query) {
+    plan->root = search_query_parse(query, &plan->clause_count);
+    plan->clauses = plan->root ? calloc(plan->clause_count + 1, sizeof(boolean_clause_t)) : NULL;
+    if (!plan->clauses) {
+        search_query_free(plan->root);
+        return false;
+    }
+    compile_clauses(plan, plan->root, false);
+    return true;
+}
+
+static void boolean_plan_free(boolean_plan_t* plan) {
+    free(plan->clauses);
+    search_query_free(plan->root);
+}
+
+// Next #tag in a line: the name ignoring ASCII case, not inside a word
+// and not followed by more of a name, though a nested "/sub" may follow;
+// its end in `end`
+static const char* find_tag_in_line(const char* line, const char* tag, const char** end) {
+    size_t length = strlen(tag);
+    for (const char* match = find_text(line, tag, false); match; match = find_text(match + 1, tag, false)) {
+        unsigned char before = match > line ? (unsigned char)match[-1] : ' ';
+        unsigned char after = (unsigned char)match[length];
+        if (isalnum(before) || before == '_' || before >= 0x80) continue;
+        if (isalnum(after) || after == '_' || after == '-' || after >= 0x80) continue;
+        *end = match + length;
+        return match;
+    }
+    return NULL;
+}
+
+// First match of a clause in a text, its end in `end`; NULL if there is
+// none. Clauses without an indexed word are substrings.
+static const char* clause_match(const boolean_clause_t* clause, const char* text, bool case_sensitive,
+                                const char** end) {
+    if (clause->node->kind == QUERY_TAG) return find_tag_in_line(text, clause->tag, end);
+    if (clause->query.term_count > 0) return verify_line(text, &clause->query, case_sensitive, end);
+    const char* match = find_text(text, clause->node->text, case_sensitive);
+    if (match) *end = match + strlen(clause->node->text);
+    return match;
+}
+
+// Whether a line is in the field a heading or code clause asks for; lines
+// of documents indexed without fields are in none
+static bool clause_field(const boolean_part_t* eval, const boolean_clause_t* clause, int document, int line) {
+    query_kind_t kind = clause->node->kind;
+    if (kind != QUERY_HEADING && kind != QUERY_CODE) return true;
+    if (!part_document_fields(eval->part, document)) return false;
+    int field = search_field_kind(part_line_field(eval->part, document, line));
+    return field == (kind == QUERY_HEADING ? SEARCH_FIELD_HEADING : SEARCH_FIELD_CODE);
+}
+
+// First line of `document` where a text, tag, heading or code clause
+// matches, and the match's columns. The cursors, cursor k on term
+// order[k], are moved within the document. Returns 1 when found, 0 when
+// not and -1 when out of memory.
+static int clause_line(const boolean_part_t* eval, const boolean_clause_t* clause, posting_cursor_t* cursors,
+                       const int* order, uint32_t document, int* line_number, int* col_start, int* col_end) {
+    const term_query_t* query = &clause->query;
+    const char* line;
+    const char* end;
+    if (query->term_count == 0) {
+        for (int l = 0; (line = part_line(eval->part, (int)document, l)); l++) {
+            if (!clause_field(eval, clause, (int)document, l)) continue;
+            const char* match = clause_match(clause, line, eval->case_sensitive, &end);
+            if (match) {
+                *line_number = l;
+                *col_start = (int)(match - line);
+                *col_end = (int)(end - line);
+                return 1;
+            }
+        }
+        return 0;
+    }
+    
+    for (int t = 0; t < query->term_count; t++) {
+        posting_cursor_seek(&cursors[t], document, 0);
+    }
+    uint32_t l;
+    int found;
+    while ((found = next_aligned_line(cursors, order, query, document, eval->positions, &l)) > 0) {
+        line = part_line(eval->part, (int)document, (int)l);
+        const char* match = line && clause_field(eval, clause, (int)document, (int)l)
+                                ? clause_match(clause, line, eval->case_sensitive, &end)
+                                : NULL;
+        if (match) {
+            *line_number = (int)l;
+            *col_start = (int)(match - line);
+            *col_end = (int)(end - line);
+            return 1;
+        }
+        posting_cursor_seek(&cursors[0], document, l + 1);
+    }
+    return found;
+}
+
+// Documents among `candidates` where a clause matches. The
+// postings of its terms, rarest first, give the documents holding them
+// all; lines are only read when the postings alone cannot tell.
+static uint8_t* clause_documents(const boolean_part_t* eval, const boolean_clause_t* clause,
+                                 const uint8_t* candidates) {
+    uint8_t* result = calloc(1, eval->bytes);
+    if (!result) return NULL;
+    const term_query_t* query = &clause->query;
+    int term_count = query->term_count;
+    int document_count = part_document_count(eval->part);
+    int line, col_start, col_end;
+    if (term_count == 0) {
+        for (int d = 0; d < document_count; d++) {
+            if (!bit_test(candidates, d)) continue;
+            int found = clause_line(eval, clause, NULL, NULL, (uint32_t)d, &line, &col_start, &col_end);
+            if (found > 0) bit_set(result, d);
+        }
+        return result;
+    }
+    
+    const part_terms_t* lookup = &eval->lookups[clause->node->clause];
+    const posting_list_t* lists[MAX_QUERY_TERMS];
+    int order[MAX_QUERY_TERMS];
+    for (int t = 0; t < term_count; t++) {
+        const posting_list_t* list = lookup->lists[t];
+        if (!list) return result;   // A term that never occurs
+        int k = t - 1;
+        while (k >= 0 && lists[k]->document_count > list->document_count) {
+            lists[k + 1] = lists[k];
+            order[k + 1] = order[k];
+            k--;
+        }
+        lists[k + 1] = list;
+        order[k + 1] = t;
+    }
+    posting_cursor_t cursors[MAX_QUERY_TERMS];
+    for (int t = 0; t < term_count; t++) {
+        posting_cursor_init(&cursors[t], lists[t]);
+    }
+    query_kind_t kind = clause->node->kind;
+    bool read_lines = kind == QUERY_TAG || kind == QUERY_HEADING || kind == QUERY_CODE || query->positional ||
+                      query->phrase_count > 1 || eval->case_sensitive;
+    
+    while (!cursors[0].done) {
+        uint32_t document = cursors[0].document;
+        if (!bit_test(candidates, (int)document)) {
+            posting_cursor_seek_document(&cursors[0], document + 1);
+            continue;
+        }
+        bool aligned = true;
+        for (int t = 1; t < term_count; t++) {
+            if (!posting_cursor_seek_document(&cursors[t], document)) return result;
+            if (cursors[t].document != document) {
+                posting_cursor_seek_document(&cursors[0], cursors[t].document);
+                aligned = false;
+                break;
+            }
+        }
+        if (!aligned) continue;
+        
+        int found = 1;
+        if (read_lines) {
+            found = clause_line(eval, clause, cursors, order, document, &line, &col_start, &col_end);
+            if (found < 0) {
+                free(result);
+                return NULL;
+            }
+        }
+        if (found) bit_set(result, (int)document);
+        posting_cursor_seek_document(&cursors[0], document + 1);
+    }
+    return result;
+}
+
+// Whether a line of a document links to a target holding `text`
+static bool links_to(const boolean_part_t* eval, int document, const char* text) {
+    if (!part_document_fields(eval->part, document)) return false;
+    size_t length = strlen(text);
+    const char* line;
+    for (int l = 0; (line = part_line(eval->part, document, l)); l++) {
+        if (!(part_line_field(eval->part, document, l) & SEARCH_FIELD_LINKS)) continue;
+        size_t line_length = strlen(line);
+        search_link_t link;
+        for (size_t from = 0; search_markdown_next_link(line, line_length, from, &link); from = link.end) {
+            for (size_t i = link.start; i + length <= link.end; i++) {
+                if (strncasecmp(line + i, text, length) == 0) return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Whether a document satisfies a title, path, extension, date or link
+// clause
+static bool metadata_match(const boolean_part_t* eval, const query_node_t* node, int document) {
+    const char* path = part_path(eval->part, document);
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    switch (node->kind) {
+    case QUERY_TITLE: {
+        char title[SUGGEST_MAX_LENGTH + 1];
+        const char* end;
+        note_title(path, title);
+        return clause_match(&eval->clauses[node->clause], title, eval->case_sensitive, &end) != NULL;
+    }
+    case QUERY_PATH:
+        return find_text(path, node->text, false) != NULL;
+    case QUERY_EXT: {
+        const char* dot = strrchr(name, '.');
+        return dot && dot != name && strcasecmp(dot + 1, node->text) == 0;
+    }
+    case QUERY_MODIFIED: {
+        int64_t modified = part_modified(eval->part, document);
+        return modified >= node->after && modified < node->before;
+    }
+    case QUERY_LINK:
+        return links_to(eval, document, node->text);
+    default:
+        return false;
+    }
+}
+
+static bool is_metadata(const query_node_t* node) {
+    return node->kind == QUERY_TITLE || node->kind == QUERY_PATH || node->kind == QUERY_EXT ||
+           node->kind == QUERY_MODIFIED;
+}
+
+// Most documents of the part a node can match, from the sizes of the
+// postings; ESTIMATE_UNKNOWN when they cannot tell (metadata, negations,
+// substrings)
+static uint64_t node_estimate(const boolean_part_t* eval, const query_node_t* node) {
+    uint64_t estimate = ESTIMATE_UNKNOWN;
+    switch (node->kind) {
+    case QUERY_TEXT:
+    case QUERY_TAG:
+    case QUERY_HEADING:
+    case QUERY_CODE: {
+        const boolean_clause_t* clause = &eval->clauses[node->clause];
+        for (int t = 0; t < clause->query.term_count; t++) {
+            const posting_list_t* list = eval->lookups[node->clause].lists[t];
+            uint64_t documents = list ? (uint64_t)list->document_count : 0;
+            if (documents < estimate) estimate = documents;
+        }
+        return estimate;
+    }
+    case QUERY_AND:
+        for (int i = 0; i < node->child_count; i++) {
+            uint64_t child = node_estimate(eval, node->children[i]);
+            if (child < estimate) estimate = child;
+        }
+        return estimate;
+    case QUERY_OR:
+        estimate = 0;
+        for (int i = 0; i < node->child_count; i++) {
+            uint64_t child = node_estimate(eval, node->children[i]);
+            if (child == ESTIMATE_UNKNOWN) return ESTIMATE_UNKNOWN;
+            estimate += child;
+        }
+        return estimate;
+    default:
+        return ESTIMATE_UNKNOWN;
+    }
+}
+
+// The plan of an AND or OR node in this part, as the order its children
+// are evaluated in: the child with the smallest postings comes first and
+// gives the candidates, metadata filters narrow them before any line is
+// read, then the other clauses by estimated postings, negations last.
+// Each child only looks at the documents still undecided.
+static int* plan_children(const boolean_part_t* eval, const query_node_t* node) {
+    int count = node->child_count;
+    int* order = malloc(count * sizeof(int));
+    uint64_t* keys = order ? malloc(count * sizeof(uint64_t)) : NULL;
+    if (!keys) {
+        free(order);
+        return NULL;
+    }
+    int first = -1;
+    for (int i = 0; i < count; i++) {
+        const query_node_t* child = node->children[i];
+        uint64_t estimate = node_estimate(eval, child);
+        uint64_t stage = child->kind == QUERY_NOT ? 3 : is_metadata(child) ? 1 : 2;
+        keys[i] = stage << 32 | (estimate < UINT32_MAX ? estimate : UINT32_MAX);
+        if (stage == 2 && estimate != ESTIMATE_UNKNOWN && (first < 0 || keys[i] < keys[first])) first = i;
+    }
+    if (first >= 0) keys[first] &= UINT32_MAX;
+    for (int i = 0; i < count; i++) {
+        int k = i - 1;
+        while (k >= 0 && keys[order[k]] > keys[i]) {
+            order[k + 1] = order[k];
+            k--;
+        }
+        order[k + 1] = i;
+    }
+    free(keys);
+    return order;
+}
+
+static bool bitmap_empty(const uint8_t* bits, size_t bytes) {
+    for (size_t b = 0; b < bytes; b++) {
+        if (bits[b]) return false;
+    }
+    return true;
+}
+
+// Documents among `candidates` (a bitmap) matching a node, as a new
+// bitmap; NULL when out of memory
+static uint8_t* evaluate_node(const boolean_part_t* eval, const query_node_t* node, const uint8_t* candidates) {
+    size_t bytes = eval->bytes;
+    switch (node->kind) {
+    case QUERY_TEXT:
+    case QUERY_TAG:
+    case QUERY_HEADING:
+    case QUERY_CODE:
+        return clause_documents(eval, &eval->clauses[node->clause], candidates);
+    case QUERY_NOT: {
+        uint8_t* excluded = evaluate_node(eval, node->children[0], candidates);
+        if (!excluded) return NULL;
+        for (size_t b = 0; b < bytes; b++) excluded[b] = candidates[b] & ~excluded[b];
+        return excluded;
+    }
+    case QUERY_AND: {
+        int* order = plan_children(eval, node);
+        if (!order) return NULL;
+        uint8_t* result = NULL;
+        for (int i = 0; i < node->child_count; i++) {
+            uint8_t* narrowed = evaluate_node(eval, node->children[order[i]], result ? result : candidates);
+            free(result);
+            result = narrowed;
+            if (!result || bitmap_empty(result, bytes)) break;
+        }
+        free(order);
+        return result;
+    }
+    case QUERY_OR: {
+        int* order = plan_children(eval, node);
+        uint8_t* result = order ? calloc(1, bytes) : NULL;
+        uint8_t* undecided = result ? malloc(bytes) : NULL;
+        if (undecided) memcpy(undecided, candidates, bytes);
+        for (int i = 0; undecided && i < node->child_count && !bitmap_empty(undecided, bytes); i++) {
+            uint8_t* matched = evaluate_node(eval, node->children[order[i]], undecided);
+            if (!matched) {
+                free(undecided);
+                undecided = NULL;
+                break;
+            }
+            for (size_t b = 0; b < bytes; b++) {
+                result[b] |= matched[b];
+                undecided[b] &= ~matched[b];
+            }
+            free(matched);
+        }
+        if (!undecided) {
+            free(result);
+            result = NULL;
+        }
+        free(undecided);
+        free(order);
+        return result;
+    }
+    default: {
+        uint8_t* result = calloc(1, bytes);
+        if (!result) return NULL;
+        for (int d = 0; d < part_document_count(eval->part); d++) {
+            if (bit_test(candidates, d) && metadata_match(eval, node, d)) bit_set(result, d);
+        }
+        return result;
+    }
+    }
+}
+
+// Rank the documents of a part matching the query: BM25 over the terms of
+// its scored clauses, each reported at the earliest match of one of them
+// (line 0 for metadata alone). In documents with fields the match in the
+// most boosted field is reported instead, its boost and the title's
+// applied to the score. `cursors` has room for every scored term,
+// those of clause c from cursor_base[c]; `matchable` is scratch space of a
+// flag per clause.
+static bool boolean_search_part(const boolean_part_t* eval, const boolean_plan_t* plan, const float* idf,
+                                float average_length, posting_cursor_t* cursors, const int* cursor_base,
+                                bool* matchable, ranking_t* ranking) {
+    const index_part_t* part = eval->part;
+    int document_count = part_document_count(part);
+    uint8_t* live = calloc(1, eval->bytes);
+    if (!live) return false;
+    for (int d = 0; d < document_count; d++) {
+        if (part_live(part, d)) bit_set(live, d);
+    }
+    uint8_t* matched = evaluate_node(eval, plan->root, live);
+    free(live);
+    if (!matched) return false;
+    
+    for (int c = 0; c < plan->clause_count; c++) {
+        const boolean_clause_t* clause = &plan->clauses[c];
+        matchable[c] = clause->scored;
+        for (int t = 0; matchable[c] && t < clause->query.term_count; t++) {
+            const posting_list_t* list = eval->lookups[c].lists[t];
+            if (list) posting_cursor_init(&cursors[cursor_base[c] + t], list);
+            else matchable[c] = false;
+        }
+    }
+    int identity[MAX_QUERY_TERMS];
+    for (int t = 0; t < MAX_QUERY_TERMS; t++) identity[t] = t;
+    float max_boost = part_has_fields(part) ? FIELD_MAX_BOOST : 1.0f;
     
-    for (int doc_idx = 0; doc_idx < index->document_count; doc_idx++) {
-        search_document_t* doc = index->documents[doc_idx];
-        
-        for (int line_idx = 0; line_idx < doc->line_count; line_idx++) {
-            const char* line = doc->lines[line_idx];
-            const char* match_pos = line;
-            
-            while ((match_pos = strstr(match_pos, query->query)) != NULL) {
-                // Expand capacity if needed
-                if (count >= capacity) {
-                    capacity = (capacity == 0) ? 10 : capacity * 2;
-                    search_result_t* new_results =
-                        realloc(results, capacity * sizeof(search_result_t));
-                    if (!new_results) {
-                        search_engine_free_results(results, count);
-                        *result_count = 0;
-                        return NULL;
-                    }
-                    results = new_results;
-                }
-                
-                int col_start = match_pos - line;
-                int col_end = col_start + strlen(query->query);
-                
-                search_result_t* result = create_search_result(
-                    doc->document_id, line_idx, col_start, col_end,
-                    1.0f, line, query->query
-                );
-                
-                if (result) {
-                    results[count++] = *result;
-                    free(result);
+    bool ok = true;
+    for (int d = 0; ok && d < document_count; d++) {
+        if (!bit_test(matched, d)) continue;
+        uint32_t length = part_document_length(part, d);
+        float score = 0.0f;
+        for (int c = 0; c < plan->clause_count; c++) {
+            for (int t = 0; matchable[c] && t < plan->clauses[c].query.term_count; t++) {
+                posting_cursor_t* cursor = &cursors[cursor_base[c] + t];
+                if (posting_cursor_seek_document(cursor, (uint32_t)d) && cursor->document == (uint32_t)d) {
+                    score += bm25_term(idf[cursor_base[c] + t], cursor->frequencies[cursor->doc_index], length,
+                                       average_length);
                 }
-                
-                match_pos++; // Continue searching in same line
-                
-                if (count >= query->max_results) break;
             }
-            
-            if (count >= query->max_results) break;
         }
+        if (ranking_full(ranking) && score * max_boost <= ranking_threshold(ranking)) continue;
         
-        if (count >= query->max_results) break;
+        bool fields = part_document_fields(part, d);
+        int best_line = -1, best_start = 0, best_end = 0;
+        float best_boost = 1.0f;
+        for (int c = 0; ok && c < plan->clause_count; c++) {
+            if (!matchable[c]) continue;
+            int line, col_start, col_end;
+            int found = clause_line(eval, &plan->clauses[c], &cursors[cursor_base[c]], identity, (uint32_t)d,
+                                    &line, &col_start, &col_end);
+            ok = found >= 0;
+            if (found <= 0) continue;
+            float boost = fields ? field_boost(part_line_field(part, d, line)) : 1.0f;
+            if (best_line < 0 || boost > best_boost ||
+                (boost == best_boost && (line < best_line || (line == best_line && col_start < best_start)))) {
+                best_line = line;
+                best_start = col_start;
+                best_end = col_end;
+                best_boost = boost;
+            }
+        }
+        if (fields) {
+            score *= best_boost;
+            for (int c = 0; c < plan->clause_count; c++) {
+                if (plan->clauses[c].scored && title_holds_term(part_path(part, d), &plan->clauses[c].query)) {
+                    score *= FIELD_TITLE_BOOST;
+                    break;
+                }
+            }
+        }
+        const char* text = part_line(part, d, best_line < 0 ? 0 : best_line);
+        ok = ok && ranking_add(ranking, part_document_id(part, d), best_line < 0 ? 0 : best_line, best_start,
+                               best_end, score, text ? text : "");
     }
-    
-    *result_count = count;
-    return results;
+    free(matched);
+    return ok;
 }
 
-// Fuzzy search implementation
-search_result_t* search_engine_search_fuzzy(search_index_t* index, const char* query, float threshold, int* result_count) {
-    if (!result_count) {
+// Boolean and field query (syntax in search_query.h): the tree is planned
+// per part from the sizes of its postings, and matching documents are
+// ranked by BM25 over its positive text and tag terms
+static search_result_t* boolean_search(search_index_t* index, const search_query_t* query, int* result_count) {
+    *result_count = 0;
+    boolean_plan_t plan;
+    if (!boolean_plan_init(&plan, query->query)) return NULL;
+    int clause_count = plan.clause_count;
+    
+    // Scored terms get a cursor and an IDF each, from cursor_base[c]
+    int* cursor_base = malloc((clause_count + 1) * sizeof(int));
+    bool* matchable = cursor_base ? malloc((clause_count + 1) * sizeof(bool)) : NULL;
+    if (!matchable) {
+        free(cursor_base);
+        boolean_plan_free(&plan);
         return NULL;
     }
-    if (!index || !query) {
-        *result_count = 0;
-        return NULL;
+    int scored_terms = 0;
+    for (int c = 0; c < clause_count; c++) {
+        cursor_base[c] = scored_terms;
+        if (plan.clauses[c].scored) scored_terms += plan.clauses[c].query.term_count;
     }
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    part_terms_t* lookups = parts ? malloc(((size_t)part_count * clause_count + 1) * sizeof(part_terms_t)) : NULL;
+    posting_cursor_t* cursors = lookups ? malloc((scored_terms + 1) * sizeof(posting_cursor_t)) : NULL;
+    float* idf = cursors ? malloc((scored_terms + 1) * sizeof(float)) : NULL;
+    uint64_t* document_frequency = idf ? calloc(scored_terms + 1, sizeof(uint64_t)) : NULL;
+    bool ok = document_frequency != NULL;
     
-    search_result_t* results = NULL;
-    int count = 0;
-    int capacity = 0;
-    
-    // Search through word index for fuzzy matches
-    for (size_t i = 0; i < index->word_index->table_size; i++) {
-        word_index_entry_t* entry = index->word_index->entries[i];
-        
-        while (entry) {
-            float score = calculate_fuzzy_score(query, entry->word);
-            
-            if (score >= threshold) {
-                // Add all occurrences of this word
-                for (int j = 0; j < entry->occurrence_count; j++) {
-                    if (count >= capacity) {
-                        capacity = (capacity == 0) ? 10 : capacity * 2;
-                        search_result_t* new_results =
-                            realloc(results, capacity * sizeof(search_result_t));
-                        if (!new_results) {
-                            search_engine_free_results(results, count);
-                            *result_count = 0;
-                            return NULL;
-                        }
-                        results = new_results;
-                    }
-                    
-                    search_result_t* result = create_search_result(
-                        entry->document_ids[j], 0, 0, 0, score, entry->word, entry->word
-                    );
-                    
-                    if (result) {
-                        results[count++] = *result;
-                        free(result);
-                    }
+    // Collection statistics over every part, as for term searches
+    uint64_t documents = 0, words = 0;
+    for (int p = 0; ok && p < part_count; p++) {
+        documents += part_document_count(&parts[p]);
+        words += part_word_count(&parts[p]);
+        for (int c = 0; c < clause_count; c++) {
+            const boolean_clause_t* clause = &plan.clauses[c];
+            part_terms_t* lookup = &lookups[(size_t)p * clause_count + c];
+            for (int t = 0; t < clause->query.term_count; t++) {
+                char lower_word[MAX_WORD_LENGTH];
+                lower_term(clause->query.terms[t], lower_word);
+                lookup->lists[t] = part_postings(&parts[p], lower_word, &lookup->views[t]);
+                if (lookup->lists[t] && clause->scored) {
+                    document_frequency[cursor_base[c] + t] += lookup->lists[t]->document_count;
                 }
             }
-            
-            entry = entry->next;
         }
     }
+    float average_length = words > 0 ? (float)words / (float)documents : 1.0f;
+    for (int i = 0; ok && i < scored_terms; i++) {
+        float df = (float)document_frequency[i];
+        idf[i] = logf(1.0f + ((float)documents - df + 0.5f) / (df + 0.5f));
+    }
     
-    *result_count = count;
+    ranking_t ranking = {0};
+    ranking.limit = query->max_results > 0 ? query->max_results : 0;
+    line_positions_t positions = {0};
+    for (int p = 0; ok && p < part_count; p++) {
+        boolean_part_t eval = { &parts[p], plan.clauses, &lookups[(size_t)p * clause_count],
+                                query->case_sensitive, bitmap_bytes(part_document_count(&parts[p])), &positions };
+        ok = boolean_search_part(&eval, &plan, idf, average_length, cursors, cursor_base, matchable, &ranking);
+    }
+    line_positions_free(&positions);
+    
+    search_result_t* results = NULL;
+    if (ok && ranking.count > 0) {
+        results = ranking_finish(&ranking, result_count);
+    } else {
+        ranking_free(&ranking);
+    }
+    free(document_frequency);
+    free(idf);
+    free(cursors);
+    free(lookups);
+    if (parts) release_parts(index, &reader, parts);
+    free(matchable);
+    free(cursor_base);
+    boolean_plan_free(&plan);
     return results;
 }
 
-// Free search results
-void search_engine_free_results(search_result_t* results, int count) {
-    if (!results) return;
-    
-    for (int i = 0; i < count; i++) {
-        free(results[i].context);
-        free(results[i].matched_text);
+// Terms of the scored clauses of a boolean query, to highlight
+static void boolean_highlight_terms(const char* query, term_query_t* parsed) {
+    boolean_plan_t plan;
+    if (!boolean_plan_init(&plan, query)) return;
+    for (int c = 0; c < plan.clause_count; c++) {
+        const boolean_clause_t* clause = &plan.clauses[c];
+        for (int t = 0; clause->scored && t < clause->query.term_count && parsed->term_count < MAX_QUERY_TERMS; t++) {
+            memcpy(parsed->terms[parsed->term_count++], clause->query.terms[t], MAX_WORD_LENGTH);
+        }
+    }
+    boolean_plan_free(&plan);
+}
+
+// ============= SNIPPETS =============
+//
+// A result's snippet is a window of its line around the densest cluster of
+// query terms. The terms' occurrences come from the postings, whose
+// positions number the words of the document, so the line is tokenized
+// once to turn them into byte offsets: the first occurrence anchors the
+// numbering and no text is searched. Highlights are returned as ranges;
+// search_engine_render_highlights() writes them out in one pass.
+
+#define SNIPPET_MAX_HITS 1024           // term occurrences read per line
+
+// A query term occurrence in a line: its word position, then its bytes
+typedef struct {
+    uint32_t position;
+    int term;
+    int start;
+    int end;
+} snippet_hit_t;
+
+static int compare_hit_positions(const void* a, const void* b) {
+    const snippet_hit_t* x = a;
+    const snippet_hit_t* y = b;
+    return (x->position > y->position) - (x->position < y->position);
+}
+
+// Occurrences of the terms (postings in `lookup`) in one line of a part's
+// document, with their byte ranges, in line order; returns their count
+static int line_hits(const part_terms_t* lookup, char terms[][MAX_WORD_LENGTH],
+                     int term_count, bool case_sensitive, int document, int line_number, const char* line,
+                     snippet_hit_t* hits) {
+    int count = 0;
+    for (int t = 0; t < term_count; t++) {
+        if (!lookup->lists[t]) continue;
+        posting_cursor_t cursor;
+        posting_cursor_init(&cursor, lookup->lists[t]);
+        posting_cursor_seek(&cursor, (uint32_t)document, (uint32_t)line_number);
+        while (!cursor.done && cursor.document == (uint32_t)document &&
+               cursor.line == (uint32_t)line_number && count < SNIPPET_MAX_HITS) {
+            hits[count++] = (snippet_hit_t){ cursor.position, t, 0, 0 };
+            posting_cursor_next(&cursor);
+        }
     }
+    if (count == 0) return 0;
+    qsort(hits, count, sizeof(snippet_hit_t), compare_hit_positions);
     
-    free(results);
+    // Tokenize like indexing; the first word spelling the first hit's term
+    // is that hit, which gives the position of the line's first word
+    char anchor[MAX_WORD_LENGTH];
+    int anchor_len = lower_term(terms[hits[0].term], anchor);
+    bool anchored = false;
+    uint32_t base = 0;
+    int next = 0, kept = 0;
+    search_tokenizer_t tokenizer;
+    search_token_t token;
+    search_tokenizer_init(&tokenizer, line, strlen(line));
+    for (uint32_t word = 0; next < count && search_tokenizer_next(&tokenizer, &token); word++) {
+        if (!anchored && word_is(&token, anchor, (size_t)anchor_len, false)) {
+            anchored = true;
+            base = hits[0].position - word;
+        }
+        for (; anchored && next < count && hits[next].position == base + word; next++) {
+            // Positions are case-insensitive; a term repeated in the query
+            // is one hit
+            const char* term = terms[hits[next].term];
+            if (kept > 0 && hits[kept - 1].position == hits[next].position) continue;
+            if (case_sensitive && !word_is(&token, term, strlen(term), true)) continue;
+            hits[kept] = hits[next];
+            hits[kept].start = (int)(token.start - line);
+            hits[kept].end = hits[kept].start + (int)token.length;
+            kept++;
+        }
+    }
+    return kept;
 }
 
-// Print statistics
-void search_engine_print_stats(const search_index_t* index) {
-    if (!index) return;
+// Move a window bound off the middle of a word or UTF-8 sequence, towards
+// `limit`
+static int snap_bound(const char* line, int at, int limit) {
+    search_tokenizer_t tokenizer;
+    search_token_t word;
+    search_tokenizer_init(&tokenizer, line, strlen(line));
+    while (search_tokenizer_next(&tokenizer, &word)) {
+        int start = (int)(word.start - line);
+        int end = start + (int)word.length;
+        if (start >= at) break;
+        if (end > at) {
+            at = limit > at ? (end < limit ? end : limit) : (start > limit ? start : limit);
+            break;
+        }
+    }
+    int step = limit > at ? 1 : -1;
+    while (at != limit && at > 0 && ((unsigned char)line[at] & 0xC0) == 0x80) at += step;
+    return at;
+}
+
+// Snippet of one line: the window of at most max_length bytes holding the
+// most distinct terms, then the most occurrences. With `cover_match` it must
+// hold the result's own match [match_start, match_end), which is one
+// occurrence; without hits the window centers on the match.
+static bool build_snippet(const char* line, snippet_hit_t* hits, int hit_count, int match_start, int match_end,
+                          bool cover_match, int max_length, search_snippet_t* snippet) {
+    int length = (int)strlen(line);
+    if (max_length <= 0 || max_length > length) max_length = length;
+    bool has_match = match_start >= 0 && match_start < match_end && match_end <= length;
+    cover_match = cover_match && has_match;
     
-    printf("Search Engine Statistics:\n");
-    printf("  Documents indexed: %d/%d\n", index->document_count, index->max_documents);
-    printf("  Word index entries: %zu\n", index->word_index->entry_count);
-    printf("  Hash table size: %zu\n", index->word_index->table_size);
-    printf("  Embeddings enabled: %s\n", index->embeddings_enabled ? "Yes" : "No");
+    int span_start = has_match ? match_start : 0;
+    int span_end = has_match ? match_end : 0;
+    int counts[MAX_QUERY_TERMS] = {0};
+    int distinct = 0, best_distinct = 0, best_count = 0;
+    for (int i = 0, j = 0; i < hit_count; i++) {
+        while (j < hit_count && (j == i || hits[j].end - hits[i].start <= max_length)) {
+            if (counts[hits[j++].term]++ == 0) distinct++;
+        }
+        bool covers = !cover_match || (hits[i].start <= match_start && match_end <= hits[j - 1].end);
+        if (covers && (distinct > best_distinct || (distinct == best_distinct && j - i > best_count))) {
+            best_distinct = distinct;
+            best_count = j - i;
+            span_start = hits[i].start;
+            span_end = hits[j - 1].end;
+        }
+        if (--counts[hits[i].term] == 0) distinct--;
+    }
     
-    if (index->embeddings_enabled) {
-        printf("  Embedding dimension: %d\n", index->embedding_dimension);
+    // Center the window on the span, inside the line
+    int start = span_start - (max_length - (span_end - span_start)) / 2;
+    if (start > span_start) start = span_start;
+    if (start > length - max_length) start = length - max_length;
+    if (start < 0) start = 0;
+    int end = start + max_length > length ? length : start + max_length;
+    if (end < span_end) end = span_end;
+    start = snap_bound(line, start, span_start);
+    end = snap_bound(line, end, span_end);
+    while (start < span_start && isspace((unsigned char)line[start])) start++;
+    while (end > span_end && isspace((unsigned char)line[end - 1])) end--;
+    
+    int highlight_count = 0;
+    for (int i = 0; i < hit_count; i++) {
+        if (hits[i].start >= start && hits[i].end <= end) highlight_count++;
+    }
+    if (hit_count == 0 && has_match) highlight_count = 1;
+    snippet->text = strndup(line + start, end - start);
+    snippet->offset = start;
+    snippet->truncated = end < length;
+    snippet->highlights = highlight_count > 0 ? malloc(highlight_count * sizeof(search_highlight_t)) : NULL;
+    snippet->highlight_count = 0;
+    if (!snippet->text || (highlight_count > 0 && !snippet->highlights)) return false;
+    for (int i = 0; i < hit_count; i++) {
+        if (hits[i].start >= start && hits[i].end <= end) {
+            snippet->highlights[snippet->highlight_count++] =
+                (search_highlight_t){ hits[i].start - start, hits[i].end - start };
+        }
     }
+    if (hit_count == 0 && has_match) {
+        snippet->highlights[snippet->highlight_count++] =
+            (search_highlight_t){ match_start - start, match_end - start };
+    }
+    return true;
 }
 
-// Highlight matches in text
-char* search_engine_highlight_matches(const char* text, const char* query, 
-                                     const char* highlight_start, const char* highlight_end) {
-    if (!text || !query || !highlight_start || !highlight_end) return NULL;
+// Part holding `document_id` and its local index there, from its location
+// when that is in the snapshot, else by a scan of the parts, newest first
+static int locate_document(const segment_snapshot_t* snapshot, const index_part_t* parts, int part_count,
+                           document_location_t location, int document_id, int* document) {
+    int p = location.segment == SEGMENT_NONE ? -1 : find_segment(snapshot, location.segment);
+    if (p >= 0 && (int)location.document < part_document_count(&parts[p]) &&
+        part_document_id(&parts[p], (int)location.document) == document_id) {
+        *document = (int)location.document;
+        return p;
+    }
+    for (p = part_count - 1; p >= 0; p--) {
+        for (int d = 0; d < part_document_count(&parts[p]); d++) {
+            if (part_document_id(&parts[p], d) == document_id) {
+                *document = d;
+                return p;
+            }
+        }
+    }
+    return -1;
+}
+
+// For each result, a window of at most max_length bytes of its line (0 for
+// all of it) around the densest cluster of query terms; for a one-term
+// query, one holding the result's own occurrence. The terms are found from
+// the indexed positions, so regex results only highlight their match.
+search_snippet_t* search_engine_snippets(search_index_t* index, const search_query_t* query,
+                                         const search_result_t* results, int count, int max_length) {
+    if (!index || !query || !results || count <= 0) return NULL;
+    term_query_t parsed = {0};
+    if (query->query && query->boolean_mode && !query->regex_mode) {
+        boolean_highlight_terms(query->query, &parsed);
+    } else if (query->query && !query->regex_mode) {
+        parse_term_query(query->query, &parsed);
+    }
+    int term_count = parsed.term_count;
+    char (*terms)[MAX_WORD_LENGTH] = parsed.terms;
     
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    part_terms_t* lookups = parts ? malloc((part_count + 1) * sizeof(part_terms_t)) : NULL;
+    bool* looked_up = lookups ? calloc(part_count + 1, sizeof(bool)) : NULL;
+    document_location_t* locations = looked_up ? malloc(count * sizeof(document_location_t)) : NULL;
+    snippet_hit_t* hits = locations ? malloc(SNIPPET_MAX_HITS * sizeof(snippet_hit_t)) : NULL;
+    search_snippet_t* snippets = hits ? calloc(count, sizeof(search_snippet_t)) : NULL;
+    bool ok = snippets != NULL;
+    if (ok) {
+        struct search_segments* segments = index->segments;
+        pthread_mutex_lock(&segments->lock);
+        for (int i = 0; i < count; i++) {
+            int id = results[i].document_id;
+            locations[i] = id >= 0 && id < segments->location_capacity
+                               ? segments->locations[id]
+                               : (document_location_t){ SEGMENT_NONE, 0 };
+        }
+        pthread_mutex_unlock(&segments->lock);
+    }
+    
+    for (int i = 0; ok && i < count; i++) {
+        const search_result_t* result = &results[i];
+        int document = 0;
+        int p = locate_document(reader.snapshot, parts, part_count, locations[i], result->document_id, &document);
+        const char* line = p >= 0 ? part_line(&parts[p], document, result->line_number) : NULL;
+        if (!line) {
+            ok = build_snippet("", hits, 0, -1, -1, false, max_length, &snippets[i]);
+            continue;
+        }
+        if (!looked_up[p]) {
+            for (int t = 0; t < term_count; t++) {
+                char lower_word[MAX_WORD_LENGTH];
+                lower_term(terms[t], lower_word);
+                lookups[p].lists[t] = part_postings(&parts[p], lower_word, &lookups[p].views[t]);
+            }
+            looked_up[p] = true;
+        }
+        int hit_count = line_hits(&lookups[p], terms, term_count, query->case_sensitive, document,
+                                  result->line_number, line, hits);
+        ok = build_snippet(line, hits, hit_count, result->column_start, result->column_end, term_count <= 1,
+                           max_length, &snippets[i]);
+    }
+    
+    free(hits);
+    free(locations);
+    free(looked_up);
+    free(lookups);
+    if (parts) release_parts(index, &reader, parts);
+    if (!ok) {
+        search_engine_free_snippets(snippets, count);
+        return NULL;
+    }
+    return snippets;
+}
+
+void search_engine_free_snippets(search_snippet_t* snippets, int count) {
+    if (!snippets) return;
+    for (int i = 0; i < count; i++) {
+        free(snippets[i].text);
+        free(snippets[i].highlights);
+    }
+    free(snippets);
+}
+
+// Sized from the ranges, then written in one pass
+char* search_engine_render_highlights(const char* text, const search_highlight_t* highlights, int count,
+                                      const char* highlight_start, const char* highlight_end) {
+    if (!text || (count > 0 && !highlights) || !highlight_start || !highlight_end) return NULL;
     size_t text_len = strlen(text);
-    size_t query_len = strlen(query);
     size_t start_len = strlen(highlight_start);
     size_t end_len = strlen(highlight_end);
-    (void)start_len; (void)end_len; // May be used for buffer sizing in full implementation
-    
-    // Estimate result size (pessimistic)
-    size_t result_size = text_len * 2 + 1000;
-    char* result = malloc(result_size);
+    char* result = malloc(text_len + (size_t)count * (start_len + end_len) + 1);
     if (!result) return NULL;
     
-    result[0] = '\0';
-    const char* src = text;
-    const char* match_pos;
-    
-    while ((match_pos = strstr(src, query)) != NULL) {
-        // Copy text before match
-        strncat(result, src, match_pos - src);
-        
-        // Add highlight start
-        strcat(result, highlight_start);
-        
-        // Add matched text
-        strncat(result, match_pos, query_len);
-        
-        // Add highlight end
-        strcat(result, highlight_end);
-        
-        src = match_pos + query_len;
+    char* out = result;
+    size_t copied = 0;
+    for (int i = 0; i < count; i++) {
+        size_t start = (size_t)highlights[i].start;
+        size_t end = (size_t)highlights[i].end;
+        if (start < copied || start > end || end > text_len) continue;  // out of order or bounds
+        memcpy(out, text + copied, start - copied);
+        out += start - copied;
+        memcpy(out, highlight_start, start_len);
+        out += start_len;
+        memcpy(out, text + start, end - start);
+        out += end - start;
+        memcpy(out, highlight_end, end_len);
+        out += end_len;
+        copied = end;
     }
+    memcpy(out, text + copied, text_len - copied + 1);
+    return result;
+}
+
+static int compare_highlights(const void* a, const void* b) {
+    const search_highlight_t* x = a;
+    const search_highlight_t* y = b;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+// Highlight the words of `text` spelling a query term, ignoring case
+char* search_engine_highlight_matches(const char* text, const char* query, 
+                                     const char* highlight_start, const char* highlight_end) {
+    if (!text || !query || !highlight_start || !highlight_end) return NULL;
     
-    // Add remaining text
-    strcat(result, src);
-    
+    char terms[MAX_QUERY_TERMS][MAX_WORD_LENGTH];
+    int term_count = tokenize_query(query, terms, MAX_QUERY_TERMS);
+    search_highlight_t* highlights = NULL;
+    int count = 0, capacity = 0;
+    for (int t = 0; t < term_count; t++) {
+        const char* end = text;
+        for (const char* match; (match = find_word_in_line(end, terms[t], false, &end)) != NULL;) {
+            if (count == capacity) {
+                capacity = capacity ? capacity * 2 : 16;
+                search_highlight_t* grown = realloc(highlights, capacity * sizeof(search_highlight_t));
+                if (!grown) {
+                    free(highlights);
+                    return NULL;
+                }
+                highlights = grown;
+            }
+            highlights[count++] = (search_highlight_t){ (int)(match - text), (int)(end - text) };
+        }
+    }
+    // Terms repeated in the query match the same words
+    if (term_count > 1 && count > 1) {
+        qsort(highlights, count, sizeof(search_highlight_t), compare_highlights);
+        int kept = 1;
+        for (int i = 1; i < count; i++) {
+            if (highlights[i].start != highlights[kept - 1].start) highlights[kept++] = highlights[i];
+        }
+        count = kept;
+    }
+    char* result = search_engine_render_highlights(text, highlights, count, highlight_start, highlight_end);
+    free(highlights);
     return result;
 }
 
-// Placeholder implementations for advanced features
+// Case-sensitive, every match
 search_result_t* search_engine_search_regex(search_index_t* index, const char* pattern, int* result_count) {
-    // TODO: Implement regex search
-    (void)index; (void)pattern; // Suppress unused warnings
-    *result_count = 0;
-    return NULL;
+    if (!result_count) return NULL;
+    if (!index || !pattern) {
+        *result_count = 0;
+        return NULL;
+    }
+    return regex_search(index, pattern, true, 0, result_count);
 }
 
 search_result_t* search_engine_search_similar(search_index_t* index, const char* text, int* result_count) {
@@ -535,19 +3670,380 @@ search_result_t* search_engine_search_semantic(search_index_t* index, const char
     return NULL;
 }
 
-void search_engine_rebuild_index(search_index_t* index) {
-    // TODO: Implement index rebuilding
-    (void)index; // Suppress unused warning
+// ============= NOTE STRUCTURE =============
+//
+// Notes indexed by markdown field keep the field of each line in their
+// segment, so their outline and links are read from the stored lines
+// without parsing the note again: the headings of a note in order, and the
+// targets of its links in order, `[text](target)` and `[[target|alias]]`
+// alike. Other notes have neither.
+
+// Part of a live document, its number there in `document`; -1 if it is
+// not in the snapshot
+static int find_document(search_index_t* index, const segment_snapshot_t* snapshot, const index_part_t* parts,
+                         int part_count, int document_id, int* document) {
+    struct search_segments* segments = index->segments;
+    pthread_mutex_lock(&segments->lock);
+    document_location_t location = document_id < segments->location_capacity
+                                       ? segments->locations[document_id]
+                                       : (document_location_t){ SEGMENT_NONE, 0 };
+    pthread_mutex_unlock(&segments->lock);
+    if (location.segment == SEGMENT_NONE) return -1;
+    int p = locate_document(snapshot, parts, part_count, location, document_id, document);
+    return p >= 0 && part_live(&parts[p], *document) ? p : -1;
+}
+
+search_heading_t* search_engine_outline(search_index_t* index, int document_id, int* count) {
+    if (!count) return NULL;
+    *count = 0;
+    if (!index || document_id < 0) return NULL;
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    if (!parts) return NULL;
+    int document = 0;
+    int p = find_document(index, reader.snapshot, parts, part_count, document_id, &document);
+    const index_part_t* part = p >= 0 && part_document_fields(&parts[p], document) ? &parts[p] : NULL;
+    
+    int heading_count = 0;
+    for (int l = 0; part && part_line(part, document, l); l++) {
+        if (search_field_kind(part_line_field(part, document, l)) == SEARCH_FIELD_HEADING) heading_count++;
+    }
+    search_heading_t* headings = heading_count > 0 ? calloc(heading_count, sizeof(search_heading_t)) : NULL;
+    bool ok = headings != NULL;
+    int h = 0;
+    const char* line;
+    for (int l = 0; ok && (line = part_line(part, document, l)); l++) {
+        uint8_t field = part_line_field(part, document, l);
+        if (search_field_kind(field) != SEARCH_FIELD_HEADING) continue;
+        size_t start;
+        size_t length = search_markdown_heading_text(line, strlen(line), &start);
+        headings[h].line_number = l;
+        headings[h].level = search_field_level(field);
+        headings[h].text = strndup(line + start, length);
+        ok = headings[h++].text != NULL;
+    }
+    release_parts(index, &reader, parts);
+    if (!ok) {
+        search_engine_free_outline(headings, h);
+        return NULL;
+    }
+    *count = heading_count;
+    return headings;
+}
+
+void search_engine_free_outline(search_heading_t* headings, int count) {
+    if (!headings) return;
+    for (int i = 0; i < count; i++) free(headings[i].text);
+    free(headings);
+}
+
+char** search_engine_links(search_index_t* index, int document_id, int* count) {
+    if (!count) return NULL;
+    *count = 0;
+    if (!index || document_id < 0) return NULL;
+    snapshot_reader_t reader;
+    int part_count;
+    index_part_t* parts = acquire_parts(index, &reader, &part_count);
+    if (!parts) return NULL;
+    int document = 0;
+    int p = find_document(index, reader.snapshot, parts, part_count, document_id, &document);
+    const index_part_t* part = p >= 0 && part_document_fields(&parts[p], document) ? &parts[p] : NULL;
+    
+    // Count, then copy
+    char** links = NULL;
+    int link_count = 0;
+    bool ok = true;
+    for (int pass = 0; ok && pass < 2; pass++) {
+        int found = 0;
+        const char* line;
+        for (int l = 0; part && (line = part_line(part, document, l)); l++) {
+            if (!(part_line_field(part, document, l) & SEARCH_FIELD_LINKS)) continue;
+            size_t length = strlen(line);
+            search_link_t link;
+            for (size_t from = 0; ok && search_markdown_next_link(line, length, from, &link); from = link.end) {
+                if (links) {
+                    links[found] = strndup(line + link.start, link.end - link.start);
+                    ok = links[found] != NULL;
+                }
+                if (ok) found++;
+            }
+        }
+        if (pass == 0) {
+            link_count = found;
+            links = found > 0 ? malloc(found * sizeof(char*)) : NULL;
+            ok = links != NULL;
+        } else if (!ok) {
+            search_engine_free_links(links, found);
+            links = NULL;
+        }
+    }
+    release_parts(index, &reader, parts);
+    if (!links) return NULL;
+    *count = link_count;
+    return links;
+}
+
+void search_engine_free_links(char** links, int count) {
+    if (!links) return;
+    for (int i = 0; i < count; i++) free(links[i]);
+    free(links);
+}
+
+// ============= COMPACTION =============
+
+// Merge the segments of a snapshot into one, without its deleted documents
+static search_segment_t* merge_snapshot(const segment_snapshot_t* snapshot) {
+    search_segment_input_t* inputs = malloc(snapshot->count * sizeof(search_segment_input_t));
+    if (!inputs) return NULL;
+    for (int i = 0; i < snapshot->count; i++) {
+        inputs[i] = (search_segment_input_t){ snapshot->segments[i]->segment, NULL, snapshot->deleted[i] };
+    }
+    search_segment_t* merged = search_segment_merge(inputs, snapshot->count);
+    free(inputs);
+    return merged;
+}
+
+// Index the live documents of a snapshot again from their text, in order,
+// into one segment, on one thread per CPU
+static search_segment_t* reindex_snapshot(const segment_snapshot_t* snapshot, bool field_indexing) {
+    int count = 0;
+    for (int i = 0; i < snapshot->count; i++) count += live_documents(snapshot, i);
+    if (count == 0) return merge_snapshot(snapshot);
+    
+    const char** filepaths = malloc(count * sizeof(char*));
+    char** contents = calloc(count, sizeof(char*));
+    int* ids = malloc(count * sizeof(int));
+    time_t* modified = malloc(count * sizeof(time_t));
+    bool ok = filepaths && contents && ids && modified;
+    int n = 0;
+    for (int i = 0; ok && i < snapshot->count; i++) {
+        const search_segment_t* segment = snapshot->segments[i]->segment;
+        for (int d = 0; ok && d < segment_documents(snapshot->segments[i]); d++) {
+            if (bit_test(snapshot->deleted[i], d)) continue;
+            
+            // Put the '\n' back between the stored lines
+            const search_segment_document_t* doc = &segment->documents[d];
+            contents[n] = malloc(doc->content_length + 1);
+            ok = contents[n] != NULL;
+            if (!ok) break;
+            memcpy(contents[n], segment->strings + doc->text_offset, doc->content_length + 1);
+            for (uint32_t l = 1; l < doc->line_count; l++) {
+                contents[n][segment->line_starts[doc->first_line + l] - 1] = '\n';
+            }
+            filepaths[n] = search_segment_path(segment, d);
+            ids[n] = (int)doc->document_id;
+            modified[n] = (time_t)doc->last_modified;
+            n++;
+        }
+    }
+    
+    search_segment_t* rebuilt = NULL;
+    int thread_count = bulk_thread_count(count, 0);
+    search_segment_t** built = ok ? calloc(thread_count, sizeof(search_segment_t*)) : NULL;
+    if (built) {
+        bulk_worker_t shared = { .filepaths = filepaths, .contents = (const char* const*)contents,
+                                 .document_ids = ids, .modified = modified, .field_indexing = field_indexing };
+        bool indexed = run_bulk_workers(&shared, count, thread_count, built);
+        if (indexed && thread_count == 1) {
+            rebuilt = built[0];
+            built[0] = NULL;
+        } else if (indexed) {
+            search_segment_input_t* inputs = malloc(thread_count * sizeof(search_segment_input_t));
+            for (int t = 0; inputs && t < thread_count; t++) {
+                inputs[t] = (search_segment_input_t){ built[t], NULL, NULL };
+            }
+            rebuilt = inputs ? search_segment_merge(inputs, thread_count) : NULL;
+            free(inputs);
+        }
+        for (int t = 0; t < thread_count; t++) search_segment_close(built[t]);
+        free(built);
+    }
+    for (int i = 0; contents && i < count; i++) free(contents[i]);
+    free(filepaths);
+    free(contents);
+    free(ids);
+    free(modified);
+    return rebuilt;
+}
+
+// Replace the published segments by one holding their live documents,
+// merged or indexed again. Writes go on meanwhile: documents deleted
+// during the build are deleted in the result, and segments flushed
+// meanwhile stay after it. Background merges wait.
+static int compact_segments(search_index_t* index, bool reindex) {
+    struct search_segments* segments = index->segments;
+    writer_lock(index);
+    int result = flush_memory(index);
+    bool field_indexing = index->field_indexing;
+    writer_unlock(index);
+    if (result != 0) return result;
+    
+    pthread_mutex_lock(&segments->lock);
+    while (segments->merging || segments->compacting) pthread_cond_wait(&segments->changed, &segments->lock);
+    segment_snapshot_t* base = snapshot_current_locked(segments);
+    bool compact = base->count > 1 || (base->count == 1 && (reindex ||
+                   live_documents(base, 0) < segment_documents(base->segments[0])));
+    if (!compact) {
+        pthread_mutex_unlock(&segments->lock);
+        return 0;
+    }
+    base->refcount++;
+    segments->compacting = true;
+    pthread_mutex_unlock(&segments->lock);
+    
+    search_segment_t* compacted = reindex ? reindex_snapshot(base, field_indexing) : merge_snapshot(base);
+    
+    pthread_mutex_lock(&segments->lock);
+    if (!compacted || !install_merge_locked(segments, base, 0, base->count, compacted)) {
+        search_segment_close(compacted);
+        result = -3;
+    }
+    snapshot_release_locked(base);
+    segments->compacting = false;
+    pthread_cond_broadcast(&segments->changed);
+    pthread_mutex_unlock(&segments->lock);
+    return result;
+}
+
+// Optimizing publishes the in-memory segment, then merges every segment
+// into one without the deleted documents, so queries read one sorted
+// dictionary and one run of postings per term; rebuilding does the same by
+// indexing the stored text again, on one thread per CPU, and applies the
+// current field indexing mode to every note
+int search_engine_rebuild_index(search_index_t* index) {
+    return index ? compact_segments(index, true) : -1;
+}
+
+int search_engine_optimize_index(search_index_t* index) {
+    return index ? compact_segments(index, false) : -1;
+}
+
+// ============= VALIDATION =============
+
+// A validation worker's share of a snapshot: every `stride`-th segment
+// from `first`
+typedef struct {
+    const segment_snapshot_t* snapshot;
+    int first;
+    int stride;
+    bool valid;
+    pthread_t thread;
+    bool started;
+} validate_worker_t;
+
+static void* validate_worker_main(void* arg) {
+    validate_worker_t* worker = arg;
+    worker->valid = true;
+    for (int i = worker->first; worker->valid && i < worker->snapshot->count; i += worker->stride) {
+        worker->valid = search_segment_validate(worker->snapshot->segments[i]->segment);
+    }
+    return NULL;
+}
+
+// The in-memory documents' lines and postings; the caller holds the
+// writer lock
+static bool memory_segment_valid(const search_index_t* index) {
+    uint32_t count = (uint32_t)index->memory_document_count;
+    for (uint32_t i = 0; i < count; i++) {
+        const search_document_t* doc = index->documents[i];
+        if (!doc || doc->line_count < 1 || doc->line_starts[0] != 0) return false;
+        for (int l = 1; l < doc->line_count; l++) {
+            uint32_t start = doc->line_starts[l];
+            if (start <= doc->line_starts[l - 1] || start > doc->content_length || doc->content[start - 1] != '\0') {
+                return false;
+            }
+        }
+    }
+    const word_index_t* dictionaries[2] = { index->word_index, index->trigram_index };
+    for (int k = 0; k < 2; k++) {
+        for (size_t e = 0; e < dictionaries[k]->entry_count; e++) {
+            const word_index_entry_t* entry = &dictionaries[k]->entries[e];
+            if (!posting_list_validate(entry->postings, count) ||
+                entry->occurrence_count != entry->postings->occurrence_count) {
+                return false;
+            }
+        }
+    }
+    return true;
 }
 
-void search_engine_optimize_index(search_index_t* index) {
-    // TODO: Implement index optimization
-    (void)index; // Suppress unused warning
+// Every live document is located in the current snapshot or the in-memory
+// segment, at a document of its id that is not deleted, and every
+// document not deleted (or queued for deletion) is located
+static bool locations_valid_locked(const search_index_t* index) {
+    struct search_segments* segments = index->segments;
+    const segment_snapshot_t* snapshot = snapshot_current_locked(segments);
+    int live = 0, in_memory = 0;
+    for (int id = 0; id < segments->location_capacity; id++) {
+        document_location_t location = segments->locations[id];
+        if (location.segment == SEGMENT_NONE) continue;
+        if (id >= segments->next_document_id) return false;
+        live++;
+        if (location.segment == SEGMENT_MEMORY) {
+            if (location.document >= (uint32_t)index->memory_document_count ||
+                index->documents[location.document]->document_id != id ||
+                bit_test(segments->memory_deleted, (int)location.document)) {
+                return false;
+            }
+            in_memory++;
+            continue;
+        }
+        int i = find_segment(snapshot, location.segment);
+        if (i < 0 || location.document >= (uint32_t)segment_documents(snapshot->segments[i]) ||
+            snapshot->segments[i]->segment->documents[location.document].document_id != (uint32_t)id ||
+            bit_test(snapshot->deleted[i], (int)location.document)) {
+            return false;
+        }
+    }
+    
+    int stored = -segments->pending_count;
+    for (int i = 0; i < snapshot->count; i++) stored += live_documents(snapshot, i);
+    int memory_live = 0;
+    for (int d = 0; d < index->memory_document_count; d++) {
+        if (!bit_test(segments->memory_deleted, d)) memory_live++;
+    }
+    return live == index->document_count && in_memory == memory_live && live - in_memory == stored;
 }
 
+// Segment checksums, document and line tables, sorted dictionaries,
+// postings in order and within bounds, and the document locations. The
+// in-memory segment and the locations are checked under the writer lock,
+// then the published segments on one thread per CPU while writes go on
 bool search_engine_validate_index(const search_index_t* index) {
-    // TODO: Implement index validation
-    return index != NULL;
+    if (!index) return false;
+    struct search_segments* segments = index->segments;
+    writer_lock(index);
+    pthread_mutex_lock(&segments->lock);
+    bool valid = locations_valid_locked(index);
+    segment_snapshot_t* snapshot = snapshot_current_locked(segments);
+    snapshot->refcount++;
+    pthread_mutex_unlock(&segments->lock);
+    valid = valid && memory_segment_valid(index);
+    pthread_mutex_unlock(&segments->writer);
+    
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int thread_count = cpus > 1 ? (int)cpus : 1;
+    if (thread_count > snapshot->count) thread_count = snapshot->count > 0 ? snapshot->count : 1;
+    validate_worker_t* workers = valid ? calloc(thread_count, sizeof(validate_worker_t)) : NULL;
+    valid = workers != NULL;
+    for (int t = 0; valid && t < thread_count; t++) {
+        workers[t] = (validate_worker_t){ .snapshot = snapshot, .first = t, .stride = thread_count };
+        workers[t].started = t > 0 && pthread_create(&workers[t].thread, NULL, validate_worker_main, &workers[t]) == 0;
+    }
+    for (int t = 0; valid && t < thread_count; t++) {
+        if (!workers[t].started) validate_worker_main(&workers[t]);
+    }
+    for (int t = 0; workers && t < thread_count; t++) {
+        if (workers[t].started) pthread_join(workers[t].thread, NULL);
+        if (!workers[t].valid) valid = false;
+    }
+    free(workers);
+    
+    pthread_mutex_lock(&segments->lock);
+    snapshot_release_locked(snapshot);
+    pthread_mutex_unlock(&segments->lock);
+    return valid;
 }
 
 void search_engine_set_embedding_dimension(search_index_t* index, int dimension) {
@@ -562,26 +4058,78 @@ void search_engine_enable_embeddings(search_index_t* index, bool enable) {
     }
 }
 
-int search_engine_save_index(const search_index_t* index, const char* filepath) {
-    // TODO: Implement index persistence
-    (void)index; (void)filepath; // Suppress unused warnings
-    return -1;
-}
-
-search_index_t* search_engine_load_index(const char* filepath) {
-    // TODO: Implement index loading
-    (void)filepath; // Suppress unused warning
-    return NULL;
+// Each line is classified as heading, body or code as the note is split
+// into lines, link targets not shown in the note are left out of its
+// words, and the fields boost ranking and drive heading:, code: and link:
+// queries
+void search_engine_set_field_indexing(search_index_t* index, bool enable) {
+    if (index) {
+        writer_lock(index);
+        index->field_indexing = enable;
+        writer_unlock(index);
+    }
 }
 
-int search_engine_remove_document(search_index_t* index, int document_id) {
-    // TODO: Implement document removal
-    (void)index; (void)document_id; // Suppress unused warnings
-    return -1;
+// Everything live is merged into one segment file, unpublished writes
+// included
+int search_engine_save_index(const search_index_t* index, const char* filepath) {
+    if (!index || !filepath) return -1;
+    struct search_segments* segments = index->segments;
+    writer_lock(index);
+    
+    // A private copy of the snapshot with the queued deletions applied; it
+    // holds its segments while merges go on
+    pthread_mutex_lock(&segments->lock);
+    segment_snapshot_t* deletions = snapshot_copy_locked(snapshot_current_locked(segments), 0);
+    for (int p = 0; deletions && p < segments->pending_count; p++) {
+        document_location_t location = segments->pending[p];
+        bit_set(deletions->deleted[find_segment(deletions, location.segment)], (int)location.document);
+    }
+    pthread_mutex_unlock(&segments->lock);
+    
+    search_segment_input_t* inputs =
+        deletions ? malloc((deletions->count + 1) * sizeof(search_segment_input_t)) : NULL;
+    search_segment_t* segment = NULL;
+    if (inputs) {
+        for (int i = 0; i < deletions->count; i++) {
+            inputs[i] = (search_segment_input_t){ deletions->segments[i]->segment, NULL, deletions->deleted[i] };
+        }
+        inputs[deletions->count] = (search_segment_input_t){ NULL, index, segments->memory_deleted };
+        segment = search_segment_merge(inputs, deletions->count + 1);
+    }
+    free(inputs);
+    if (deletions) {
+        pthread_mutex_lock(&segments->lock);
+        snapshot_release_locked(deletions);
+        pthread_mutex_unlock(&segments->lock);
+    }
+    pthread_mutex_unlock(&segments->writer);
+    if (!segment) return -1;
+    
+    int result = search_segment_write(segment, filepath);
+    search_segment_close(segment);
+    return result;
 }
 
-int search_engine_update_document(search_index_t* index, int document_id, const char* content) {
-    // TODO: Implement document updating
-    (void)index; (void)document_id; (void)content; // Suppress unused warnings
-    return -1;
+// The saved segment is mapped and searched in place; documents added
+// afterwards go to the in-memory segment as usual
+search_index_t* search_engine_load_index(const char* filepath) {
+    search_segment_t* segment = search_segment_open(filepath);
+    if (!segment) return NULL;
+    
+    int stored = search_segment_document_count(segment);
+    search_index_t* index = search_engine_create(stored * 2 > MEMORY_SEGMENT_DOCUMENTS
+                                                 ? stored * 2 : MEMORY_SEGMENT_DOCUMENTS);
+    if (!index) {
+        search_segment_close(segment);
+        return NULL;
+    }
+    if (stored > 0 && !add_segments(index->segments, &segment, 1, NULL, 0)) {
+        search_segment_close(segment);
+        search_engine_destroy(index);
+        return NULL;
+    }
+    if (stored == 0) search_segment_close(segment);
+    index->document_count = stored;
+    return index;
 }
@@ -22,7 +22,8 @@ typedef struct {
     char* query;
     bool case_sensitive;
     bool regex_mode;
-    bool whole_words_only;
+    bool boolean_mode;              // AND/OR/NOT and fields, see search_query.h
+    bool whole_words_only;          // ranked word search, else substrings
     bool fuzzy_search;
     float fuzzy_threshold;
     int max_results;
@@ -32,22 +33,41 @@ typedef struct {
 typedef struct {
     int document_id;
     char* filepath;
-    char* content;
-    char** lines;
+    char* content;                  // its lines, NUL-terminated in place of '\n'
+    uint32_t* line_starts;          // offset of each line in content
+    uint8_t* line_fields;           // markdown field of each line, NULL without field indexing
     int line_count;
+    int word_count;                 // indexed words, the BM25 length
     size_t content_length;
     time_t last_modified;
 } search_document_t;
 
 // Search index structure
 typedef struct {
+    // In-memory segment: documents added since the last flush, by local
+    // index. Only writers see it; searches see it once flushed.
     search_document_t** documents;
-    int document_count;
+    int memory_document_count;
+    int document_count;             // live documents in all segments
     int max_documents;
     
-    // Word index for fast searching
+    // Word index for fast searching (postings of `documents`)
     struct word_index* word_index;
     
+    // Trigram index for substring and regex search: the documents holding
+    // each trigram (see search_regex.h)
+    struct word_index* trigram_index;
+    
+    // Immutable segments, their deletions and background merging
+    struct search_segments* segments;
+    
+    // Prefix completions for live suggestions
+    struct search_suggestions* suggestions;
+    
+    // New documents are indexed by markdown field (see
+    // search_engine_set_field_indexing())
+    bool field_indexing;
+    
     // Embedding support (for future ML integration)
     float** embeddings;
     int embedding_dimension;
@@ -56,18 +76,25 @@ typedef struct {
 
 // Word index entry
 typedef struct word_index_entry {
-    char* word;
-    int* document_ids;
-    int* positions;
+    char* word;                     // interned in the word index string arena
+    struct posting_list* postings;  // compressed (document, line, position) list
     int occurrence_count;
-    struct word_index_entry* next;
 } word_index_entry_t;
 
-// Word index hash table
+// Word index slot: the term hash and its entry (index + 1, 0 when empty)
+typedef struct {
+    uint32_t hash;
+    uint32_t entry;
+} word_index_slot_t;
+
+// Word index: open-addressing (Robin Hood) table over a dense entry array
 typedef struct word_index {
-    word_index_entry_t** entries;
-    size_t table_size;
+    word_index_entry_t* entries;    // in insertion order
     size_t entry_count;
+    size_t entry_capacity;
+    word_index_slot_t* slots;
+    size_t table_size;              // slot count, a power of two
+    struct word_arena_block* arena; // term strings, never moved
 } word_index_t;
 
 // Search engine API
@@ -79,30 +106,80 @@ int search_engine_add_document(search_index_t* index, const char* filepath, cons
 int search_engine_remove_document(search_index_t* index, int document_id);
 int search_engine_update_document(search_index_t* index, int document_id, const char* content);
 
-// Search operations
+// Index on thread_count threads (0: one per CPU); first id, -2 when full
+int search_engine_add_documents(search_index_t* index, const char* const* filepaths, const char* const* contents,
+                                int count, int thread_count);
+
+// Search operations; query modes, syntax and ranking in search_query.h
 search_result_t* search_engine_search(search_index_t* index, const search_query_t* query, int* result_count);
 search_result_t* search_engine_search_fuzzy(search_index_t* index, const char* query, float threshold, int* result_count);
 search_result_t* search_engine_search_regex(search_index_t* index, const char* pattern, int* result_count);
 
+// Indexed words and note titles starting with `prefix`, most frequent first
+char** search_engine_suggest(search_index_t* index, const char* prefix, int max_suggestions, int* count);
+void search_engine_free_suggestions(char** suggestions, int count);
+
 // Advanced search features
 search_result_t* search_engine_search_similar(search_index_t* index, const char* text, int* result_count);
 search_result_t* search_engine_search_semantic(search_index_t* index, const char* query, int* result_count);
 
-// Indexing operations
-void search_engine_rebuild_index(search_index_t* index);
-void search_engine_optimize_index(search_index_t* index);
+// Maintenance, for idle time: one segment of the live documents; 0, or -3
+int search_engine_rebuild_index(search_index_t* index);
+int search_engine_optimize_index(search_index_t* index);
+
+// Segments: publish the writes so far (each write publishes on return, queued ones within a second)
+int search_engine_flush(search_index_t* index);
+void search_engine_wait_for_merges(search_index_t* index);
+int search_engine_segment_count(const search_index_t* index);
+
+// Snippets: per result, at most max_length bytes of its line around the terms
+typedef struct {
+    int start;                      // bytes, end excluded
+    int end;
+} search_highlight_t;
+
+typedef struct {
+    char* text;
+    int offset;                     // of text in the line
+    bool truncated;                 // the line goes on after text
+    search_highlight_t* highlights; // in text, in order
+    int highlight_count;
+} search_snippet_t;
+
+search_snippet_t* search_engine_snippets(search_index_t* index, const search_query_t* query,
+                                         const search_result_t* results, int count, int max_length);
+void search_engine_free_snippets(search_snippet_t* snippets, int count);
+
+// Note structure: headings and link targets of notes indexed by field
+typedef struct {
+    int line_number;
+    int level;                      // 1 to 6
+    char* text;                     // without the '#' markers
+} search_heading_t;
+
+search_heading_t* search_engine_outline(search_index_t* index, int document_id, int* count);
+void search_engine_free_outline(search_heading_t* headings, int count);
+char** search_engine_links(search_index_t* index, int document_id, int* count);
+void search_engine_free_links(char** links, int count);
 
 // Utility functions
 void search_engine_free_results(search_result_t* results, int count);
+// `text` with each range wrapped in the markers
+char* search_engine_render_highlights(const char* text, const search_highlight_t* highlights, int count,
+                                      const char* highlight_start, const char* highlight_end);
+// `text` with the words spelling a query term wrapped, ignoring case
 char* search_engine_highlight_matches(const char* text, const char* query, const char* highlight_start, const char* highlight_end);
 
 // Statistics and debugging
 void search_engine_print_stats(const search_index_t* index);
+// Check the segments and document locations, segments in parallel
 bool search_engine_validate_index(const search_index_t* index);
 
 // Configuration
 void search_engine_set_embedding_dimension(search_index_t* index, int dimension);
 void search_engine_enable_embeddings(search_index_t* index, bool enable);
+// Index notes added from now on by markdown field (off by default)
+void search_engine_set_field_indexing(search_index_t* index, bool enable);
 
 // Persistence (for saving/loading index)
 int search_engine_save_index(const search_index_t* index, const char* filepath);
@@ -0,0 +1,129 @@
+#include "search_markdown.h"
+#include "search_tokenizer.h"
+#include <string.h>
+
+bool search_field_valid(uint8_t field) {
+    int kind = search_field_kind(field);
+    int level = search_field_level(field);
+    if (field & ~(SEARCH_FIELD_KIND_MASK | SEARCH_FIELD_LEVEL_MASK | SEARCH_FIELD_LINKS)) return false;
+    if (kind == SEARCH_FIELD_HEADING) return level >= 1 && level <= 6;
+    return kind <= SEARCH_FIELD_CODE && level == 0;
+}
+
+size_t search_note_title(const char* path, const char** title) {
+    const char* name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    const char* dot = strrchr(name, '.');
+    *title = name;
+    return dot && dot != name ? (size_t)(dot - name) : strlen(name);
+}
+
+bool search_note_title_holds(const char* path, const char* folded, size_t folded_length) {
+    const char* title;
+    size_t length = search_note_title(path, &title);
+    search_tokenizer_t tokenizer;
+    search_token_t token;
+    search_tokenizer_init(&tokenizer, title, length);
+    while (search_tokenizer_next(&tokenizer, &token)) {
+        if (token.indexed && search_fold_equal(token.start, token.length, folded, folded_length)) return true;
+    }
+    return false;
+}
+
+static bool blank_from(const char* line, size_t length, size_t i) {
+    for (; i < length; i++) {
+        if (line[i] != ' ' && line[i] != '\t') return false;
+    }
+    return true;
+}
+
+uint8_t search_markdown_line(search_markdown_t* state, const char* line, size_t length) {
+    size_t indent = 0;
+    while (indent < length && indent < 4 && line[indent] == ' ') indent++;
+
+    // Fences open and close code blocks, and belong to them
+    if (indent < 4 && indent < length && (line[indent] == '`' || line[indent] == '~')) {
+        char c = line[indent];
+        size_t run = 0;
+        while (indent + run < length && line[indent + run] == c) run++;
+        size_t rest = indent + run;
+        if (run >= 3 && !state->fence && (c == '~' || !memchr(line + rest, '`', length - rest))) {
+            state->fence = c;
+            state->fence_length = run;
+            return SEARCH_FIELD_CODE;
+        }
+        if (run >= 3 && c == state->fence && run >= state->fence_length && blank_from(line, length, rest)) {
+            state->fence = 0;
+            return SEARCH_FIELD_CODE;
+        }
+    }
+    if (state->fence) return SEARCH_FIELD_CODE;
+
+    uint8_t field = SEARCH_FIELD_BODY;
+    size_t level = 0;
+    while (indent < 4 && indent + level < length && line[indent + level] == '#') level++;
+    if (level >= 1 && level <= 6 &&
+        (indent + level == length || line[indent + level] == ' ' || line[indent + level] == '\t')) {
+        field = (uint8_t)(SEARCH_FIELD_HEADING | level << SEARCH_FIELD_LEVEL_SHIFT);
+    }
+    search_link_t link;
+    if (search_markdown_next_link(line, length, 0, &link)) field |= SEARCH_FIELD_LINKS;
+    return field;
+}
+
+size_t search_markdown_heading_text(const char* line, size_t length, size_t* start) {
+    size_t i = 0;
+    while (i < length && line[i] == ' ') i++;
+    while (i < length && line[i] == '#') i++;
+    while (i < length && (line[i] == ' ' || line[i] == '\t')) i++;
+    size_t end = length;
+    while (end > i && (line[end - 1] == ' ' || line[end - 1] == '\t')) end--;
+
+    // An optional closing sequence of '#' after a space
+    size_t closing = end;
+    while (closing > i && line[closing - 1] == '#') closing--;
+    if (closing < end && (closing == i || line[closing - 1] == ' ' || line[closing - 1] == '\t')) {
+        end = closing;
+        while (end > i && (line[end - 1] == ' ' || line[end - 1] == '\t')) end--;
+    }
+    *start = i;
+    return end - i;
+}
+
+bool search_markdown_next_link(const char* line, size_t length, size_t from, search_link_t* link) {
+    bool bracket = memchr(line, '[', from < length ? from : length) != NULL;
+    for (size_t i = from; i + 1 < length; i++) {
+        if (line[i] == '[' && line[i + 1] == '[') {
+            // [[target]], [[target|alias]]
+            size_t start = i + 2;
+            size_t end = start;
+            while (end + 1 < length && !(line[end] == ']' && line[end + 1] == ']')) end++;
+            if (end + 1 >= length) return false;
+            size_t target_end = start;
+            while (target_end < end && line[target_end] != '|') target_end++;
+            if (target_end > start) {
+                *link = (search_link_t){ start, target_end, false };
+                return true;
+            }
+            i = end + 1;
+            continue;
+        }
+        if (line[i] == '[') bracket = true;
+        if (bracket && line[i] == ']' && line[i + 1] == '(') {
+            // [text](target "title"), [text](<target>)
+            size_t start = i + 2;
+            size_t end = start;
+            char close = ')';
+            if (start < length && line[start] == '<') {
+                close = '>';
+                end = ++start;
+            }
+            while (end < length && line[end] != close && (close == '>' || line[end] != ' ')) end++;
+            if (end < length && end > start) {
+                *link = (search_link_t){ start, end, true };
+                return true;
+            }
+        }
+    }
+    return false;
+}
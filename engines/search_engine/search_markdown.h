@@ -0,0 +1,66 @@
+#ifndef SEARCH_MARKDOWN_H
+#define SEARCH_MARKDOWN_H
+
+// Markdown structure of notes for field indexing (internal to the search
+// engine).
+//
+// Lines are classified in one pass, in order, as they are split: ATX
+// headings (`#` to `######` then a space), lines of fenced code blocks
+// (``` or ~~~, fences included) and body text. Links are `[text](target)`,
+// `![alt](target)` and `[[target]]` outside code; the target of the first
+// two is not shown in the rendered note, so it is not indexed as text.
+// A note's title is its file name without directory or extension.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A line's field byte: its kind, a heading's level and whether it links
+#define SEARCH_FIELD_BODY 0
+#define SEARCH_FIELD_HEADING 1
+#define SEARCH_FIELD_CODE 2
+#define SEARCH_FIELD_KIND_MASK 0x03
+#define SEARCH_FIELD_LEVEL_SHIFT 2      // 1 to 6 for headings, else 0
+#define SEARCH_FIELD_LEVEL_MASK 0x1C
+#define SEARCH_FIELD_LINKS 0x20
+
+static inline int search_field_kind(uint8_t field) {
+    return field & SEARCH_FIELD_KIND_MASK;
+}
+
+static inline int search_field_level(uint8_t field) {
+    return (field & SEARCH_FIELD_LEVEL_MASK) >> SEARCH_FIELD_LEVEL_SHIFT;
+}
+
+// Whether a byte is a field this classifier produces
+bool search_field_valid(uint8_t field);
+
+// Title of a note at `path`: its start in `path` and its length
+size_t search_note_title(const char* path, const char** title);
+
+// Whether a word of the note's title folds to `folded` (search_tokenizer.h)
+bool search_note_title_holds(const char* path, const char* folded, size_t folded_length);
+
+// Block state carried from line to line
+typedef struct {
+    char fence;                     // '`' or '~' inside a fenced code block, else 0
+    size_t fence_length;
+} search_markdown_t;
+
+// Field of the next line of a note (`length` bytes, no '\n')
+uint8_t search_markdown_line(search_markdown_t* state, const char* line, size_t length);
+
+// Text of a heading line: offset and length without its markers
+size_t search_markdown_heading_text(const char* line, size_t length, size_t* start);
+
+typedef struct {
+    size_t start;                   // the target, in bytes of the line
+    size_t end;
+    bool hidden;                    // a destination, not shown in the note
+} search_link_t;
+
+// First link of a line at or after byte `from`; false when there is none.
+// Scanning on from link->end finds the next one.
+bool search_markdown_next_link(const char* line, size_t length, size_t from, search_link_t* link);
+
+#endif // SEARCH_MARKDOWN_H
@@ -0,0 +1,550 @@
+#include "search_postings.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define POSTINGS_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define POSTINGS_NEON 1
+#endif
+
+// A frame is one bit-width byte followed by 128 values of that width,
+// interleaved over 4 lanes: value 4*i + lane is the i-th value of `lane`,
+// and lane words are interleaved the same way. A frame of width b takes
+// 16 * b bytes after its header.
+#define FRAME_VALUES POSTING_BLOCK_SIZE
+#define LANE_VALUES (FRAME_VALUES / 4)
+
+static inline int bits_needed(uint32_t value) {
+    return value ? 32 - __builtin_clz(value) : 0;
+}
+
+static uint8_t* write_frame(uint8_t* out, const uint32_t* values) {
+    uint32_t all = 0;
+    for (int i = 0; i < FRAME_VALUES; i++) all |= values[i];
+    int b = bits_needed(all);
+    *out++ = (uint8_t)b;
+    if (b == 0) return out;
+
+    for (int lane = 0; lane < 4; lane++) {
+        uint64_t acc = 0;
+        int bits = 0;
+        int word = 0;
+        for (int i = 0; i < LANE_VALUES; i++) {
+            acc |= (uint64_t)values[4 * i + lane] << bits;
+            bits += b;
+            if (bits >= 32) {
+                uint32_t w = (uint32_t)acc;
+                memcpy(out + 4 * (4 * word + lane), &w, 4);
+                word++;
+                acc >>= 32;
+                bits -= 32;
+            }
+        }
+    }
+    return out + 16 * b;
+}
+
+static inline const uint8_t* skip_frame(const uint8_t* in) {
+    return in + 1 + 16 * in[0];
+}
+
+static const uint8_t* read_frame(const uint8_t* in, uint32_t* values) {
+    int b = *in++;
+    if (b == 0) {
+        memset(values, 0, sizeof(uint32_t) * FRAME_VALUES);
+        return in;
+    }
+    uint32_t mask = b == 32 ? 0xFFFFFFFFu : (1u << b) - 1;
+
+#if POSTINGS_SSE2
+    const __m128i* words = (const __m128i*)in;
+    __m128i vmask = _mm_set1_epi32((int)mask);
+    __m128i current = _mm_loadu_si128(words++);
+    int shift = 0;
+    for (int i = 0; i < LANE_VALUES; i++) {
+        __m128i v = _mm_srl_epi32(current, _mm_cvtsi32_si128(shift));
+        if (shift + b > 32) {
+            current = _mm_loadu_si128(words++);
+            v = _mm_or_si128(v, _mm_sll_epi32(current, _mm_cvtsi32_si128(32 - shift)));
+            shift += b - 32;
+        } else if (shift + b == 32) {
+            if (i + 1 < LANE_VALUES) current = _mm_loadu_si128(words++);
+            shift = 0;
+        } else {
+            shift += b;
+        }
+        _mm_storeu_si128((__m128i*)(values + 4 * i), _mm_and_si128(v, vmask));
+    }
+#elif POSTINGS_NEON
+    const uint32_t* words = (const uint32_t*)in;
+    uint32x4_t vmask = vdupq_n_u32(mask);
+    uint32x4_t current = vld1q_u32(words);
+    words += 4;
+    int shift = 0;
+    for (int i = 0; i < LANE_VALUES; i++) {
+        uint32x4_t v = vshlq_u32(current, vdupq_n_s32(-shift));
+        if (shift + b > 32) {
+            current = vld1q_u32(words);
+            words += 4;
+            v = vorrq_u32(v, vshlq_u32(current, vdupq_n_s32(32 - shift)));
+            shift += b - 32;
+        } else if (shift + b == 32) {
+            if (i + 1 < LANE_VALUES) {
+                current = vld1q_u32(words);
+                words += 4;
+            }
+            shift = 0;
+        } else {
+            shift += b;
+        }
+        vst1q_u32(values + 4 * i, vandq_u32(v, vmask));
+    }
+#else
+    for (int lane = 0; lane < 4; lane++) {
+        uint64_t acc = 0;
+        int bits = 0;
+        int word = 0;
+        for (int i = 0; i < LANE_VALUES; i++) {
+            if (bits < b) {
+                uint32_t w;
+                memcpy(&w, in + 4 * (4 * word + lane), 4);
+                acc |= (uint64_t)w << bits;
+                word++;
+                bits += 32;
+            }
+            values[4 * i + lane] = (uint32_t)acc & mask;
+            acc >>= b;
+            bits -= b;
+        }
+    }
+#endif
+    return in + 16 * b;
+}
+
+// Undo the stride-4 delta coding: row i += row i-1, starting from `base`
+static void prefix_sum_d4(uint32_t* values, uint32_t base) {
+#if POSTINGS_SSE2
+    __m128i previous = _mm_set1_epi32((int)base);
+    for (int i = 0; i < FRAME_VALUES; i += 4) {
+        __m128i v = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(values + i)), previous);
+        _mm_storeu_si128((__m128i*)(values + i), v);
+        previous = v;
+    }
+#elif POSTINGS_NEON
+    uint32x4_t previous = vdupq_n_u32(base);
+    for (int i = 0; i < FRAME_VALUES; i += 4) {
+        uint32x4_t v = vaddq_u32(vld1q_u32(values + i), previous);
+        vst1q_u32(values + i, v);
+        previous = v;
+    }
+#else
+    for (int i = 0; i < FRAME_VALUES; i++) {
+        values[i] += i < 4 ? base : values[i - 4];
+    }
+#endif
+}
+
+// ============= WRITING =============
+
+void posting_list_init(posting_list_t* list) {
+    memset(list, 0, sizeof(*list));
+}
+
+void posting_list_free(posting_list_t* list) {
+    if (!list) return;
+    free(list->data);
+    free(list->skips);
+    free(list->tail_documents);
+    free(list->tail_frequencies);
+    free(list->tail_lines);
+    free(list->tail_positions);
+    memset(list, 0, sizeof(*list));
+}
+
+static bool grow(void** array, int* capacity, int needed, size_t item_size, int initial) {
+    if (needed <= *capacity) return true;
+    int new_capacity = *capacity ? *capacity : initial;
+    while (new_capacity < needed) new_capacity *= 2;
+    void* grown = realloc(*array, new_capacity * item_size);
+    if (!grown) return false;
+    *array = grown;
+    *capacity = new_capacity;
+    return true;
+}
+
+// Pack documents (at most one block) and their occurrence gaps as a new block
+static bool append_block(posting_list_t* list, const uint32_t* documents, const uint32_t* frequencies,
+                         int n, const uint32_t* lines, const uint32_t* positions, int occurrences) {
+    int chunks = (occurrences + FRAME_VALUES - 1) / FRAME_VALUES;
+    size_t bound = 1 + 2 * (1 + 16 * 32) + (size_t)chunks * 2 * (1 + 16 * 32);
+
+    int capacity = (int)list->capacity;
+    if (!grow((void**)&list->data, &capacity, (int)(list->size + bound), 1, 4096)) return false;
+    list->capacity = (uint32_t)capacity;
+    if (!grow((void**)&list->skips, &list->skip_capacity, list->block_count + 1,
+              sizeof(posting_skip_t), 4)) {
+        return false;
+    }
+
+    uint32_t values[FRAME_VALUES];
+    uint32_t base = list->block_count ? list->skips[list->block_count - 1].last_document : 0;
+    uint8_t* out = list->data + list->size;
+    *out++ = (uint8_t)(n - 1);
+
+    // Stride-4 document deltas; padding repeats the last document
+    for (int i = 0; i < FRAME_VALUES; i++) {
+        uint32_t document = documents[i < n ? i : n - 1];
+        uint32_t previous = i < 4 ? base : documents[i - 4 < n ? i - 4 : n - 1];
+        values[i] = document - previous;
+    }
+    out = write_frame(out, values);
+
+    for (int i = 0; i < FRAME_VALUES; i++) {
+        values[i] = i < n ? frequencies[i] - 1 : 0;
+    }
+    out = write_frame(out, values);
+
+    uint32_t position_values[FRAME_VALUES];
+    for (int chunk = 0; chunk < chunks; chunk++) {
+        for (int i = 0; i < FRAME_VALUES; i++) {
+            int k = chunk * FRAME_VALUES + i;
+            values[i] = k < occurrences ? lines[k] : 0;
+            position_values[i] = k < occurrences ? positions[k] : 0;
+        }
+        out = write_frame(out, values);
+        out = write_frame(out, position_values);
+    }
+
+    uint32_t max_frequency = 0;
+    for (int i = 0; i < n; i++) {
+        if (frequencies[i] > max_frequency) max_frequency = frequencies[i];
+    }
+    list->skips[list->block_count].last_document = documents[n - 1];
+    list->skips[list->block_count].offset = list->size;
+    list->skips[list->block_count].max_frequency = max_frequency;
+    list->skips[list->block_count].min_length = 0;
+    list->skips[list->block_count].fields = 0;
+    list->block_count++;
+    list->size = (uint32_t)(out - list->data);
+    return true;
+}
+
+static bool flush_tail(posting_list_t* list) {
+    if (!append_block(list, list->tail_documents, list->tail_frequencies, list->tail_count,
+                      list->tail_lines, list->tail_positions, list->tail_occurrences)) {
+        return false;
+    }
+    list->tail_count = 0;
+    list->tail_occurrences = 0;
+    return true;
+}
+
+bool posting_list_add(posting_list_t* list, uint32_t document, uint32_t line, uint32_t position) {
+    bool same_document = list->tail_count > 0 &&
+                         list->tail_documents[list->tail_count - 1] == document;
+    if (!same_document) {
+        if (list->tail_count == POSTING_BLOCK_SIZE && !flush_tail(list)) return false;
+        if (!grow((void**)&list->tail_documents, &list->tail_capacity, list->tail_count + 1,
+                  sizeof(uint32_t), 4)) {
+            return false;
+        }
+        int capacity = list->tail_capacity;
+        void* frequencies = realloc(list->tail_frequencies, capacity * sizeof(uint32_t));
+        if (!frequencies) return false;
+        list->tail_frequencies = frequencies;
+    }
+
+    int occurrence_capacity = list->tail_occurrence_capacity;
+    if (!grow((void**)&list->tail_lines, &occurrence_capacity, list->tail_occurrences + 1,
+              sizeof(uint32_t), 4)) {
+        return false;
+    }
+    if (occurrence_capacity != list->tail_occurrence_capacity) {
+        void* positions = realloc(list->tail_positions, occurrence_capacity * sizeof(uint32_t));
+        if (!positions) return false;
+        list->tail_positions = positions;
+        list->tail_occurrence_capacity = occurrence_capacity;
+    }
+
+    if (same_document) {
+        list->tail_frequencies[list->tail_count - 1]++;
+        list->tail_lines[list->tail_occurrences] = line - list->last_line;
+        list->tail_positions[list->tail_occurrences] = position - list->last_position;
+    } else {
+        list->tail_documents[list->tail_count] = document;
+        list->tail_frequencies[list->tail_count] = 1;
+        list->tail_count++;
+        list->document_count++;
+        list->tail_lines[list->tail_occurrences] = line;
+        list->tail_positions[list->tail_occurrences] = position;
+    }
+    list->tail_occurrences++;
+    list->occurrence_count++;
+    list->last_line = line;
+    list->last_position = position;
+    return true;
+}
+
+bool posting_list_pack(const posting_list_t* list, posting_list_t* packed) {
+    posting_list_init(packed);
+    if (list->size > 0) {
+        packed->data = malloc(list->size);
+        packed->skips = malloc(list->block_count * sizeof(posting_skip_t));
+        if (!packed->data || !packed->skips) {
+            posting_list_free(packed);
+            return false;
+        }
+        memcpy(packed->data, list->data, list->size);
+        memcpy(packed->skips, list->skips, list->block_count * sizeof(posting_skip_t));
+        packed->size = packed->capacity = list->size;
+        packed->block_count = packed->skip_capacity = list->block_count;
+    }
+    if (list->tail_count > 0 &&
+        !append_block(packed, list->tail_documents, list->tail_frequencies, list->tail_count,
+                      list->tail_lines, list->tail_positions, list->tail_occurrences)) {
+        posting_list_free(packed);
+        return false;
+    }
+    packed->document_count = list->document_count;
+    packed->occurrence_count = list->occurrence_count;
+    return true;
+}
+
+void posting_list_view(posting_list_t* list, const uint8_t* data, uint32_t size,
+                       const posting_skip_t* skips, int block_count,
+                       int document_count, int occurrence_count) {
+    posting_list_init(list);
+    list->data = (uint8_t*)data;
+    list->size = size;
+    list->skips = (posting_skip_t*)skips;
+    list->block_count = block_count;
+    list->document_count = document_count;
+    list->occurrence_count = occurrence_count;
+}
+
+void posting_list_set_lengths(posting_list_t* list, const uint32_t* lengths) {
+    uint32_t documents[FRAME_VALUES];
+    for (int block = 0; block < list->block_count; block++) {
+        const uint8_t* in = list->data + list->skips[block].offset;
+        int n = *in++ + 1;
+        read_frame(in, documents);
+        prefix_sum_d4(documents, block ? list->skips[block - 1].last_document : 0);
+        uint32_t min_length = UINT32_MAX;
+        for (int i = 0; i < n; i++) {
+            if (lengths[documents[i]] < min_length) min_length = lengths[documents[i]];
+        }
+        list->skips[block].min_length = min_length;
+    }
+}
+
+size_t posting_list_memory(const posting_list_t* list) {
+    return list->capacity + list->skip_capacity * sizeof(posting_skip_t) +
+           list->tail_capacity * 2 * sizeof(uint32_t) +
+           list->tail_occurrence_capacity * 2 * sizeof(uint32_t);
+}
+
+bool posting_list_validate(const posting_list_t* list, uint32_t document_count) {
+    // Skips first: the cursor trusts them and the block headers
+    for (int block = 0; block < list->block_count; block++) {
+        const posting_skip_t* skip = &list->skips[block];
+        if (skip->offset >= list->size || list->data[skip->offset] >= POSTING_BLOCK_SIZE) return false;
+        if (block > 0 && (skip->offset <= skip[-1].offset || skip->last_document <= skip[-1].last_document)) {
+            return false;
+        }
+    }
+
+    posting_cursor_t cursor;
+    int documents = 0, occurrences = 0;
+    uint32_t document = 0, line = 0, position = 0;
+    for (posting_cursor_init(&cursor, list); !cursor.done; posting_cursor_next(&cursor)) {
+        if (cursor.document >= document_count) return false;
+        if (occurrences == 0 || cursor.document != document) {
+            if (occurrences > 0 && cursor.document < document) return false;
+            if (cursor.block < list->block_count && cursor.doc_index == cursor.doc_count - 1 &&
+                cursor.document != list->skips[cursor.block].last_document) {
+                return false;
+            }
+            documents++;
+        } else if (cursor.line < line || (cursor.line == line && cursor.position <= position)) {
+            return false;
+        }
+        document = cursor.document;
+        line = cursor.line;
+        position = cursor.position;
+        occurrences++;
+    }
+    return documents == list->document_count && occurrences == list->occurrence_count;
+}
+
+// ============= READING =============
+
+static bool load_block(posting_cursor_t* cursor, int block) {
+    const posting_list_t* list = cursor->list;
+    cursor->block = block;
+    cursor->doc_index = 0;
+    cursor->doc_occurrence_start = 0;
+
+    if (block == list->block_count) {
+        if (list->tail_count == 0) return false;
+        cursor->doc_count = list->tail_count;
+        memcpy(cursor->documents, list->tail_documents, list->tail_count * sizeof(uint32_t));
+        memcpy(cursor->frequencies, list->tail_frequencies, list->tail_count * sizeof(uint32_t));
+        cursor->raw_lines = list->tail_lines;
+        cursor->raw_positions = list->tail_positions;
+        return true;
+    }
+    if (block > list->block_count) return false;
+
+    const uint8_t* in = list->data + list->skips[block].offset;
+    cursor->doc_count = *in++ + 1;
+    in = read_frame(in, cursor->documents);
+    prefix_sum_d4(cursor->documents, block ? list->skips[block - 1].last_document : 0);
+    in = read_frame(in, cursor->frequencies);
+    for (int i = 0; i < cursor->doc_count; i++) cursor->frequencies[i]++;
+
+    cursor->raw_lines = NULL;
+    cursor->raw_positions = NULL;
+    cursor->chunk_data = in;
+    cursor->chunk = 0;
+    cursor->decoded_chunk = -1;
+    return true;
+}
+
+// Line and position gaps of occurrence `k` of the current block
+static inline void occurrence_gaps(posting_cursor_t* cursor, int k, uint32_t* line_gap,
+                                   uint32_t* position_gap) {
+    if (cursor->raw_lines) {
+        *line_gap = cursor->raw_lines[k];
+        *position_gap = cursor->raw_positions[k];
+        return;
+    }
+
+    int chunk = k / FRAME_VALUES;
+    if (chunk != cursor->decoded_chunk) {
+        while (cursor->chunk < chunk) {
+            cursor->chunk_data = skip_frame(skip_frame(cursor->chunk_data));
+            cursor->chunk++;
+        }
+        read_frame(read_frame(cursor->chunk_data, cursor->line_gaps), cursor->position_gaps);
+        cursor->decoded_chunk = chunk;
+    }
+    *line_gap = cursor->line_gaps[k % FRAME_VALUES];
+    *position_gap = cursor->position_gaps[k % FRAME_VALUES];
+}
+
+static void enter_document(posting_cursor_t* cursor) {
+    cursor->occurrence_in_doc = 0;
+    cursor->document = cursor->documents[cursor->doc_index];
+    cursor->pending = false;
+    occurrence_gaps(cursor, cursor->doc_occurrence_start, &cursor->line, &cursor->position);
+}
+
+static inline void decode_pending(posting_cursor_t* cursor) {
+    if (cursor->pending) enter_document(cursor);
+}
+
+void posting_cursor_init(posting_cursor_t* cursor, const posting_list_t* list) {
+    cursor->list = list;
+    cursor->pending = false;
+    cursor->done = !load_block(cursor, 0);
+    if (!cursor->done) enter_document(cursor);
+}
+
+bool posting_cursor_next(posting_cursor_t* cursor) {
+    if (cursor->done) return false;
+    decode_pending(cursor);
+
+    if (++cursor->occurrence_in_doc < (int)cursor->frequencies[cursor->doc_index]) {
+        uint32_t line_gap, position_gap;
+        occurrence_gaps(cursor, cursor->doc_occurrence_start + cursor->occurrence_in_doc,
+                        &line_gap, &position_gap);
+        cursor->line += line_gap;
+        cursor->position += position_gap;
+        return true;
+    }
+
+    cursor->doc_occurrence_start += cursor->frequencies[cursor->doc_index];
+    if (++cursor->doc_index >= cursor->doc_count && !load_block(cursor, cursor->block + 1)) {
+        cursor->done = true;
+        return false;
+    }
+    enter_document(cursor);
+    return true;
+}
+
+bool posting_cursor_seek_document(posting_cursor_t* cursor, uint32_t document) {
+    if (cursor->done) return false;
+    if (cursor->document >= document) return true;
+
+    // Jump over whole blocks with the skip entries
+    if (document > cursor->documents[cursor->doc_count - 1]) {
+        const posting_list_t* list = cursor->list;
+        int lo = cursor->block + 1, hi = list->block_count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (list->skips[mid].last_document < document) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        if (!load_block(cursor, lo) || document > cursor->documents[cursor->doc_count - 1]) {
+            cursor->done = true;
+            return false;
+        }
+    }
+
+    // Skip documents inside the block without reading their occurrences
+    while (cursor->documents[cursor->doc_index] < document) {
+        cursor->doc_occurrence_start += cursor->frequencies[cursor->doc_index];
+        cursor->doc_index++;
+    }
+    cursor->occurrence_in_doc = 0;
+    cursor->document = cursor->documents[cursor->doc_index];
+    cursor->pending = true;
+    return true;
+}
+
+bool posting_cursor_seek(posting_cursor_t* cursor, uint32_t document, uint32_t line) {
+    if (cursor->done) return false;
+    if (cursor->document < document && !posting_cursor_seek_document(cursor, document)) return false;
+    decode_pending(cursor);
+    if (cursor->document > document || cursor->line >= line) return true;
+
+    while (cursor->document == document && cursor->line < line) {
+        if (!posting_cursor_next(cursor)) return false;
+    }
+    return true;
+}
+
+bool posting_cursor_block_bound(const posting_cursor_t* cursor, uint32_t document,
+                                posting_skip_t* bound) {
+    if (cursor->done) return false;
+    const posting_list_t* list = cursor->list;
+    int lo = cursor->block, hi = list->block_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (list->skips[mid].last_document < document) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < list->block_count) {
+        *bound = list->skips[lo];
+        return true;
+    }
+    if (list->tail_count == 0 || list->tail_documents[list->tail_count - 1] < document) return false;
+    bound->last_document = UINT32_MAX;
+    bound->offset = 0;
+    bound->max_frequency = 0;
+    bound->min_length = 0;
+    bound->fields = 0;
+    for (int i = 0; i < list->tail_count; i++) {
+        if (list->tail_frequencies[i] > bound->max_frequency) bound->max_frequency = list->tail_frequencies[i];
+    }
+    return true;
+}
@@ -0,0 +1,126 @@
+#ifndef SEARCH_POSTINGS_H
+#define SEARCH_POSTINGS_H
+
+// Compressed posting lists (internal to the search engine).
+//
+// A posting list holds the occurrences of one term as (document, line,
+// position), sorted. Documents are grouped in blocks of
+// POSTING_BLOCK_SIZE: document ids are delta coded with a stride of 4 and
+// bit-packed in frames of 128 values over 4 interleaved 32-bit lanes, so
+// decoding is a SIMD unpack plus one vector add per row. Each block stores
+// the term frequency of its documents, then the line and position gaps of
+// their occurrences, also in 128-value frames. A skip entry per block lets
+// readers jump over blocks without decoding them. Documents are appended to
+// an uncompressed tail until a block is full.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define POSTING_BLOCK_SIZE 128
+
+typedef struct {
+    uint32_t last_document;
+    uint32_t offset;                // byte offset of the block in `data`
+    uint32_t max_frequency;         // score bounds of the block's documents
+    uint32_t min_length;            // shortest document, 0 when unknown
+    uint32_t fields;                // fields of its occurrences (search_segment.h), 0 when unknown
+} posting_skip_t;
+
+typedef struct posting_list {
+    uint8_t* data;                  // packed blocks
+    uint32_t size;
+    uint32_t capacity;
+    posting_skip_t* skips;
+    int block_count;
+    int skip_capacity;
+
+    // Append buffer: documents not packed yet, occurrences as gaps
+    uint32_t* tail_documents;
+    uint32_t* tail_frequencies;
+    int tail_count;
+    int tail_capacity;
+    uint32_t* tail_lines;
+    uint32_t* tail_positions;
+    int tail_occurrences;
+    int tail_occurrence_capacity;
+    uint32_t last_line;
+    uint32_t last_position;
+
+    int document_count;
+    int occurrence_count;
+} posting_list_t;
+
+void posting_list_init(posting_list_t* list);
+void posting_list_free(posting_list_t* list);
+
+// Occurrences must be added in (document, line, position) order
+bool posting_list_add(posting_list_t* list, uint32_t document, uint32_t line, uint32_t position);
+
+// Copy of `list` with its tail packed as a final, possibly partial, block:
+// the form stored in segments. The copy owns its buffers.
+bool posting_list_pack(const posting_list_t* list, posting_list_t* packed);
+
+// Read-only list over packed blocks owned elsewhere (no tail). Views are
+// never added to or freed.
+void posting_list_view(posting_list_t* list, const uint8_t* data, uint32_t size,
+                       const posting_skip_t* skips, int block_count,
+                       int document_count, int occurrence_count);
+
+// Set the min_length of every block from `lengths`, indexed by document
+void posting_list_set_lengths(posting_list_t* list, const uint32_t* lengths);
+
+// Whether the list decodes to occurrences in strictly increasing
+// (document, line, position) order, with documents below document_count,
+// block bounds matching the skips, and its counts
+bool posting_list_validate(const posting_list_t* list, uint32_t document_count);
+
+// Bytes used by the list, excluding the struct itself
+size_t posting_list_memory(const posting_list_t* list);
+
+// Forward reader over the occurrences of a list
+typedef struct {
+    const posting_list_t* list;
+    int block;                      // block being read; block_count means the tail
+    int doc_count;
+    int doc_index;
+    uint32_t documents[POSTING_BLOCK_SIZE];
+    uint32_t frequencies[POSTING_BLOCK_SIZE];
+
+    // Occurrence gaps of the current block
+    const uint32_t* raw_lines;      // tail: gaps read in place
+    const uint32_t* raw_positions;
+    const uint8_t* chunk_data;      // packed: frame pair of chunk `chunk`
+    int chunk;
+    int decoded_chunk;
+    uint32_t line_gaps[POSTING_BLOCK_SIZE];
+    uint32_t position_gaps[POSTING_BLOCK_SIZE];
+    int doc_occurrence_start;       // index of the current document's first occurrence
+    int occurrence_in_doc;
+    bool pending;                   // document entered, its occurrence not decoded yet
+
+    bool done;
+    uint32_t document;              // current occurrence
+    uint32_t line;
+    uint32_t position;
+} posting_cursor_t;
+
+// Positions the cursor on the first occurrence (done if the list is empty)
+void posting_cursor_init(posting_cursor_t* cursor, const posting_list_t* list);
+bool posting_cursor_next(posting_cursor_t* cursor);
+
+// Advance to the first occurrence at or after (document, line)
+bool posting_cursor_seek(posting_cursor_t* cursor, uint32_t document, uint32_t line);
+
+// Advance to the first document at or after `document` without decoding
+// its occurrences: `line` and `position` are not valid until the next
+// posting_cursor_next() or posting_cursor_seek(), which decode them.
+bool posting_cursor_seek_document(posting_cursor_t* cursor, uint32_t document);
+
+// Bounds of the block at or after the cursor that would hold `document`,
+// read from the skips without decoding. The tail reports UINT32_MAX as its
+// last document. False when the list ends before `document`.
+bool posting_cursor_block_bound(const posting_cursor_t* cursor, uint32_t document,
+                                posting_skip_t* bound);
+
+#endif // SEARCH_POSTINGS_H
@@ -0,0 +1,322 @@
+#define _POSIX_C_SOURCE 200809L
+#include "search_query.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#define MAX_QUERY_DEPTH 64              // nested groups and negations
+
+typedef enum {
+    TOKEN_END,
+    TOKEN_OPEN,
+    TOKEN_CLOSE,
+    TOKEN_AND,
+    TOKEN_OR,
+    TOKEN_NOT,                      // NOT, or '-' before a clause
+    TOKEN_CLAUSE,                   // a word, "phrase" or field:value
+} token_kind_t;
+
+typedef struct {
+    token_kind_t kind;
+    const char* start;
+    const char* end;
+} query_token_t;
+
+typedef struct {
+    const char* next;
+    int depth;
+    int clause_count;
+} query_parser_t;
+
+static const struct {
+    const char* name;
+    query_kind_t kind;
+} fields[] = {
+    { "title", QUERY_TITLE },
+    { "tag", QUERY_TAG },
+    { "path", QUERY_PATH },
+    { "ext", QUERY_EXT },
+    { "modified", QUERY_MODIFIED },
+    { "heading", QUERY_HEADING },
+    { "code", QUERY_CODE },
+    { "link", QUERY_LINK },
+};
+
+// Kind of the field named by `length` bytes of `name`, or QUERY_TEXT
+static query_kind_t field_kind(const char* name, size_t length) {
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        if (strlen(fields[i].name) == length && strncasecmp(name, fields[i].name, length) == 0) {
+            return fields[i].kind;
+        }
+    }
+    return QUERY_TEXT;
+}
+
+// End of a quoted string opening at `quote`: past its closing quote, or the
+// end of the query
+static const char* quoted_end(const char* quote) {
+    const char* close = strchr(quote + 1, '"');
+    return close ? close + 1 : quote + strlen(quote);
+}
+
+// The token at `p`; returns the position after it
+static const char* lex(const char* p, query_token_t* token) {
+    while (isspace((unsigned char)*p)) p++;
+    token->start = p;
+    token->end = p + 1;
+    if (*p == '\0') {
+        token->kind = TOKEN_END;
+        token->end = p;
+    } else if (*p == '(') {
+        token->kind = TOKEN_OPEN;
+    } else if (*p == ')') {
+        token->kind = TOKEN_CLOSE;
+    } else if (*p == '-' && p[1] && !isspace((unsigned char)p[1]) && p[1] != ')') {
+        token->kind = TOKEN_NOT;
+    } else if (*p == '"') {
+        token->kind = TOKEN_CLAUSE;
+        token->end = quoted_end(p);
+    } else {
+        const char* q = p;
+        while (*q && !isspace((unsigned char)*q) && *q != '(' && *q != ')' && *q != '"') q++;
+        size_t length = (size_t)(q - p);
+        token->kind = TOKEN_CLAUSE;
+        token->end = q;
+        if (*q == '"' && q[-1] == ':' && field_kind(p, length - 1) != QUERY_TEXT) {
+            token->end = quoted_end(q);
+        } else if (length == 3 && memcmp(p, "AND", 3) == 0) {
+            token->kind = TOKEN_AND;
+        } else if (length == 2 && memcmp(p, "OR", 2) == 0) {
+            token->kind = TOKEN_OR;
+        } else if (length == 3 && memcmp(p, "NOT", 3) == 0) {
+            token->kind = TOKEN_NOT;
+        }
+    }
+    return token->end;
+}
+
+static token_kind_t peek(const query_parser_t* parser) {
+    query_token_t token;
+    lex(parser->next, &token);
+    return token.kind;
+}
+
+static query_node_t* node_create(query_kind_t kind) {
+    query_node_t* node = calloc(1, sizeof(query_node_t));
+    if (!node) return NULL;
+    node->kind = kind;
+    node->clause = -1;
+    node->after = INT64_MIN;
+    node->before = INT64_MAX;
+    return node;
+}
+
+void search_query_free(query_node_t* node) {
+    if (!node) return;
+    for (int i = 0; i < node->child_count; i++) search_query_free(node->children[i]);
+    free(node->children);
+    free(node->text);
+    free(node);
+}
+
+// Add `child` to an AND or OR node, flattening nodes of the same kind.
+// Takes ownership of `child`.
+static bool node_add(query_node_t* node, query_node_t* child) {
+    int added = child->kind == node->kind ? child->child_count : 1;
+    query_node_t** children = realloc(node->children, (node->child_count + added) * sizeof(query_node_t*));
+    if (!children) {
+        search_query_free(child);
+        return false;
+    }
+    node->children = children;
+    if (child->kind != node->kind) {
+        children[node->child_count++] = child;
+        return true;
+    }
+    memcpy(children + node->child_count, child->children, added * sizeof(query_node_t*));
+    node->child_count += added;
+    child->child_count = 0;
+    search_query_free(child);
+    return true;
+}
+
+// Start of a local day plus `days`, normalized by mktime
+static int64_t day_start(int year, int month, int day, int days) {
+    struct tm date = {0};
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day + days;
+    date.tm_isdst = -1;
+    return (int64_t)mktime(&date);
+}
+
+// Set the interval of a modified: clause from `> >= < <= =` and a date
+static bool parse_modified(query_node_t* node, const char* value) {
+    const char* op = value;
+    while (*value == '<' || *value == '>' || *value == '=') value++;
+    size_t op_length = (size_t)(value - op);
+    int year, month, day, length = 0;
+    if (sscanf(value, "%4d-%2d-%2d%n", &year, &month, &day, &length) != 3 || value[length] != '\0' ||
+        month < 1 || month > 12 || day < 1 || day > 31) {
+        return false;
+    }
+    // Reject days the month does not have, which mktime would carry over
+    struct tm date = {0};
+    date.tm_year = year - 1900;
+    date.tm_mon = month - 1;
+    date.tm_mday = day;
+    date.tm_isdst = -1;
+    if (mktime(&date) == (time_t)-1 || date.tm_mday != day) return false;
+
+    int64_t start = day_start(year, month, day, 0);
+    int64_t next = day_start(year, month, day, 1);
+    if (op_length == 0 || (op_length == 1 && *op == '=')) {
+        node->after = start;
+        node->before = next;
+    } else if (op_length == 1 && *op == '>') {
+        node->after = next;
+    } else if (op_length == 2 && memcmp(op, ">=", 2) == 0) {
+        node->after = start;
+    } else if (op_length == 1 && *op == '<') {
+        node->before = start;
+    } else if (op_length == 2 && memcmp(op, "<=", 2) == 0) {
+        node->before = next;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// A word, "phrase" or field:value clause
+static query_node_t* parse_clause(query_parser_t* parser, const query_token_t* token) {
+    const char* value = token->start;
+    query_kind_t kind = QUERY_TEXT;
+    const char* colon = memchr(value, ':', (size_t)(token->end - value));
+    if (*value != '"' && colon) {
+        kind = field_kind(value, (size_t)(colon - value));
+        if (kind != QUERY_TEXT) value = colon + 1;
+    }
+    const char* end = token->end;
+    bool phrase = *value == '"';
+    if (phrase) {
+        value++;
+        if (end > value && end[-1] == '"') end--;
+    }
+    if (kind == QUERY_TAG && value < end && *value == '#') value++;
+    if (kind == QUERY_EXT && value < end && *value == '.') value++;
+    if (value >= end) return NULL;
+
+    query_node_t* node = node_create(kind);
+    if (!node) return NULL;
+    node->text = strndup(value, (size_t)(end - value));
+    node->phrase = phrase;
+    if (!node->text || (kind == QUERY_MODIFIED && !parse_modified(node, node->text))) {
+        search_query_free(node);
+        return NULL;
+    }
+    if (kind == QUERY_TEXT || kind == QUERY_TITLE || kind == QUERY_TAG || kind == QUERY_HEADING ||
+        kind == QUERY_CODE) {
+        node->clause = parser->clause_count++;
+    }
+    return node;
+}
+
+static query_node_t* parse_or(query_parser_t* parser);
+
+// A clause, group or negation
+static query_node_t* parse_unary(query_parser_t* parser) {
+    query_token_t token;
+    parser->next = lex(parser->next, &token);
+    if (token.kind == TOKEN_CLAUSE) return parse_clause(parser, &token);
+    if (token.kind != TOKEN_OPEN && token.kind != TOKEN_NOT) return NULL;
+    if (++parser->depth > MAX_QUERY_DEPTH) return NULL;
+
+    query_node_t* node;
+    if (token.kind == TOKEN_OPEN) {
+        node = parse_or(parser);
+        parser->next = lex(parser->next, &token);
+        if (node && token.kind != TOKEN_CLOSE) {
+            search_query_free(node);
+            node = NULL;
+        }
+    } else {
+        query_node_t* child = parse_unary(parser);
+        node = child ? node_create(QUERY_NOT) : NULL;
+        query_node_t** children = node ? malloc(sizeof(query_node_t*)) : NULL;
+        if (children) {
+            children[0] = child;
+            node->children = children;
+            node->child_count = 1;
+        } else {
+            search_query_free(child);
+            search_query_free(node);
+            node = NULL;
+        }
+    }
+    parser->depth--;
+    return node;
+}
+
+// Clauses side by side or joined by AND
+static query_node_t* parse_and(query_parser_t* parser) {
+    query_node_t* first = parse_unary(parser);
+    query_node_t* node = NULL;
+    for (;;) {
+        token_kind_t next = first ? peek(parser) : TOKEN_END;
+        if (next == TOKEN_END || next == TOKEN_CLOSE || next == TOKEN_OR) break;
+        if (next == TOKEN_AND) {
+            query_token_t token;
+            parser->next = lex(parser->next, &token);
+        }
+        if (!node) {
+            node = node_create(QUERY_AND);
+            if (!node || !node_add(node, first)) {
+                if (!node) search_query_free(first);
+                search_query_free(node);
+                return NULL;
+            }
+        }
+        query_node_t* child = parse_unary(parser);
+        if (!child || !node_add(node, child)) {
+            search_query_free(node);
+            return NULL;
+        }
+    }
+    return node ? node : first;
+}
+
+static query_node_t* parse_or(query_parser_t* parser) {
+    query_node_t* first = parse_and(parser);
+    if (!first || peek(parser) != TOKEN_OR) return first;
+    query_node_t* node = node_create(QUERY_OR);
+    if (!node || !node_add(node, first)) {
+        if (!node) search_query_free(first);
+        search_query_free(node);
+        return NULL;
+    }
+    while (peek(parser) == TOKEN_OR) {
+        query_token_t token;
+        parser->next = lex(parser->next, &token);
+        query_node_t* child = parse_and(parser);
+        if (!child || !node_add(node, child)) {
+            search_query_free(node);
+            return NULL;
+        }
+    }
+    return node;
+}
+
+query_node_t* search_query_parse(const char* query, int* clause_count) {
+    if (!query || !clause_count) return NULL;
+    query_parser_t parser = { query, 0, 0 };
+    query_node_t* root = parse_or(&parser);
+    if (root && peek(&parser) != TOKEN_END) {
+        search_query_free(root);
+        return NULL;
+    }
+    *clause_count = parser.clause_count;
+    return root;
+}
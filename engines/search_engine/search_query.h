@@ -0,0 +1,73 @@
+#ifndef SEARCH_QUERY_H
+#define SEARCH_QUERY_H
+
+// Boolean and field queries (internal to the search engine), and the
+// query modes of search_engine_search().
+//
+// By default the query is a substring, found inside words too, every
+// occurrence in corpus order. With whole_words_only it is a term search:
+// words are runs of letters, digits and '_' in UTF-8, each ideograph being
+// a word of its own, compared ignoring case. A matching line holds every
+// word; a "quoted phrase" must appear as consecutive words, and
+// `a NEAR/k b` asks for a and b (words or phrases) with at most k words
+// between them. A query of one word or phrase reports each occurrence,
+// others the line. Results are ranked by BM25, best first, and
+// max_results keeps the top ones; a query of lone characters, which are
+// not indexed, is a scan for them as whole words. With regex_mode the query is a pattern
+// (syntax in search_regex.h) and every match is returned in corpus order;
+// search_engine_search_regex() is the case-sensitive, unlimited form.
+//
+// With boolean_mode the query follows the syntax below; each matching note
+// is one result, ranked by BM25 over its text and tag terms and placed at
+// its first match, line 0 for metadata alone. In notes indexed by markdown
+// field, matches in headings and in notes whose title holds a query term
+// rank higher, matches in code blocks lower, and a boolean result is
+// placed at its best field.
+//
+// Syntax: words and "quoted phrases" match the text; `a b` and `a AND b`
+// ask for both, `a OR b` for either (AND binds tighter), `NOT a` and `-a`
+// exclude, and parentheses group. Fields restrict a clause to note
+// metadata: `title:` words of the file name without its extension,
+// `tag:` a #tag in the text (nested tags #a/b match tag:a), `path:` a
+// substring of the path, `ext:` the file extension, and `modified:` the
+// last modification date as YYYY-MM-DD, optionally after one of
+// `> >= < <= =`. In notes indexed by markdown field, `heading:` and
+// `code:` match text in headings or code blocks only, and `link:` a
+// substring of a link target. Field values may be quoted. Operators are
+// uppercase; other words, and fields this list does not name, are text.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef enum {
+    QUERY_AND,
+    QUERY_OR,
+    QUERY_NOT,                      // its one child
+    QUERY_TEXT,
+    QUERY_TITLE,
+    QUERY_TAG,
+    QUERY_PATH,
+    QUERY_EXT,
+    QUERY_MODIFIED,
+    QUERY_HEADING,
+    QUERY_CODE,
+    QUERY_LINK,
+} query_kind_t;
+
+typedef struct query_node {
+    query_kind_t kind;
+    struct query_node** children;   // AND, OR and NOT
+    int child_count;
+    char* text;                     // value of a text or field clause
+    bool phrase;                    // the value was quoted
+    int clause;                     // TEXT, TITLE, TAG, HEADING and CODE: their index, in query order
+    int64_t after;                  // MODIFIED: times in [after, before)
+    int64_t before;
+} query_node_t;
+
+// Tree of a query and its count of indexed clauses; NULL if
+// the query is empty, invalid or too deeply nested, or when out of memory
+query_node_t* search_query_parse(const char* query, int* clause_count);
+void search_query_free(query_node_t* node);
+
+#endif // SEARCH_QUERY_H
@@ -0,0 +1,764 @@
+#include "search_regex.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_PROGRAM 20000               // instructions, after expanding repeats
+#define MAX_REPEAT 1000
+#define MAX_LITERAL_TRIGRAMS 16         // per literal run, spread over it
+
+// ============= TRIGRAM QUERIES =============
+
+static trigram_query_t all_query = { TRIGRAM_ALL, "", NULL, 0 };
+
+void trigram_query_free(trigram_query_t* query) {
+    if (!query || query == &all_query) return;
+    for (int i = 0; i < query->child_count; i++) trigram_query_free(query->children[i]);
+    free(query->children);
+    free(query);
+}
+
+static bool same_trigram(const trigram_query_t* a, const trigram_query_t* b) {
+    return a->op == TRIGRAM_ONE && b->op == TRIGRAM_ONE && memcmp(a->trigram, b->trigram, 3) == 0;
+}
+
+// Add `child` to an AND or OR node, flattening nodes of the same kind.
+// Takes ownership of `child`.
+static bool query_add(trigram_query_t* node, trigram_query_t* child) {
+    if (child->op == node->op) {
+        for (int i = 0; i < child->child_count; i++) {
+            if (!query_add(node, child->children[i])) {
+                child->children[i] = &all_query;
+                trigram_query_free(child);
+                return false;
+            }
+            child->children[i] = &all_query;
+        }
+        trigram_query_free(child);
+        return true;
+    }
+    for (int i = 0; i < node->child_count; i++) {
+        if (same_trigram(node->children[i], child)) {
+            trigram_query_free(child);
+            return true;
+        }
+    }
+    trigram_query_t** children = realloc(node->children, (node->child_count + 1) * sizeof(*children));
+    if (!children) {
+        trigram_query_free(child);
+        return false;
+    }
+    node->children = children;
+    node->children[node->child_count++] = child;
+    return true;
+}
+
+static trigram_query_t* query_node(trigram_op_t op) {
+    trigram_query_t* node = calloc(1, sizeof(trigram_query_t));
+    if (node) node->op = op;
+    return node;
+}
+
+// Collapse a finished AND or OR node: no children means no constraint, one
+// child stands for itself
+static trigram_query_t* query_finish(trigram_query_t* node) {
+    if (!node) return &all_query;
+    if (node->child_count == 0) {
+        trigram_query_free(node);
+        return &all_query;
+    }
+    if (node->child_count == 1) {
+        trigram_query_t* child = node->children[0];
+        node->child_count = 0;
+        trigram_query_free(node);
+        return child;
+    }
+    return node;
+}
+
+// AND of `query` and `child`, both owned
+static trigram_query_t* query_and(trigram_query_t* query, trigram_query_t* child) {
+    if (child->op == TRIGRAM_ALL) return query;
+    if (query->op == TRIGRAM_ALL) return child;
+    trigram_query_t* node = query->op == TRIGRAM_AND ? query : query_node(TRIGRAM_AND);
+    if (!node) {
+        trigram_query_free(child);
+        return query;           // Fewer constraints, still correct
+    }
+    if (node != query && !query_add(node, query)) {
+        trigram_query_free(child);
+        return query_finish(node);
+    }
+    query_add(node, child);
+    return query_finish(node);
+}
+
+trigram_query_t* trigram_query_literal(const char* text, size_t length) {
+    if (length < 3) return &all_query;
+    size_t count = length - 2;
+    size_t stride = count > MAX_LITERAL_TRIGRAMS ? (count + MAX_LITERAL_TRIGRAMS - 1) / MAX_LITERAL_TRIGRAMS : 1;
+    trigram_query_t* query = &all_query;
+    for (size_t i = 0; i < count; i += stride) {
+        // Always include the last trigram so the whole literal is covered
+        size_t at = i + stride >= count ? count - 1 : i;
+        trigram_query_t* leaf = query_node(TRIGRAM_ONE);
+        if (!leaf) break;
+        search_trigram(text + at, leaf->trigram);
+        query = query_and(query, leaf);
+        if (at == count - 1) break;
+    }
+    return query;
+}
+
+// ============= PARSING =============
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_CHAR,
+    NODE_ANY,
+    NODE_CLASS,
+    NODE_BOL,
+    NODE_EOL,
+    NODE_WORD_BOUNDARY,
+    NODE_NOT_WORD_BOUNDARY,
+    NODE_CONCAT,
+    NODE_ALTERNATE,
+    NODE_REPEAT,
+} node_type_t;
+
+typedef struct node {
+    node_type_t type;
+    unsigned char c;                // NODE_CHAR
+    int class_index;                // NODE_CLASS
+    int min, max;                   // NODE_REPEAT, max -1 when unbounded
+    struct node** children;
+    int child_count;
+} node_t;
+
+typedef enum {
+    OP_CHAR,
+    OP_ANY,
+    OP_CLASS,
+    OP_MATCH,
+    OP_JMP,
+    OP_SPLIT,
+    OP_BOL,
+    OP_EOL,
+    OP_WORD_BOUNDARY,
+    OP_NOT_WORD_BOUNDARY,
+} opcode_t;
+
+typedef struct {
+    uint8_t op;
+    unsigned char c;                // OP_CHAR
+    int x;                          // OP_CLASS: class; OP_JMP, OP_SPLIT: target
+    int y;                          // OP_SPLIT: second target
+} inst_t;
+
+typedef struct {
+    int pc;
+    size_t start;
+} thread_t;
+
+// Threads of one position, each instruction at most once
+typedef struct {
+    thread_t* threads;
+    int count;
+    unsigned* marks;                // generation that added each instruction
+    unsigned generation;
+} thread_list_t;
+
+struct search_regex {
+    bool case_sensitive;
+    uint8_t (*classes)[32];         // 256-bit byte sets
+    int class_count;
+    inst_t* program;
+    int program_size;
+    trigram_query_t* prefilter;
+
+    // Matching scratch
+    thread_list_t lists[2];
+    int* stack;
+};
+
+typedef struct {
+    const char* pattern;
+    size_t pos;
+    bool error;
+    search_regex_t* regex;
+    node_t** nodes;                 // every node, freed together
+    int node_count;
+    int node_capacity;
+} parser_t;
+
+static node_t* new_node(parser_t* parser, node_type_t type) {
+    if (parser->node_count == parser->node_capacity) {
+        int capacity = parser->node_capacity ? parser->node_capacity * 2 : 32;
+        node_t** nodes = realloc(parser->nodes, capacity * sizeof(node_t*));
+        if (!nodes) {
+            parser->error = true;
+            return NULL;
+        }
+        parser->nodes = nodes;
+        parser->node_capacity = capacity;
+    }
+    node_t* node = calloc(1, sizeof(node_t));
+    if (!node) {
+        parser->error = true;
+        return NULL;
+    }
+    node->type = type;
+    parser->nodes[parser->node_count++] = node;
+    return node;
+}
+
+static bool add_child(parser_t* parser, node_t* node, node_t* child) {
+    node_t** children = realloc(node->children, (node->child_count + 1) * sizeof(node_t*));
+    if (!children) {
+        parser->error = true;
+        return false;
+    }
+    node->children = children;
+    node->children[node->child_count++] = child;
+    return true;
+}
+
+static int new_class(parser_t* parser) {
+    search_regex_t* regex = parser->regex;
+    uint8_t (*classes)[32] = realloc(regex->classes, (regex->class_count + 1) * sizeof(*classes));
+    if (!classes) {
+        parser->error = true;
+        return -1;
+    }
+    regex->classes = classes;
+    memset(regex->classes[regex->class_count], 0, 32);
+    return regex->class_count++;
+}
+
+static inline void class_set(uint8_t* bits, unsigned char c) {
+    bits[c >> 3] |= (uint8_t)(1u << (c & 7));
+}
+
+static inline bool class_test(const uint8_t* bits, unsigned char c) {
+    return (bits[c >> 3] >> (c & 7)) & 1;
+}
+
+static inline bool is_word_byte(unsigned char c) {
+    return isalnum(c) || c == '_';
+}
+
+// Add the bytes of a \d \w \s class (or their complements) to `bits`
+static bool add_escape_class(uint8_t* bits, char escape) {
+    char lower = (char)tolower((unsigned char)escape);
+    if (lower != 'd' && lower != 'w' && lower != 's') return false;
+    for (int c = 0; c < 256; c++) {
+        bool member = lower == 'd' ? isdigit(c) : lower == 'w' ? is_word_byte((unsigned char)c) : isspace(c);
+        if (member != (escape != lower)) class_set(bits, (unsigned char)c);
+    }
+    return true;
+}
+
+static unsigned char escaped_char(char c) {
+    switch (c) {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    default: return (unsigned char)c;
+    }
+}
+
+static node_t* parse_class(parser_t* parser) {
+    const char* p = parser->pattern;
+    int index = new_class(parser);
+    if (index < 0) return NULL;
+    uint8_t* bits = parser->regex->classes[index];
+    bool negated = p[parser->pos] == '^';
+    if (negated) parser->pos++;
+
+    bool first = true;
+    while (p[parser->pos] && (p[parser->pos] != ']' || first)) {
+        first = false;
+        unsigned char low = (unsigned char)p[parser->pos++];
+        if (low == '\\') {
+            char escape = p[parser->pos];
+            if (!escape) break;
+            parser->pos++;
+            if (add_escape_class(bits, escape)) continue;
+            low = escaped_char(escape);
+        }
+        unsigned char high = low;
+        if (p[parser->pos] == '-' && p[parser->pos + 1] && p[parser->pos + 1] != ']') {
+            parser->pos++;
+            high = (unsigned char)p[parser->pos++];
+            if (high == '\\' && p[parser->pos]) high = escaped_char(p[parser->pos++]);
+            if (high < low) {
+                parser->error = true;
+                return NULL;
+            }
+        }
+        for (int c = low; c <= high; c++) class_set(bits, (unsigned char)c);
+    }
+    if (p[parser->pos] != ']') {
+        parser->error = true;
+        return NULL;
+    }
+    parser->pos++;
+
+    if (!parser->regex->case_sensitive) {
+        for (int c = 'a'; c <= 'z'; c++) {
+            if (class_test(bits, (unsigned char)c) || class_test(bits, (unsigned char)toupper(c))) {
+                class_set(bits, (unsigned char)c);
+                class_set(bits, (unsigned char)toupper(c));
+            }
+        }
+    }
+    if (negated) {
+        for (int i = 0; i < 32; i++) bits[i] = (uint8_t)~bits[i];
+    }
+    node_t* node = new_node(parser, NODE_CLASS);
+    if (node) node->class_index = index;
+    return node;
+}
+
+static node_t* parse_alternate(parser_t* parser);
+
+static node_t* parse_atom(parser_t* parser) {
+    const char* p = parser->pattern;
+    char c = p[parser->pos++];
+    switch (c) {
+    case '(': {
+        node_t* inner = parse_alternate(parser);
+        if (parser->error || p[parser->pos] != ')') {
+            parser->error = true;
+            return NULL;
+        }
+        parser->pos++;
+        return inner;
+    }
+    case '[':
+        return parse_class(parser);
+    case '.':
+        return new_node(parser, NODE_ANY);
+    case '^':
+        return new_node(parser, NODE_BOL);
+    case '$':
+        return new_node(parser, NODE_EOL);
+    case '*': case '+': case '?': case ')':
+        parser->error = true;           // Nothing to repeat, or unbalanced
+        return NULL;
+    case '\\': {
+        char escape = p[parser->pos];
+        if (!escape) {
+            parser->error = true;
+            return NULL;
+        }
+        parser->pos++;
+        if (escape == 'b') return new_node(parser, NODE_WORD_BOUNDARY);
+        if (escape == 'B') return new_node(parser, NODE_NOT_WORD_BOUNDARY);
+        int index = new_class(parser);
+        if (index >= 0 && add_escape_class(parser->regex->classes[index], escape)) {
+            node_t* node = new_node(parser, NODE_CLASS);
+            if (node) node->class_index = index;
+            return node;
+        }
+        if (index >= 0) parser->regex->class_count--;
+        c = (char)escaped_char(escape);
+        break;
+    }
+    default:
+        break;
+    }
+    node_t* node = new_node(parser, NODE_CHAR);
+    if (node) node->c = (unsigned char)c;
+    return node;
+}
+
+static bool parse_count(parser_t* parser, int* value) {
+    const char* p = parser->pattern;
+    if (!isdigit((unsigned char)p[parser->pos])) return false;
+    int n = 0;
+    while (isdigit((unsigned char)p[parser->pos])) {
+        n = n * 10 + (p[parser->pos++] - '0');
+        if (n > MAX_REPEAT) return false;
+    }
+    *value = n;
+    return true;
+}
+
+static node_t* parse_repeat(parser_t* parser) {
+    node_t* atom = parse_atom(parser);
+    const char* p = parser->pattern;
+    while (atom && !parser->error) {
+        int min, max;
+        char c = p[parser->pos];
+        if (c == '*') {
+            min = 0; max = -1;
+        } else if (c == '+') {
+            min = 1; max = -1;
+        } else if (c == '?') {
+            min = 0; max = 1;
+        } else if (c == '{' && isdigit((unsigned char)p[parser->pos + 1])) {
+            parser->pos++;
+            if (!parse_count(parser, &min)) {
+                parser->error = true;
+                return NULL;
+            }
+            max = min;
+            if (p[parser->pos] == ',') {
+                parser->pos++;
+                max = -1;
+                if (p[parser->pos] != '}' && (!parse_count(parser, &max) || max < min)) {
+                    parser->error = true;
+                    return NULL;
+                }
+            }
+            if (p[parser->pos] != '}') {
+                parser->error = true;
+                return NULL;
+            }
+        } else {
+            break;
+        }
+        parser->pos++;
+        node_t* repeat = new_node(parser, NODE_REPEAT);
+        if (!repeat || !add_child(parser, repeat, atom)) return NULL;
+        repeat->min = min;
+        repeat->max = max;
+        atom = repeat;
+    }
+    return atom;
+}
+
+static node_t* parse_concat(parser_t* parser) {
+    node_t* concat = new_node(parser, NODE_CONCAT);
+    const char* p = parser->pattern;
+    while (concat && !parser->error && p[parser->pos] && p[parser->pos] != '|' && p[parser->pos] != ')') {
+        node_t* item = parse_repeat(parser);
+        if (!item || !add_child(parser, concat, item)) return NULL;
+    }
+    return concat;
+}
+
+static node_t* parse_alternate(parser_t* parser) {
+    node_t* first = parse_concat(parser);
+    if (!first || parser->pattern[parser->pos] != '|') return first;
+    node_t* alternate = new_node(parser, NODE_ALTERNATE);
+    if (!alternate || !add_child(parser, alternate, first)) return NULL;
+    while (!parser->error && parser->pattern[parser->pos] == '|') {
+        parser->pos++;
+        node_t* next = parse_concat(parser);
+        if (!next || !add_child(parser, alternate, next)) return NULL;
+    }
+    return alternate;
+}
+
+// ============= COMPILING =============
+
+static int emit(search_regex_t* regex, opcode_t op) {
+    if (regex->program_size >= MAX_PROGRAM) return -1;
+    inst_t* inst = &regex->program[regex->program_size];
+    memset(inst, 0, sizeof(*inst));
+    inst->op = (uint8_t)op;
+    return regex->program_size++;
+}
+
+static bool compile_node(search_regex_t* regex, const node_t* node) {
+    int at;
+    switch (node->type) {
+    case NODE_EMPTY:
+        return true;
+    case NODE_CHAR:
+        if ((at = emit(regex, OP_CHAR)) < 0) return false;
+        regex->program[at].c = regex->case_sensitive ? node->c : (unsigned char)tolower(node->c);
+        return true;
+    case NODE_ANY:
+        return emit(regex, OP_ANY) >= 0;
+    case NODE_CLASS:
+        if ((at = emit(regex, OP_CLASS)) < 0) return false;
+        regex->program[at].x = node->class_index;
+        return true;
+    case NODE_BOL:
+        return emit(regex, OP_BOL) >= 0;
+    case NODE_EOL:
+        return emit(regex, OP_EOL) >= 0;
+    case NODE_WORD_BOUNDARY:
+        return emit(regex, OP_WORD_BOUNDARY) >= 0;
+    case NODE_NOT_WORD_BOUNDARY:
+        return emit(regex, OP_NOT_WORD_BOUNDARY) >= 0;
+    case NODE_CONCAT:
+        for (int i = 0; i < node->child_count; i++) {
+            if (!compile_node(regex, node->children[i])) return false;
+        }
+        return true;
+    case NODE_ALTERNATE: {
+        // split L1, next; L1: child; jmp end; next: ...
+        int jumps[node->child_count];
+        for (int i = 0; i < node->child_count; i++) {
+            int split = -1;
+            if (i + 1 < node->child_count && (split = emit(regex, OP_SPLIT)) < 0) return false;
+            if (split >= 0) regex->program[split].x = regex->program_size;
+            if (!compile_node(regex, node->children[i])) return false;
+            jumps[i] = -1;
+            if (split >= 0) {
+                if ((jumps[i] = emit(regex, OP_JMP)) < 0) return false;
+                regex->program[split].y = regex->program_size;
+            }
+        }
+        for (int i = 0; i < node->child_count; i++) {
+            if (jumps[i] >= 0) regex->program[jumps[i]].x = regex->program_size;
+        }
+        return true;
+    }
+    case NODE_REPEAT: {
+        const node_t* child = node->children[0];
+        for (int i = 0; i < node->min; i++) {
+            if (!compile_node(regex, child)) return false;
+        }
+        if (node->max < 0) {
+            // loop: split body, end; body: child; jmp loop
+            int loop = emit(regex, OP_SPLIT);
+            if (loop < 0) return false;
+            regex->program[loop].x = regex->program_size;
+            if (!compile_node(regex, child) || (at = emit(regex, OP_JMP)) < 0) return false;
+            regex->program[at].x = loop;
+            regex->program[loop].y = regex->program_size;
+            return true;
+        }
+        // Optional copies, each skipping to the end
+        int optional = node->max - node->min;
+        int splits[optional > 0 ? optional : 1];
+        for (int i = 0; i < optional; i++) {
+            if ((splits[i] = emit(regex, OP_SPLIT)) < 0) return false;
+            regex->program[splits[i]].x = regex->program_size;
+            if (!compile_node(regex, child)) return false;
+        }
+        for (int i = 0; i < optional; i++) regex->program[splits[i]].y = regex->program_size;
+        return true;
+    }
+    }
+    return false;
+}
+
+// Trigrams every match of `node` contains. Runs of consecutive literal
+// characters give their trigrams; zero-width assertions don't break a run.
+static trigram_query_t* node_prefilter(const node_t* node) {
+    switch (node->type) {
+    case NODE_CONCAT: {
+        trigram_query_t* query = &all_query;
+        char run[MAX_REPEAT];
+        size_t run_length = 0;
+        for (int i = 0; i <= node->child_count; i++) {
+            const node_t* child = i < node->child_count ? node->children[i] : NULL;
+            if (child && child->type == NODE_CHAR && run_length < sizeof(run)) {
+                run[run_length++] = (char)child->c;
+                continue;
+            }
+            if (child && (child->type == NODE_BOL || child->type == NODE_EOL ||
+                          child->type == NODE_WORD_BOUNDARY || child->type == NODE_NOT_WORD_BOUNDARY)) {
+                continue;
+            }
+            query = query_and(query, trigram_query_literal(run, run_length));
+            run_length = 0;
+            if (child) query = query_and(query, node_prefilter(child));
+        }
+        return query;
+    }
+    case NODE_ALTERNATE: {
+        trigram_query_t* query = query_node(TRIGRAM_OR);
+        if (!query) return &all_query;
+        for (int i = 0; i < node->child_count; i++) {
+            trigram_query_t* child = node_prefilter(node->children[i]);
+            if (child->op == TRIGRAM_ALL || !query_add(query, child)) {
+                trigram_query_free(query);
+                return &all_query;
+            }
+        }
+        return query_finish(query);
+    }
+    case NODE_REPEAT:
+        return node->min > 0 ? node_prefilter(node->children[0]) : &all_query;
+    default:
+        return &all_query;
+    }
+}
+
+static void free_nodes(parser_t* parser) {
+    for (int i = 0; i < parser->node_count; i++) {
+        free(parser->nodes[i]->children);
+        free(parser->nodes[i]);
+    }
+    free(parser->nodes);
+}
+
+search_regex_t* search_regex_compile(const char* pattern, bool case_sensitive) {
+    if (!pattern) return NULL;
+    search_regex_t* regex = calloc(1, sizeof(search_regex_t));
+    if (!regex) return NULL;
+    regex->case_sensitive = case_sensitive;
+    regex->prefilter = &all_query;
+
+    parser_t parser = { pattern, 0, false, regex, NULL, 0, 0 };
+    node_t* root = parse_alternate(&parser);
+    if (!root || parser.error || pattern[parser.pos] != '\0') {
+        free_nodes(&parser);
+        search_regex_free(regex);
+        return NULL;
+    }
+
+    regex->program = malloc(MAX_PROGRAM * sizeof(inst_t));
+    bool ok = regex->program && compile_node(regex, root) && emit(regex, OP_MATCH) >= 0;
+    if (ok) regex->prefilter = node_prefilter(root);
+    free_nodes(&parser);
+    if (ok) {
+        int size = regex->program_size;
+        for (int i = 0; i < 2 && ok; i++) {
+            regex->lists[i].threads = malloc(size * sizeof(thread_t));
+            regex->lists[i].marks = calloc(size, sizeof(unsigned));
+            ok = regex->lists[i].threads && regex->lists[i].marks;
+        }
+        regex->stack = malloc(size * sizeof(int));
+        ok = ok && regex->stack;
+    }
+    if (!ok) {
+        search_regex_free(regex);
+        return NULL;
+    }
+    return regex;
+}
+
+void search_regex_free(search_regex_t* regex) {
+    if (!regex) return;
+    trigram_query_free(regex->prefilter);
+    free(regex->classes);
+    free(regex->program);
+    for (int i = 0; i < 2; i++) {
+        free(regex->lists[i].threads);
+        free(regex->lists[i].marks);
+    }
+    free(regex->stack);
+    free(regex);
+}
+
+const trigram_query_t* search_regex_prefilter(const search_regex_t* regex) {
+    return regex ? regex->prefilter : &all_query;
+}
+
+// ============= MATCHING =============
+
+static void list_clear(const search_regex_t* regex, thread_list_t* list) {
+    list->count = 0;
+    if (++list->generation == 0) {
+        // Marks from before the wrap would look current
+        memset(list->marks, 0, regex->program_size * sizeof(unsigned));
+        list->generation = 1;
+    }
+}
+
+// Add the thread at `pc` to `list`, following jumps, splits and assertions
+// at text position `pos`
+static void add_thread(search_regex_t* regex, thread_list_t* list, int pc, size_t start,
+                       const char* text, size_t length, size_t pos) {
+    int* stack = regex->stack;
+    int top = 0;
+    if (list->marks[pc] == list->generation) return;
+    list->marks[pc] = list->generation;
+    stack[top++] = pc;
+    while (top > 0) {
+        pc = stack[--top];
+        const inst_t* inst = &regex->program[pc];
+        int next[2];
+        int count = 0;
+        switch (inst->op) {
+        case OP_JMP:
+            next[count++] = inst->x;
+            break;
+        case OP_SPLIT:
+            next[count++] = inst->y;
+            next[count++] = inst->x;
+            break;
+        case OP_BOL:
+            if (pos == 0) next[count++] = pc + 1;
+            break;
+        case OP_EOL:
+            if (pos == length) next[count++] = pc + 1;
+            break;
+        case OP_WORD_BOUNDARY:
+        case OP_NOT_WORD_BOUNDARY: {
+            bool before = pos > 0 && is_word_byte((unsigned char)text[pos - 1]);
+            bool after = pos < length && is_word_byte((unsigned char)text[pos]);
+            if ((before != after) == (inst->op == OP_WORD_BOUNDARY)) next[count++] = pc + 1;
+            break;
+        }
+        default:
+            list->threads[list->count].pc = pc;
+            list->threads[list->count].start = start;
+            list->count++;
+            break;
+        }
+        for (int i = 0; i < count; i++) {
+            if (list->marks[next[i]] == list->generation) continue;
+            list->marks[next[i]] = list->generation;
+            stack[top++] = next[i];
+        }
+    }
+}
+
+bool search_regex_find(search_regex_t* regex, const char* text, size_t length, size_t from,
+                       size_t* match_start, size_t* match_end) {
+    thread_list_t* current = &regex->lists[0];
+    thread_list_t* next = &regex->lists[1];
+    bool matched = false;
+    size_t best_start = 0, best_end = 0;
+    list_clear(regex, current);
+
+    // One pass over the text; threads carry their start, and at each
+    // instruction the earliest start wins, which makes the result the
+    // leftmost-longest match
+    for (size_t pos = from; pos <= length; pos++) {
+        if (!matched) add_thread(regex, current, 0, pos, text, length, pos);
+        if (current->count == 0) {
+            if (matched) break;
+            // Nothing started here (a failed assertion); try the next position
+            list_clear(regex, current);
+            continue;
+        }
+        list_clear(regex, next);
+        unsigned char c = pos < length ? (unsigned char)text[pos] : 0;
+        unsigned char folded = regex->case_sensitive ? c : (unsigned char)tolower(c);
+        for (int i = 0; i < current->count; i++) {
+            const thread_t* thread = &current->threads[i];
+            if (matched && thread->start > best_start) continue;
+            const inst_t* inst = &regex->program[thread->pc];
+            bool advance = false;
+            switch (inst->op) {
+            case OP_MATCH:
+                if (!matched || thread->start < best_start || pos > best_end) {
+                    matched = true;
+                    best_start = thread->start;
+                    best_end = pos;
+                }
+                break;
+            case OP_CHAR:
+                advance = pos < length && folded == inst->c;
+                break;
+            case OP_ANY:
+                advance = pos < length;
+                break;
+            case OP_CLASS:
+                advance = pos < length && class_test(regex->classes[inst->x], c);
+                break;
+            default:
+                break;
+            }
+            if (advance) add_thread(regex, next, thread->pc + 1, thread->start, text, length, pos + 1);
+        }
+        thread_list_t* swap = current;
+        current = next;
+        next = swap;
+    }
+    if (matched) {
+        *match_start = best_start;
+        *match_end = best_end;
+    }
+    return matched;
+}
@@ -0,0 +1,63 @@
+#ifndef SEARCH_REGEX_H
+#define SEARCH_REGEX_H
+
+// Regular expressions and trigram prefilters (internal to the search
+// engine).
+//
+// Patterns are compiled to a Thompson NFA and run as a Pike VM: matching is
+// linear in the text for any pattern, with no backtracking. Syntax: literals,
+// `.`, classes `[a-z]` `[^...]`, escapes `\d \w \s \D \W \S \b \B` and
+// escaped metacharacters, anchors `^ $`, groups `( )`, alternation `|` and
+// the quantifiers `* + ? {m} {m,} {m,n}` (`{` is a literal otherwise).
+// Text is matched byte by byte, one line at a time.
+//
+// A compiled pattern also yields a trigram query: trigrams that every match
+// must contain, as an AND/OR tree. Documents lacking them are skipped
+// without running the matcher.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <ctype.h>
+
+// Trigram key of the three bytes at `text`: ASCII letters are lowercased so
+// one key serves both case modes
+static inline void search_trigram(const char* text, char trigram[4]) {
+    for (int i = 0; i < 3; i++) trigram[i] = (char)tolower((unsigned char)text[i]);
+    trigram[3] = '\0';
+}
+
+typedef enum {
+    TRIGRAM_ALL,                    // no constraint
+    TRIGRAM_ONE,
+    TRIGRAM_AND,
+    TRIGRAM_OR,
+} trigram_op_t;
+
+// AND and OR nodes never hold TRIGRAM_ALL children
+typedef struct trigram_query {
+    trigram_op_t op;
+    char trigram[4];                // TRIGRAM_ONE
+    struct trigram_query** children;
+    int child_count;
+} trigram_query_t;
+
+// Trigrams of a literal substring; TRIGRAM_ALL below three bytes or when out
+// of memory, which only loses filtering
+trigram_query_t* trigram_query_literal(const char* text, size_t length);
+void trigram_query_free(trigram_query_t* query);
+
+typedef struct search_regex search_regex_t;
+
+// NULL if the pattern is invalid or too large
+search_regex_t* search_regex_compile(const char* pattern, bool case_sensitive);
+void search_regex_free(search_regex_t* regex);
+
+// Leftmost-longest match in `text` starting at or after `from`. Uses
+// scratch space in the regex: one search at a time per compiled pattern.
+bool search_regex_find(search_regex_t* regex, const char* text, size_t length, size_t from,
+                       size_t* match_start, size_t* match_end);
+
+// Trigrams every match contains; owned by the regex
+const trigram_query_t* search_regex_prefilter(const search_regex_t* regex);
+
+#endif // SEARCH_REGEX_H
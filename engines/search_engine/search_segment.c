@@ -0,0 +1,717 @@
+#define _POSIX_C_SOURCE 200809L
+#include "search_segment.h"
+#include "search_markdown.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ALIGN8(n) (((n) + 7) & ~(uint64_t)7)
+
+// 64-bit checksum: four independent lanes of 8-byte words (xxHash64
+// rounds), so verifying a large segment runs near memory speed
+static uint64_t segment_checksum(const uint8_t* data, size_t size) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = { prime1 + prime2, prime2, 0, (uint64_t)0 - prime1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * lane, 8);
+            uint64_t acc = lanes[lane] + word * prime2;
+            lanes[lane] = ((acc << 31) | (acc >> 33)) * prime1;
+        }
+    }
+
+    uint64_t hash = size;
+    for (int lane = 0; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * prime1;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// Point the section pointers into the image
+static void segment_bind(search_segment_t* segment) {
+    const search_segment_header_t* header = (const search_segment_header_t*)segment->base;
+    segment->header = header;
+    segment->documents = (const search_segment_document_t*)(segment->base + header->documents_offset);
+    segment->line_starts = (const uint32_t*)(segment->base + header->lines_offset);
+    segment->line_fields = segment->base + header->fields_offset;
+    segment->terms = (const search_segment_term_t*)(segment->base + header->terms_offset);
+    segment->trigrams = (const search_segment_term_t*)(segment->base + header->trigrams_offset);
+    segment->skips = (const posting_skip_t*)(segment->base + header->skips_offset);
+    segment->postings = segment->base + header->postings_offset;
+    segment->strings = (const char*)(segment->base + header->strings_offset);
+}
+
+// ============= BUILDING =============
+
+static inline bool is_deleted(const uint8_t* deleted, int document) {
+    return deleted && (deleted[document >> 3] >> (document & 7)) & 1;
+}
+
+// Merge state of one input
+typedef struct {
+    const search_segment_input_t* input;
+    int document_count;
+    int32_t* remap;                     // input document -> output document, -1 if dropped
+    bool identity;                      // remap is the identity
+
+    // Dictionary being merged
+    const search_segment_term_t* terms; // of a segment
+    const word_index_entry_t** entries; // in memory, sorted
+    size_t term_count;
+    size_t next_term;
+} merge_input_t;
+
+// A term of the image with its packed postings
+typedef struct {
+    const char* word;
+    uint32_t word_length;
+    posting_list_t postings;
+    bool owned;
+} build_term_t;
+
+static int compare_entries(const void* a, const void* b) {
+    const word_index_entry_t* x = *(const word_index_entry_t* const*)a;
+    const word_index_entry_t* y = *(const word_index_entry_t* const*)b;
+    return strcmp(x->word, y->word);
+}
+
+static void segment_term_view(const search_segment_t* segment, const search_segment_term_t* term,
+                              posting_list_t* postings) {
+    posting_list_view(postings, segment->postings + term->postings_offset, term->postings_size,
+                      segment->skips + term->first_block, term->block_count,
+                      term->document_count, term->occurrence_count);
+}
+
+static const char* input_word(const merge_input_t* state, size_t i) {
+    const search_segment_t* segment = state->input->segment;
+    return segment ? segment->strings + state->terms[i].word_offset : state->entries[i]->word;
+}
+
+static const posting_list_t* input_postings(const merge_input_t* state, size_t i, posting_list_t* view) {
+    const search_segment_t* segment = state->input->segment;
+    if (!segment) return state->entries[i]->postings;
+    segment_term_view(segment, &state->terms[i], view);
+    return view;
+}
+
+// Point every input at its word (0) or trigram (1) dictionary
+static bool start_dictionary(merge_input_t* states, int count, int dictionary) {
+    for (int k = 0; k < count; k++) {
+        merge_input_t* state = &states[k];
+        const search_segment_t* segment = state->input->segment;
+        state->next_term = 0;
+        free(state->entries);
+        state->entries = NULL;
+        if (segment) {
+            state->terms = dictionary ? segment->trigrams : segment->terms;
+            state->term_count = dictionary ? segment->header->trigram_count : segment->header->term_count;
+            continue;
+        }
+        const search_index_t* index = state->input->index;
+        const word_index_t* word_index = dictionary ? index->trigram_index : index->word_index;
+        state->term_count = word_index->entry_count;
+        state->entries = malloc((state->term_count + 1) * sizeof(*state->entries));
+        if (!state->entries) return false;
+        for (size_t i = 0; i < state->term_count; i++) state->entries[i] = &word_index->entries[i];
+        qsort(state->entries, state->term_count, sizeof(*state->entries), compare_entries);
+    }
+    return true;
+}
+
+static void free_merge_inputs(merge_input_t* states, int count) {
+    for (int k = 0; k < count; k++) {
+        free(states[k].remap);
+        free(states[k].entries);
+    }
+    free(states);
+}
+
+static void free_build_terms(build_term_t* terms, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (terms[i].owned) posting_list_free(&terms[i].postings);
+    }
+    free(terms);
+}
+
+// Where the fields of an output document come from
+typedef struct {
+    const uint8_t* line_fields;     // NULL for a document without fields
+    const char* path;
+} merge_fields_t;
+
+// OR the fields of every occurrence of a word into its blocks' skips
+static void set_block_fields(posting_list_t* list, const char* word, const merge_fields_t* fields) {
+    size_t length = strlen(word);
+    uint32_t document = UINT32_MAX;
+    int shift = 0;                      // SEARCH_BLOCK_TITLE_SHIFT when the title holds the word
+    posting_cursor_t cursor;
+    for (posting_cursor_init(&cursor, list); !cursor.done; posting_cursor_next(&cursor)) {
+        const merge_fields_t* source = &fields[cursor.document];
+        if (cursor.document != document) {
+            document = cursor.document;
+            shift = source->line_fields && search_note_title_holds(source->path, word, length)
+                        ? SEARCH_BLOCK_TITLE_SHIFT : 0;
+        }
+        int kind = source->line_fields ? search_field_kind(source->line_fields[cursor.line]) : SEARCH_FIELD_BODY;
+        list->skips[cursor.block].fields |= (1u << kind) << shift;
+    }
+}
+
+// Postings of the smallest head term over every input holding it. A term
+// from one input whose documents keep their numbers is reused as is.
+// `lengths` are the output documents' lengths, for the block bounds.
+static bool merge_term(merge_input_t* states, int count, const char* word, const uint32_t* lengths,
+                       build_term_t* term) {
+    int sources = 0, source = -1;
+    for (int k = 0; k < count; k++) {
+        if (states[k].next_term < states[k].term_count &&
+            strcmp(input_word(&states[k], states[k].next_term), word) == 0) {
+            sources++;
+            source = k;
+        }
+    }
+
+    posting_list_t view;
+    if (sources == 1 && states[source].identity) {
+        const posting_list_t* postings = input_postings(&states[source], states[source].next_term, &view);
+        states[source].next_term++;
+        if (states[source].input->segment) {
+            term->postings = view;
+            term->owned = false;
+            return true;
+        }
+        term->owned = true;
+        if (!posting_list_pack(postings, &term->postings)) return false;
+        posting_list_set_lengths(&term->postings, lengths);
+        return true;
+    }
+
+    posting_list_t merged;
+    posting_list_init(&merged);
+    bool ok = true;
+    for (int k = 0; k < count && ok; k++) {
+        merge_input_t* state = &states[k];
+        if (state->next_term >= state->term_count ||
+            strcmp(input_word(state, state->next_term), word) != 0) {
+            continue;
+        }
+        posting_cursor_t cursor;
+        for (posting_cursor_init(&cursor, input_postings(state, state->next_term, &view));
+             !cursor.done && ok; posting_cursor_next(&cursor)) {
+            int32_t document = state->remap[cursor.document];
+            if (document >= 0) {
+                ok = posting_list_add(&merged, (uint32_t)document, cursor.line, cursor.position);
+            }
+        }
+        state->next_term++;
+    }
+    term->owned = true;
+    ok = ok && posting_list_pack(&merged, &term->postings);
+    posting_list_free(&merged);
+    if (ok) posting_list_set_lengths(&term->postings, lengths);
+    return ok;
+}
+
+// k-way merge of the dictionaries the inputs point at, appended to `terms`.
+// Blocks of new postings get their fields from `fields` unless it is NULL.
+static bool merge_dictionary(merge_input_t* states, int count, const uint32_t* lengths,
+                             const merge_fields_t* fields, build_term_t* terms, size_t* term_count,
+                             uint64_t* block_count, uint64_t* postings_size, uint64_t* strings_size) {
+    for (;;) {
+        const char* word = NULL;
+        for (int k = 0; k < count; k++) {
+            if (states[k].next_term >= states[k].term_count) continue;
+            const char* head = input_word(&states[k], states[k].next_term);
+            if (!word || strcmp(head, word) < 0) word = head;
+        }
+        if (!word) return true;
+
+        build_term_t* term = &terms[*term_count];
+        if (!merge_term(states, count, word, lengths, term)) return false;
+        if (term->postings.document_count == 0) {
+            if (term->owned) posting_list_free(&term->postings);
+            memset(term, 0, sizeof(*term));
+            continue;                   // Every document holding it was dropped
+        }
+        if (fields && term->owned) set_block_fields(&term->postings, word, fields);
+        term->word = word;
+        term->word_length = (uint32_t)strlen(word);
+        *block_count += term->postings.block_count;
+        *postings_size += term->postings.size;
+        *strings_size += term->word_length + 1;
+        (*term_count)++;
+    }
+}
+
+search_segment_t* search_segment_merge(const search_segment_input_t* inputs, int input_count) {
+    if (!inputs || input_count <= 0) return NULL;
+    merge_input_t* states = calloc(input_count, sizeof(merge_input_t));
+    if (!states) return NULL;
+
+    // Number the kept documents in input order
+    int32_t document_count = 0;
+    uint64_t line_count = 0, strings_size = 0, word_count = 0;
+    uint32_t* lengths = NULL;
+    merge_fields_t* fields = NULL;
+    bool any_fields = false;
+    size_t term_capacity = 0;
+    for (int k = 0; k < input_count; k++) {
+        const search_segment_input_t* input = &inputs[k];
+        merge_input_t* state = &states[k];
+        state->input = input;
+        state->document_count = input->segment ? (int)input->segment->header->document_count
+                                               : input->index->memory_document_count;
+        state->remap = malloc((state->document_count + 1) * sizeof(int32_t));
+        uint32_t* grown = realloc(lengths, (document_count + state->document_count + 1) * sizeof(uint32_t));
+        if (grown) lengths = grown;
+        merge_fields_t* grown_fields = realloc(fields, (document_count + state->document_count + 1) *
+                                                           sizeof(merge_fields_t));
+        if (grown_fields) fields = grown_fields;
+        if (!state->remap || !grown || !grown_fields) {
+            free(lengths);
+            free(fields);
+            free_merge_inputs(states, input_count);
+            return NULL;
+        }
+        state->identity = document_count == 0;
+        for (int i = 0; i < state->document_count; i++) {
+            if (is_deleted(input->deleted, i)) {
+                state->remap[i] = -1;
+                state->identity = false;
+                continue;
+            }
+            state->remap[i] = document_count;
+            merge_fields_t* field = &fields[document_count];
+            if (input->segment) {
+                const search_segment_t* segment = input->segment;
+                const search_segment_document_t* doc = &segment->documents[i];
+                bool has_fields = (doc->flags & SEARCH_SEGMENT_FIELDS) != 0;
+                field->line_fields = has_fields ? segment->line_fields + doc->first_line : NULL;
+                field->path = segment->strings + doc->path_offset;
+                lengths[document_count++] = doc->word_count;
+                line_count += doc->line_count;
+                strings_size += doc->path_length + 1 + doc->content_length + 1;
+            } else {
+                const search_document_t* doc = input->index->documents[i];
+                field->line_fields = doc->line_fields;
+                field->path = doc->filepath;
+                lengths[document_count++] = (uint32_t)doc->word_count;
+                line_count += doc->line_count;
+                strings_size += strlen(doc->filepath) + 1 + doc->content_length + 1;
+            }
+            any_fields |= field->line_fields != NULL;
+        }
+
+        if (input->segment) {
+            term_capacity += input->segment->header->term_count + input->segment->header->trigram_count;
+        } else {
+            term_capacity += input->index->word_index->entry_count + input->index->trigram_index->entry_count;
+        }
+    }
+
+    // k-way merge of the sorted words, then of the sorted trigrams
+    build_term_t* terms = calloc(term_capacity + 1, sizeof(build_term_t));
+    size_t term_count = 0, word_term_count = 0;
+    uint64_t block_count = 0, postings_size = 0;
+    bool merged = terms != NULL;
+    for (int dictionary = 0; dictionary < 2 && merged; dictionary++) {
+        merged = start_dictionary(states, input_count, dictionary) &&
+                 merge_dictionary(states, input_count, lengths, dictionary == 0 && any_fields ? fields : NULL,
+                                  terms, &term_count, &block_count, &postings_size, &strings_size);
+        if (dictionary == 0) word_term_count = term_count;
+    }
+    if (!merged) {
+        if (terms) free_build_terms(terms, term_count + 1);
+        free(lengths);
+        free(fields);
+        free_merge_inputs(states, input_count);
+        return NULL;
+    }
+    free(fields);
+
+    search_segment_header_t header = {0};
+    memcpy(header.magic, SEARCH_SEGMENT_MAGIC, 8);
+    header.version = SEARCH_SEGMENT_VERSION;
+    header.byte_order = SEARCH_SEGMENT_BYTE_ORDER;
+    header.document_count = (uint32_t)document_count;
+    header.term_count = (uint32_t)word_term_count;
+    header.trigram_count = (uint32_t)(term_count - word_term_count);
+    header.line_count = (uint32_t)line_count;
+    header.block_count = (uint32_t)block_count;
+    for (int32_t i = 0; i < document_count; i++) word_count += lengths[i];
+    header.word_count = word_count;
+    header.documents_offset = ALIGN8(sizeof(header));
+    header.lines_offset = header.documents_offset + (uint64_t)document_count * sizeof(search_segment_document_t);
+    header.fields_offset = ALIGN8(header.lines_offset + line_count * sizeof(uint32_t));
+    header.terms_offset = ALIGN8(header.fields_offset + line_count);
+    header.trigrams_offset = header.terms_offset + word_term_count * sizeof(search_segment_term_t);
+    header.skips_offset = header.terms_offset + term_count * sizeof(search_segment_term_t);
+    header.postings_offset = ALIGN8(header.skips_offset + block_count * sizeof(posting_skip_t));
+    header.strings_offset = ALIGN8(header.postings_offset + postings_size);
+    header.file_size = ALIGN8(header.strings_offset + strings_size);
+
+    search_segment_t* segment = calloc(1, sizeof(search_segment_t));
+    uint8_t* base = segment ? calloc(1, header.file_size) : NULL;
+    if (!base) {
+        free(segment);
+        free_build_terms(terms, term_count);
+        free(lengths);
+        free_merge_inputs(states, input_count);
+        return NULL;
+    }
+    memcpy(base, &header, sizeof(header));
+    segment->base = base;
+    segment->size = header.file_size;
+    segment->mapped = false;
+
+    search_segment_document_t* documents = (search_segment_document_t*)(base + header.documents_offset);
+    uint32_t* line_starts = (uint32_t*)(base + header.lines_offset);
+    uint8_t* line_fields = base + header.fields_offset;
+    search_segment_term_t* out_terms = (search_segment_term_t*)(base + header.terms_offset);
+    posting_skip_t* skips = (posting_skip_t*)(base + header.skips_offset);
+    uint8_t* postings = base + header.postings_offset;
+    char* strings = (char*)(base + header.strings_offset);
+    uint64_t string_offset = 0;
+    uint32_t line = 0;
+    uint32_t out_flags = 0;
+
+    for (int k = 0; k < input_count; k++) {
+        const merge_input_t* state = &states[k];
+        for (int i = 0; i < state->document_count; i++) {
+            if (state->remap[i] < 0) continue;
+            search_segment_document_t* doc = &documents[state->remap[i]];
+
+            if (state->input->segment) {
+                const search_segment_t* stored = state->input->segment;
+                const search_segment_document_t* source = &stored->documents[i];
+                *doc = *source;
+                doc->first_line = line;
+                doc->path_offset = string_offset;
+                memcpy(strings + string_offset, stored->strings + source->path_offset, source->path_length + 1);
+                string_offset += source->path_length + 1;
+                doc->text_offset = string_offset;
+                memcpy(strings + string_offset, stored->strings + source->text_offset,
+                       source->content_length + 1);
+                string_offset += source->content_length + 1;
+                memcpy(line_starts + line, stored->line_starts + source->first_line,
+                       source->line_count * sizeof(uint32_t));
+                memcpy(line_fields + line, stored->line_fields + source->first_line, source->line_count);
+                line += source->line_count;
+                out_flags |= doc->flags;
+                continue;
+            }
+
+            const search_document_t* source = state->input->index->documents[i];
+            doc->document_id = (uint32_t)source->document_id;
+            doc->line_count = (uint32_t)source->line_count;
+            doc->first_line = line;
+            doc->path_length = (uint32_t)strlen(source->filepath);
+            doc->path_offset = string_offset;
+            memcpy(strings + string_offset, source->filepath, doc->path_length + 1);
+            string_offset += doc->path_length + 1;
+            doc->text_offset = string_offset;
+            doc->content_length = source->content_length;
+            doc->last_modified = (int64_t)source->last_modified;
+            doc->word_count = (uint32_t)source->word_count;
+            if (source->line_fields) {
+                doc->flags = SEARCH_SEGMENT_FIELDS;
+                memcpy(line_fields + line, source->line_fields, source->line_count);
+                out_flags |= doc->flags;
+            }
+
+            memcpy(strings + string_offset, source->content, source->content_length + 1);
+            memcpy(line_starts + line, source->line_starts, source->line_count * sizeof(uint32_t));
+            line += source->line_count;
+            string_offset += source->content_length + 1;
+        }
+    }
+
+    uint64_t postings_offset = 0;
+    uint32_t block = 0;
+    for (size_t i = 0; i < term_count; i++) {
+        const build_term_t* term = &terms[i];
+        search_segment_term_t* out = &out_terms[i];
+        out->word_offset = string_offset;
+        out->word_length = term->word_length;
+        memcpy(strings + string_offset, term->word, term->word_length);
+        string_offset += term->word_length + 1;
+
+        out->postings_offset = postings_offset;
+        out->postings_size = term->postings.size;
+        out->first_block = block;
+        out->block_count = (uint32_t)term->postings.block_count;
+        out->document_count = (uint32_t)term->postings.document_count;
+        out->occurrence_count = (uint32_t)term->postings.occurrence_count;
+        memcpy(postings + postings_offset, term->postings.data, term->postings.size);
+        memcpy(skips + block, term->postings.skips, term->postings.block_count * sizeof(posting_skip_t));
+        postings_offset += term->postings.size;
+        block += out->block_count;
+    }
+    free_build_terms(terms, term_count);
+    free(lengths);
+    free_merge_inputs(states, input_count);
+
+    search_segment_header_t* out_header = (search_segment_header_t*)base;
+    out_header->flags = out_flags;
+    out_header->checksum = segment_checksum(base + sizeof(header), header.file_size - sizeof(header));
+    segment_bind(segment);
+    return segment;
+}
+
+// ============= FILES =============
+
+int search_segment_write(const search_segment_t* segment, const char* filepath) {
+    if (!segment || !filepath) return -1;
+
+    size_t length = strlen(filepath);
+    char* temporary = malloc(length + 5);
+    if (!temporary) return -1;
+    memcpy(temporary, filepath, length);
+    memcpy(temporary + length, ".tmp", 5);
+
+    FILE* file = fopen(temporary, "wb");
+    if (!file) {
+        free(temporary);
+        return -1;
+    }
+    bool ok = fwrite(segment->base, 1, segment->size, file) == segment->size;
+    ok = fclose(file) == 0 && ok;
+    if (ok) ok = rename(temporary, filepath) == 0;
+    if (!ok) remove(temporary);
+    free(temporary);
+    return ok ? 0 : -1;
+}
+
+static bool section_fits(uint64_t offset, uint64_t count, size_t item_size, uint64_t end) {
+    return offset % 8 == 0 && offset <= end && count <= (end - offset) / item_size;
+}
+
+static bool segment_structure_valid(const search_segment_t* segment);
+
+search_segment_t* search_segment_open(const char* filepath) {
+    if (!filepath) return NULL;
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(search_segment_header_t)) {
+        close(fd);
+        return NULL;
+    }
+    size_t size = (size_t)st.st_size;
+    void* base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) return NULL;
+
+    const search_segment_header_t* h = base;
+    bool valid = memcmp(h->magic, SEARCH_SEGMENT_MAGIC, 8) == 0 &&
+                 h->version == SEARCH_SEGMENT_VERSION &&
+                 h->byte_order == SEARCH_SEGMENT_BYTE_ORDER &&
+                 h->file_size == size &&
+                 h->documents_offset >= sizeof(*h) &&
+                 section_fits(h->documents_offset, h->document_count, sizeof(search_segment_document_t), h->lines_offset) &&
+                 section_fits(h->lines_offset, h->line_count, sizeof(uint32_t), h->fields_offset) &&
+                 section_fits(h->fields_offset, h->line_count, 1, h->terms_offset) &&
+                 section_fits(h->terms_offset, h->term_count, sizeof(search_segment_term_t), h->trigrams_offset) &&
+                 section_fits(h->trigrams_offset, h->trigram_count, sizeof(search_segment_term_t), h->skips_offset) &&
+                 section_fits(h->skips_offset, h->block_count, sizeof(posting_skip_t), h->postings_offset) &&
+                 section_fits(h->postings_offset, 0, 1, h->strings_offset) &&
+                 section_fits(h->strings_offset, 0, 1, size) &&
+                 h->checksum == segment_checksum((const uint8_t*)base + sizeof(*h), size - sizeof(*h));
+
+    search_segment_t* segment = valid ? calloc(1, sizeof(search_segment_t)) : NULL;
+    if (!segment) {
+        munmap(base, size);
+        return NULL;
+    }
+    segment->base = base;
+    segment->size = size;
+    segment->mapped = true;
+    segment_bind(segment);
+    if (!segment_structure_valid(segment)) {
+        search_segment_close(segment);
+        return NULL;
+    }
+    return segment;
+}
+
+void search_segment_close(search_segment_t* segment) {
+    if (!segment) return;
+    if (segment->mapped) {
+        munmap(segment->base, segment->size);
+    } else {
+        free(segment->base);
+    }
+    free(segment);
+}
+
+// ============= VALIDATION =============
+
+// Whether `length` bytes at `offset` of the strings, then a NUL, fit
+static bool string_fits(const search_segment_t* segment, uint64_t offset, uint64_t length) {
+    uint64_t size = segment->size - segment->header->strings_offset;
+    return offset < size && length < size - offset && segment->strings[offset + length] == '\0';
+}
+
+static bool dictionary_valid(const search_segment_t* segment, const search_segment_term_t* terms,
+                             uint32_t count) {
+    const search_segment_header_t* h = segment->header;
+    uint64_t postings_size = h->strings_offset - h->postings_offset;
+    const char* previous = NULL;
+    for (uint32_t i = 0; i < count; i++) {
+        const search_segment_term_t* term = &terms[i];
+        if (!string_fits(segment, term->word_offset, term->word_length)) return false;
+        const char* word = segment->strings + term->word_offset;
+        if (strlen(word) != term->word_length || (previous && strcmp(previous, word) >= 0)) return false;
+        previous = word;
+        if (term->postings_offset > postings_size || term->postings_size > postings_size - term->postings_offset ||
+            term->first_block > h->block_count || term->block_count > h->block_count - term->first_block) {
+            return false;
+        }
+        posting_list_t postings;
+        segment_term_view(segment, term, &postings);
+        if (!posting_list_validate(&postings, h->document_count)) return false;
+    }
+    return true;
+}
+
+static int compare_ids(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Document ids fit the index's int ids and appear once
+static bool document_ids_valid(const search_segment_t* segment) {
+    const search_segment_header_t* h = segment->header;
+    if (h->document_count == 0) return true;
+    uint32_t* ids = malloc(h->document_count * sizeof(uint32_t));
+    if (!ids) return false;
+    bool valid = true;
+    for (uint32_t d = 0; valid && d < h->document_count; d++) {
+        ids[d] = segment->documents[d].document_id;
+        valid = ids[d] < INT32_MAX;
+    }
+    if (valid) qsort(ids, h->document_count, sizeof(uint32_t), compare_ids);
+    for (uint32_t d = 1; valid && d < h->document_count; d++) {
+        valid = ids[d] != ids[d - 1];
+    }
+    free(ids);
+    return valid;
+}
+
+// Every invariant but the checksum, so that nothing read from the image
+// leaves it
+static bool segment_structure_valid(const search_segment_t* segment) {
+    const search_segment_header_t* h = segment->header;
+    if (!document_ids_valid(segment)) return false;
+
+    // Lines NUL-terminated in their document's text
+    uint64_t word_count = 0;
+    for (uint32_t d = 0; d < h->document_count; d++) {
+        const search_segment_document_t* doc = &segment->documents[d];
+        if (!string_fits(segment, doc->path_offset, doc->path_length) ||
+            !string_fits(segment, doc->text_offset, doc->content_length) ||
+            doc->line_count == 0 || doc->first_line > h->line_count ||
+            doc->line_count > h->line_count - doc->first_line) {
+            return false;
+        }
+        const uint32_t* starts = segment->line_starts + doc->first_line;
+        const uint8_t* fields = segment->line_fields + doc->first_line;
+        const char* text = segment->strings + doc->text_offset;
+        if (starts[0] != 0 || (doc->flags & ~SEARCH_SEGMENT_FIELDS) ||
+            ((doc->flags & SEARCH_SEGMENT_FIELDS) && !(h->flags & SEARCH_SEGMENT_FIELDS))) {
+            return false;
+        }
+        for (uint32_t l = 0; l < doc->line_count; l++) {
+            if (l > 0 && (starts[l] <= starts[l - 1] || starts[l] > doc->content_length ||
+                          text[starts[l] - 1] != '\0')) {
+                return false;
+            }
+            if ((doc->flags & SEARCH_SEGMENT_FIELDS) ? !search_field_valid(fields[l]) : fields[l] != 0) return false;
+        }
+        word_count += doc->word_count;
+    }
+    return word_count == h->word_count && dictionary_valid(segment, segment->terms, h->term_count) &&
+           dictionary_valid(segment, segment->trigrams, h->trigram_count);
+}
+
+bool search_segment_validate(const search_segment_t* segment) {
+    if (!segment) return false;
+    const search_segment_header_t* h = segment->header;
+    return h->checksum == segment_checksum(segment->base + sizeof(*h), segment->size - sizeof(*h)) &&
+           segment_structure_valid(segment);
+}
+
+// ============= QUERIES =============
+
+int search_segment_document_count(const search_segment_t* segment) {
+    return segment ? (int)segment->header->document_count : 0;
+}
+
+const char* search_segment_path(const search_segment_t* segment, int document) {
+    if (!segment || document < 0 || document >= (int)segment->header->document_count) return NULL;
+    return segment->strings + segment->documents[document].path_offset;
+}
+
+const char* search_segment_line(const search_segment_t* segment, int document, int line) {
+    if (!segment || document < 0 || document >= (int)segment->header->document_count) return NULL;
+    const search_segment_document_t* doc = &segment->documents[document];
+    if (line < 0 || line >= (int)doc->line_count) return NULL;
+    return segment->strings + doc->text_offset + segment->line_starts[doc->first_line + line];
+}
+
+uint8_t search_segment_line_field(const search_segment_t* segment, int document, int line) {
+    if (!segment || document < 0 || document >= (int)segment->header->document_count) return 0;
+    const search_segment_document_t* doc = &segment->documents[document];
+    if (line < 0 || line >= (int)doc->line_count) return 0;
+    return segment->line_fields[doc->first_line + line];
+}
+
+static bool find_in_dictionary(const search_segment_t* segment, const search_segment_term_t* terms,
+                               size_t count, const char* word, posting_list_t* postings) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int order = strcmp(segment->strings + terms[mid].word_offset, word);
+        if (order == 0) {
+            segment_term_view(segment, &terms[mid], postings);
+            return true;
+        }
+        if (order < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return false;
+}
+
+bool search_segment_find_term(const search_segment_t* segment, const char* word,
+                              posting_list_t* postings) {
+    if (!segment || !word) return false;
+    return find_in_dictionary(segment, segment->terms, segment->header->term_count, word, postings);
+}
+
+bool search_segment_find_trigram(const search_segment_t* segment, const char* trigram,
+                                 posting_list_t* postings) {
+    if (!segment || !trigram) return false;
+    return find_in_dictionary(segment, segment->trigrams, segment->header->trigram_count, trigram, postings);
+}
+
+const char* search_segment_term(const search_segment_t* segment, size_t i, posting_list_t* postings) {
+    if (!segment || i >= segment->header->term_count) return NULL;
+    segment_term_view(segment, &segment->terms[i], postings);
+    return segment->strings + segment->terms[i].word_offset;
+}
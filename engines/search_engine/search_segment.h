@@ -0,0 +1,156 @@
+#ifndef SEARCH_SEGMENT_H
+#define SEARCH_SEGMENT_H
+
+// Immutable index segments (internal to the search engine).
+//
+// A segment is one position-independent byte image holding documents,
+// their lines and a sorted term dictionary with packed posting lists. The
+// same bytes are used in memory and on disk: an opened file is mmap'ed and
+// queried in place, with no deserialization.
+//
+// Layout (host byte order, checked on open; every section 8-byte aligned):
+//   header        search_segment_header_t
+//   documents     search_segment_document_t[document_count]
+//   line starts   uint32_t per line, relative to its document's text
+//   line fields   uint8_t per line (search_markdown.h), 0 for documents
+//                 indexed without fields
+//   terms         search_segment_term_t[term_count], sorted by word
+//   trigrams      search_segment_term_t[trigram_count], sorted, with one
+//                 posting per document holding the trigram
+//   skips         posting_skip_t per posting block, grouped by term, with
+//                 the block's score bounds and, for words, its fields
+//   postings      packed posting blocks (search_postings.h)
+//   strings       words, paths and document texts, NUL-terminated
+//
+// A document's text is stored line by line, each line NUL-terminated in
+// place of its '\n', so lines are returned as plain C strings. The header
+// checksum covers every byte after the header.
+
+#include "search_engine.h"
+#include "search_postings.h"
+
+#define SEARCH_SEGMENT_MAGIC "MDSEGIDX"
+#define SEARCH_SEGMENT_VERSION 5
+#define SEARCH_SEGMENT_BYTE_ORDER 0x01020304u
+
+// Document flag: indexed with its markdown fields. Set in the header when
+// any document is.
+#define SEARCH_SEGMENT_FIELDS 0x1u
+
+// Fields of a word's posting block: bit 1 << kind (search_markdown.h) for
+// each kind of line holding it, shifted left by SEARCH_BLOCK_TITLE_SHIFT
+// in documents whose title holds it. Documents without fields count as
+// body; set only in segments with fields, so search can bound field boosts
+// per block.
+#define SEARCH_BLOCK_TITLE_SHIFT 4
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t file_size;
+    uint64_t checksum;
+    uint32_t document_count;
+    uint32_t term_count;
+    uint32_t line_count;
+    uint32_t block_count;
+    uint32_t trigram_count;
+    uint32_t flags;
+    uint64_t word_count;            // indexed words over all documents
+    uint64_t documents_offset;
+    uint64_t lines_offset;
+    uint64_t fields_offset;
+    uint64_t terms_offset;
+    uint64_t trigrams_offset;
+    uint64_t skips_offset;
+    uint64_t postings_offset;
+    uint64_t strings_offset;
+} search_segment_header_t;
+
+typedef struct {
+    uint32_t document_id;
+    uint32_t line_count;
+    uint32_t first_line;            // index of its first line start
+    uint32_t path_length;
+    uint32_t word_count;            // indexed words, the BM25 length
+    uint32_t flags;
+    uint64_t path_offset;           // into strings
+    uint64_t text_offset;           // into strings
+    uint64_t content_length;
+    int64_t last_modified;
+} search_segment_document_t;
+
+typedef struct {
+    uint64_t word_offset;           // into strings
+    uint64_t postings_offset;       // into postings
+    uint32_t postings_size;
+    uint32_t first_block;           // index of its first skip
+    uint32_t block_count;
+    uint32_t word_length;
+    uint32_t document_count;
+    uint32_t occurrence_count;
+} search_segment_term_t;
+
+typedef struct search_segment {
+    uint8_t* base;
+    size_t size;
+    bool mapped;                    // base is an mmap of a file, else malloc'ed
+
+    const search_segment_header_t* header;
+    const search_segment_document_t* documents;
+    const uint32_t* line_starts;
+    const uint8_t* line_fields;
+    const search_segment_term_t* terms;
+    const search_segment_term_t* trigrams;
+    const posting_skip_t* skips;
+    const uint8_t* postings;
+    const char* strings;
+} search_segment_t;
+
+// Input of a merge: a segment, or the in-memory documents of an index
+typedef struct {
+    const search_segment_t* segment;
+    const search_index_t* index;    // used when `segment` is NULL
+    const uint8_t* deleted;         // bitmap of documents to drop, or NULL
+} search_segment_input_t;
+
+// New segment holding the kept documents of every input, in input order
+// (segment-local numbers follow that order), with their term dictionaries
+// merged. Document ids are kept.
+search_segment_t* search_segment_merge(const search_segment_input_t* inputs, int input_count);
+
+// Write the image to `filepath` (through a temporary file and a rename)
+int search_segment_write(const search_segment_t* segment, const char* filepath);
+
+// Map a segment file. Returns NULL if it is missing, truncated, of another
+// version or byte order, or fails its checksum or search_segment_validate().
+search_segment_t* search_segment_open(const char* filepath);
+void search_segment_close(search_segment_t* segment);
+
+// Check a segment against its checksum and its invariants: document ids
+// unique and below INT32_MAX, document and line tables within the text,
+// dictionaries sorted, postings in order and within the segment's documents
+bool search_segment_validate(const search_segment_t* segment);
+
+int search_segment_document_count(const search_segment_t* segment);
+const char* search_segment_path(const search_segment_t* segment, int document);
+
+// Line `line` of document `document` (segment-local), or NULL
+const char* search_segment_line(const search_segment_t* segment, int document, int line);
+
+// Field byte of a line (search_markdown.h), 0 if there is no such line
+uint8_t search_segment_line_field(const search_segment_t* segment, int document, int line);
+
+// Postings of a lowercase word as a view into the segment. Documents in
+// the postings are segment-local indexes.
+bool search_segment_find_term(const search_segment_t* segment, const char* word,
+                              posting_list_t* postings);
+
+// Postings of a trigram (see search_trigram()): documents only
+bool search_segment_find_trigram(const search_segment_t* segment, const char* trigram,
+                                 posting_list_t* postings);
+
+// The `i`-th word in dictionary order, with its postings view
+const char* search_segment_term(const search_segment_t* segment, size_t i, posting_list_t* postings);
+
+#endif // SEARCH_SEGMENT_H
@@ -0,0 +1,308 @@
+#include "search_suggest.h"
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t offset;                // of the block's first entry in `data`
+    uint32_t max_weight;
+} suggest_block_t;
+
+struct suggest_dictionary {
+    uint8_t* data;                  // front-coded entries
+    size_t size;
+    suggest_block_t* blocks;
+    size_t block_count;
+    size_t entry_count;
+
+    // Sparse table: heaviest[k][i] is the leftmost heaviest block among
+    // blocks i .. i + 2^k - 1
+    uint32_t** heaviest;
+    int levels;
+};
+
+// Case-insensitive order over the first SUGGEST_MAX_LENGTH bytes
+static int compare_folded(const char* a, const char* b) {
+    for (size_t i = 0; i < SUGGEST_MAX_LENGTH; i++) {
+        int ca = tolower((unsigned char)a[i]), cb = tolower((unsigned char)b[i]);
+        if (ca != cb) return ca - cb;
+        if (!ca) return 0;
+    }
+    return 0;
+}
+
+static bool has_prefix_folded(const char* text, const char* prefix, size_t prefix_length) {
+    for (size_t i = 0; i < prefix_length; i++) {
+        if (tolower((unsigned char)text[i]) != tolower((unsigned char)prefix[i])) return false;
+    }
+    return true;
+}
+
+static int compare_entries(const void* a, const void* b) {
+    const char* x = ((const suggest_entry_t*)a)->text;
+    const char* y = ((const suggest_entry_t*)b)->text;
+    int order = compare_folded(x, y);
+    return order ? order : strncmp(x, y, SUGGEST_MAX_LENGTH);
+}
+
+static size_t text_length(const char* text) {
+    size_t length = strlen(text);
+    return length < SUGGEST_MAX_LENGTH ? length : SUGGEST_MAX_LENGTH;
+}
+
+static uint8_t* write_varint(uint8_t* p, uint32_t value) {
+    while (value >= 0x80) {
+        *p++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+static uint32_t read_varint(const uint8_t** p) {
+    uint32_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *(*p)++;
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
+
+suggest_dictionary_t* suggest_dictionary_build(suggest_entry_t* entries, size_t count) {
+    suggest_dictionary_t* dictionary = calloc(1, sizeof(suggest_dictionary_t));
+    if (!dictionary) return NULL;
+    qsort(entries, count, sizeof(suggest_entry_t), compare_entries);
+
+    // Fold entries equal up to case into the first one
+    size_t unique = 0;
+    size_t capacity = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (unique > 0 && compare_folded(entries[unique - 1].text, entries[i].text) == 0) {
+            uint32_t sum = entries[unique - 1].weight + entries[i].weight;
+            entries[unique - 1].weight = sum < entries[i].weight ? UINT32_MAX : sum;
+            continue;
+        }
+        entries[unique++] = entries[i];
+        capacity += 2 + text_length(entries[i].text) + 5;
+    }
+
+    dictionary->data = malloc(capacity ? capacity : 1);
+    dictionary->block_count = (unique + SUGGEST_BLOCK_SIZE - 1) / SUGGEST_BLOCK_SIZE;
+    dictionary->blocks = calloc(dictionary->block_count ? dictionary->block_count : 1,
+                                sizeof(suggest_block_t));
+    if (!dictionary->data || !dictionary->blocks) {
+        suggest_dictionary_free(dictionary);
+        return NULL;
+    }
+    uint8_t* p = dictionary->data;
+    const char* previous = "";
+    size_t previous_length = 0;
+    for (size_t i = 0; i < unique; i++) {
+        suggest_block_t* block = &dictionary->blocks[i / SUGGEST_BLOCK_SIZE];
+        size_t length = text_length(entries[i].text);
+        size_t shared = 0;
+        if (i % SUGGEST_BLOCK_SIZE == 0) {
+            block->offset = (uint64_t)(p - dictionary->data);
+        } else {
+            while (shared < length && shared < previous_length && entries[i].text[shared] == previous[shared]) {
+                shared++;
+            }
+        }
+        if (entries[i].weight > block->max_weight) block->max_weight = entries[i].weight;
+        *p++ = (uint8_t)shared;
+        *p++ = (uint8_t)(length - shared);
+        memcpy(p, entries[i].text + shared, length - shared);
+        p += length - shared;
+        p = write_varint(p, entries[i].weight);
+        previous = entries[i].text;
+        previous_length = length;
+    }
+    dictionary->size = (size_t)(p - dictionary->data);
+    dictionary->entry_count = unique;
+
+    size_t blocks = dictionary->block_count;
+    while (((size_t)1 << dictionary->levels) <= blocks) dictionary->levels++;
+    dictionary->heaviest = calloc(dictionary->levels ? dictionary->levels : 1, sizeof(uint32_t*));
+    if (!dictionary->heaviest) {
+        suggest_dictionary_free(dictionary);
+        return NULL;
+    }
+    for (int k = 0; k < dictionary->levels; k++) {
+        size_t span = (size_t)1 << k;
+        dictionary->heaviest[k] = malloc((blocks - span + 1) * sizeof(uint32_t));
+        if (!dictionary->heaviest[k]) {
+            suggest_dictionary_free(dictionary);
+            return NULL;
+        }
+        for (size_t i = 0; i + span <= blocks; i++) {
+            if (k == 0) {
+                dictionary->heaviest[0][i] = (uint32_t)i;
+                continue;
+            }
+            uint32_t left = dictionary->heaviest[k - 1][i];
+            uint32_t right = dictionary->heaviest[k - 1][i + span / 2];
+            dictionary->heaviest[k][i] =
+                dictionary->blocks[right].max_weight > dictionary->blocks[left].max_weight ? right : left;
+        }
+    }
+    return dictionary;
+}
+
+// Leftmost heaviest block in [low, high)
+static size_t heaviest_block(const suggest_dictionary_t* dictionary, size_t low, size_t high) {
+    int k = 0;
+    while (((size_t)2 << k) <= high - low) k++;
+    uint32_t left = dictionary->heaviest[k][low];
+    uint32_t right = dictionary->heaviest[k][high - ((size_t)1 << k)];
+    return dictionary->blocks[right].max_weight > dictionary->blocks[left].max_weight ? right : left;
+}
+
+void suggest_dictionary_free(suggest_dictionary_t* dictionary) {
+    if (!dictionary) return;
+    if (dictionary->heaviest) {
+        for (int k = 0; k < dictionary->levels; k++) free(dictionary->heaviest[k]);
+        free(dictionary->heaviest);
+    }
+    free(dictionary->data);
+    free(dictionary->blocks);
+    free(dictionary);
+}
+
+size_t suggest_dictionary_size(const suggest_dictionary_t* dictionary) {
+    return dictionary ? dictionary->entry_count : 0;
+}
+
+// Decode the entry at `*p` over the previous entry's `text`
+static uint32_t next_entry(const uint8_t** p, char* text) {
+    size_t shared = *(*p)++;
+    size_t suffix = *(*p)++;
+    memcpy(text + shared, *p, suffix);
+    text[shared + suffix] = '\0';
+    *p += suffix;
+    return read_varint(p);
+}
+
+static void block_first(const suggest_dictionary_t* dictionary, size_t block, char* text) {
+    const uint8_t* p = dictionary->data + dictionary->blocks[block].offset;
+    next_entry(&p, text);
+}
+
+// A run of blocks still to visit, keyed by its heaviest block
+typedef struct {
+    size_t low, high, heaviest;
+    uint32_t weight;
+} block_range_t;
+
+static bool range_before(const block_range_t* a, const block_range_t* b) {
+    return a->weight != b->weight ? a->weight > b->weight : a->low < b->low;
+}
+
+static void push_range(const suggest_dictionary_t* dictionary, block_range_t* heap, int* count,
+                       size_t low, size_t high) {
+    if (low >= high) return;
+    block_range_t range = { low, high, heaviest_block(dictionary, low, high), 0 };
+    range.weight = dictionary->blocks[range.heaviest].max_weight;
+    int i = (*count)++;
+    while (i > 0 && range_before(&range, &heap[(i - 1) / 2])) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    heap[i] = range;
+}
+
+static block_range_t pop_range(block_range_t* heap, int* count) {
+    block_range_t top = heap[0];
+    block_range_t last = heap[--*count];
+    int i = 0;
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= *count) break;
+        if (child + 1 < *count && range_before(&heap[child + 1], &heap[child])) child++;
+        if (!range_before(&heap[child], &last)) break;
+        heap[i] = heap[child];
+        i = child;
+    }
+    heap[i] = last;
+    return top;
+}
+
+// First block whose first entry is at or past the prefix (`past`: beyond
+// every completion of it)
+static size_t find_block(const suggest_dictionary_t* dictionary, const char* prefix, size_t prefix_length,
+                         bool past) {
+    char text[SUGGEST_MAX_LENGTH + 1];
+    size_t low = 0, high = dictionary->block_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        block_first(dictionary, mid, text);
+        int order = compare_folded(text, prefix);
+        bool after = past ? order > 0 && !has_prefix_folded(text, prefix, prefix_length) : order >= 0;
+        if (after) high = mid;
+        else low = mid + 1;
+    }
+    return low;
+}
+
+int suggest_dictionary_complete(const suggest_dictionary_t* dictionary, const char* prefix, int max,
+                                char (*texts)[SUGGEST_MAX_LENGTH + 1], uint32_t* weights) {
+    size_t prefix_length = strlen(prefix);
+    if (!dictionary || max <= 0 || prefix_length > SUGGEST_MAX_LENGTH) return 0;
+    if (max > SUGGEST_MAX_RESULTS) max = SUGGEST_MAX_RESULTS;
+
+    // Completions start in the block before the first one at or past the
+    // prefix and end before the first one past all of them
+    size_t first = find_block(dictionary, prefix, prefix_length, false);
+    size_t end = find_block(dictionary, prefix, prefix_length, true);
+    if (first > 0) first--;
+
+    // Best first: decode the heaviest block left, then split its range,
+    // until no range can beat the last result. Ranks (dictionary order)
+    // break ties.
+    size_t ranks[SUGGEST_MAX_RESULTS];
+    int heap_capacity = 2 * max + 8;
+    block_range_t* heap = malloc(heap_capacity * sizeof(block_range_t));
+    if (!heap) return 0;
+    int heap_count = 0;
+    int count = 0;
+    char text[SUGGEST_MAX_LENGTH + 1];
+    push_range(dictionary, heap, &heap_count, first, end);
+    while (heap_count > 0) {
+        block_range_t range = pop_range(heap, &heap_count);
+        if (count == max && (range.weight < weights[max - 1] ||
+                             (range.weight == weights[max - 1] && range.low * SUGGEST_BLOCK_SIZE > ranks[max - 1]))) {
+            break;
+        }
+        const uint8_t* p = dictionary->data + dictionary->blocks[range.heaviest].offset;
+        size_t rank = range.heaviest * SUGGEST_BLOCK_SIZE;
+        size_t n = dictionary->entry_count - rank < SUGGEST_BLOCK_SIZE ? dictionary->entry_count - rank
+                                                                       : SUGGEST_BLOCK_SIZE;
+        for (size_t i = 0; i < n; i++, rank++) {
+            uint32_t weight = next_entry(&p, text);
+            if (!has_prefix_folded(text, prefix, prefix_length)) continue;
+            int position = count;
+            while (position > 0 && (weights[position - 1] < weight ||
+                                    (weights[position - 1] == weight && ranks[position - 1] > rank))) {
+                position--;
+            }
+            if (position >= max) continue;
+            int last = count < max ? count : max - 1;
+            memmove(&texts[position + 1], &texts[position], (size_t)(last - position) * sizeof(texts[0]));
+            memmove(&weights[position + 1], &weights[position], (size_t)(last - position) * sizeof(weights[0]));
+            memmove(&ranks[position + 1], &ranks[position], (size_t)(last - position) * sizeof(ranks[0]));
+            strcpy(texts[position], text);
+            weights[position] = weight;
+            ranks[position] = rank;
+            if (count < max) count++;
+        }
+        if (heap_count + 2 > heap_capacity) {
+            block_range_t* grown = realloc(heap, 2 * heap_capacity * sizeof(block_range_t));
+            if (!grown) break;
+            heap = grown;
+            heap_capacity *= 2;
+        }
+        push_range(dictionary, heap, &heap_count, range.low, range.heaviest);
+        push_range(dictionary, heap, &heap_count, range.heaviest + 1, range.high);
+    }
+    free(heap);
+    return count;
+}
@@ -0,0 +1,42 @@
+#ifndef SEARCH_SUGGEST_H
+#define SEARCH_SUGGEST_H
+
+// Completion dictionary (internal to the search engine).
+//
+// Completions are sorted case-insensitively and front-coded in blocks of
+// SUGGEST_BLOCK_SIZE: each entry stores the length of the prefix it shares
+// with the previous one, the rest of its text and its weight as a varint;
+// the first entry of a block is stored whole so blocks can be binary
+// searched. A prefix selects a contiguous run of blocks; a sparse table over
+// the blocks' largest weights lets a top-N lookup decode them heaviest
+// first and stop once no block left can beat the N best found so far.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SUGGEST_BLOCK_SIZE 16
+#define SUGGEST_MAX_LENGTH 255      // longer texts are cut
+#define SUGGEST_MAX_RESULTS 64
+
+typedef struct {
+    const char* text;
+    uint32_t weight;
+} suggest_entry_t;
+
+typedef struct suggest_dictionary suggest_dictionary_t;
+
+// Dictionary of `entries` (sorted in place). Texts equal up to case are
+// one completion, spelled as the first one met, with their weights summed.
+suggest_dictionary_t* suggest_dictionary_build(suggest_entry_t* entries, size_t count);
+void suggest_dictionary_free(suggest_dictionary_t* dictionary);
+
+size_t suggest_dictionary_size(const suggest_dictionary_t* dictionary);
+
+// Up to `max` completions starting with `prefix` (ignoring case), heaviest
+// first, ties in dictionary order. Each is copied into a
+// SUGGEST_MAX_LENGTH + 1 byte slot of `texts`; returns the count.
+int suggest_dictionary_complete(const suggest_dictionary_t* dictionary, const char* prefix, int max,
+                                char (*texts)[SUGGEST_MAX_LENGTH + 1], uint32_t* weights);
+
+#endif // SEARCH_SUGGEST_H
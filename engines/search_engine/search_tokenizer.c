@@ -0,0 +1,385 @@
+#include "search_tokenizer.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define TOKENIZER_SSE2 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define TOKENIZER_NEON 1
+#endif
+
+// ============= CHARACTER CLASSES =============
+
+enum {
+    CHAR_WORD,
+    CHAR_SEPARATOR,
+    CHAR_IDEOGRAPH
+};
+
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+    uint8_t kind;
+} char_range_t;
+
+// Non-ASCII code points that are not plain word characters, sorted; the
+// rest (letters, marks, digits of every script) are
+static const char_range_t char_ranges[] = {
+    { 0x0080, 0x00A9, CHAR_SEPARATOR },     // controls, no-break space, ¡ to ©
+    { 0x00AB, 0x00B4, CHAR_SEPARATOR },     // « to ´
+    { 0x00B6, 0x00B9, CHAR_SEPARATOR },     // ¶ to ¹
+    { 0x00BB, 0x00BF, CHAR_SEPARATOR },     // » to ¿
+    { 0x00D7, 0x00D7, CHAR_SEPARATOR },     // ×
+    { 0x00F7, 0x00F7, CHAR_SEPARATOR },     // ÷
+    { 0x02C2, 0x02C5, CHAR_SEPARATOR },     // modifier symbols
+    { 0x02D2, 0x02DF, CHAR_SEPARATOR },
+    { 0x037E, 0x037E, CHAR_SEPARATOR },     // Greek question mark
+    { 0x0387, 0x0387, CHAR_SEPARATOR },
+    { 0x055A, 0x055F, CHAR_SEPARATOR },     // Armenian punctuation
+    { 0x0589, 0x058A, CHAR_SEPARATOR },
+    { 0x05BE, 0x05BE, CHAR_SEPARATOR },     // Hebrew punctuation
+    { 0x05C0, 0x05C0, CHAR_SEPARATOR },
+    { 0x05C3, 0x05C3, CHAR_SEPARATOR },
+    { 0x05C6, 0x05C6, CHAR_SEPARATOR },
+    { 0x05F3, 0x05F4, CHAR_SEPARATOR },
+    { 0x0600, 0x060F, CHAR_SEPARATOR },     // Arabic punctuation
+    { 0x061B, 0x061F, CHAR_SEPARATOR },
+    { 0x066A, 0x066D, CHAR_SEPARATOR },
+    { 0x06D4, 0x06D4, CHAR_SEPARATOR },
+    { 0x0964, 0x0965, CHAR_SEPARATOR },     // Devanagari danda
+    { 0x0970, 0x0970, CHAR_SEPARATOR },
+    { 0x0E4F, 0x0E4F, CHAR_SEPARATOR },     // Thai punctuation
+    { 0x0E5A, 0x0E5B, CHAR_SEPARATOR },
+    { 0x10FB, 0x10FB, CHAR_SEPARATOR },
+    { 0x1360, 0x1368, CHAR_SEPARATOR },     // Ethiopic punctuation
+    { 0x1680, 0x1680, CHAR_SEPARATOR },     // Ogham space
+    { 0x169B, 0x169C, CHAR_SEPARATOR },
+    { 0x16EB, 0x16ED, CHAR_SEPARATOR },
+    { 0x1800, 0x180A, CHAR_SEPARATOR },     // Mongolian punctuation
+    { 0x2000, 0x203E, CHAR_SEPARATOR },     // spaces, dashes, quotes, ellipsis
+    { 0x2041, 0x2053, CHAR_SEPARATOR },     // (‿ and ⁀ join words like '_')
+    { 0x2055, 0x2070, CHAR_SEPARATOR },
+    { 0x2074, 0x207E, CHAR_SEPARATOR },     // superscripts and subscripts
+    { 0x2080, 0x208E, CHAR_SEPARATOR },
+    { 0x20A0, 0x20CF, CHAR_SEPARATOR },     // currency
+    { 0x2100, 0x2BFF, CHAR_SEPARATOR },     // letterlike, arrows, math, box drawing, dingbats
+    { 0x2E00, 0x2E7F, CHAR_SEPARATOR },     // supplemental punctuation
+    { 0x2E80, 0x2FFF, CHAR_SEPARATOR },     // CJK radicals, ideographic description
+    { 0x3000, 0x3004, CHAR_SEPARATOR },     // ideographic space, 、 。
+    { 0x3008, 0x3020, CHAR_SEPARATOR },     // CJK brackets
+    { 0x3030, 0x3030, CHAR_SEPARATOR },
+    { 0x303D, 0x303F, CHAR_SEPARATOR },
+    { 0x3040, 0x309F, CHAR_IDEOGRAPH },     // hiragana
+    { 0x30A0, 0x30A0, CHAR_SEPARATOR },
+    { 0x30FB, 0x30FB, CHAR_SEPARATOR },     // katakana middle dot
+    { 0x3400, 0x4DBF, CHAR_IDEOGRAPH },     // CJK extension A
+    { 0x4E00, 0x9FFF, CHAR_IDEOGRAPH },     // CJK unified ideographs
+    { 0xD800, 0xDFFF, CHAR_SEPARATOR },     // surrogates
+    { 0xE000, 0xF8FF, CHAR_SEPARATOR },     // private use
+    { 0xF900, 0xFAFF, CHAR_IDEOGRAPH },     // CJK compatibility ideographs
+    { 0xFD3E, 0xFD3F, CHAR_SEPARATOR },
+    { 0xFE10, 0xFE1F, CHAR_SEPARATOR },     // vertical forms
+    { 0xFE30, 0xFE32, CHAR_SEPARATOR },     // CJK compatibility forms
+    { 0xFE35, 0xFE4C, CHAR_SEPARATOR },
+    { 0xFE50, 0xFE6F, CHAR_SEPARATOR },     // small forms
+    { 0xFEFF, 0xFEFF, CHAR_SEPARATOR },     // byte order mark
+    { 0xFF01, 0xFF0F, CHAR_SEPARATOR },     // fullwidth punctuation
+    { 0xFF1A, 0xFF20, CHAR_SEPARATOR },
+    { 0xFF3B, 0xFF3E, CHAR_SEPARATOR },
+    { 0xFF40, 0xFF40, CHAR_SEPARATOR },
+    { 0xFF5B, 0xFF65, CHAR_SEPARATOR },
+    { 0xFFE0, 0xFFFF, CHAR_SEPARATOR },     // fullwidth symbols, specials
+    { 0x1F000, 0x1FBFF, CHAR_SEPARATOR },   // emoji, pictographs, game symbols
+    { 0x20000, 0x3FFFF, CHAR_IDEOGRAPH },   // CJK extensions B and beyond
+    { 0xE0000, 0x10FFFF, CHAR_SEPARATOR },  // tags, private use
+};
+
+static int char_class(uint32_t c) {
+    if (c >= 0x00C0 && c < 0x02C2) return c == 0x00D7 || c == 0x00F7 ? CHAR_SEPARATOR : CHAR_WORD;
+    int lo = 0, hi = (int)(sizeof(char_ranges) / sizeof(char_ranges[0]));
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (char_ranges[mid].last < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < (int)(sizeof(char_ranges) / sizeof(char_ranges[0])) && char_ranges[lo].first <= c) {
+        return char_ranges[lo].kind;
+    }
+    return CHAR_WORD;
+}
+
+// ============= UTF-8 =============
+
+// Code point at `p` and its byte count in `length`; -1 (one byte) for an
+// invalid, overlong or truncated sequence
+static int32_t decode_utf8(const unsigned char* p, const unsigned char* end, int* length) {
+    unsigned char lead = p[0];
+    *length = 1;
+    if (lead < 0x80) return lead;
+    int count;
+    uint32_t c;
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        count = 2;
+        c = lead & 0x1F;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        count = 3;
+        c = lead & 0x0F;
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        count = 4;
+        c = lead & 0x07;
+    } else {
+        return -1;
+    }
+    if (end - p < count) return -1;
+    for (int i = 1; i < count; i++) {
+        if ((p[i] & 0xC0) != 0x80) return -1;
+        c = (c << 6) | (p[i] & 0x3F);
+    }
+    if ((count == 3 && c < 0x800) || (count == 4 && (c < 0x10000 || c > 0x10FFFF))) return -1;
+    *length = count;
+    return (int32_t)c;
+}
+
+static int encode_utf8(uint32_t c, char* out) {
+    if (c < 0x80) {
+        out[0] = (char)c;
+        return 1;
+    }
+    if (c < 0x800) {
+        out[0] = (char)(0xC0 | (c >> 6));
+        out[1] = (char)(0x80 | (c & 0x3F));
+        return 2;
+    }
+    if (c < 0x10000) {
+        out[0] = (char)(0xE0 | (c >> 12));
+        out[1] = (char)(0x80 | ((c >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (c & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (c >> 18));
+    out[1] = (char)(0x80 | ((c >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((c >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (c & 0x3F));
+    return 4;
+}
+
+// ============= CASE FOLDING =============
+
+// Uppercase letters from `first` to `last`, every `step`-th one, lowercase
+// at `delta` from them
+typedef struct {
+    uint32_t first;
+    uint32_t last;
+    int32_t delta;
+    uint8_t step;
+} fold_range_t;
+
+static const fold_range_t fold_ranges[] = {
+    { 0x00C0, 0x00D6, 32, 1 },              // À to Ö
+    { 0x00D8, 0x00DE, 32, 1 },              // Ø to Þ
+    { 0x0100, 0x012F, 1, 2 },               // Latin Extended-A pairs
+    { 0x0130, 0x0130, -199, 1 },            // İ to i
+    { 0x0132, 0x0137, 1, 2 },
+    { 0x0139, 0x0148, 1, 2 },
+    { 0x014A, 0x0177, 1, 2 },               // Œ among them
+    { 0x0178, 0x0178, -121, 1 },            // Ÿ to ÿ
+    { 0x0179, 0x017E, 1, 2 },
+    { 0x0386, 0x0386, 38, 1 },              // Greek with tonos
+    { 0x0388, 0x038A, 37, 1 },
+    { 0x038C, 0x038C, 64, 1 },
+    { 0x038E, 0x038F, 63, 1 },
+    { 0x0391, 0x03A1, 32, 1 },              // Greek
+    { 0x03A3, 0x03AB, 32, 1 },
+    { 0x0400, 0x040F, 80, 1 },              // Cyrillic
+    { 0x0410, 0x042F, 32, 1 },
+    { 0x0460, 0x0481, 1, 2 },
+    { 0x048A, 0x04BF, 1, 2 },
+    { 0x1E00, 0x1E95, 1, 2 },               // Latin Extended Additional
+    { 0x1EA0, 0x1EFF, 1, 2 },
+    { 0xFF21, 0xFF3A, 32, 1 },              // fullwidth Latin
+};
+
+static inline unsigned char fold_ascii(unsigned char c) {
+    return (unsigned char)(c - 'A') < 26 ? (unsigned char)(c + 32) : c;
+}
+
+static uint32_t fold_char(uint32_t c) {
+    if (c < 0x80) return fold_ascii((unsigned char)c);
+    if (c < 0xC0) return c;
+    int lo = 0, hi = (int)(sizeof(fold_ranges) / sizeof(fold_ranges[0]));
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (fold_ranges[mid].last < c) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo < (int)(sizeof(fold_ranges) / sizeof(fold_ranges[0]))) {
+        const fold_range_t* range = &fold_ranges[lo];
+        if (range->first <= c && (c - range->first) % range->step == 0) return (uint32_t)((int32_t)c + range->delta);
+    }
+    return c;
+}
+
+size_t search_fold(const char* text, size_t length, char* folded, size_t size) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    size_t out = 0;
+    while (p < end) {
+        char bytes[4];
+        int in, count;
+        if (*p < 0x80) {
+            bytes[0] = (char)fold_ascii(*p);
+            in = count = 1;
+        } else {
+            int32_t c = decode_utf8(p, end, &in);
+            if (c < 0) {
+                bytes[0] = (char)*p;
+                count = 1;
+            } else {
+                count = encode_utf8(fold_char((uint32_t)c), bytes);
+            }
+        }
+        if (out + count >= size) break;
+        memcpy(folded + out, bytes, count);
+        out += count;
+        p += in;
+    }
+    if (size > 0) folded[out] = '\0';
+    return out;
+}
+
+bool search_fold_equal(const char* text, size_t length, const char* folded, size_t folded_length) {
+    const unsigned char* p = (const unsigned char*)text;
+    const unsigned char* end = p + length;
+    size_t at = 0;
+    while (p < end) {
+        if (*p < 0x80) {
+            if (at == folded_length || (unsigned char)folded[at] != fold_ascii(*p)) return false;
+            p++;
+            at++;
+            continue;
+        }
+        char bytes[4];
+        int in, count;
+        int32_t c = decode_utf8(p, end, &in);
+        if (c < 0) {
+            bytes[0] = (char)*p;
+            count = 1;
+        } else {
+            count = encode_utf8(fold_char((uint32_t)c), bytes);
+        }
+        if (folded_length - at < (size_t)count || memcmp(folded + at, bytes, count) != 0) return false;
+        p += in;
+        at += count;
+    }
+    return at == folded_length;
+}
+
+// ============= TOKENIZER =============
+
+static inline bool is_ascii_word(unsigned char c) {
+    return (unsigned char)((c | 0x20) - 'a') < 26 || (unsigned char)(c - '0') < 10 || c == '_';
+}
+
+// Index of the first of 16 bytes that may start a word (an ASCII word byte
+// or a non-ASCII one), or with `in_word`, that is not an ASCII word byte;
+// 16 if none is
+static inline int chunk_stop(const unsigned char* p, bool in_word) {
+#if TOKENIZER_SSE2
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i letter = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i word = _mm_or_si128(_mm_or_si128(digit, letter), _mm_cmpeq_epi8(v, _mm_set1_epi8('_')));
+    uint32_t word_mask = (uint32_t)_mm_movemask_epi8(word);
+    uint32_t stop = in_word ? ~word_mask & 0xFFFF : word_mask | (uint32_t)_mm_movemask_epi8(v);
+    return stop ? __builtin_ctz(stop) : 16;
+#elif TOKENIZER_NEON
+    uint8x16_t v = vld1q_u8(p);
+    uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+    uint8x16_t digit = vcltq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(10));
+    uint8x16_t letter = vcltq_u8(vsubq_u8(lower, vdupq_n_u8('a')), vdupq_n_u8(26));
+    uint8x16_t word = vorrq_u8(vorrq_u8(digit, letter), vceqq_u8(v, vdupq_n_u8('_')));
+    uint8x16_t stop = in_word ? vmvnq_u8(word) : vorrq_u8(word, vcgeq_u8(v, vdupq_n_u8(0x80)));
+    // Four bits per byte
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(stop), 4)), 0);
+    return mask ? __builtin_ctzll(mask) / 4 : 16;
+#else
+    for (int i = 0; i < 16; i++) {
+        if (in_word ? !is_ascii_word(p[i]) : (is_ascii_word(p[i]) || p[i] >= 0x80)) return i;
+    }
+    return 16;
+#endif
+}
+
+// First byte at or after `p` that may start a word, or that ends one
+static const unsigned char* scan_ascii(const unsigned char* p, const unsigned char* end, bool in_word) {
+    while (end - p >= 16) {
+        int stop = chunk_stop(p, in_word);
+        if (stop < 16) return p + stop;
+        p += 16;
+    }
+    while (p < end && (in_word ? is_ascii_word(*p) : !is_ascii_word(*p) && *p < 0x80)) p++;
+    return p;
+}
+
+void search_tokenizer_init(search_tokenizer_t* tokenizer, const char* text, size_t length) {
+    tokenizer->next = text;
+    tokenizer->end = text + length;
+}
+
+bool search_tokenizer_next(search_tokenizer_t* tokenizer, search_token_t* token) {
+    const unsigned char* p = (const unsigned char*)tokenizer->next;
+    const unsigned char* end = (const unsigned char*)tokenizer->end;
+
+    // Skip separators
+    for (;;) {
+        p = scan_ascii(p, end, false);
+        if (p == end) {
+            tokenizer->next = tokenizer->end;
+            return false;
+        }
+        if (*p < 0x80) break;
+        int length;
+        int32_t c = decode_utf8(p, end, &length);
+        int kind = c < 0 ? CHAR_SEPARATOR : char_class((uint32_t)c);
+        if (kind == CHAR_IDEOGRAPH) {
+            token->start = (const char*)p;
+            token->length = (size_t)length;
+            token->indexed = true;
+            tokenizer->next = (const char*)(p + length);
+            return true;
+        }
+        if (kind == CHAR_WORD) break;
+        p += length;
+    }
+
+    // A run of word characters, ASCII ones in bulk
+    const unsigned char* start = p;
+    int characters = 0;
+    while (p < end) {
+        const unsigned char* ascii_end = scan_ascii(p, end, true);
+        characters += (int)(ascii_end - p);
+        p = ascii_end;
+        if (p == end || *p < 0x80) break;
+        int length;
+        int32_t c = decode_utf8(p, end, &length);
+        if (c < 0 || char_class((uint32_t)c) != CHAR_WORD) break;
+        characters++;
+        p += length;
+    }
+    token->start = (const char*)start;
+    token->length = (size_t)(p - start);
+    token->indexed = characters > 1;
+    tokenizer->next = (const char*)p;
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef SEARCH_TOKENIZER_H
+#define SEARCH_TOKENIZER_H
+
+// Word tokenizer (internal to the search engine), shared by indexing and
+// queries.
+//
+// Words are runs of letters, digits and '_' in UTF-8 text. ASCII is
+// classified 16 bytes at a time (SSE2 or NEON where available); other
+// characters are words unless a compact table of Unicode ranges marks them
+// as separators (spaces, punctuation, symbols, emoji) or as ideographs
+// (Han, hiragana), which are each a word of their own. Invalid UTF-8 bytes
+// separate words.
+//
+// Words fold to lowercase over ASCII, Latin-1, Latin Extended-A and
+// Additional, Greek, Cyrillic and fullwidth Latin.
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    const char* start;
+    size_t length;                  // bytes
+    bool indexed;                   // not a lone character (an ideograph is)
+} search_token_t;
+
+typedef struct {
+    const char* next;
+    const char* end;
+} search_tokenizer_t;
+
+// Tokenize the `length` bytes of `text`
+void search_tokenizer_init(search_tokenizer_t* tokenizer, const char* text, size_t length);
+
+// Next word; false at the end
+bool search_tokenizer_next(search_tokenizer_t* tokenizer, search_token_t* token);
+
+// Lowercase form of `length` bytes into `folded`, cut on a character
+// boundary to at most size - 1 bytes and terminated; returns its length
+size_t search_fold(const char* text, size_t length, char* folded, size_t size);
+
+// Whether `length` bytes of `text` fold to the `folded_length` bytes of
+// `folded`
+bool search_fold_equal(const char* text, size_t length, const char* folded, size_t folded_length);
+
+#endif // SEARCH_TOKENIZER_H
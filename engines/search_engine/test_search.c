@@ -0,0 +1,1624 @@
+// test_search.c - Unit tests for the search engine
+#define _POSIX_C_SOURCE 200809L
+#undef NDEBUG
+#include "search_engine.h"
+#include "search_postings.h"
+#include "search_query.h"
+#include "search_regex.h"
+#include "search_segment.h"
+#include "search_tokenizer.h"
+#include <assert.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+static search_index_t* create_test_index(void) {
+    search_index_t* index = search_engine_create(16);
+    assert(index != NULL);
+    assert(search_engine_add_document(index, "a.md",
+        "# Notes\nThe search engine is fast.\nTesting the engine: engine engine\n") == 0);
+    assert(search_engine_add_document(index, "b.md",
+        "Search results\nfast search, slow engine\nnothing here") == 1);
+    assert(search_engine_add_document(index, "c.md", "") == 2);
+    return index;
+}
+
+static search_result_t* run(search_index_t* index, const char* text, bool case_sensitive,
+                            int max_results, int* count) {
+    search_query_t query = {0};
+    query.query = (char*)text;
+    query.whole_words_only = true;
+    query.case_sensitive = case_sensitive;
+    query.max_results = max_results;
+    return search_engine_search(index, &query, count);
+}
+
+static search_result_t* run_substring(search_index_t* index, const char* text, bool case_sensitive,
+                                      int max_results, int* count) {
+    search_query_t query = {0};
+    query.query = (char*)text;
+    query.case_sensitive = case_sensitive;
+    query.max_results = max_results;
+    return search_engine_search(index, &query, count);
+}
+
+static void test_single_term_occurrences(void) {
+    search_index_t* index = create_test_index();
+    int count;
+    search_result_t* results = run(index, "engine", false, 100, &count);
+
+    // Every whole-word occurrence, in corpus order
+    assert(count == 5);
+    assert(results[0].document_id == 0 && results[0].line_number == 1);
+    assert(results[0].column_start == 11 && results[0].column_end == 17);
+    assert(results[1].line_number == 2 && results[1].column_start == 12);
+    assert(results[3].line_number == 2 && results[3].column_start == 27);
+    assert(results[4].document_id == 1 && results[4].line_number == 1);
+    assert(strcmp(results[4].matched_text, "engine") == 0);
+    search_engine_free_results(results, count);
+
+    results = run(index, "engine", false, 2, &count);
+    assert(count == 2);
+    search_engine_free_results(results, count);
+
+    // Whole words only: "test" is not "Testing"
+    results = run(index, "test", false, 100, &count);
+    assert(count == 0 && results == NULL);
+    search_engine_destroy(index);
+}
+
+static void test_multi_term_and(void) {
+    search_index_t* index = create_test_index();
+    int count;
+    search_result_t* results = run(index, "fast engine", false, 100, &count);
+
+    // One result per line holding both terms, at the first term
+    assert(count == 2);
+    assert(results[0].document_id == 0 && results[0].line_number == 1);
+    assert(results[0].column_start == 21);
+    assert(results[1].document_id == 1 && results[1].line_number == 1);
+    search_engine_free_results(results, count);
+
+    results = run(index, "search nothing", false, 100, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+    search_engine_destroy(index);
+}
+
+static void test_case_and_fallback(void) {
+    search_index_t* index = create_test_index();
+    int count;
+    search_result_t* results = run(index, "Search", true, 100, &count);
+    assert(count == 1 && results[0].document_id == 1 && results[0].line_number == 0);
+    search_engine_free_results(results, count);
+
+    results = run(index, "SEARCH", false, 100, &count);
+    assert(count == 3);
+    search_engine_free_results(results, count);
+
+    // No word at all: no whole word matches, a substring scan finds it
+    results = run(index, ", ", false, 100, &count);
+    assert(count == 0 && results == NULL);
+    results = run_substring(index, ", ", false, 100, &count);
+    assert(count == 1 && results[0].document_id == 1 && results[0].column_start == 11);
+    search_engine_free_results(results, count);
+    search_engine_destroy(index);
+}
+
+static void test_large_vocabulary(void) {
+    // Enough distinct terms to resize the table and fill several arena
+    // blocks; a bulk add indexes them all into one in-memory dictionary
+    enum { TERMS = 20000, DOCUMENTS = TERMS / 1000 };
+    search_index_t* index = search_engine_create(DOCUMENTS);
+    char* contents[DOCUMENTS];
+    char names[DOCUMENTS][32];
+    const char* paths[DOCUMENTS];
+    for (int d = 0; d < DOCUMENTS; d++) {
+        char* p = contents[d] = malloc(TERMS);
+        assert(p != NULL);
+        for (int i = d * 1000; i < (d + 1) * 1000; i++) {
+            p += sprintf(p, "term%dx%s", i, i % 10 == 9 ? "\n" : " ");
+        }
+        *p = '\0';
+        sprintf(names[d], "v%d.md", d);
+        paths[d] = names[d];
+    }
+    assert(search_engine_add_documents(index, paths, (const char* const*)contents, DOCUMENTS, 1) == 0);
+
+    int count;
+    char term[32];
+    for (int i = 0; i < TERMS; i += 7) {
+        sprintf(term, "TERM%dX", i);
+        search_result_t* results = run(index, term, false, 100, &count);
+        assert(count == 1 && results[0].document_id == i / 1000);
+        assert(results[0].line_number == (i % 1000) / 10);
+        search_engine_free_results(results, count);
+    }
+    search_result_t* results = run(index, "term20000x", false, 100, &count);
+    assert(count == 0 && results == NULL);
+
+    for (int d = 0; d < DOCUMENTS; d++) free(contents[d]);
+    search_engine_destroy(index);
+}
+
+// Same results, field by field
+static void assert_same_results(search_index_t* a, search_index_t* b, const char* text,
+                                bool case_sensitive) {
+    int count_a, count_b;
+    search_result_t* results_a = run(a, text, case_sensitive, 0, &count_a);
+    search_result_t* results_b = run(b, text, case_sensitive, 0, &count_b);
+    assert(count_a == count_b);
+    for (int i = 0; i < count_a; i++) {
+        assert(results_a[i].document_id == results_b[i].document_id);
+        assert(results_a[i].line_number == results_b[i].line_number);
+        assert(results_a[i].column_start == results_b[i].column_start);
+        assert(strcmp(results_a[i].context, results_b[i].context) == 0);
+    }
+    search_engine_free_results(results_a, count_a);
+    search_engine_free_results(results_b, count_b);
+}
+
+static void test_save_and_load(void) {
+    const char* path = "test_search_index.seg";
+    search_index_t* index = create_test_index();
+    assert(search_engine_save_index(index, path) == 0);
+
+    search_index_t* loaded = search_engine_load_index(path);
+    assert(loaded != NULL && loaded->document_count == 3);
+    const char* queries[] = { "engine", "fast engine", "Search", "search nothing", ", ", "notes" };
+    for (int i = 0; i < 6; i++) {
+        assert_same_results(index, loaded, queries[i], false);
+        assert_same_results(index, loaded, queries[i], true);
+    }
+
+    // Documents added after loading are searched along with the segment,
+    // and saving again merges both
+    const char* extra = "another engine\nfast engine here\n";
+    assert(search_engine_add_document(index, "d.md", extra) == 3);
+    assert(search_engine_add_document(loaded, "d.md", extra) == 3);
+    assert_same_results(index, loaded, "fast engine", false);
+    assert(search_engine_save_index(loaded, path) == 0);
+    search_engine_destroy(loaded);
+
+    loaded = search_engine_load_index(path);
+    assert(loaded != NULL && loaded->document_count == 4);
+    for (int i = 0; i < 6; i++) {
+        assert_same_results(index, loaded, queries[i], false);
+    }
+    int count, expected;
+    search_result_t* results = search_engine_search_fuzzy(index, "engin", 0.5f, &expected);
+    search_engine_free_results(results, expected);
+    results = search_engine_search_fuzzy(loaded, "engin", 0.5f, &count);
+    assert(count == expected && count > 0);
+    search_engine_free_results(results, count);
+    search_engine_destroy(loaded);
+
+    // Corrupted or truncated files are rejected
+    FILE* file = fopen(path, "r+b");
+    assert(file != NULL);
+    fseek(file, -3, SEEK_END);
+    fputc('!', file);
+    fclose(file);
+    assert(search_engine_load_index(path) == NULL);
+    assert(truncate(path, 64) == 0);
+    assert(search_engine_load_index(path) == NULL);
+    assert(search_engine_load_index("missing.seg") == NULL);
+
+    remove(path);
+    search_engine_destroy(index);
+}
+
+// Same checksum as search_segment.c, to forge well-sealed damaged files
+static uint64_t forged_checksum(const uint8_t* data, size_t size) {
+    const uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+    uint64_t lanes[4] = { prime1 + prime2, prime2, 0, (uint64_t)0 - prime1 };
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            uint64_t word;
+            memcpy(&word, data + i + 8 * lane, 8);
+            uint64_t acc = lanes[lane] + word * prime2;
+            lanes[lane] = ((acc << 31) | (acc >> 33)) * prime1;
+        }
+    }
+    uint64_t hash = size;
+    for (int lane = 0; lane < 4; lane++) {
+        hash = (hash ^ lanes[lane]) * prime1;
+        hash ^= hash >> 29;
+    }
+    for (; i < size; i++) {
+        hash = (hash ^ data[i]) * 0x100000001b3ULL;
+    }
+    hash ^= hash >> 32;
+    return hash;
+}
+
+// A writable copy of the index as saved to `path`
+static search_segment_t* saved_segment(search_index_t* index, const char* path) {
+    assert(search_engine_save_index(index, path) == 0);
+    search_segment_t* saved = search_segment_open(path);
+    assert(saved != NULL);
+    search_segment_input_t input = { saved, NULL, NULL };
+    search_segment_t* segment = search_segment_merge(&input, 1);
+    search_segment_close(saved);
+    remove(path);
+    return segment;
+}
+
+// Write the segment with a valid checksum and try to load it
+static bool forged_segment_loads(search_segment_t* segment, const char* path) {
+    search_segment_header_t* header = (search_segment_header_t*)segment->base;
+    header->checksum = forged_checksum(segment->base + sizeof(*header), segment->size - sizeof(*header));
+    assert(search_segment_write(segment, path) == 0);
+    search_index_t* loaded = search_engine_load_index(path);
+    search_engine_destroy(loaded);
+    return loaded != NULL;
+}
+
+// Files with a correct checksum but out-of-range ids or offsets are
+// rejected when opened, before any of them is followed
+static void test_forged_segments(void) {
+    const char* path = "test_search_forged.seg";
+    search_index_t* index = create_test_index();
+    search_segment_t* segment = saved_segment(index, path);
+    assert(segment != NULL);
+    search_segment_document_t* documents = (search_segment_document_t*)segment->documents;
+    search_segment_term_t* terms = (search_segment_term_t*)segment->terms;
+    assert(forged_segment_loads(segment, path));
+
+    const uint32_t bad_ids[] = { 0xFFFFFFFFu, 0x7FFFFFFFu, 1 };
+    for (int i = 0; i < 3; i++) {
+        uint32_t id = documents[0].document_id;
+        documents[0].document_id = bad_ids[i];
+        assert(!forged_segment_loads(segment, path));
+        documents[0].document_id = id;
+    }
+    uint64_t offset = documents[1].path_offset;
+    documents[1].path_offset = segment->size;
+    assert(!forged_segment_loads(segment, path));
+    documents[1].path_offset = offset;
+    offset = documents[1].text_offset;
+    documents[1].text_offset = UINT64_MAX - 4;
+    assert(!forged_segment_loads(segment, path));
+    documents[1].text_offset = offset;
+    offset = terms[0].word_offset;
+    terms[0].word_offset = segment->size * 2;
+    assert(!forged_segment_loads(segment, path));
+    terms[0].word_offset = offset;
+    assert(forged_segment_loads(segment, path));
+
+    remove(path);
+    search_segment_close(segment);
+    search_engine_destroy(index);
+}
+
+static void test_remove_and_update(void) {
+    search_index_t* index = create_test_index();
+    int count;
+    assert(search_engine_remove_document(index, 1) == 0);
+    assert(search_engine_remove_document(index, 1) == -1);
+    assert(index->document_count == 2);
+    search_result_t* results = run(index, "search", false, 100, &count);
+    assert(count == 1 && results[0].document_id == 0);
+    search_engine_free_results(results, count);
+
+    // Updates keep the id; the old text is gone
+    assert(search_engine_update_document(index, 0, "brand new text\nnew engine") == 0);
+    results = run(index, "engine", false, 100, &count);
+    assert(count == 1 && results[0].document_id == 0 && results[0].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "fast", false, 100, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+    assert(search_engine_update_document(index, 1, "gone") == -1);
+
+    // The same through a flushed segment. Each write above published
+    // itself: nothing is left in memory.
+    assert(search_engine_flush(index) == 0);
+    assert(index->memory_document_count == 0 && search_engine_segment_count(index) > 0);
+    assert(search_engine_update_document(index, 0, "third engine version") == 0);
+    results = run(index, "engine", false, 100, &count);
+    assert(count == 1 && results[0].document_id == 0 && results[0].line_number == 0);
+    search_engine_free_results(results, count);
+    assert(search_engine_remove_document(index, 0) == 0);
+    results = run(index, "engine", false, 100, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+    results = search_engine_search_fuzzy(index, "engin", 0.5f, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+    assert(index->document_count == 1);
+    search_engine_destroy(index);
+}
+
+static void test_segment_merges(void) {
+    // Flushes make many small segments; the merge thread folds them while
+    // deletions keep landing, and results never change
+    enum { DOCUMENTS = 400, PER_FLUSH = 10 };
+    search_index_t* index = search_engine_create(DOCUMENTS);
+    search_index_t* reference = search_engine_create(DOCUMENTS);
+    char content[128];
+    for (int d = 0; d < DOCUMENTS; d++) {
+        sprintf(content, "note %d mentions topic%d\nshared words here\n", d, d % 7);
+        assert(search_engine_add_document(index, "n.md", content) == d);
+        assert(search_engine_add_document(reference, "n.md", content) == d);
+        if (d % PER_FLUSH == PER_FLUSH - 1) assert(search_engine_flush(index) == 0);
+        if (d % 3 == 0 && d > 20) {
+            assert(search_engine_remove_document(index, d - 20) == 0);
+            assert(search_engine_remove_document(reference, d - 20) == 0);
+        }
+    }
+    assert_same_results(index, reference, "shared", false);
+    search_engine_wait_for_merges(index);
+    assert(search_engine_segment_count(index) < DOCUMENTS / PER_FLUSH / 2);
+    assert(index->document_count == reference->document_count);
+    assert(search_engine_validate_index(index));
+    const char* queries[] = { "shared", "topic3", "note words", "mentions topic6" };
+    for (int i = 0; i < 4; i++) {
+        assert_same_results(index, reference, queries[i], false);
+    }
+
+    // Saving merges everything left, deletions included
+    const char* path = "test_search_merge.seg";
+    assert(search_engine_save_index(index, path) == 0);
+    search_index_t* loaded = search_engine_load_index(path);
+    assert(loaded != NULL && loaded->document_count == reference->document_count);
+    assert(search_engine_segment_count(loaded) == 1);
+    for (int i = 0; i < 4; i++) {
+        assert_same_results(loaded, reference, queries[i], false);
+    }
+    assert(search_engine_update_document(loaded, 399, "replaced") == 0);
+    assert(search_engine_add_document(loaded, "new.md", "fresh") == DOCUMENTS);
+    remove(path);
+    search_engine_destroy(loaded);
+    search_engine_destroy(reference);
+    search_engine_destroy(index);
+}
+
+static void test_bm25_ranking(void) {
+    search_index_t* index = search_engine_create(16);
+    search_engine_add_document(index, "once.md", "one mention of zebra among many other words here");
+    search_engine_add_document(index, "often.md", "zebra zebra\nzebra again");
+    search_engine_add_document(index, "short.md", "zebra");
+    int count;
+    search_result_t* results = run(index, "zebra", false, 100, &count);
+
+    // Higher term frequency and shorter documents rank first; lines of one
+    // document stay in order
+    assert(count == 5);
+    assert(results[0].document_id == 1 && results[0].line_number == 0 && results[0].column_start == 0);
+    assert(results[1].document_id == 1 && results[1].column_start == 6);
+    assert(results[2].document_id == 1 && results[2].line_number == 1);
+    assert(results[3].document_id == 2 && results[4].document_id == 0);
+    assert(results[0].relevance_score == results[2].relevance_score);
+    assert(results[2].relevance_score > results[3].relevance_score);
+    assert(results[3].relevance_score > results[4].relevance_score && results[4].relevance_score > 0.0f);
+    search_engine_free_results(results, count);
+    search_engine_destroy(index);
+}
+
+static void test_top_k_pruning(void) {
+    // Enough documents for many posting blocks in several segments; a
+    // limited query returns exactly the head of the full ranking, also
+    // with field boosts bounded per block
+    enum { DOCUMENTS = 3000 };
+    for (int fields = 0; fields < 2; fields++) {
+        search_index_t* index = search_engine_create(DOCUMENTS);
+        char content[256];
+        for (int d = 0; d < DOCUMENTS; d++) {
+            char* p = content;
+            if (fields && d % 3 == 0) p += sprintf(p, "# ");
+            for (int w = 0; w < 3 + d % 11; w++) {
+                if (w == 2) p += sprintf(p, fields && d % 4 == 0 ? "\n```\n" : "\n");
+                p += sprintf(p, "%s ", (d * 7 + w) % 5 == 0 ? "common" : (d + w) % 13 == 0 ? "rare" : "filler");
+            }
+            if (fields && d % 4 == 0) p += sprintf(p, "\n```");
+            if (d == 500) search_engine_set_field_indexing(index, fields);
+            const char* path = d % 17 == 0 ? "rare.md" : d % 19 == 0 ? "notes/Common notes.md" : "p.md";
+            assert(search_engine_add_document(index, path, content) == d);
+            if (d == 1500) assert(search_engine_flush(index) == 0);
+        }
+        const char* queries[] = { "common", "rare", "common rare" };
+        for (int q = 0; q < 3; q++) {
+            int all_count;
+            search_result_t* all = run(index, queries[q], false, 0, &all_count);
+            assert(all_count > 10);
+            for (int i = 1; i < all_count; i++) {
+                assert(all[i - 1].relevance_score >= all[i].relevance_score);
+            }
+            int limits[] = { 1, 10, 100 };
+            for (int l = 0; l < 3; l++) {
+                int count;
+                search_result_t* top = run(index, queries[q], false, limits[l], &count);
+                assert(count == (limits[l] < all_count ? limits[l] : all_count));
+                for (int i = 0; i < count; i++) {
+                    assert(top[i].document_id == all[i].document_id);
+                    assert(top[i].line_number == all[i].line_number);
+                    assert(top[i].column_start == all[i].column_start);
+                    assert(top[i].relevance_score == all[i].relevance_score);
+                }
+                search_engine_free_results(top, count);
+            }
+            search_engine_free_results(all, all_count);
+        }
+        search_engine_destroy(index);
+    }
+}
+
+static search_result_t* run_regex(search_index_t* index, const char* pattern, bool case_sensitive,
+                                  int* count) {
+    search_query_t query = {0};
+    query.query = (char*)pattern;
+    query.case_sensitive = case_sensitive;
+    query.regex_mode = true;
+    return search_engine_search(index, &query, count);
+}
+
+// Number of regex matches, and the first one's text
+static int count_matches(search_index_t* index, const char* pattern, bool case_sensitive, char* first) {
+    int count;
+    search_result_t* results = run_regex(index, pattern, case_sensitive, &count);
+    if (first) strcpy(first, count > 0 ? results[0].matched_text : "");
+    search_engine_free_results(results, count);
+    return count;
+}
+
+static void test_regex_search(void) {
+    search_index_t* index = create_test_index();
+    char first[256];
+    assert(count_matches(index, "engine", true, NULL) == 5);
+    assert(count_matches(index, "eng.ne|slow", true, NULL) == 6);
+    assert(count_matches(index, "^[A-Z][a-z]+", true, first) == 3 && strcmp(first, "The") == 0);
+    assert(count_matches(index, "\\bs\\w*", false, first) == 4 && strcmp(first, "search") == 0);
+    assert(count_matches(index, "st\\b", true, NULL) == 2);
+    assert(count_matches(index, "fast\\.$", true, NULL) == 1);
+    assert(count_matches(index, "SEARCH", true, NULL) == 0);
+    assert(count_matches(index, "SEARCH", false, NULL) == 3);
+    assert(count_matches(index, "[^a-z ]", true, first) == 8 && strcmp(first, "#") == 0);
+    assert(count_matches(index, "(engine ?){2,3}", true, first) == 1 && strcmp(first, "engine engine") == 0);
+
+    // Leftmost-longest, whole alternatives
+    assert(count_matches(index, "eng|engine|en", true, first) == 5 && strcmp(first, "engine") == 0);
+
+    // Substrings inside words, as substring queries find them
+    int count, substrings;
+    search_result_t* results = run_regex(index, "ngin", false, &count);
+    assert(count == 5 && results[0].column_start == 12 && results[0].column_end == 16);
+    search_engine_free_results(results, count);
+    results = run_substring(index, "ngin", false, 0, &substrings);
+    assert(substrings == count && results[0].column_end == 16);
+    search_engine_free_results(results, substrings);
+    results = run_regex(index, "esting", false, &count);
+    assert(count == 1 && results[0].document_id == 0 && results[0].line_number == 2);
+    search_engine_free_results(results, count);
+
+    // Invalid patterns and empty matches find nothing
+    assert(count_matches(index, "(engine", true, NULL) == 0);
+    assert(count_matches(index, "[a-", true, NULL) == 0);
+    assert(count_matches(index, "x*", true, NULL) == 0);
+    assert(count_matches(index, "", true, NULL) == 0);
+    results = search_engine_search_regex(index, "fast|slow", &count);
+    assert(count == 3);
+    search_engine_free_results(results, count);
+
+    // No backtracking: nested stars against a long miss stay linear
+    char* text = malloc(100001);
+    assert(text != NULL);
+    memset(text, 'a', 100000);
+    text[100000] = '\0';
+    assert(search_engine_add_document(index, "long.md", text) == 3);
+    assert(count_matches(index, "(a*)*b", true, NULL) == 0);
+    results = run_regex(index, "(a|aa)+$", true, &count);
+    assert(count == 1 && results[0].column_start == 0 && results[0].column_end == 100000);
+    search_engine_free_results(results, count);
+    free(text);
+    search_engine_destroy(index);
+}
+
+static void test_trigram_prefilter(void) {
+    // Skipped documents never hold a match: filtered searches agree with
+    // matching every line, in memory, in segments and after a reload
+    enum { DOCUMENTS = 300 };
+    const char* words[] = { "alpha", "beta", "gamma", "delta", "kappa", "lambda", "Omega", "sigma" };
+    search_index_t* index = search_engine_create(DOCUMENTS);
+    static char contents[DOCUMENTS][256];
+    srand(11);
+    for (int d = 0; d < DOCUMENTS; d++) {
+        char* content = contents[d];
+        char* p = content;
+        for (int w = 0; w < 2 + rand() % 8; w++) {
+            p += sprintf(p, "%s%d%s", words[rand() % 8], rand() % 50, w % 4 == 3 ? "\n" : "-");
+        }
+        assert(search_engine_add_document(index, "t.md", content) == d);
+        if (d % 100 == 99) assert(search_engine_flush(index) == 0);
+    }
+    const char* patterns[] = { "pha1", "mma[0-9]+-del", "(kap|lam)b?", "omega4", "Omega4",
+                               "a\\d\\d-s", "ta.*ta", "x|ppa", "^sigma", "amb|gam|mega" };
+    const char* path = "test_search_trigram.seg";
+    assert(search_engine_save_index(index, path) == 0);
+    search_index_t* loaded = search_engine_load_index(path);
+    assert(loaded != NULL);
+    for (int i = 0; i < 10; i++) {
+        for (int sensitive = 0; sensitive < 2; sensitive++) {
+            search_regex_t* regex = search_regex_compile(patterns[i], sensitive);
+            assert(regex != NULL);
+            int expected = 0;
+            for (int d = 0; d < DOCUMENTS; d++) {
+                for (const char* text = contents[d]; *text; text += strcspn(text, "\n") + 1) {
+                    size_t from = 0, start, end, length = strcspn(text, "\n");
+                    while (from <= length && search_regex_find(regex, text, length, from, &start, &end)) {
+                        if (end > start) expected++;
+                        from = end > start ? end : start + 1;
+                    }
+                    if (!text[length]) break;
+                }
+            }
+            search_regex_free(regex);
+            assert(count_matches(index, patterns[i], sensitive, NULL) == expected);
+            assert(count_matches(loaded, patterns[i], sensitive, NULL) == expected);
+        }
+    }
+
+    // Substring queries go through the same filter
+    const char* substrings[] = { "a1-", "A1-", "mma4", "ta2-", "Ome" };
+    for (int i = 0; i < 5; i++) {
+        for (int sensitive = 0; sensitive < 2; sensitive++) {
+            size_t length = strlen(substrings[i]);
+            int expected = 0;
+            for (int d = 0; d < DOCUMENTS; d++) {
+                for (const char* text = contents[d]; *text; text++) {
+                    if (sensitive ? strncmp(text, substrings[i], length) == 0
+                                  : strncasecmp(text, substrings[i], length) == 0) {
+                        expected++;
+                    }
+                }
+            }
+            int count;
+            search_result_t* results = run_substring(index, substrings[i], sensitive, 0, &count);
+            assert(count == expected);
+            search_engine_free_results(results, count);
+            results = run_substring(loaded, substrings[i], sensitive, 0, &count);
+            assert(count == expected);
+            search_engine_free_results(results, count);
+        }
+    }
+    remove(path);
+    search_engine_destroy(loaded);
+    search_engine_destroy(index);
+}
+
+static int edit_distance(const char* a, const char* b) {
+    int n = (int)strlen(b);
+    int* row = malloc((n + 1) * sizeof(int));
+    for (int j = 0; j <= n; j++) row[j] = j;
+    for (int i = 1; a[i - 1]; i++) {
+        int diagonal = row[0];
+        row[0] = i;
+        for (int j = 1; j <= n; j++) {
+            int cost = diagonal + (a[i - 1] != b[j - 1]);
+            if (row[j] + 1 < cost) cost = row[j] + 1;
+            if (row[j - 1] + 1 < cost) cost = row[j - 1] + 1;
+            diagonal = row[j];
+            row[j] = cost;
+        }
+    }
+    int distance = row[n];
+    free(row);
+    return distance;
+}
+
+static void test_fuzzy_search(void) {
+    // Matches over the dictionaries of every part agree with scoring each
+    // distinct word directly
+    enum { DOCUMENTS = 200, VOCABULARY = 400 };
+    static char vocabulary[VOCABULARY][16];
+    static int frequency[VOCABULARY];
+    srand(5);
+    for (int w = 0; w < VOCABULARY; w++) {
+        int length = 2 + rand() % 9;
+        for (int i = 0; i < length; i++) vocabulary[w][i] = "abcdeilmnorst"[rand() % 13];
+        vocabulary[w][length] = '\0';
+    }
+    search_index_t* index = search_engine_create(DOCUMENTS);
+    char content[512];
+    for (int d = 0; d < DOCUMENTS; d++) {
+        char* p = content;
+        for (int k = 0; k < 20; k++) {
+            int w = rand() % VOCABULARY;
+            frequency[w]++;
+            p += sprintf(p, "%s ", vocabulary[w]);
+        }
+        assert(search_engine_add_document(index, "f.md", content) == d);
+        if (d == 120) assert(search_engine_flush(index) == 0);
+    }
+    const char* queries[] = { "stream", "Lemon", "a", "decimals", "ooooo", "" };
+    float thresholds[] = { 0.0f, 0.34f, 0.5f, 0.75f, 1.0f };
+    for (int q = 0; q < 6; q++) {
+        char lower[16];
+        for (int i = 0; i <= (int)strlen(queries[q]); i++) lower[i] = (char)tolower((unsigned char)queries[q][i]);
+        for (int t = 0; t < 5; t++) {
+            int expected = 0;
+            for (int w = 0; w < VOCABULARY; w++) {
+                bool seen = false;
+                for (int v = 0; v < w; v++) seen = seen || strcmp(vocabulary[v], vocabulary[w]) == 0;
+                size_t la = strlen(lower), lb = strlen(vocabulary[w]);
+                size_t longer = la > lb ? la : lb;
+                float score = 1.0f - (float)edit_distance(lower, vocabulary[w]) / longer;
+                if (!seen && score >= thresholds[t]) {
+                    for (int v = w; v < VOCABULARY; v++) {
+                        if (strcmp(vocabulary[v], vocabulary[w]) == 0) expected += frequency[v];
+                    }
+                }
+            }
+            int count;
+            search_result_t* results = search_engine_search_fuzzy(index, queries[q], thresholds[t], &count);
+            assert(count == expected);
+            for (int i = 0; i < count; i++) assert(results[i].relevance_score >= thresholds[t]);
+            search_engine_free_results(results, count);
+        }
+    }
+
+    // Long queries cost heap rows, not stack
+    char* long_query = malloc(20001);
+    memset(long_query, 'e', 20000);
+    long_query[20000] = '\0';
+    int count;
+    search_result_t* results = search_engine_search_fuzzy(index, long_query, 0.9f, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+    free(long_query);
+    search_engine_destroy(index);
+}
+
+static void assert_suggestions(search_index_t* index, const char* prefix, int max, const char** expected,
+                               int expected_count) {
+    int count;
+    char** suggestions = search_engine_suggest(index, prefix, max, &count);
+    assert(count == expected_count);
+    for (int i = 0; i < count; i++) assert(strcmp(suggestions[i], expected[i]) == 0);
+    search_engine_free_suggestions(suggestions, count);
+}
+
+static int compare_weighted(const void* a, const void* b) {
+    const char* const* x = a;
+    const char* const* y = b;
+    int wx = atoi(x[1]), wy = atoi(y[1]);
+    return wx != wy ? wy - wx : strcasecmp(x[0], y[0]);
+}
+
+static void test_suggestions(void) {
+    search_index_t* index = search_engine_create(16);
+    search_engine_add_document(index, "notes/Meeting Notes.md", "meeting agenda\nmeet the team");
+    search_engine_add_document(index, "Memo.md", "meeting moved\nmemory leak");
+    search_engine_add_document(index, "c.md", "Meeting again, melody");
+
+    // By documents holding the word, then in order; titles weigh one
+    const char* me[] = { "meeting", "meet", "Meeting Notes", "melody", "Memo" };
+    assert_suggestions(index, "me", 5, me, 5);
+    const char* mee[] = { "meeting", "meet", "Meeting Notes" };
+    assert_suggestions(index, "MEE", 10, mee, 3);
+    assert_suggestions(index, "meeting n", 10, mee + 2, 1);
+    assert_suggestions(index, "x", 10, NULL, 0);
+    assert_suggestions(index, "me", 0, NULL, 0);
+
+    // Changes show up on the next request, from segments as well
+    assert(search_engine_flush(index) == 0);
+    assert(search_engine_remove_document(index, 1) == 0);
+    const char* mem[] = { "memory" };
+    assert(search_engine_update_document(index, 2, "memory") == 0);
+    assert_suggestions(index, "mem", 10, mem, 1);
+    search_engine_destroy(index);
+
+    // Many blocks of completions: top-N agrees with sorting every word
+    enum { DOCUMENTS = 300, VOCABULARY = 3000 };
+    static char vocabulary[VOCABULARY][12];
+    static int canonical[VOCABULARY], holders[VOCABULARY], last_holder[VOCABULARY];
+    static char weights[VOCABULARY][12];
+    static const char* table[VOCABULARY + DOCUMENTS][2];
+    static char titles[DOCUMENTS][16];
+    srand(9);
+    for (int w = 0; w < VOCABULARY; w++) {
+        int length = 2 + rand() % 6;
+        for (int i = 0; i < length; i++) vocabulary[w][i] = "abcdefg"[rand() % 7];
+        vocabulary[w][length] = '\0';
+        canonical[w] = w;
+        for (int v = 0; v < w; v++) {
+            if (strcmp(vocabulary[v], vocabulary[w]) == 0) {
+                canonical[w] = v;
+                break;
+            }
+        }
+    }
+    index = search_engine_create(DOCUMENTS);
+    for (int d = 0; d < DOCUMENTS; d++) {
+        char content[512];
+        char* p = content;
+        for (int k = 0; k < 40; k++) {
+            int w = canonical[rand() % VOCABULARY];
+            p += sprintf(p, "%s ", vocabulary[w]);
+            if (last_holder[w] != d + 1) holders[w]++;
+            last_holder[w] = d + 1;
+        }
+        sprintf(titles[d], "gab%d", d);
+        char path[32];
+        sprintf(path, "gab%d.md", d);
+        assert(search_engine_add_document(index, path, content) == d);
+        if (d % 100 == 99) assert(search_engine_flush(index) == 0);
+    }
+    int rows = 0;
+    for (int w = 0; w < VOCABULARY; w++) {
+        if (holders[w] == 0) continue;
+        sprintf(weights[w], "%d", holders[w]);
+        table[rows][0] = vocabulary[w];
+        table[rows][1] = weights[w];
+        rows++;
+    }
+    for (int d = 0; d < DOCUMENTS; d++) {
+        table[rows][0] = titles[d];
+        table[rows][1] = "1";
+        rows++;
+    }
+    qsort(table, rows, sizeof(table[0]), compare_weighted);
+    const char* prefixes[] = { "a", "ab", "gab", "gab1", "fed", "cc", "g", "abcdefg" };
+    for (int i = 0; i < 8; i++) {
+        const char* expected[20];
+        int expected_count = 0;
+        for (int r = 0; r < rows && expected_count < 20; r++) {
+            if (strncmp(table[r][0], prefixes[i], strlen(prefixes[i])) == 0) expected[expected_count++] = table[r][0];
+        }
+        assert_suggestions(index, prefixes[i], 20, expected, expected_count);
+    }
+    search_engine_destroy(index);
+}
+
+// Searches run on other threads while one thread indexes and rewrites
+// notes. Each search sees a published state: every add before it or none
+// of the later ones, and an update never hides its document.
+enum { CONCURRENT_DOCUMENTS = 1200, CONCURRENT_UPDATES = 1500, CONCURRENT_READERS = 3 };
+
+typedef struct {
+    search_index_t* index;
+    atomic_int phase;               // 0 adding, 1 updating (all adds published), 2 done
+    atomic_int searches;
+} concurrent_test_t;
+
+static void* concurrent_writer(void* arg) {
+    concurrent_test_t* test = arg;
+    char content[128];
+    for (int d = 0; d < CONCURRENT_DOCUMENTS; d++) {
+        sprintf(content, "note %d shared\nbody words\n", d);
+        assert(search_engine_add_document(test->index, "n.md", content) == d);
+    }
+    assert(search_engine_flush(test->index) == 0);
+    atomic_store(&test->phase, 1);
+    for (int u = 0; u < CONCURRENT_UPDATES; u++) {
+        int d = (u * 7919) % CONCURRENT_DOCUMENTS;
+        sprintf(content, "note %d shared\nrevised words pass%d\n", d, u);
+        assert(search_engine_update_document(test->index, d, content) == 0);
+    }
+    atomic_store(&test->phase, 2);
+    return NULL;
+}
+
+static void* concurrent_reader(void* arg) {
+    concurrent_test_t* test = arg;
+    int seen = 0;
+    while (atomic_load(&test->phase) < 2) {
+        int phase = atomic_load(&test->phase);
+        int count;
+        search_result_t* results = run(test->index, "shared", false, 0, &count);
+        assert(count >= seen && count <= CONCURRENT_DOCUMENTS);
+        assert(phase == 0 || count == CONCURRENT_DOCUMENTS);
+        for (int i = 0; i < count; i++) {
+            assert(results[i].document_id >= 0 && results[i].document_id < CONCURRENT_DOCUMENTS);
+            assert(results[i].context && strstr(results[i].context, "shared"));
+        }
+        search_engine_free_results(results, count);
+        seen = count;
+
+        results = run(test->index, "words", false, 0, &count);
+        assert(phase == 0 || count == CONCURRENT_DOCUMENTS);
+        search_engine_free_results(results, count);
+        char** suggestions = search_engine_suggest(test->index, "re", 5, &count);
+        search_engine_free_suggestions(suggestions, count);
+        atomic_fetch_add(&test->searches, 1);
+    }
+    return NULL;
+}
+
+// Compacts and checks the index while it is written and searched
+static void* concurrent_maintainer(void* arg) {
+    concurrent_test_t* test = arg;
+    for (int pass = 0; atomic_load(&test->phase) < 2; pass++) {
+        assert((pass % 4 == 3 ? search_engine_rebuild_index(test->index)
+                              : search_engine_optimize_index(test->index)) == 0);
+        assert(search_engine_validate_index(test->index));
+    }
+    return NULL;
+}
+
+static void test_concurrent_search(void) {
+    concurrent_test_t test = { search_engine_create(CONCURRENT_DOCUMENTS), 0, 0 };
+    assert(test.index != NULL);
+    pthread_t writer, maintainer, readers[CONCURRENT_READERS];
+    for (int r = 0; r < CONCURRENT_READERS; r++) {
+        assert(pthread_create(&readers[r], NULL, concurrent_reader, &test) == 0);
+    }
+    assert(pthread_create(&writer, NULL, concurrent_writer, &test) == 0);
+    assert(pthread_create(&maintainer, NULL, concurrent_maintainer, &test) == 0);
+    pthread_join(writer, NULL);
+    pthread_join(maintainer, NULL);
+    for (int r = 0; r < CONCURRENT_READERS; r++) pthread_join(readers[r], NULL);
+    assert(atomic_load(&test.searches) > 0);
+
+    int count;
+    search_result_t* results = run(test.index, "words", false, 0, &count);
+    assert(count == CONCURRENT_DOCUMENTS);
+    search_engine_free_results(results, count);
+    results = run(test.index, "revised", false, 0, &count);
+    assert(count == CONCURRENT_DOCUMENTS);          // 7919 is coprime with the document count
+    search_engine_free_results(results, count);
+    results = run(test.index, "body", false, 0, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+    assert(test.index->document_count == CONCURRENT_DOCUMENTS);
+    assert(search_engine_validate_index(test.index));
+    search_engine_destroy(test.index);
+}
+
+static void test_phrase_and_near(void) {
+    search_index_t* index = search_engine_create(8);
+    search_engine_add_document(index, "a.md", "the quick brown fox\nbrown quick fox, quick-brown Fox");
+    search_engine_add_document(index, "b.md", "read a book today\nread the book, a Book to read");
+    search_engine_add_document(index, "c.md", "alpha one two three beta\nbeta alpha\nalpha x x x x x x beta");
+    assert(search_engine_flush(index) == 0);
+    search_engine_add_document(index, "d.md", "la la land\nquick brown");
+
+    // Each phrase occurrence, spanning the phrase; punctuation between
+    // words is no break
+    int count;
+    search_result_t* results = run(index, "\"quick brown\"", false, 0, &count);
+    assert(count == 3);
+    assert(results[0].document_id == 0 && results[0].line_number == 0 && results[0].column_start == 4);
+    assert(strcmp(results[0].matched_text, "quick brown") == 0);
+    assert(results[1].line_number == 1 && strcmp(results[1].matched_text, "quick-brown") == 0);
+    assert(results[2].document_id == 3 && results[2].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "\"brown quick\"", false, 0, &count);
+    assert(count == 1 && results[0].document_id == 0 && results[0].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "\"quick brown\"", true, 0, &count);
+    assert(count == 3);
+    search_engine_free_results(results, count);
+    results = run(index, "\"brown Fox\"", true, 0, &count);
+    assert(count == 1 && results[0].column_start == 23);
+    search_engine_free_results(results, count);
+
+    // Single letters keep their place and must match
+    results = run(index, "\"read a book\"", false, 0, &count);
+    assert(count == 1 && results[0].document_id == 1 && results[0].line_number == 0);
+    search_engine_free_results(results, count);
+    results = run(index, "\"the book a book\"", false, 0, &count);
+    assert(count == 1 && strcmp(results[0].matched_text, "the book, a Book") == 0);
+    search_engine_free_results(results, count);
+    results = run(index, "\"la la land\"", false, 0, &count);
+    assert(count == 1 && results[0].document_id == 3);
+    search_engine_free_results(results, count);
+    results = run(index, "\"land la\"", false, 0, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+
+    // Phrases and words together: the line once
+    results = run(index, "fox \"quick brown\"", false, 0, &count);
+    assert(count == 2 && results[0].line_number == 0 && results[1].line_number == 1);
+    search_engine_free_results(results, count);
+
+    // NEAR/k: at most k words between them, in either order
+    results = run(index, "alpha NEAR/3 beta", false, 0, &count);
+    assert(count == 2 && results[0].line_number == 0 && results[1].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "alpha NEAR/2 beta", false, 0, &count);
+    assert(count == 1 && results[0].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "alpha NEAR/7 beta", false, 0, &count);
+    assert(count == 3);
+    search_engine_free_results(results, count);
+    results = run(index, "\"one two\" NEAR/1 three", false, 0, &count);
+    assert(count == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "\"two three\" NEAR/1 one", false, 0, &count);
+    assert(count == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "one NEAR/1 beta", false, 0, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+
+    // Top-k ranking still applies
+    results = run(index, "\"quick brown\"", false, 1, &count);
+    assert(count == 1);
+    search_engine_free_results(results, count);
+    search_engine_destroy(index);
+}
+
+static search_result_t* run_boolean(search_index_t* index, const char* text, bool case_sensitive,
+                                    int max_results, int* count) {
+    search_query_t query = {0};
+    query.query = (char*)text;
+    query.boolean_mode = true;
+    query.case_sensitive = case_sensitive;
+    query.max_results = max_results;
+    return search_engine_search(index, &query, count);
+}
+
+// Whether a boolean query matches exactly the documents in `expected`
+// (ascending, -1 terminated)
+static bool boolean_matches(search_index_t* index, const char* text, const int* expected) {
+    int count;
+    search_result_t* results = run_boolean(index, text, false, 0, &count);
+    bool seen[8] = {false};
+    for (int i = 0; i < count; i++) {
+        if (results[i].document_id < 0 || results[i].document_id >= 8 || seen[results[i].document_id]) return false;
+        seen[results[i].document_id] = true;
+    }
+    search_engine_free_results(results, count);
+    int expected_count = 0;
+    for (; expected[expected_count] >= 0; expected_count++) {
+        if (!seen[expected[expected_count]]) return false;
+    }
+    return count == expected_count;
+}
+
+static void test_boolean_queries(void) {
+    // Parsing: AND binds tighter than OR, juxtaposition is AND, fields and
+    // operators only where this grammar has them
+    int clauses;
+    query_node_t* tree = search_query_parse("a b OR c", &clauses);
+    assert(tree && tree->kind == QUERY_OR && tree->child_count == 2 && clauses == 3);
+    assert(tree->children[0]->kind == QUERY_AND && tree->children[0]->child_count == 2);
+    search_query_free(tree);
+    tree = search_query_parse("-(a OR b) AND NOT NOT c", &clauses);
+    assert(tree && tree->kind == QUERY_AND && tree->child_count == 2);
+    assert(tree->children[0]->kind == QUERY_NOT && tree->children[0]->children[0]->kind == QUERY_OR);
+    assert(tree->children[1]->kind == QUERY_NOT && tree->children[1]->children[0]->kind == QUERY_NOT);
+    search_query_free(tree);
+    tree = search_query_parse("title:\"x y\" tag:#foo ext:.MD http://site and", &clauses);
+    assert(tree && tree->child_count == 5 && clauses == 4);
+    assert(tree->children[0]->kind == QUERY_TITLE && tree->children[0]->phrase &&
+           strcmp(tree->children[0]->text, "x y") == 0);
+    assert(tree->children[1]->kind == QUERY_TAG && strcmp(tree->children[1]->text, "foo") == 0);
+    assert(tree->children[2]->kind == QUERY_EXT && strcmp(tree->children[2]->text, "MD") == 0);
+    assert(tree->children[3]->kind == QUERY_TEXT && tree->children[4]->kind == QUERY_TEXT);
+    search_query_free(tree);
+    tree = search_query_parse("modified:>=2024-02-29", &clauses);
+    assert(tree && tree->kind == QUERY_MODIFIED && tree->before == INT64_MAX && tree->after > 0);
+    search_query_free(tree);
+    const char* invalid[] = { "", "(a", "a)", "a AND", "OR b", "()", "title:", "modified:2023-02-29",
+                              "modified:~2024-01-01", "NOT" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        assert(search_query_parse(invalid[i], &clauses) == NULL);
+    }
+
+    search_index_t* index = search_engine_create(8);
+    search_engine_add_document(index, "notes/Project Plan.md",
+                               "# Plan\nThe project #work/q3 starts soon\nbudget review with the team");
+    search_engine_add_document(index, "notes/groceries.txt", "milk eggs bread\n#home shopping list");
+    assert(search_engine_flush(index) == 0);
+    search_engine_add_document(index, "journal/2024-01-02.md", "Team meeting about the budget\nproject kickoff #work");
+    search_engine_add_document(index, "journal/draft.md", "draft budget notes #workshop");
+
+    assert(boolean_matches(index, "budget AND project", (int[]){ 0, 2, -1 }));
+    assert(boolean_matches(index, "budget project", (int[]){ 0, 2, -1 }));
+    assert(boolean_matches(index, "budget -project", (int[]){ 3, -1 }));
+    assert(boolean_matches(index, "budget NOT project", (int[]){ 3, -1 }));
+    assert(boolean_matches(index, "NOT budget", (int[]){ 1, -1 }));
+    assert(boolean_matches(index, "milk OR kickoff", (int[]){ 1, 2, -1 }));
+    assert(boolean_matches(index, "(milk OR kickoff) ext:md", (int[]){ 2, -1 }));
+    assert(boolean_matches(index, "milk OR kickoff ext:md", (int[]){ 1, 2, -1 }));
+    assert(boolean_matches(index, "\"team meeting\" OR \"the team\"", (int[]){ 0, 2, -1 }));
+    assert(boolean_matches(index, "\"meeting team\"", (int[]){ -1 }));
+    assert(boolean_matches(index, "budget and", (int[]){ -1 }));
+
+    // Tags: nested tags match their parent, longer names do not
+    assert(boolean_matches(index, "tag:work", (int[]){ 0, 2, -1 }));
+    assert(boolean_matches(index, "tag:work/q3", (int[]){ 0, -1 }));
+    assert(boolean_matches(index, "tag:#HOME", (int[]){ 1, -1 }));
+    assert(boolean_matches(index, "tag:workshop OR tag:home", (int[]){ 1, 3, -1 }));
+    assert(boolean_matches(index, "work -tag:work", (int[]){ -1 }));
+
+    // Metadata alone, or narrowing text clauses
+    assert(boolean_matches(index, "title:plan", (int[]){ 0, -1 }));
+    assert(boolean_matches(index, "title:\"project plan\"", (int[]){ 0, -1 }));
+    assert(boolean_matches(index, "title:\"plan project\"", (int[]){ -1 }));
+    assert(boolean_matches(index, "path:journal -draft", (int[]){ 2, -1 }));
+    assert(boolean_matches(index, "ext:txt OR path:DRAFT", (int[]){ 1, 3, -1 }));
+    char today[64], tomorrow[64];
+    time_t now = time(NULL);
+    strftime(today, sizeof(today), "modified:%Y-%m-%d", localtime(&now));
+    now += 2 * 24 * 3600;
+    strftime(tomorrow, sizeof(tomorrow), "modified:>=%Y-%m-%d", localtime(&now));
+    assert(boolean_matches(index, today, (int[]){ 0, 1, 2, 3, -1 }));
+    assert(boolean_matches(index, tomorrow, (int[]){ -1 }));
+    assert(boolean_matches(index, "modified:>2000-01-01 milk", (int[]){ 1, -1 }));
+    assert(boolean_matches(index, "modified:<2000-01-01", (int[]){ -1 }));
+
+    // One result per note, at its first match; line 0 for metadata
+    int count;
+    search_result_t* results = run_boolean(index, "budget AND project", false, 0, &count);
+    assert(count == 2);
+    for (int i = 0; i < count; i++) {
+        if (results[i].document_id == 0) {
+            assert(results[i].line_number == 1 && strcmp(results[i].matched_text, "project") == 0);
+        } else {
+            assert(results[i].line_number == 0 && strcmp(results[i].matched_text, "budget") == 0);
+        }
+    }
+    search_engine_free_results(results, count);
+    results = run_boolean(index, "tag:work", false, 0, &count);
+    assert(count == 2 && strcmp(results[0].matched_text, "#work") == 0);
+    search_engine_free_results(results, count);
+    results = run_boolean(index, "title:plan", false, 0, &count);
+    assert(count == 1 && results[0].line_number == 0 && strcmp(results[0].context, "# Plan") == 0);
+    search_engine_free_results(results, count);
+
+    // Case, limits and snippets
+    results = run_boolean(index, "Team", true, 0, &count);
+    assert(count == 1 && results[0].document_id == 2);
+    search_engine_free_results(results, count);
+    results = run_boolean(index, "budget", false, 2, &count);
+    assert(count == 2);
+    search_engine_free_results(results, count);
+    search_query_t query = {0};
+    query.query = "budget -project";
+    query.boolean_mode = true;
+    results = search_engine_search(index, &query, &count);
+    assert(count == 1);
+    search_snippet_t* snippets = search_engine_snippets(index, &query, results, count, 0);
+    assert(snippets && snippets[0].highlight_count == 1);
+    assert(strncmp(snippets[0].text + snippets[0].highlights[0].start, "budget", 6) == 0);
+    search_engine_free_snippets(snippets, count);
+    search_engine_free_results(results, count);
+
+    // Deleted notes never match
+    assert(search_engine_remove_document(index, 2) == 0);
+    assert(boolean_matches(index, "tag:work", (int[]){ 0, -1 }));
+    assert(boolean_matches(index, "NOT milk", (int[]){ 0, 3, -1 }));
+    results = run_boolean(index, "(budget", false, 0, &count);
+    assert(results == NULL && count == 0);
+    search_engine_destroy(index);
+}
+
+static void test_bulk_indexing(void) {
+    // Whatever the thread count, bulk indexing matches one-by-one adds; a
+    // single thread still freezes batches and merges them
+    enum { DOCUMENTS = 2500, EXISTING = 5 };
+    static char texts[DOCUMENTS][96];
+    const char* filepaths[DOCUMENTS];
+    const char* contents[DOCUMENTS];
+    for (int d = 0; d < DOCUMENTS; d++) {
+        sprintf(texts[d], "bulk note %d about topic%d\nshared words here\n", d, d % 11);
+        filepaths[d] = d % 2 ? "odd.md" : "even.md";
+        contents[d] = texts[d];
+    }
+    search_index_t* reference = search_engine_create(DOCUMENTS + EXISTING);
+    for (int d = 0; d < EXISTING; d++) {
+        assert(search_engine_add_document(reference, "old.md", "existing shared note") == d);
+    }
+    for (int d = 0; d < DOCUMENTS; d++) {
+        assert(search_engine_add_document(reference, filepaths[d], contents[d]) == EXISTING + d);
+    }
+    const char* queries[] = { "shared", "topic3", "bulk note", "existing", "2499" };
+    const int thread_counts[] = { 1, 4, 0 };
+    for (int t = 0; t < 3; t++) {
+        search_index_t* index = search_engine_create(DOCUMENTS + EXISTING);
+        for (int d = 0; d < EXISTING; d++) {
+            assert(search_engine_add_document(index, "old.md", "existing shared note") == d);
+        }
+        assert(search_engine_add_documents(index, filepaths, contents, DOCUMENTS, thread_counts[t]) == EXISTING);
+        assert(index->document_count == reference->document_count);
+        for (int i = 0; i < 5; i++) {
+            assert_same_results(index, reference, queries[i], false);
+        }
+        int count_a, count_b;
+        search_result_t* a = search_engine_search_regex(index, "topic1[0-9]", &count_a);
+        search_result_t* b = search_engine_search_regex(reference, "topic1[0-9]", &count_b);
+        assert(count_a == count_b && count_a > 0);
+        search_engine_free_results(a, count_a);
+        search_engine_free_results(b, count_b);
+        assert(search_engine_add_documents(index, filepaths, contents, 1, t) == -2);
+        assert(search_engine_remove_document(index, EXISTING + 7) == 0);
+        assert(search_engine_add_documents(index, filepaths, contents, 1, t) == DOCUMENTS + EXISTING);
+        search_engine_destroy(index);
+    }
+    search_engine_destroy(reference);
+}
+
+// Every highlight of a snippet spells `word`, ignoring case
+static void assert_highlights(const search_snippet_t* snippet, const char* word) {
+    for (int h = 0; h < snippet->highlight_count; h++) {
+        const search_highlight_t* range = &snippet->highlights[h];
+        assert(range->start >= 0 && range->end <= (int)strlen(snippet->text));
+        assert(range->end - range->start == (int)strlen(word));
+        assert(strncasecmp(snippet->text + range->start, word, strlen(word)) == 0);
+    }
+}
+
+static void test_snippets(void) {
+    search_index_t* index = search_engine_create(8);
+    char line[512] = "alpha starts here";
+    for (int i = 0; i < 20; i++) strcat(line, " filler words");
+    strcat(line, " then alpha beta gamma close together");
+    for (int i = 0; i < 10; i++) strcat(line, " more filler");
+    char content[600];
+    sprintf(content, "title line\n%s\nlast line with Alpha", line);
+    search_engine_add_document(index, "a.md", "unrelated text");
+    assert(search_engine_add_document(index, "b.md", content) == 1);
+
+    // The window holding both terms wins over the first occurrence
+    search_query_t query = {0};
+    query.query = "alpha gamma";
+    query.whole_words_only = true;
+    int count;
+    search_result_t* results = search_engine_search(index, &query, &count);
+    assert(count == 1 && results[0].line_number == 1);
+    search_snippet_t* snippets = search_engine_snippets(index, &query, results, count, 40);
+    assert(snippets != NULL);
+    assert((int)strlen(snippets[0].text) <= 40 && snippets[0].truncated);
+    assert(strstr(snippets[0].text, "alpha beta gamma") != NULL);
+    assert(strncmp(line + snippets[0].offset, snippets[0].text, strlen(snippets[0].text)) == 0);
+    assert(snippets[0].highlight_count == 2);
+    assert(strncmp(snippets[0].text + snippets[0].highlights[0].start, "alpha", 5) == 0);
+    assert(strncmp(snippets[0].text + snippets[0].highlights[1].start, "gamma", 5) == 0);
+    char* rendered = search_engine_render_highlights(snippets[0].text, snippets[0].highlights,
+                                                     snippets[0].highlight_count, "[", "]");
+    assert(strstr(rendered, "[alpha] beta [gamma]") != NULL);
+    free(rendered);
+    search_engine_free_snippets(snippets, count);
+    search_engine_free_results(results, count);
+
+    // One term: each occurrence's snippet shows that occurrence; the whole
+    // line with 0, and case-sensitive queries skip other spellings
+    query.query = "alpha";
+    results = search_engine_search(index, &query, &count);
+    assert(count == 3);
+    snippets = search_engine_snippets(index, &query, results, count, 30);
+    for (int i = 0; i < count; i++) {
+        assert(snippets[i].offset <= results[i].column_start);
+        assert(results[i].column_end <= snippets[i].offset + (int)strlen(snippets[i].text));
+        assert(snippets[i].highlight_count >= 1);
+        assert_highlights(&snippets[i], "alpha");
+    }
+    search_engine_free_snippets(snippets, count);
+    snippets = search_engine_snippets(index, &query, results, count, 0);
+    assert(strcmp(snippets[0].text, line) == 0 && snippets[0].offset == 0 && !snippets[0].truncated);
+    assert(snippets[0].highlight_count == 2);
+    assert(snippets[0].highlights[1].start == (int)(strstr(line, "then alpha") - line) + 5);
+    assert(strcmp(snippets[2].text, "last line with Alpha") == 0 && snippets[2].highlight_count == 1);
+    search_engine_free_snippets(snippets, count);
+    search_engine_free_results(results, count);
+    query.query = "Alpha";
+    query.case_sensitive = true;
+    results = search_engine_search(index, &query, &count);
+    assert(count == 1);
+    snippets = search_engine_snippets(index, &query, results, count, 0);
+    assert(snippets[0].highlight_count == 1 && snippets[0].highlights[0].start == 15);
+    search_engine_free_snippets(snippets, count);
+    search_engine_free_results(results, count);
+
+    // Regex results highlight their match; snippets follow updates
+    assert(search_engine_update_document(index, 1, "gamma ray\nbeta gamma gamma") == 0);
+    query.query = "ga[m]+a r";
+    query.regex_mode = true;
+    results = search_engine_search(index, &query, &count);
+    assert(count == 1);
+    snippets = search_engine_snippets(index, &query, results, count, 0);
+    assert(strcmp(snippets[0].text, "gamma ray") == 0 && snippets[0].highlight_count == 1);
+    assert(snippets[0].highlights[0].start == 0 && snippets[0].highlights[0].end == 7);
+    search_engine_free_snippets(snippets, count);
+    search_engine_free_results(results, count);
+    query.query = "gamma";
+    query.regex_mode = false;
+    query.case_sensitive = false;
+    results = search_engine_search(index, &query, &count);
+    assert(count == 3);
+    snippets = search_engine_snippets(index, &query, results, count, 0);
+    assert(snippets[2].highlight_count == 2);
+    assert_highlights(&snippets[2], "gamma");
+    search_engine_free_snippets(snippets, count);
+    search_engine_free_results(results, count);
+
+    char* highlighted = search_engine_highlight_matches("Fast engine, FAST cars; breakfast", "fast", "<b>", "</b>");
+    assert(strcmp(highlighted, "<b>Fast</b> engine, <b>FAST</b> cars; breakfast") == 0);
+    free(highlighted);
+    search_engine_destroy(index);
+}
+
+static void test_tokenizer(void) {
+    // Words cross the 16-byte chunks; non-ASCII letters continue them,
+    // punctuation and ideographs split them
+    const char* text = "a_long_identifier_over_chunks, déjà-vu «Été» naïve—x 東京タワー 42";
+    const char* expected[] = { "a_long_identifier_over_chunks", "déjà", "vu", "Été", "naïve", "x",
+                               "東", "京", "タワー", "42" };
+    search_tokenizer_t tokenizer;
+    search_token_t token;
+    search_tokenizer_init(&tokenizer, text, strlen(text));
+    int count = 0;
+    while (search_tokenizer_next(&tokenizer, &token)) {
+        assert(count < 10);
+        assert(token.length == strlen(expected[count]) &&
+               strncmp(token.start, expected[count], token.length) == 0);
+        assert(token.indexed == (strcmp(expected[count], "x") != 0));
+        count++;
+    }
+    assert(count == 10);
+
+    // Folding beyond ASCII, cut on a character boundary
+    char folded[16];
+    assert(search_fold("ÉTÉ ŒUVRE Ωmega ПРИВЕТ", strlen("ÉTÉ ŒUVRE Ωmega ПРИВЕТ"), folded, sizeof(folded)) == 15);
+    assert(strcmp(folded, "été œuvre ω") == 0);
+    assert(search_fold_equal("NAÏVE", 6, "naïve", 6));
+    assert(!search_fold_equal("naive", 5, "naïve", 6));
+
+    // Invalid UTF-8 separates words
+    search_tokenizer_init(&tokenizer, "ab\xff" "cd", 5);
+    assert(search_tokenizer_next(&tokenizer, &token) && token.length == 2);
+    assert(search_tokenizer_next(&tokenizer, &token) && strncmp(token.start, "cd", 2) == 0);
+    assert(!search_tokenizer_next(&tokenizer, &token));
+}
+
+static void test_unicode_search(void) {
+    search_index_t* index = search_engine_create(8);
+    search_engine_add_document(index, "fr.md", "Résumé de l'été\nÉTÉ indien, «naïve» réponse");
+    search_engine_add_document(index, "jp.md", "東京タワーに行く\n京都");
+
+    // Accented words fold like ASCII ones, and guillemets are no letters
+    int count;
+    search_result_t* results = run(index, "été", false, 0, &count);
+    assert(count == 2);
+    assert(results[0].line_number == 0 && strcmp(results[0].matched_text, "été") == 0);
+    assert(results[1].line_number == 1 && strcmp(results[1].matched_text, "ÉTÉ") == 0);
+    search_engine_free_results(results, count);
+    results = run(index, "ÉTÉ", true, 0, &count);
+    assert(count == 1 && results[0].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(index, "NAÏVE", false, 0, &count);
+    assert(count == 1 && results[0].column_start == (int)strlen("ÉTÉ indien, «"));
+    search_engine_free_results(results, count);
+
+    // Ideographs are words of their own; written together they are a phrase
+    results = run(index, "東京", false, 0, &count);
+    assert(count == 1 && results[0].line_number == 0 && strcmp(results[0].matched_text, "東京") == 0);
+    search_engine_free_results(results, count);
+    results = run(index, "京", false, 0, &count);
+    assert(count == 2);
+    search_engine_free_results(results, count);
+    results = run(index, "京東", false, 0, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+
+    char* highlighted = search_engine_highlight_matches("Un été, l'ÉTÉ", "ete été", "[", "]");
+    assert(strcmp(highlighted, "Un [été], l'[ÉTÉ]") == 0);
+    free(highlighted);
+    search_engine_destroy(index);
+}
+
+static void test_optimize_and_validate(void) {
+    // Small segments with deletions compact into one; results never change
+    enum { DOCUMENTS = 300, PER_FLUSH = 25 };
+    search_index_t* index = search_engine_create(DOCUMENTS);
+    search_index_t* reference = search_engine_create(DOCUMENTS);
+    char content[128];
+    for (int d = 0; d < DOCUMENTS; d++) {
+        sprintf(content, "note %d about topic%d\nété %s words\n", d, d % 5, d % 2 ? "odd" : "even");
+        assert(search_engine_add_document(index, "n.md", content) == d);
+        assert(search_engine_add_document(reference, "n.md", content) == d);
+        if (d % PER_FLUSH == PER_FLUSH - 1) assert(search_engine_flush(index) == 0);
+    }
+    for (int d = 0; d < DOCUMENTS; d += 4) {
+        assert(search_engine_remove_document(index, d) == 0);
+        assert(search_engine_remove_document(reference, d) == 0);
+    }
+    assert(search_engine_update_document(index, 5, "updated topic1 note") == 0);
+    assert(search_engine_update_document(reference, 5, "updated topic1 note") == 0);
+    assert(search_engine_validate_index(index));
+
+    const char* queries[] = { "topic3", "note odd", "\"été odd\"", "updated", "words" };
+    assert(search_engine_optimize_index(index) == 0);
+    assert(search_engine_segment_count(index) == 1);
+    assert(search_engine_validate_index(index));
+    for (int i = 0; i < 5; i++) assert_same_results(index, reference, queries[i], false);
+    assert(search_engine_optimize_index(index) == 0);
+    assert(search_engine_segment_count(index) == 1);
+
+    // Rebuilding indexes the stored text again; writes go on after it
+    assert(search_engine_remove_document(index, 7) == 0);
+    assert(search_engine_remove_document(reference, 7) == 0);
+    assert(search_engine_rebuild_index(index) == 0);
+    assert(search_engine_segment_count(index) == 1 && index->document_count == reference->document_count);
+    assert(search_engine_validate_index(index));
+    for (int i = 0; i < 5; i++) assert_same_results(index, reference, queries[i], false);
+    assert(search_engine_add_document(index, "new.md", "fresh topic3") == DOCUMENTS);
+    assert(search_engine_add_document(reference, "new.md", "fresh topic3") == DOCUMENTS);
+    assert(search_engine_validate_index(index));
+    assert_same_results(index, reference, "topic3", false);
+    search_engine_destroy(reference);
+
+    // A damaged segment fails its checksum
+    assert(search_engine_add_document(index, "last.md", "one more note\nwith two lines") == DOCUMENTS + 1);
+    search_segment_t* segment = saved_segment(index, "test_damaged_index.seg");
+    assert(segment != NULL && search_segment_validate(segment));
+    segment->base[segment->size - 2] ^= 0x20;
+    assert(!search_segment_validate(segment));
+    search_segment_close(segment);
+    search_engine_destroy(index);
+}
+
+// Score of the result at a document's line, or -1
+static float result_score(const search_result_t* results, int count, int document_id, int line_number) {
+    for (int i = 0; i < count; i++) {
+        if (results[i].document_id == document_id && results[i].line_number == line_number) {
+            return results[i].relevance_score;
+        }
+    }
+    return -1.0f;
+}
+
+static void test_field_indexing(void) {
+    search_index_t* index = search_engine_create(8);
+    assert(search_engine_add_document(index, "plain.md", "# Heading compost\ncompost here") == 0);
+    search_engine_set_field_indexing(index, true);
+    assert(search_engine_add_document(index, "notes/Gardening.md",
+        "# Compost guide\n"
+        "Turn the compost weekly.\n"
+        "See [tips](https://example.com/compost-tips) and [[Soil Notes|soil]].\n"
+        "```python\n"
+        "compost = mix(greens, browns)\n"
+        "```\n"
+        "## Tools ##\n"
+        "A fork works.") == 1);
+    assert(search_engine_add_document(index, "notes/misc.md", "random compost remark\n~~~\nfoo compost\n~~~") == 2);
+    const char* paths[] = { "notes/Compost.md", "notes/other.md" };
+    const char* contents[] = { "about compost", "about compost" };
+    assert(search_engine_add_documents(index, paths, contents, 2, 1) == 3);
+
+    // Headings rank above body text, code below; the title boosts a note.
+    // Notes indexed without fields score every line alike.
+    int count;
+    search_result_t* results = run(index, "compost", false, 0, &count);
+    float heading = result_score(results, count, 1, 0);
+    float body = result_score(results, count, 1, 1);
+    float code = result_score(results, count, 1, 4);
+    assert(heading > body && body > code && code > 0.0f);
+    assert(result_score(results, count, 1, 2) < 0.0f);
+    assert(result_score(results, count, 0, 0) == result_score(results, count, 0, 1));
+    assert(result_score(results, count, 2, 0) > result_score(results, count, 2, 2));
+    assert(result_score(results, count, 3, 0) > result_score(results, count, 4, 0));
+    search_engine_free_results(results, count);
+
+    // Link destinations are not note text; wiki link targets are shown
+    results = run(index, "example", false, 0, &count);
+    assert(count == 0);
+    results = run(index, "soil", false, 0, &count);
+    assert(count == 2 && results[0].document_id == 1 && results[0].line_number == 2);
+    search_engine_free_results(results, count);
+
+    // Outline and links come from the stored fields
+    search_heading_t* outline = search_engine_outline(index, 1, &count);
+    assert(count == 2);
+    assert(outline[0].line_number == 0 && outline[0].level == 1 && strcmp(outline[0].text, "Compost guide") == 0);
+    assert(outline[1].line_number == 6 && outline[1].level == 2 && strcmp(outline[1].text, "Tools") == 0);
+    search_engine_free_outline(outline, count);
+    char** links = search_engine_links(index, 1, &count);
+    assert(count == 2 && strcmp(links[0], "https://example.com/compost-tips") == 0 &&
+           strcmp(links[1], "Soil Notes") == 0);
+    search_engine_free_links(links, count);
+    assert(search_engine_outline(index, 0, &count) == NULL && count == 0);
+    assert(search_engine_links(index, 2, &count) == NULL && count == 0);
+    assert(search_engine_outline(index, 99, &count) == NULL && count == 0);
+
+    // Field queries, and boolean results placed at their best field
+    assert(boolean_matches(index, "heading:compost", (int[]){ 1, -1 }));
+    assert(boolean_matches(index, "code:compost", (int[]){ 1, 2, -1 }));
+    assert(boolean_matches(index, "code:compost -heading:tools", (int[]){ 2, -1 }));
+    assert(boolean_matches(index, "link:soil OR link:EXAMPLE.com", (int[]){ 1, -1 }));
+    assert(boolean_matches(index, "code:fork", (int[]){ -1 }));
+    results = run_boolean(index, "compost -title:compost", false, 0, &count);
+    assert(count == 4);
+    assert(result_score(results, count, 1, 0) > 0.0f && result_score(results, count, 2, 0) > 0.0f);
+    search_engine_free_results(results, count);
+
+    // Fields survive validation, saving and merging; rebuilding applies
+    // the current mode to every note
+    assert(search_engine_validate_index(index));
+    const char* path = "test_fields_index.seg";
+    assert(search_engine_save_index(index, path) == 0);
+    search_index_t* loaded = search_engine_load_index(path);
+    assert(loaded != NULL);
+    assert_same_results(index, loaded, "compost", false);
+    assert(boolean_matches(loaded, "heading:compost", (int[]){ 1, -1 }));
+    outline = search_engine_outline(loaded, 1, &count);
+    assert(count == 2 && strcmp(outline[1].text, "Tools") == 0);
+    search_engine_free_outline(outline, count);
+    search_engine_destroy(loaded);
+    remove(path);
+    assert(search_engine_optimize_index(index) == 0);
+    assert(search_engine_validate_index(index));
+    assert(boolean_matches(index, "heading:compost", (int[]){ 1, -1 }));
+    assert(search_engine_rebuild_index(index) == 0);
+    assert(search_engine_validate_index(index));
+    assert(boolean_matches(index, "heading:compost", (int[]){ 0, 1, -1 }));
+    search_engine_set_field_indexing(index, false);
+    assert(search_engine_rebuild_index(index) == 0);
+    assert(search_engine_validate_index(index));
+    assert(boolean_matches(index, "heading:compost", (int[]){ -1 }));
+    results = run(index, "example", false, 0, &count);
+    assert(count == 1);
+    search_engine_free_results(results, count);
+    search_engine_destroy(index);
+}
+
+static void test_posting_list_roundtrip(void) {
+    // Enough documents for several packed blocks plus a tail, with gaps
+    // of every bit width
+    enum { N = 6000 };
+    static uint32_t documents[N], lines[N], positions[N];
+    uint32_t document = 0;
+    int n = 0;
+    srand(7);
+    while (n < N) {
+        document += 1 + (rand() % 4 == 0 ? (uint32_t)rand() % 5000 : 0);
+        int occurrences = 1 + (rand() % 32 == 0 ? rand() % 300 : rand() % 3);
+        uint32_t line = (uint32_t)rand() % 100, position = (uint32_t)rand() % 1000;
+        for (int k = 0; k < occurrences && n < N; k++, n++) {
+            documents[n] = document;
+            lines[n] = line;
+            positions[n] = position;
+            line += (uint32_t)rand() % 3;
+            position += 1 + (uint32_t)rand() % (1u << (rand() % 20));
+        }
+    }
+
+    posting_list_t list;
+    posting_list_init(&list);
+    for (int i = 0; i < N; i++) {
+        assert(posting_list_add(&list, documents[i], lines[i], positions[i]));
+    }
+    assert(list.block_count > 2 && list.occurrence_count == N);
+
+    posting_cursor_t cursor;
+    int i = 0;
+    for (posting_cursor_init(&cursor, &list); !cursor.done; posting_cursor_next(&cursor), i++) {
+        assert(cursor.document == documents[i] && cursor.line == lines[i]);
+        assert(cursor.position == positions[i]);
+    }
+    assert(i == N);
+
+    // Seeks land on the first occurrence at or after (document, line)
+    posting_cursor_init(&cursor, &list);
+    for (int target = 0; target < N; target += 1 + rand() % 97) {
+        uint32_t line = lines[target] + (rand() % 2);
+        int expected = target;
+        while (expected > 0 && documents[expected - 1] == documents[target] &&
+               lines[expected - 1] >= line) {
+            expected--;
+        }
+        while (expected < N && documents[expected] == documents[target] && lines[expected] < line) {
+            expected++;
+        }
+        if (!posting_cursor_seek(&cursor, documents[target], line)) {
+            assert(expected == N);
+            break;
+        }
+        assert(cursor.document == documents[expected] && cursor.line == lines[expected]);
+        assert(cursor.position == positions[expected]);
+    }
+    assert(!posting_cursor_seek(&cursor, documents[N - 1] + 1, 0) && cursor.done);
+
+    posting_list_free(&list);
+    posting_cursor_init(&cursor, &list);
+    assert(cursor.done);
+}
+
+// Without whole_words_only the query matches inside words, in corpus order
+static void test_substring_search(void) {
+    search_index_t* index = create_test_index();
+    int count;
+    search_result_t* results = run_substring(index, "ngin", false, 100, &count);
+    assert(count == 5);
+    assert(results[0].document_id == 0 && results[0].line_number == 1 && results[0].column_start == 12);
+    assert(results[4].document_id == 1 && results[4].line_number == 1);
+    search_engine_free_results(results, count);
+
+    results = run(index, "ngin", false, 100, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+
+    results = run_substring(index, "SEARCH", true, 100, &count);
+    assert(count == 0);
+    search_engine_free_results(results, count);
+
+    results = run_substring(index, "arch res", false, 100, &count);
+    assert(count == 1 && results[0].document_id == 1 && results[0].column_start == 2);
+    search_engine_free_results(results, count);
+
+    // Word queries with no indexed word still match whole words only
+    search_index_t* letters = search_engine_create(4);
+    assert(search_engine_add_document(letters, "l.md", "fox x example\nX marks, a b c\nax xa") == 0);
+    results = run(letters, "x", false, 100, &count);
+    assert(count == 2 && results[0].line_number == 0 && results[0].column_start == 4 &&
+           results[1].line_number == 1 && results[1].column_start == 0 && results[1].column_end == 1);
+    search_engine_free_results(results, count);
+    results = run(letters, "X", true, 100, &count);
+    assert(count == 1 && results[0].line_number == 1);
+    search_engine_free_results(results, count);
+    results = run(letters, "a b", false, 100, &count);
+    assert(count == 1 && results[0].column_start == 9 && results[0].column_end == 12);
+    search_engine_free_results(results, count);
+    results = run(letters, "!", false, 100, &count);
+    assert(count == 0 && results == NULL);
+    search_engine_destroy(letters);
+
+    // Every occurrence agrees with a plain strstr over the lines
+    search_index_t* words = search_engine_create(256);
+    char text[128];
+    int expected = 0;
+    for (int i = 0; i < 200; i++) {
+        snprintf(text, sizeof(text), "foobar%d baz\nqux %dfoo barfoo\n", i, i * 7);
+        assert(search_engine_add_document(words, "n.md", text) == i);
+        if (i % 5 == 0) {
+            assert(search_engine_remove_document(words, i) == 0);
+        } else {
+            expected += 2;
+        }
+    }
+    results = run_substring(words, "oba", false, 1000, &count);
+    assert(count == expected / 2);
+    for (int i = 0; i < count; i++) {
+        assert(results[i].document_id % 5 != 0 && results[i].line_number == 0 && results[i].column_start == 2);
+    }
+    search_engine_free_results(results, count);
+    results = run_substring(words, "rfoo", false, 1000, &count);
+    assert(count == expected / 2);
+    search_engine_free_results(results, count);
+    results = run_substring(words, "foo", false, 1000, &count);
+    assert(count == expected * 3 / 2);
+    search_engine_free_results(results, count);
+    search_engine_destroy(words);
+    search_engine_destroy(index);
+}
+
+int main(void) {
+    test_single_term_occurrences();
+    test_multi_term_and();
+    test_case_and_fallback();
+    test_substring_search();
+    test_bm25_ranking();
+    test_top_k_pruning();
+    test_large_vocabulary();
+    test_save_and_load();
+    test_forged_segments();
+    test_remove_and_update();
+    test_segment_merges();
+    test_regex_search();
+    test_trigram_prefilter();
+    test_fuzzy_search();
+    test_suggestions();
+    test_concurrent_search();
+    test_phrase_and_near();
+    test_boolean_queries();
+    test_bulk_indexing();
+    test_snippets();
+    test_tokenizer();
+    test_unicode_search();
+    test_optimize_and_validate();
+    test_field_indexing();
+    test_posting_list_roundtrip();
+    printf("search engine tests passed\n");
+    return 0;
+}
@@ -0,0 +1,38 @@
+// bench_alloc.h - Allocation counting shim for scriptable_tui benchmarks
+//
+// Force-included (-include bench_alloc.h) into every translation unit of the
+// scriptable TUI, cursor engine included, so that allocations made while a
+// keystroke is replayed can be attributed to it. The counters themselves live
+// in scriptable_tui.c.
+
+#ifndef TUI_BENCH_ALLOC_H
+#define TUI_BENCH_ALLOC_H
+
+// clock_gettime/getrusage under -std=c11; must precede the first system header
+#ifndef _POSIX_C_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    uint64_t allocations;     // malloc/calloc/realloc calls
+    uint64_t bytes_requested; // bytes asked for by those calls
+    uint64_t frees;
+} tui_alloc_stats_t;
+
+void* tui_bench_malloc(size_t size);
+void* tui_bench_calloc(size_t count, size_t size);
+void* tui_bench_realloc(void* ptr, size_t size);
+void tui_bench_free(void* ptr);
+tui_alloc_stats_t tui_bench_alloc_stats(void);
+
+#define malloc(size) tui_bench_malloc(size)
+#define calloc(count, size) tui_bench_calloc(count, size)
+#define realloc(ptr, size) tui_bench_realloc(ptr, size)
+#define free(ptr) tui_bench_free(ptr)
+
+#endif // TUI_BENCH_ALLOC_H
@@ -180,6 +180,11 @@ void test_position_adjustment() {
 int main() {
     printf("🚀 DÉMONSTRATION - Bibliothèque C de Gestion de Curseur\n");
     printf("═══════════════════════════════════════════════════════\n");
+
+    // The demo prints the full before/after strings
+    cursor_config_t config = cursor_get_config();
+    config.full_content_output = true;
+    cursor_set_config(&config);
     
     test_formatting_detection();
     print_separator();
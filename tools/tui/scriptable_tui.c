@@ -1,34 +1,424 @@
+#include "bench_alloc.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
 #include "cursor_manager.h"
 
-#define MAX_LINES 100
-#define MAX_LINE_LENGTH 1024
+#define MAX_UNDO_RECORDS 1024
+#define MAX_TRACE_LINE 4096
+#define DEFAULT_BENCH_LINES 1000
+
+// ============= ALLOCATION COUNTERS =============
+
+// The macros from bench_alloc.h route every allocation of the binary through
+// these wrappers; the parenthesized names below call the real allocator.
+static tui_alloc_stats_t alloc_stats = {0};
+
+void* tui_bench_malloc(size_t size) {
+    alloc_stats.allocations++;
+    alloc_stats.bytes_requested += size;
+    return (malloc)(size);
+}
+
+void* tui_bench_calloc(size_t count, size_t size) {
+    alloc_stats.allocations++;
+    alloc_stats.bytes_requested += count * size;
+    return (calloc)(count, size);
+}
+
+void* tui_bench_realloc(void* ptr, size_t size) {
+    alloc_stats.allocations++;
+    alloc_stats.bytes_requested += size;
+    return (realloc)(ptr, size);
+}
+
+void tui_bench_free(void* ptr) {
+    if (ptr) alloc_stats.frees++;
+    (free)(ptr);
+}
+
+tui_alloc_stats_t tui_bench_alloc_stats(void) {
+    return alloc_stats;
+}
+
+// ============= EDITOR BUFFER =============
+
+typedef struct {
+    char* text;
+    int length;
+    int capacity;
+} tui_line_t;
+
+// One reversible edit: `deleted` was replaced by `inserted` at (line, col)
+typedef struct {
+    int line;
+    int col;
+    char* deleted;
+    int deleted_len;
+    char* inserted;
+    int inserted_len;
+    int cursor_line_before;
+    int cursor_col_before;
+} edit_record_t;
 
 // Editor state
 typedef struct {
-    char lines[MAX_LINES][MAX_LINE_LENGTH];
+    tui_line_t* lines;
     int line_count;
+    int line_capacity;
     int cursor_line;
     int cursor_col;
+
+    edit_record_t undo[MAX_UNDO_RECORDS]; // ring: the oldest record is at undo_start
+    int undo_start;
+    int undo_count;    // records stored
+    int undo_position; // records currently applied (redo starts here)
 } scriptable_editor_t;
 
 static scriptable_editor_t editor = {0};
 
+// The `i`-th undo record, oldest first
+static edit_record_t* undo_record(int i) {
+    return &editor.undo[(editor.undo_start + i) % MAX_UNDO_RECORDS];
+}
+
+static void line_reserve(tui_line_t* line, int needed) {
+    if (needed + 1 <= line->capacity) return;
+    int capacity = line->capacity ? line->capacity : 32;
+    while (capacity < needed + 1) capacity *= 2;
+    char* text = realloc(line->text, capacity);
+    if (!text) {
+        fprintf(stderr, "❌ Mémoire insuffisante\n");
+        exit(1);
+    }
+    line->text = text;
+    line->capacity = capacity;
+}
+
+static void line_set(tui_line_t* line, const char* text, int len) {
+    line_reserve(line, len);
+    memcpy(line->text, text, len);
+    line->length = len;
+    line->text[len] = '\0';
+}
+
+static void line_append(tui_line_t* line, const char* text, int len) {
+    line_reserve(line, line->length + len);
+    memcpy(line->text + line->length, text, len);
+    line->length += len;
+    line->text[line->length] = '\0';
+}
+
+// Insert `count` empty lines before index `at`
+static void buffer_insert_lines(int at, int count) {
+    if (editor.line_count + count > editor.line_capacity) {
+        int capacity = editor.line_capacity ? editor.line_capacity : 64;
+        while (capacity < editor.line_count + count) capacity *= 2;
+        tui_line_t* lines = realloc(editor.lines, capacity * sizeof(tui_line_t));
+        if (!lines) {
+            fprintf(stderr, "❌ Mémoire insuffisante\n");
+            exit(1);
+        }
+        editor.lines = lines;
+        editor.line_capacity = capacity;
+    }
+    memmove(&editor.lines[at + count], &editor.lines[at],
+            (editor.line_count - at) * sizeof(tui_line_t));
+    memset(&editor.lines[at], 0, count * sizeof(tui_line_t));
+    for (int i = 0; i < count; i++) {
+        line_set(&editor.lines[at + i], "", 0);
+    }
+    editor.line_count += count;
+}
+
+static void buffer_remove_lines(int at, int count) {
+    for (int i = 0; i < count; i++) {
+        free(editor.lines[at + i].text);
+    }
+    memmove(&editor.lines[at], &editor.lines[at + count],
+            (editor.line_count - at - count) * sizeof(tui_line_t));
+    editor.line_count -= count;
+}
+
+static void buffer_clear(void) {
+    for (int i = 0; i < editor.line_count; i++) {
+        free(editor.lines[i].text);
+    }
+    free(editor.lines);
+    for (int i = 0; i < editor.undo_count; i++) {
+        free(undo_record(i)->deleted);
+        free(undo_record(i)->inserted);
+    }
+    memset(&editor, 0, sizeof(editor));
+}
+
+// Insert text (may contain '\n') at (line, col); returns the end position
+static void buffer_insert(int line, int col, const char* text, int len,
+                          int* end_line, int* end_col) {
+    tui_line_t* current = &editor.lines[line];
+    int tail_len = current->length - col;
+    char* tail = malloc(tail_len + 1);
+    memcpy(tail, current->text + col, tail_len);
+    current->length = col;
+    current->text[col] = '\0';
+
+    const char* segment = text;
+    const char* end = text + len;
+    while (segment <= end) {
+        const char* newline = memchr(segment, '\n', end - segment);
+        int segment_len = (int)((newline ? newline : end) - segment);
+        line_append(&editor.lines[line], segment, segment_len);
+        if (!newline) break;
+        buffer_insert_lines(line + 1, 1);
+        line++;
+        segment = newline + 1;
+    }
+
+    *end_line = line;
+    *end_col = editor.lines[line].length;
+    line_append(&editor.lines[line], tail, tail_len);
+    free(tail);
+}
+
+// Delete `len` bytes starting at (line, col), line breaks counting as one
+// byte; the removed text is returned as a new string
+static char* buffer_delete(int line, int col, int len) {
+    char* deleted = malloc(len + 1);
+    int copied = 0;
+    int last_line = line;
+    int last_col = col;
+
+    while (copied < len) {
+        tui_line_t* current = &editor.lines[last_line];
+        int available = current->length - last_col;
+        int take = (len - copied < available) ? len - copied : available;
+        memcpy(deleted + copied, current->text + last_col, take);
+        copied += take;
+        last_col += take;
+        if (copied < len) {
+            if (last_line + 1 >= editor.line_count) break;
+            deleted[copied++] = '\n';
+            last_line++;
+            last_col = 0;
+        }
+    }
+    deleted[copied] = '\0';
+
+    tui_line_t* first = &editor.lines[line];
+    tui_line_t* last = &editor.lines[last_line];
+    int rest_len = last->length - last_col;
+    if (last_line == line) {
+        memmove(first->text + col, first->text + last_col, rest_len + 1);
+        first->length = col + rest_len;
+    } else {
+        first->length = col;
+        line_append(first, last->text + last_col, rest_len);
+        buffer_remove_lines(line + 1, last_line - line);
+    }
+    return deleted;
+}
+
+static void undo_push(edit_record_t record) {
+    // A new edit discards everything that could have been redone
+    for (int i = editor.undo_position; i < editor.undo_count; i++) {
+        free(undo_record(i)->deleted);
+        free(undo_record(i)->inserted);
+    }
+    editor.undo_count = editor.undo_position;
+
+    // At the cap the oldest record is dropped in place
+    if (editor.undo_count == MAX_UNDO_RECORDS) {
+        free(undo_record(0)->deleted);
+        free(undo_record(0)->inserted);
+        editor.undo_start = (editor.undo_start + 1) % MAX_UNDO_RECORDS;
+        editor.undo_count--;
+    }
+    *undo_record(editor.undo_count++) = record;
+    editor.undo_position = editor.undo_count;
+}
+
+// Replace `delete_len` bytes at (line, col) with `insert`, record it for undo
+// and leave the cursor after the inserted text
+static void editor_replace(int line, int col, int delete_len,
+                           const char* insert, int insert_len) {
+    edit_record_t record = {0};
+    record.line = line;
+    record.col = col;
+    record.cursor_line_before = editor.cursor_line;
+    record.cursor_col_before = editor.cursor_col;
+    record.deleted = buffer_delete(line, col, delete_len);
+    record.deleted_len = (int)strlen(record.deleted);
+    record.inserted = malloc(insert_len + 1);
+    memcpy(record.inserted, insert, insert_len);
+    record.inserted[insert_len] = '\0';
+    record.inserted_len = insert_len;
+
+    buffer_insert(line, col, insert, insert_len, &editor.cursor_line, &editor.cursor_col);
+    undo_push(record);
+}
+
+// ============= EDITOR OPERATIONS =============
+
+static void clamp_cursor(void) {
+    if (editor.cursor_line >= editor.line_count) editor.cursor_line = editor.line_count - 1;
+    if (editor.cursor_line < 0) editor.cursor_line = 0;
+    int len = editor.lines[editor.cursor_line].length;
+    if (editor.cursor_col > len) editor.cursor_col = len;
+    if (editor.cursor_col < 0) editor.cursor_col = 0;
+}
+
+static const char* current_text(void) {
+    return editor.lines[editor.cursor_line].text;
+}
+
+static void op_type(const char* text, int len) {
+    editor_replace(editor.cursor_line, editor.cursor_col, 0, text, len);
+}
+
+// Smart line split through the cursor engine; returns the split column
+static int op_enter(void) {
+    cursor_operation_result_t result =
+        cursor_handle_enter_key(editor.cursor_col, current_text(), true);
+    int split = result.success ? result.delta.offset : editor.cursor_col;
+    cursor_free_result(&result);
+
+    editor_replace(editor.cursor_line, split, 0, "\n", 1);
+    return split;
+}
+
+// Backspace: delete a character, or merge with the previous line
+static bool op_backspace(void) {
+    if (editor.cursor_col > 0) {
+        editor_replace(editor.cursor_line, editor.cursor_col - 1, 1, "", 0);
+        return true;
+    }
+    if (editor.cursor_line == 0) return false;
+
+    tui_line_t* prev = &editor.lines[editor.cursor_line - 1];
+    cursor_operation_result_t result =
+        cursor_merge_lines(prev->text, current_text(), true);
+    bool merged = result.success;
+    if (merged) {
+        // The delta replaces the line break, possibly with a separating space
+        editor_replace(editor.cursor_line - 1, result.delta.offset, result.delta.delete_length,
+                       result.delta.insert_text, result.delta.insert_length);
+    }
+    cursor_free_result(&result);
+    return merged;
+}
+
+static void op_delete(void) {
+    int len = editor.lines[editor.cursor_line].length;
+    if (editor.cursor_col < len || editor.cursor_line + 1 < editor.line_count) {
+        int line = editor.cursor_line;
+        int col = editor.cursor_col;
+        editor_replace(line, col, 1, "", 0);
+        editor.cursor_line = line;
+        editor.cursor_col = col;
+    }
+}
+
+static void op_move(const char* key) {
+    if (strcmp(key, "left") == 0) {
+        if (editor.cursor_col > 0) {
+            editor.cursor_col--;
+        } else if (editor.cursor_line > 0) {
+            editor.cursor_line--;
+            editor.cursor_col = editor.lines[editor.cursor_line].length;
+        }
+    } else if (strcmp(key, "right") == 0) {
+        if (editor.cursor_col < editor.lines[editor.cursor_line].length) {
+            editor.cursor_col++;
+        } else if (editor.cursor_line + 1 < editor.line_count) {
+            editor.cursor_line++;
+            editor.cursor_col = 0;
+        }
+    } else if (strcmp(key, "up") == 0) {
+        editor.cursor_line--;
+    } else if (strcmp(key, "down") == 0) {
+        editor.cursor_line++;
+    } else if (strcmp(key, "home") == 0) {
+        editor.cursor_col = cursor_move_to_line_start(current_text(), editor.cursor_col).position;
+    } else if (strcmp(key, "end") == 0) {
+        editor.cursor_col = cursor_move_to_line_end(current_text(), editor.cursor_col).position;
+    } else if (strcmp(key, "word-left") == 0) {
+        editor.cursor_col = cursor_move_word_left(current_text(), editor.cursor_col).position;
+    } else if (strcmp(key, "word-right") == 0) {
+        editor.cursor_col = cursor_move_word_right(current_text(), editor.cursor_col).position;
+    }
+    clamp_cursor();
+}
+
+static bool op_undo(void) {
+    if (editor.undo_position == 0) return false;
+    edit_record_t* record = undo_record(--editor.undo_position);
+    int end_line, end_col;
+    free(buffer_delete(record->line, record->col, record->inserted_len));
+    buffer_insert(record->line, record->col, record->deleted, record->deleted_len,
+                  &end_line, &end_col);
+    editor.cursor_line = record->cursor_line_before;
+    editor.cursor_col = record->cursor_col_before;
+    clamp_cursor();
+    return true;
+}
+
+static bool op_redo(void) {
+    if (editor.undo_position == editor.undo_count) return false;
+    edit_record_t* record = undo_record(editor.undo_position++);
+    free(buffer_delete(record->line, record->col, record->deleted_len));
+    buffer_insert(record->line, record->col, record->inserted, record->inserted_len,
+                  &editor.cursor_line, &editor.cursor_col);
+    return true;
+}
+
+// Find next occurrence after the cursor, wrapping around the document
+static bool op_search(const char* query) {
+    if (!query[0]) return false;
+    for (int i = 0; i <= editor.line_count; i++) {
+        int line = (editor.cursor_line + i) % editor.line_count;
+        const char* text = editor.lines[line].text;
+        int from = (i == 0) ? editor.cursor_col + 1 : 0;
+        if (from > editor.lines[line].length) continue;
+        const char* match = strstr(text + from, query);
+        if (match) {
+            editor.cursor_line = line;
+            editor.cursor_col = (int)(match - text);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Status bar refresh done by the interactive editor after every key
+static formatting_context_t refresh_status(void) {
+    return cursor_analyze_formatting(current_text(), editor.cursor_col);
+}
+
+// ============= SCRIPTED DEMO =============
+
 // Initialize editor with test content
 void init_editor() {
-    editor.cursor_line = 0;
-    editor.cursor_col = 0;
-    editor.line_count = 6;
-    
-    strcpy(editor.lines[0], "# TUI Editor - Test Cursor Management");
-    strcpy(editor.lines[1], "");
-    strcpy(editor.lines[2], "- *Italique* test");
-    strcpy(editor.lines[3], "- **Gras** test");
-    strcpy(editor.lines[4], "- ==Surligné== test");
-    strcpy(editor.lines[5], "- ++Souligné++ test");
+    static const char* demo_lines[] = {
+        "# TUI Editor - Test Cursor Management",
+        "",
+        "- *Italique* test",
+        "- **Gras** test",
+        "- ==Surligné== test",
+        "- ++Souligné++ test",
+    };
+
+    buffer_clear();
+    int count = (int)(sizeof(demo_lines) / sizeof(demo_lines[0]));
+    buffer_insert_lines(0, count);
+    for (int i = 0; i < count; i++) {
+        line_set(&editor.lines[i], demo_lines[i], (int)strlen(demo_lines[i]));
+    }
 }
 
 // Display current state
@@ -36,17 +426,16 @@ void display_state() {
     printf("\n" "┌─────────────────────────────────────────────────────────┐\n");
     printf("│ ÉDITEUR TUI SCRIPTABLE - État Actuel                   │\n");
     printf("└─────────────────────────────────────────────────────────┘\n");
-    
+
     for (int i = 0; i < editor.line_count; i++) {
-        char prefix[10];
         if (i == editor.cursor_line) {
-            sprintf(prefix, "→%2d", i + 1);
+            printf("→%2d", i + 1);
         } else {
-            sprintf(prefix, " %2d", i + 1);
+            printf(" %2d", i + 1);
         }
-        
-        printf("%s│ %s", prefix, editor.lines[i]);
-        
+
+        printf("│ %s", editor.lines[i].text);
+
         // Show cursor position on current line
         if (i == editor.cursor_line) {
             printf("\n     ");
@@ -57,11 +446,10 @@ void display_state() {
         }
         printf("\n");
     }
-    
+
     // Show formatting context at cursor
-    const char* current_line = editor.lines[editor.cursor_line];
-    formatting_context_t ctx = cursor_analyze_formatting(current_line, editor.cursor_col);
-    
+    formatting_context_t ctx = refresh_status();
+
     const char* format_type = "";
     switch(ctx.type) {
         case MARKER_NONE: format_type = "NONE"; break;
@@ -71,11 +459,11 @@ void display_state() {
         case MARKER_UNDERLINE: format_type = "UNDERLINE"; break;
         case MARKER_HEADER: format_type = "HEADER"; break;
     }
-    
-    printf("\n📍 Curseur: Ligne %d, Col %d | Formatage: %s%s\n", 
-           editor.cursor_line + 1, editor.cursor_col + 1, 
+
+    printf("\n📍 Curseur: Ligne %d, Col %d | Formatage: %s%s\n",
+           editor.cursor_line + 1, editor.cursor_col + 1,
            format_type, ctx.inside_marker ? " (INSIDE)" : "");
-    
+
     printf("═══════════════════════════════════════════════════════════\n");
 }
 
@@ -83,23 +471,17 @@ void display_state() {
 void move_cursor(int line, int col) {
     if (line >= 0 && line < editor.line_count) {
         editor.cursor_line = line;
-        int line_length = strlen(editor.lines[line]);
-        if (col >= 0 && col <= line_length) {
-            editor.cursor_col = col;
-        } else if (col < 0) {
-            editor.cursor_col = 0;
-        } else {
-            editor.cursor_col = line_length;
-        }
+        editor.cursor_col = col;
+        clamp_cursor();
         printf("🚶 Curseur déplacé à: ligne %d, colonne %d\n", line + 1, col);
     }
 }
 
 void move_to_middle_of_formatting(int line) {
     if (line >= 0 && line < editor.line_count) {
-        const char* text = editor.lines[line];
-        int len = strlen(text);
-        
+        const char* text = editor.lines[line].text;
+        int len = editor.lines[line].length;
+
         // Find formatting in the line
         for (int pos = 0; pos < len; pos++) {
             formatting_context_t ctx = cursor_analyze_formatting(text, pos);
@@ -107,7 +489,7 @@ void move_to_middle_of_formatting(int line) {
                 // Found formatting, go to middle
                 int middle = (ctx.start_pos + ctx.end_pos) / 2;
                 move_cursor(line, middle);
-                printf("🎯 Curseur placé au centre du formatage %s\n", 
+                printf("🎯 Curseur placé au centre du formatage %s\n",
                        ctx.type == MARKER_BOLD ? "BOLD" :
                        ctx.type == MARKER_ITALIC ? "ITALIC" :
                        ctx.type == MARKER_HIGHLIGHT ? "HIGHLIGHT" : "UNKNOWN");
@@ -121,142 +503,591 @@ void move_to_middle_of_formatting(int line) {
 // Simulate Enter key
 void press_enter() {
     printf("\n🔑 Appui sur ENTRÉE...\n");
-    
-    const char* current_line = editor.lines[editor.cursor_line];
-    cursor_operation_result_t result = cursor_handle_enter_key(editor.cursor_col, current_line, true);
-    
-    if (result.success) {
-        // Update current line
-        if (result.before_cursor) {
-            strcpy(editor.lines[editor.cursor_line], result.before_cursor);
-        }
-        
-        // Insert new line
-        for (int i = editor.line_count; i > editor.cursor_line; i--) {
-            strcpy(editor.lines[i], editor.lines[i - 1]);
-        }
-        editor.line_count++;
-        editor.cursor_line++;
-        
-        if (result.after_cursor) {
-            strcpy(editor.lines[editor.cursor_line], result.after_cursor);
-        } else {
-            strcpy(editor.lines[editor.cursor_line], "");
-        }
-        
-        editor.cursor_col = result.new_position.position;
-        
-        printf("✅ Division réussie:\n");
-        printf("   Ligne précédente: \"%s\"\n", result.before_cursor ? result.before_cursor : "");
-        printf("   Nouvelle ligne: \"%s\"\n", result.after_cursor ? result.after_cursor : "");
-        printf("   Curseur à: col %d\n", editor.cursor_col);
-    } else {
-        printf("❌ Échec de la division: %s\n", result.error_message ? result.error_message : "Erreur inconnue");
-    }
-    
-    cursor_free_result(&result);
+
+    op_enter();
+
+    printf("✅ Division réussie:\n");
+    printf("   Ligne précédente: \"%s\"\n", editor.lines[editor.cursor_line - 1].text);
+    printf("   Nouvelle ligne: \"%s\"\n", current_text());
+    printf("   Curseur à: col %d\n", editor.cursor_col);
 }
 
 // Simulate Backspace
 void press_backspace() {
     printf("\n🔑 Appui sur BACKSPACE...\n");
-    
-    if (editor.cursor_col > 0) {
-        // Delete character
-        char* line = editor.lines[editor.cursor_line];
-        int len = strlen(line);
-        memmove(&line[editor.cursor_col - 1], &line[editor.cursor_col], len - editor.cursor_col + 1);
-        editor.cursor_col--;
-        printf("🔤 Caractère supprimé\n");
-    } else if (editor.cursor_line > 0) {
-        // Merge lines
-        char* prev_line = editor.lines[editor.cursor_line - 1];
-        char* curr_line = editor.lines[editor.cursor_line];
-        
-        cursor_operation_result_t result = cursor_merge_lines(prev_line, curr_line, true);
-        
-        if (result.success && result.before_cursor) {
-            strcpy(editor.lines[editor.cursor_line - 1], result.before_cursor);
-            editor.cursor_col = result.new_position.position;
-            
-            // Remove current line
-            for (int i = editor.cursor_line; i < editor.line_count - 1; i++) {
-                strcpy(editor.lines[i], editor.lines[i + 1]);
-            }
-            editor.line_count--;
-            editor.cursor_line--;
-            
-            printf("✅ Fusion réussie: \"%s\" (curseur à col %d)\n", 
-                   result.before_cursor, editor.cursor_col);
-        } else {
+
+    bool at_line_start = editor.cursor_col == 0;
+    if (!op_backspace()) {
+        if (at_line_start && editor.cursor_line > 0) {
             printf("❌ Échec de la fusion\n");
         }
-        
-        cursor_free_result(&result);
+        return;
+    }
+
+    if (at_line_start) {
+        printf("✅ Fusion réussie: \"%s\" (curseur à col %d)\n",
+               current_text(), editor.cursor_col);
+    } else {
+        printf("🔤 Caractère supprimé\n");
     }
 }
 
 // Type text
 void type_text(const char* text) {
     printf("\n⌨️  Frappe: \"%s\"\n", text);
-    
-    char* line = editor.lines[editor.cursor_line];
-    int len = strlen(line);
-    int text_len = strlen(text);
-    
-    // Make room for new text
-    memmove(&line[editor.cursor_col + text_len], &line[editor.cursor_col], len - editor.cursor_col + 1);
-    
-    // Insert text
-    memcpy(&line[editor.cursor_col], text, text_len);
-    editor.cursor_col += text_len;
+    op_type(text, (int)strlen(text));
 }
 
 // Execute a script of commands
 void execute_script() {
     printf("🎬 DÉMARRAGE DU SCRIPT D'INTERACTION\n");
-    
+
     display_state();
-    
+
     printf("\n📝 Test 1: Aller au centre de '**Gras**' et appuyer sur Entrée\n");
     move_to_middle_of_formatting(3); // Line with "- **Gras** test"
     display_state();
-    
+
     press_enter();
     display_state();
-    
+
     printf("\n📝 Test 2: Supprimer pour fusionner les lignes\n");
     press_backspace();
     display_state();
-    
+
     printf("\n📝 Test 3: Aller au centre de '*Italique*' et diviser\n");
     move_to_middle_of_formatting(2); // Line with "- *Italique* test"
     display_state();
-    
+
     press_enter();
     display_state();
-    
+
     printf("\n📝 Test 4: Taper du texte\n");
     type_text("NOUVEAU");
     display_state();
-    
+
     printf("\n📝 Test 5: Fusionner à nouveau\n");
     move_cursor(editor.cursor_line + 1, 0); // Aller au début de la ligne suivante
     press_backspace();
     display_state();
-    
+
     printf("\n🎊 SCRIPT TERMINÉ!\n");
 }
 
+// ============= KEYSTROKE REPLAY BENCHMARK =============
+//
+// Trace files hold one command per line ('#' starts a comment):
+//   goto <line|middle|end> [col|end]   place the cursor (not timed)
+//   type <text>                        one timed event per character; \n \t \\ escapes
+//   key <name>                         enter backspace delete left right up down
+//                                      home end word-left word-right undo redo
+//   paste <lines>                      paste a block of sample lines
+//   search <query>                     find next occurrence (wraps)
+//   repeat <count> <command>           run a command several times
+
+typedef enum {
+    TRACE_GOTO,
+    TRACE_TYPE,
+    TRACE_KEY,
+    TRACE_PASTE,
+    TRACE_SEARCH
+} trace_op_t;
+
+typedef struct {
+    trace_op_t op;
+    int repeat;
+    int line;  // TRACE_GOTO: -1 = middle, -2 = end
+    int col;   // TRACE_GOTO: -1 = end of line; TRACE_PASTE: line count
+    char* text;
+    int text_len;
+} trace_command_t;
+
+typedef struct {
+    char name[256];
+    trace_command_t* commands;
+    int command_count;
+} trace_t;
+
+typedef struct {
+    uint64_t* samples;
+    int count;
+    int capacity;
+    uint64_t allocations;
+    uint64_t bytes_requested;
+    uint64_t max_event_allocations;
+} trace_stats_t;
+
+typedef struct {
+    int lines;
+    int iterations;
+    bool json;
+    const char* sample_file;
+} bench_options_t;
+
+static const char* default_sample_lines[] = {
+    "# Journal de projet",
+    "",
+    "Paragraphe avec du **gras**, de l'*italique* et du ==surligné== au fil du texte.",
+    "- ++Souligné++ dans une liste à puces",
+    "- Élément de liste avec un [lien](https://example.com) et du `code`",
+    "## Notes de réunion",
+    "Texte ordinaire pour remplir le document de test avec des mots courants.",
+    "1. Première étape **importante** à valider",
+    "> Citation avec *emphase* et ==mise en avant==",
+    "",
+};
+
+static char** sample_lines = NULL;
+static int sample_line_count = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Peak RSS of this process (RUSAGE_SELF) or of its largest finished child
+// (RUSAGE_CHILDREN)
+static long peak_rss_kb(int who) {
+    struct rusage usage;
+    if (getrusage(who, &usage) != 0) return -1;
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024; // bytes on macOS
+#else
+    return usage.ru_maxrss;        // kilobytes on Linux
+#endif
+}
+
+static bool load_sample_lines(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "❌ Impossible d'ouvrir %s\n", path);
+        return false;
+    }
+    char buffer[MAX_TRACE_LINE];
+    int capacity = 0;
+    while (fgets(buffer, sizeof(buffer), file)) {
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        if (sample_line_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            sample_lines = realloc(sample_lines, capacity * sizeof(char*));
+        }
+        size_t len = strlen(buffer);
+        sample_lines[sample_line_count] = malloc(len + 1);
+        memcpy(sample_lines[sample_line_count], buffer, len + 1);
+        sample_line_count++;
+    }
+    fclose(file);
+    if (sample_line_count == 0) {
+        fprintf(stderr, "❌ Fichier d'exemple vide: %s\n", path);
+        return false;
+    }
+    return true;
+}
+
+static void load_bench_document(int lines) {
+    buffer_clear();
+    buffer_insert_lines(0, lines);
+    for (int i = 0; i < lines; i++) {
+        const char* text = sample_lines[i % sample_line_count];
+        line_set(&editor.lines[i], text, (int)strlen(text));
+    }
+}
+
+static int unescape(char* text) {
+    char* out = text;
+    for (char* in = text; *in; in++) {
+        if (*in == '\\' && in[1]) {
+            in++;
+            *out++ = (*in == 'n') ? '\n' : (*in == 't') ? '\t' : *in;
+        } else {
+            *out++ = *in;
+        }
+    }
+    *out = '\0';
+    return (int)(out - text);
+}
+
+static bool parse_trace_command(char* line, trace_command_t* command, const char* path, int line_no) {
+    memset(command, 0, sizeof(*command));
+    command->repeat = 1;
+
+    if (strncmp(line, "repeat ", 7) == 0) {
+        char* rest = NULL;
+        long count = strtol(line + 7, &rest, 10);
+        if (count <= 0 || !rest || *rest != ' ') goto invalid;
+        command->repeat = (int)count;
+        line = rest + 1;
+    }
+
+    char* arg = strchr(line, ' ');
+    if (arg) *arg++ = '\0';
+    else arg = line + strlen(line);
+
+    if (strcmp(line, "goto") == 0) {
+        char line_arg[32] = "", col_arg[32] = "0";
+        if (sscanf(arg, "%31s %31s", line_arg, col_arg) < 1) goto invalid;
+        command->op = TRACE_GOTO;
+        command->line = strcmp(line_arg, "middle") == 0 ? -1 :
+                        strcmp(line_arg, "end") == 0 ? -2 : atoi(line_arg) - 1;
+        command->col = strcmp(col_arg, "end") == 0 ? -1 : atoi(col_arg);
+    } else if (strcmp(line, "type") == 0 || strcmp(line, "search") == 0 ||
+               strcmp(line, "key") == 0) {
+        command->op = line[0] == 't' ? TRACE_TYPE : line[0] == 's' ? TRACE_SEARCH : TRACE_KEY;
+        size_t len = strlen(arg);
+        command->text = malloc(len + 1);
+        memcpy(command->text, arg, len + 1);
+        command->text_len = command->op == TRACE_KEY ? (int)len : unescape(command->text);
+        if (command->text_len == 0) goto invalid;
+    } else if (strcmp(line, "paste") == 0) {
+        command->op = TRACE_PASTE;
+        command->col = atoi(arg);
+        if (command->col <= 0) goto invalid;
+    } else {
+        goto invalid;
+    }
+    return true;
+
+invalid:
+    free(command->text);
+    fprintf(stderr, "❌ %s:%d: commande invalide\n", path, line_no);
+    return false;
+}
+
+static bool load_trace(const char* path, trace_t* trace) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "❌ Impossible d'ouvrir la trace %s\n", path);
+        return false;
+    }
+
+    const char* base = strrchr(path, '/');
+    base = base ? base + 1 : path;
+    snprintf(trace->name, sizeof(trace->name), "%s", base);
+    char* dot = strrchr(trace->name, '.');
+    if (dot && dot != trace->name) *dot = '\0';
+
+    char buffer[MAX_TRACE_LINE];
+    int capacity = 0;
+    int line_no = 0;
+    bool ok = true;
+    while (ok && fgets(buffer, sizeof(buffer), file)) {
+        line_no++;
+        buffer[strcspn(buffer, "\r\n")] = '\0';
+        char* line = buffer;
+        while (*line == ' ' || *line == '\t') line++;
+        if (*line == '\0' || *line == '#') continue;
+
+        if (trace->command_count == capacity) {
+            capacity = capacity ? capacity * 2 : 32;
+            trace->commands = realloc(trace->commands, capacity * sizeof(trace_command_t));
+        }
+        ok = parse_trace_command(line, &trace->commands[trace->command_count], path, line_no);
+        if (ok) trace->command_count++;
+    }
+    fclose(file);
+    return ok;
+}
+
+static void free_trace(trace_t* trace) {
+    for (int i = 0; i < trace->command_count; i++) {
+        free(trace->commands[i].text);
+    }
+    free(trace->commands);
+    memset(trace, 0, sizeof(*trace));
+}
+
+static void record_sample(trace_stats_t* stats, uint64_t elapsed,
+                          tui_alloc_stats_t before, tui_alloc_stats_t after) {
+    if (stats->count == stats->capacity) {
+        stats->capacity = stats->capacity ? stats->capacity * 2 : 1024;
+        stats->samples = realloc(stats->samples, stats->capacity * sizeof(uint64_t));
+    }
+    stats->samples[stats->count++] = elapsed;
+
+    uint64_t allocations = after.allocations - before.allocations;
+    stats->allocations += allocations;
+    stats->bytes_requested += after.bytes_requested - before.bytes_requested;
+    if (allocations > stats->max_event_allocations) {
+        stats->max_event_allocations = allocations;
+    }
+}
+
+static char* build_paste_block(int lines, int* out_len) {
+    size_t total = 0;
+    for (int i = 0; i < lines; i++) {
+        total += strlen(sample_lines[i % sample_line_count]) + 1;
+    }
+    char* block = malloc(total + 1);
+    char* out = block;
+    for (int i = 0; i < lines; i++) {
+        const char* text = sample_lines[i % sample_line_count];
+        size_t len = strlen(text);
+        memcpy(out, text, len);
+        out += len;
+        *out++ = '\n';
+    }
+    *out = '\0';
+    *out_len = (int)total;
+    return block;
+}
+
+static void run_key(const char* key) {
+    if (strcmp(key, "enter") == 0) op_enter();
+    else if (strcmp(key, "backspace") == 0) op_backspace();
+    else if (strcmp(key, "delete") == 0) op_delete();
+    else if (strcmp(key, "undo") == 0) op_undo();
+    else if (strcmp(key, "redo") == 0) op_redo();
+    else op_move(key);
+}
+
+// Bytes of the UTF-8 character at `text`, within `len` bytes; invalid
+// bytes count as one character each
+static int utf8_char_length(const char* text, int len) {
+    unsigned char lead = (unsigned char)text[0];
+    int length = lead < 0x80 ? 1 : (lead & 0xE0) == 0xC0 ? 2 : (lead & 0xF0) == 0xE0 ? 3 :
+                 (lead & 0xF8) == 0xF0 ? 4 : 1;
+    if (length > len) return 1;
+    for (int i = 1; i < length; i++) {
+        if (((unsigned char)text[i] & 0xC0) != 0x80) return 1;
+    }
+    return length;
+}
+
+static int utf8_char_count(const char* text, int len) {
+    int count = 0;
+    for (int i = 0; i < len; i += utf8_char_length(text + i, len - i)) count++;
+    return count;
+}
+
+// Replay a trace, timing every keystroke-sized event
+static void replay_trace(const trace_t* trace, trace_stats_t* stats) {
+    for (int c = 0; c < trace->command_count; c++) {
+        const trace_command_t* command = &trace->commands[c];
+
+        if (command->op == TRACE_GOTO) {
+            editor.cursor_line = command->line == -1 ? editor.line_count / 2 :
+                                 command->line == -2 ? editor.line_count - 1 : command->line;
+            clamp_cursor();
+            editor.cursor_col = command->col < 0 ? editor.lines[editor.cursor_line].length
+                                                 : command->col;
+            clamp_cursor();
+            continue;
+        }
+
+        char* paste = NULL;
+        int paste_len = 0;
+        if (command->op == TRACE_PASTE) {
+            paste = build_paste_block(command->col, &paste_len);
+        }
+
+        int events = command->op == TRACE_TYPE ? utf8_char_count(command->text, command->text_len) : 1;
+        for (int r = 0; r < command->repeat; r++) {
+            int offset = 0;
+            for (int e = 0; e < events; e++) {
+                tui_alloc_stats_t before = tui_bench_alloc_stats();
+                uint64_t start = now_ns();
+
+                switch (command->op) {
+                    case TRACE_TYPE: {
+                        const char* character = command->text + offset;
+                        int length = utf8_char_length(character, command->text_len - offset);
+                        if (*character == '\n') op_enter();
+                        else op_type(character, length);
+                        offset += length;
+                        break;
+                    }
+                    case TRACE_KEY:
+                        run_key(command->text);
+                        break;
+                    case TRACE_PASTE:
+                        op_type(paste, paste_len);
+                        break;
+                    case TRACE_SEARCH:
+                        op_search(command->text);
+                        break;
+                    case TRACE_GOTO:
+                        break;
+                }
+                refresh_status();
+
+                uint64_t elapsed = now_ns() - start;
+                record_sample(stats, elapsed, before, tui_bench_alloc_stats());
+            }
+        }
+        free(paste);
+    }
+}
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentile over sorted samples
+static uint64_t percentile(const uint64_t* sorted, int count, double p) {
+    if (count == 0) return 0;
+    int rank = (int)((p / 100.0) * count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > count) rank = count;
+    return sorted[rank - 1];
+}
+
+static void report_trace(const trace_t* trace, trace_stats_t* stats, int document_lines,
+                         size_t document_bytes, bool json, bool first) {
+    qsort(stats->samples, stats->count, sizeof(uint64_t), compare_u64);
+    uint64_t total = 0;
+    for (int i = 0; i < stats->count; i++) total += stats->samples[i];
+    uint64_t mean = stats->count ? total / stats->count : 0;
+    uint64_t p50 = percentile(stats->samples, stats->count, 50);
+    uint64_t p95 = percentile(stats->samples, stats->count, 95);
+    uint64_t p99 = percentile(stats->samples, stats->count, 99);
+    uint64_t max = stats->count ? stats->samples[stats->count - 1] : 0;
+    double allocs_per_event = stats->count ? (double)stats->allocations / stats->count : 0.0;
+
+    if (json) {
+        printf("%s\n    {\"name\": \"%s\", \"events\": %d, \"document_lines\": %d, "
+               "\"document_bytes\": %zu,\n"
+               "     \"latency_ns\": {\"p50\": %llu, \"p95\": %llu, \"p99\": %llu, "
+               "\"max\": %llu, \"mean\": %llu},\n"
+               "     \"allocations\": {\"count\": %llu, \"bytes\": %llu, "
+               "\"per_event\": %.2f, \"max_per_event\": %llu},\n"
+               "     \"peak_rss_kb\": %ld}",
+               first ? "" : ",", trace->name, stats->count, document_lines, document_bytes,
+               (unsigned long long)p50, (unsigned long long)p95, (unsigned long long)p99,
+               (unsigned long long)max, (unsigned long long)mean,
+               (unsigned long long)stats->allocations,
+               (unsigned long long)stats->bytes_requested, allocs_per_event,
+               (unsigned long long)stats->max_event_allocations, peak_rss_kb(RUSAGE_SELF));
+    } else {
+        printf("%-20s %8d  p50 %9.1fµs  p95 %9.1fµs  p99 %9.1fµs  max %9.1fµs  "
+               "allocs/évt %7.2f  RSS %ld KB\n",
+               trace->name, stats->count, p50 / 1000.0, p95 / 1000.0, p99 / 1000.0,
+               max / 1000.0, allocs_per_event, peak_rss_kb(RUSAGE_SELF));
+    }
+}
+
+// Load and replay one trace, then report it; returns the exit status
+static int run_trace(const char* path, const bench_options_t* options, bool first) {
+    trace_t trace = {0};
+    if (!load_trace(path, &trace)) {
+        free_trace(&trace);
+        return 1;
+    }
+
+    trace_stats_t stats = {0};
+    load_bench_document(options->lines);
+    size_t document_bytes = 0;
+    for (int i = 0; i < editor.line_count; i++) {
+        document_bytes += editor.lines[i].length + 1;
+    }
+    for (int it = 0; it < options->iterations; it++) {
+        load_bench_document(options->lines);
+        replay_trace(&trace, &stats);
+    }
+
+    report_trace(&trace, &stats, options->lines, document_bytes, options->json, first);
+    free(stats.samples);
+    free_trace(&trace);
+    buffer_clear();
+    return 0;
+}
+
+static void print_bench_usage(const char* program) {
+    fprintf(stderr,
+            "Utilisation: %s bench [options] TRACE...\n"
+            "  --lines N        taille du document d'exemple (défaut %d lignes)\n"
+            "  --file PATH      lignes d'exemple lues depuis un fichier\n"
+            "  --iterations N   rejouer chaque trace N fois\n"
+            "  --format FMT     text (défaut) ou json\n",
+            program, DEFAULT_BENCH_LINES);
+}
+
+static int run_bench(int argc, char* argv[]) {
+    bench_options_t options = {DEFAULT_BENCH_LINES, 1, false, NULL};
+    int first_trace = argc;
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--lines") == 0 && i + 1 < argc) {
+            options.lines = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--file") == 0 && i + 1 < argc) {
+            options.sample_file = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            options.iterations = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            options.json = strcmp(argv[++i], "json") == 0;
+        } else if (argv[i][0] == '-') {
+            print_bench_usage(argv[0]);
+            return 1;
+        } else {
+            first_trace = i;
+            break;
+        }
+    }
+    if (first_trace >= argc || options.lines <= 0 || options.iterations <= 0) {
+        print_bench_usage(argv[0]);
+        return 1;
+    }
+
+    if (options.sample_file) {
+        if (!load_sample_lines(options.sample_file)) return 1;
+    } else {
+        sample_lines = (char**)default_sample_lines;
+        sample_line_count = (int)(sizeof(default_sample_lines) / sizeof(default_sample_lines[0]));
+    }
+
+    if (options.json) {
+        printf("{\n  \"tool\": \"scriptable_tui\",\n  \"iterations\": %d,\n  \"traces\": [",
+               options.iterations);
+    } else {
+        printf("📊 Benchmark de frappe: document de %d lignes, %d itération(s)\n",
+               options.lines, options.iterations);
+    }
+
+    // Each trace runs in a process of its own, so that the peak RSS it
+    // reports is its own and not that of the traces before it
+    int status = 0;
+    for (int t = first_trace; t < argc && status == 0; t++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if (pid == 0) {
+            int result = run_trace(argv[t], &options, t == first_trace);
+            fflush(stdout);
+            _exit(result);
+        }
+        int child_status;
+        if (pid < 0 || waitpid(pid, &child_status, 0) < 0 || !WIFEXITED(child_status) ||
+            WEXITSTATUS(child_status) != 0) {
+            status = 1;
+        }
+    }
+
+    if (options.json) {
+        printf("\n  ],\n  \"peak_rss_kb\": %ld\n}\n", peak_rss_kb(RUSAGE_CHILDREN));
+    }
+
+    buffer_clear();
+    if (options.sample_file) {
+        for (int i = 0; i < sample_line_count; i++) free(sample_lines[i]);
+        free(sample_lines);
+    }
+    return status;
+}
+
 int main(int argc, char* argv[]) {
-    init_editor();
-    
+    if (argc > 1 && strcmp(argv[1], "bench") == 0) {
+        return run_bench(argc, argv);
+    }
+
     if (argc > 1 && strcmp(argv[1], "interactive") == 0) {
         printf("Mode interactif non supporté dans cet environnement.\n");
-        printf("Utilisation: %s [script]\n", argv[0]);
+        printf("Utilisation: %s [script] | %s bench [options] TRACE...\n", argv[0], argv[0]);
         return 1;
     }
-    
+
+    init_editor();
     execute_script();
+    buffer_clear();
     return 0;
-}
\ No newline at end of file
+}
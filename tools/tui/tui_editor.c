@@ -287,6 +287,11 @@ void tui_editor_init() {
     
     strcpy(E.filename, "untitled.md");
     E.show_line_numbers = 1;
+
+    // Line operations rebuild whole lines from before/after strings
+    cursor_config_t config = cursor_get_config();
+    config.full_content_output = true;
+    cursor_set_config(&config);
     E.insert_mode = 1;  // Start in insert mode
     E.search_mode = 0;
     E.search.direction = 1;  // Forward search by default
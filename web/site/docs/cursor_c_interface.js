@@ -5,6 +5,7 @@ class CCursorManager {
     constructor(wasmModule) {
         this.module = wasmModule;
         this.isReady = false;
+        this.mappedText = null; // text the C offset map was last synced with
         
         if (wasmModule) {
             this.initializeBindings();
@@ -36,7 +37,22 @@ class CCursorManager {
         }
         
         try {
-            const result = this.module.ccall('cursor_wasm_html_to_markdown', 'number', ['number', 'string'], [htmlPosition, markdownText]);
+            // The offset map stays in C until the text changes, so cursor
+            // moves neither copy the text nor rebuild the map
+            let result;
+            if (typeof this.module._cursor_wasm_offset_map_sync === 'function') {
+                if (markdownText !== this.mappedText) {
+                    this.mappedText = null;
+                    if (this.module.ccall('cursor_wasm_offset_map_sync', 'number', ['string'], [markdownText])) {
+                        this.mappedText = markdownText;
+                    }
+                }
+                result = this.mappedText !== null
+                    ? this.module.ccall('cursor_wasm_offset_map_to_source', 'number', ['number'], [htmlPosition])
+                    : -1;
+            } else {
+                result = this.module.ccall('cursor_wasm_html_to_markdown', 'number', ['number', 'string'], [htmlPosition, markdownText]);
+            }
             console.log(`[CCursorManager] 🔄 HTML ${htmlPosition} -> MD ${result}`);
             return result >= 0 ? result : htmlPosition;
         } catch (error) {